@@ -1,6 +1,8 @@
 #include <gst/gst.h>
 #include <gst/app/gstappsink.h>
 
+#include "gst_buffer_info_meta.h"
+
  
 #include <opencv2/opencv.hpp>
 #include <opencv2/highgui/highgui.hpp>
@@ -32,55 +34,7 @@ GstFlowReturn new_preroll2(GstAppSink *appsink, gpointer data)
 
 // --------------------------------------------------------------------------------------------------------------------------------------------
 
-#define D_USE_META_STATIC   1         // no malloc, static prealocation
-
-typedef struct _GstBufferInfoMeta  GstBufferInfoMeta;
-typedef struct _GstBufferInfo      GstBufferInfo    ;
-
-// folowings is define in #include "../v4l2_nv_extensions.h" but need to add a lot of stuff to
-// fullfill compilers needs
-//
-typedef struct MVInfo_ {
-    /** Number of pixels the macro block moved in horizontal direction. */
-    gint32 mv_x   : 16;
-    /** Number of pixels the macro block moved in vertical direction. */
-    gint32 mv_y   : 14;
-    /** Temporal hints used by hardware for Motion Estimation. */
-    guint32 weight : 2;
-} MVInfo;
-
-/**
- * Holds the motion vector parameters for one complete frame.
- */
-typedef struct metadata_MV_
-{
-    /** Size of the pMVInfo buffer, in bytes. */
-    guint32 bufSize;
-    /** Pointer to the buffer containing the motion vectors. */
-    #ifdef D_USE_META_STATIC    // no malloc, static prealocation
-        int        m_nInfoCount;
-        MVInfo  rec_mv_info[12000];
-    #else
-        MVInfo  *pMVInfo;
-    #endif
-
-} metadata_MV;
-
-struct _GstBufferInfo
-{
-    //long              m_lCounter;
-    metadata_MV       m_enc_mv_metadata;
-};
-
-struct _GstBufferInfoMeta
-{
-    // Required as it is base structure for metadata
-    // https://gstreamer.freedesktop.org/data/doc/gstreamer/head/gstreamer/html/gstreamer-GstMeta.html
-    GstMeta meta;  
 
-    // Custom fields
-    GstBufferInfo info;
-};  
 
 // ----------------------------------------------------------------------------------------------------------------------------------------------------------------------
 //
@@ -66,6 +66,21 @@ void AllocateMyMetaData( GstBufferInfo *pBufferInfo, v4l2_ctrl_videoenc_outputbu
         }  
 }
 
+// ---------------------------------------------------------------------------------------------------------------------------------------------------
+//
+void SetMyEncoderStats( GstBufferInfo *pBufferInfo, v4l2_ctrl_videoenc_outputbuf_metadata *p_meta )
+{
+    if (pBufferInfo != NULL && p_meta != NULL)
+        {
+        pBufferInfo->m_enc_stats.bValid           = TRUE;
+        pBufferInfo->m_enc_stats.KeyFrame         = p_meta->KeyFrame ? TRUE : FALSE;
+        pBufferInfo->m_enc_stats.AvgQP            = p_meta->AvgQP;
+        pBufferInfo->m_enc_stats.FrameMinQP       = p_meta->FrameMinQP;
+        pBufferInfo->m_enc_stats.FrameMaxQP       = p_meta->FrameMaxQP;
+        pBufferInfo->m_enc_stats.EncodedFrameBits = p_meta->EncodedFrameBits;
+        }
+}
+
 // ----------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 //
 // Register metadata type and returns Gtype
@@ -117,6 +132,7 @@ static gboolean gst_buffer_info_meta_init(GstMeta *meta, gpointer params, GstBuf
     GstBufferInfoMeta *gst_buffer_info_meta = (GstBufferInfoMeta*)meta;     
 
     memset ((void *) &gst_buffer_info_meta->info.m_enc_mv_metadata, 0, sizeof (gst_buffer_info_meta->info.m_enc_mv_metadata));
+    memset ((void *) &gst_buffer_info_meta->info.m_enc_stats, 0, sizeof (gst_buffer_info_meta->info.m_enc_stats));
 
     //g_print ("gst_buffer_info_meta_init\n");
 
@@ -172,6 +188,8 @@ GstBufferInfoMeta* gst_buffer_add_buffer_info_meta( GstBuffer *buffer, GstBuffer
     // https://gstreamer.freedesktop.org/data/doc/gstreamer/head/gstreamer/html/GstBuffer.html#gst-buffer-add-meta
     gst_buffer_info_meta = (GstBufferInfoMeta *) gst_buffer_add_meta (buffer, GST_BUFFER_INFO_META_INFO, NULL);
 
+    gst_buffer_info_meta->info.m_enc_stats = buffer_info->m_enc_stats;
+
     #ifdef D_USE_META_STATIC
         gst_buffer_info_meta->info.m_enc_mv_metadata.bufSize        = buffer_info->m_enc_mv_metadata.bufSize;
         gst_buffer_info_meta->info.m_enc_mv_metadata.m_nInfoCount   = buffer_info->m_enc_mv_metadata.m_nInfoCount;
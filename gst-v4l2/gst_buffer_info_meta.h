@@ -42,9 +42,29 @@ typedef struct metadata_MV_ {
 
 } metadata_MV;
 
+/**
+ * Holds the encoder statistics for one complete frame.
+ */
+typedef struct encoder_stats_ {
+    /** TRUE when the fields below were reported by the encoder. */
+    gboolean bValid;
+    /** Boolean value indicating if current frame is a key frame. */
+    gboolean KeyFrame;
+    /** Average QP value of the frame. */
+    guint32 AvgQP;
+    /** Minumum QP value in the frame. */
+    guint32 FrameMinQP;
+    /** Maximum QP value in the frame. */
+    guint32 FrameMaxQP;
+    /** Number of bits needed to encode the frame. */
+    guint32 EncodedFrameBits;
+
+} encoder_stats;
+
 struct _GstBufferInfo {
     
     metadata_MV   m_enc_mv_metadata;
+    encoder_stats m_enc_stats;      // appended, keep the layout of m_enc_mv_metadata
 };
 
 
@@ -60,6 +80,8 @@ struct _GstBufferInfoMeta {
 
 GST_EXPORT void AllocateMyMetaData( GstBufferInfo *pBufferInfo, v4l2_ctrl_videoenc_outputbuf_metadata_MV *p_meta_MV, int nInfoCount );
 
+GST_EXPORT void SetMyEncoderStats( GstBufferInfo *pBufferInfo, v4l2_ctrl_videoenc_outputbuf_metadata *p_meta );
+
 GType gst_buffer_info_meta_api_get_type(void);
  
 GST_EXPORT const GstMetaInfo * gst_buffer_info_meta_get_info(void);
@@ -0,0 +1,2440 @@
+/*
+ * gsth264mvparse.c: macroblock motion vectors of H.264 P slices, read from
+ * the compressed bitstream
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Entropy decodes the macroblock layer of P and SP slices far enough to
+ * rebuild the motion vectors (ITU-T H.264, 7.3.4 to 7.3.5 and 8.4.1).
+ * Residual blocks have to be walked to stay in sync with the bitstream, but
+ * only their coefficient counts are kept, which is what the CAVLC and CABAC
+ * context selection of the following blocks depends on.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "gsth264mvparse.h"
+
+#define MAX_SPS_COUNT           32
+#define MAX_PPS_COUNT           256
+
+/* bytes of a slice NAL unescaped to find out the slice type before the whole
+ * NAL is copied */
+#define SLICE_PEEK_SIZE         16
+
+/* zero bytes kept after the RBSP so that the bit readers never test for the
+ * end of the buffer in the middle of a read */
+#define RBSP_PADDING            16
+
+/* MaxFS of level 6.2, no conforming stream has larger frames */
+#define MAX_FRAME_MBS           139264
+
+#define NUM_CABAC_CONTEXTS      460
+
+/* first level of the CAVLC tables, longer codes go through a second one */
+#define VLC_BITS                8
+
+/* Tables 9-12 to 9-33, (m, n) for cabac_init_idc 0..2, ctxIdx 0..459 */
+static const gint8 cabac_init_pb[3][460][2] = {
+  {
+    {20, -15}, {2, 54}, {3, 74}, {20, -15}, {2, 54}, {3, 74},
+    {-28, 127}, {-23, 104}, {-6, 53}, {-1, 54}, {7, 51}, {23, 33},
+    {23, 2}, {21, 0}, {1, 9}, {0, 49}, {-37, 118}, {5, 57},
+    {-13, 78}, {-11, 65}, {1, 62}, {12, 49}, {-4, 73}, {17, 50},
+    {18, 64}, {9, 43}, {29, 0}, {26, 67}, {16, 90}, {9, 104},
+    {-46, 127}, {-20, 104}, {1, 67}, {-13, 78}, {-11, 65}, {1, 62},
+    {-6, 86}, {-17, 95}, {-6, 61}, {9, 45}, {-3, 69}, {-6, 81},
+    {-11, 96}, {6, 55}, {7, 67}, {-5, 86}, {2, 88}, {0, 58},
+    {-3, 76}, {-10, 94}, {5, 54}, {4, 69}, {-3, 81}, {0, 88},
+    {-7, 67}, {-5, 74}, {-4, 74}, {-5, 80}, {-7, 72}, {1, 58},
+    {0, 41}, {0, 63}, {0, 63}, {0, 63}, {-9, 83}, {4, 86},
+    {0, 97}, {-7, 72}, {13, 41}, {3, 62}, {0, 45}, {-4, 78},
+    {-3, 96}, {-27, 126}, {-28, 98}, {-25, 101}, {-23, 67}, {-28, 82},
+    {-20, 94}, {-16, 83}, {-22, 110}, {-21, 91}, {-18, 102}, {-13, 93},
+    {-29, 127}, {-7, 92}, {-5, 89}, {-7, 96}, {-13, 108}, {-3, 46},
+    {-1, 65}, {-1, 57}, {-9, 93}, {-3, 74}, {-9, 92}, {-8, 87},
+    {-23, 126}, {5, 54}, {6, 60}, {6, 59}, {6, 69}, {-1, 48},
+    {0, 68}, {-4, 69}, {-8, 88}, {-2, 85}, {-6, 78}, {-1, 75},
+    {-7, 77}, {2, 54}, {5, 50}, {-3, 68}, {1, 50}, {6, 42},
+    {-4, 81}, {1, 63}, {-4, 70}, {0, 67}, {2, 57}, {-2, 76},
+    {11, 35}, {4, 64}, {1, 61}, {11, 35}, {18, 25}, {12, 24},
+    {13, 29}, {13, 36}, {-10, 93}, {-7, 73}, {-2, 73}, {13, 46},
+    {9, 49}, {-7, 100}, {9, 53}, {2, 53}, {5, 53}, {-2, 61},
+    {0, 56}, {0, 56}, {-13, 63}, {-5, 60}, {-1, 62}, {4, 57},
+    {-6, 69}, {4, 57}, {14, 39}, {4, 51}, {13, 68}, {3, 64},
+    {1, 61}, {9, 63}, {7, 50}, {16, 39}, {5, 44}, {4, 52},
+    {11, 48}, {-5, 60}, {-1, 59}, {0, 59}, {22, 33}, {5, 44},
+    {14, 43}, {-1, 78}, {0, 60}, {9, 69}, {11, 28}, {2, 40},
+    {3, 44}, {0, 49}, {0, 46}, {2, 44}, {2, 51}, {0, 47},
+    {4, 39}, {2, 62}, {6, 46}, {0, 54}, {3, 54}, {2, 58},
+    {4, 63}, {6, 51}, {6, 57}, {7, 53}, {6, 52}, {6, 55},
+    {11, 45}, {14, 36}, {8, 53}, {-1, 82}, {7, 55}, {-3, 78},
+    {15, 46}, {22, 31}, {-1, 84}, {25, 7}, {30, -7}, {28, 3},
+    {28, 4}, {32, 0}, {34, -1}, {30, 6}, {30, 6}, {32, 9},
+    {31, 19}, {26, 27}, {26, 30}, {37, 20}, {28, 34}, {17, 70},
+    {1, 67}, {5, 59}, {9, 67}, {16, 30}, {18, 32}, {18, 35},
+    {22, 29}, {24, 31}, {23, 38}, {18, 43}, {20, 41}, {11, 63},
+    {9, 59}, {9, 64}, {-1, 94}, {-2, 89}, {-9, 108}, {-6, 76},
+    {-2, 44}, {0, 45}, {0, 52}, {-3, 64}, {-2, 59}, {-4, 70},
+    {-4, 75}, {-8, 82}, {-17, 102}, {-9, 77}, {3, 24}, {0, 42},
+    {0, 48}, {0, 55}, {-6, 59}, {-7, 71}, {-12, 83}, {-11, 87},
+    {-30, 119}, {1, 58}, {-3, 29}, {-1, 36}, {1, 38}, {2, 43},
+    {-6, 55}, {0, 58}, {0, 64}, {-3, 74}, {-10, 90}, {0, 70},
+    {-4, 29}, {5, 31}, {7, 42}, {1, 59}, {-2, 58}, {-3, 72},
+    {-3, 81}, {-11, 97}, {0, 58}, {8, 5}, {10, 14}, {14, 18},
+    {13, 27}, {2, 40}, {0, 58}, {-3, 70}, {-6, 79}, {-8, 85},
+    {0, 0}, {-13, 106}, {-16, 106}, {-10, 87}, {-21, 114}, {-18, 110},
+    {-14, 98}, {-22, 110}, {-21, 106}, {-18, 103}, {-21, 107}, {-23, 108},
+    {-26, 112}, {-10, 96}, {-12, 95}, {-5, 91}, {-9, 93}, {-22, 94},
+    {-5, 86}, {9, 67}, {-4, 80}, {-10, 85}, {-1, 70}, {7, 60},
+    {9, 58}, {5, 61}, {12, 50}, {15, 50}, {18, 49}, {17, 54},
+    {10, 41}, {7, 46}, {-1, 51}, {7, 49}, {8, 52}, {9, 41},
+    {6, 47}, {2, 55}, {13, 41}, {10, 44}, {6, 50}, {5, 53},
+    {13, 49}, {4, 63}, {6, 64}, {-2, 69}, {-2, 59}, {6, 70},
+    {10, 44}, {9, 31}, {12, 43}, {3, 53}, {14, 34}, {10, 38},
+    {-3, 52}, {13, 40}, {17, 32}, {7, 44}, {7, 38}, {13, 50},
+    {10, 57}, {26, 43}, {14, 11}, {11, 14}, {9, 11}, {18, 11},
+    {21, 9}, {23, -2}, {32, -15}, {32, -15}, {34, -21}, {39, -23},
+    {42, -33}, {41, -31}, {46, -28}, {38, -12}, {21, 29}, {45, -24},
+    {53, -45}, {48, -26}, {65, -43}, {43, -19}, {39, -10}, {30, 9},
+    {18, 26}, {20, 27}, {0, 57}, {-14, 82}, {-5, 75}, {-19, 97},
+    {-35, 125}, {27, 0}, {28, 0}, {31, -4}, {27, 6}, {34, 8},
+    {30, 10}, {24, 22}, {33, 19}, {22, 32}, {26, 31}, {21, 41},
+    {26, 44}, {23, 47}, {16, 65}, {14, 71}, {8, 60}, {6, 63},
+    {17, 65}, {21, 24}, {23, 20}, {26, 23}, {27, 32}, {28, 23},
+    {28, 24}, {23, 40}, {24, 32}, {28, 29}, {23, 42}, {19, 57},
+    {22, 53}, {22, 61}, {11, 86}, {12, 40}, {11, 51}, {14, 59},
+    {-4, 79}, {-7, 71}, {-5, 69}, {-9, 70}, {-8, 66}, {-10, 68},
+    {-19, 73}, {-12, 69}, {-16, 70}, {-15, 67}, {-20, 62}, {-19, 70},
+    {-16, 66}, {-22, 65}, {-20, 63}, {9, -2}, {26, -9}, {33, -9},
+    {39, -7}, {41, -2}, {45, 3}, {49, 9}, {45, 27}, {36, 59},
+    {-6, 66}, {-7, 35}, {-7, 42}, {-8, 45}, {-5, 48}, {-12, 56},
+    {-6, 60}, {-5, 62}, {-8, 66}, {-8, 76}, {-5, 85}, {-6, 81},
+    {-10, 77}, {-7, 81}, {-17, 80}, {-18, 73}, {-4, 74}, {-10, 83},
+    {-9, 71}, {-9, 67}, {-1, 61}, {-8, 66}, {-14, 66}, {0, 59},
+    {2, 59}, {21, -13}, {33, -14}, {39, -7}, {46, -2}, {51, 2},
+    {60, 6}, {61, 17}, {55, 34}, {42, 62},
+  },
+  {
+    {20, -15}, {2, 54}, {3, 74}, {20, -15}, {2, 54}, {3, 74},
+    {-28, 127}, {-23, 104}, {-6, 53}, {-1, 54}, {7, 51}, {22, 25},
+    {34, 0}, {16, 0}, {-2, 9}, {4, 41}, {-29, 118}, {2, 65},
+    {-6, 71}, {-13, 79}, {5, 52}, {9, 50}, {-3, 70}, {10, 54},
+    {26, 34}, {19, 22}, {40, 0}, {57, 2}, {41, 36}, {26, 69},
+    {-45, 127}, {-15, 101}, {-4, 76}, {-6, 71}, {-13, 79}, {5, 52},
+    {6, 69}, {-13, 90}, {0, 52}, {8, 43}, {-2, 69}, {-5, 82},
+    {-10, 96}, {2, 59}, {2, 75}, {-3, 87}, {-3, 100}, {1, 56},
+    {-3, 74}, {-6, 85}, {0, 59}, {-3, 81}, {-7, 86}, {-5, 95},
+    {-1, 66}, {-1, 77}, {1, 70}, {-2, 86}, {-5, 72}, {0, 61},
+    {0, 41}, {0, 63}, {0, 63}, {0, 63}, {-9, 83}, {4, 86},
+    {0, 97}, {-7, 72}, {13, 41}, {3, 62}, {13, 15}, {7, 51},
+    {2, 80}, {-39, 127}, {-18, 91}, {-17, 96}, {-26, 81}, {-35, 98},
+    {-24, 102}, {-23, 97}, {-27, 119}, {-24, 99}, {-21, 110}, {-18, 102},
+    {-36, 127}, {0, 80}, {-5, 89}, {-7, 94}, {-4, 92}, {0, 39},
+    {0, 65}, {-15, 84}, {-35, 127}, {-2, 73}, {-12, 104}, {-9, 91},
+    {-31, 127}, {3, 55}, {7, 56}, {7, 55}, {8, 61}, {-3, 53},
+    {0, 68}, {-7, 74}, {-9, 88}, {-13, 103}, {-13, 91}, {-9, 89},
+    {-14, 92}, {-8, 76}, {-12, 87}, {-23, 110}, {-24, 105}, {-10, 78},
+    {-20, 112}, {-17, 99}, {-78, 127}, {-70, 127}, {-50, 127}, {-46, 127},
+    {-4, 66}, {-5, 78}, {-4, 71}, {-8, 72}, {2, 59}, {-1, 55},
+    {-7, 70}, {-6, 75}, {-8, 89}, {-34, 119}, {-3, 75}, {32, 20},
+    {30, 22}, {-44, 127}, {0, 54}, {-5, 61}, {0, 58}, {-1, 60},
+    {-3, 61}, {-8, 67}, {-25, 84}, {-14, 74}, {-5, 65}, {5, 52},
+    {2, 57}, {0, 61}, {-9, 69}, {-11, 70}, {18, 55}, {-4, 71},
+    {0, 58}, {7, 61}, {9, 41}, {18, 25}, {9, 32}, {5, 43},
+    {9, 47}, {0, 44}, {0, 51}, {2, 46}, {19, 38}, {-4, 66},
+    {15, 38}, {12, 42}, {9, 34}, {0, 89}, {4, 45}, {10, 28},
+    {10, 31}, {33, -11}, {52, -43}, {18, 15}, {28, 0}, {35, -22},
+    {38, -25}, {34, 0}, {39, -18}, {32, -12}, {102, -94}, {0, 0},
+    {56, -15}, {33, -4}, {29, 10}, {37, -5}, {51, -29}, {39, -9},
+    {52, -34}, {69, -58}, {67, -63}, {44, -5}, {32, 7}, {55, -29},
+    {32, 1}, {0, 0}, {27, 36}, {33, -25}, {34, -30}, {36, -28},
+    {38, -28}, {38, -27}, {34, -18}, {35, -16}, {34, -14}, {32, -8},
+    {37, -6}, {35, 0}, {30, 10}, {28, 18}, {26, 25}, {29, 41},
+    {0, 75}, {2, 72}, {8, 77}, {14, 35}, {18, 31}, {17, 35},
+    {21, 30}, {17, 45}, {20, 42}, {18, 45}, {27, 26}, {16, 54},
+    {7, 66}, {16, 56}, {11, 73}, {10, 67}, {-10, 116}, {-23, 112},
+    {-15, 71}, {-7, 61}, {0, 53}, {-5, 66}, {-11, 77}, {-9, 80},
+    {-9, 84}, {-10, 87}, {-34, 127}, {-21, 101}, {-3, 39}, {-5, 53},
+    {-7, 61}, {-11, 75}, {-15, 77}, {-17, 91}, {-25, 107}, {-25, 111},
+    {-28, 122}, {-11, 76}, {-10, 44}, {-10, 52}, {-10, 57}, {-9, 58},
+    {-16, 72}, {-7, 69}, {-4, 69}, {-5, 74}, {-9, 86}, {2, 66},
+    {-9, 34}, {1, 32}, {11, 31}, {5, 52}, {-2, 55}, {-2, 67},
+    {0, 73}, {-8, 89}, {3, 52}, {7, 4}, {10, 8}, {17, 8},
+    {16, 19}, {3, 37}, {-1, 61}, {-5, 73}, {-1, 70}, {-4, 78},
+    {0, 0}, {-21, 126}, {-23, 124}, {-20, 110}, {-26, 126}, {-25, 124},
+    {-17, 105}, {-27, 121}, {-27, 117}, {-17, 102}, {-26, 117}, {-27, 116},
+    {-33, 122}, {-10, 95}, {-14, 100}, {-8, 95}, {-17, 111}, {-28, 114},
+    {-6, 89}, {-2, 80}, {-4, 82}, {-9, 85}, {-8, 81}, {-1, 72},
+    {5, 64}, {1, 67}, {9, 56}, {0, 69}, {1, 69}, {7, 69},
+    {-7, 69}, {-6, 67}, {-16, 77}, {-2, 64}, {2, 61}, {-6, 67},
+    {-3, 64}, {2, 57}, {-3, 65}, {-3, 66}, {0, 62}, {9, 51},
+    {-1, 66}, {-2, 71}, {-2, 75}, {-1, 70}, {-9, 72}, {14, 60},
+    {16, 37}, {0, 47}, {18, 35}, {11, 37}, {12, 41}, {10, 41},
+    {2, 48}, {12, 41}, {13, 41}, {0, 59}, {3, 50}, {19, 40},
+    {3, 66}, {18, 50}, {19, -6}, {18, -6}, {14, 0}, {26, -12},
+    {31, -16}, {33, -25}, {33, -22}, {37, -28}, {39, -30}, {42, -30},
+    {47, -42}, {45, -36}, {49, -34}, {41, -17}, {32, 9}, {69, -71},
+    {63, -63}, {66, -64}, {77, -74}, {54, -39}, {52, -35}, {41, -10},
+    {36, 0}, {40, -1}, {30, 14}, {28, 26}, {23, 37}, {12, 55},
+    {11, 65}, {37, -33}, {39, -36}, {40, -37}, {38, -30}, {46, -33},
+    {42, -30}, {40, -24}, {49, -29}, {38, -12}, {40, -10}, {38, -3},
+    {46, -5}, {31, 20}, {29, 30}, {25, 44}, {12, 48}, {11, 49},
+    {26, 45}, {22, 22}, {23, 22}, {27, 21}, {33, 20}, {26, 28},
+    {30, 24}, {27, 34}, {18, 42}, {25, 39}, {18, 50}, {12, 70},
+    {21, 54}, {14, 71}, {11, 83}, {25, 32}, {21, 49}, {21, 54},
+    {-5, 85}, {-6, 81}, {-10, 77}, {-7, 81}, {-17, 80}, {-18, 73},
+    {-4, 74}, {-10, 83}, {-9, 71}, {-9, 67}, {-1, 61}, {-8, 66},
+    {-14, 66}, {0, 59}, {2, 59}, {17, -10}, {32, -13}, {42, -9},
+    {49, -5}, {53, 0}, {64, 3}, {68, 10}, {66, 27}, {47, 57},
+    {-5, 71}, {0, 24}, {-1, 36}, {-2, 42}, {-2, 52}, {-9, 57},
+    {-6, 63}, {-4, 65}, {-4, 67}, {-7, 82}, {-3, 81}, {-3, 76},
+    {-7, 72}, {-6, 78}, {-12, 72}, {-14, 68}, {-3, 70}, {-6, 76},
+    {-5, 66}, {-5, 62}, {0, 57}, {-4, 61}, {-9, 60}, {1, 54},
+    {2, 58}, {17, -10}, {32, -13}, {42, -9}, {49, -5}, {53, 0},
+    {64, 3}, {68, 10}, {66, 27}, {47, 57},
+  },
+  {
+    {20, -15}, {2, 54}, {3, 74}, {20, -15}, {2, 54}, {3, 74},
+    {-28, 127}, {-23, 104}, {-6, 53}, {-1, 54}, {7, 51}, {29, 16},
+    {25, 0}, {14, 0}, {-10, 51}, {-3, 62}, {-27, 99}, {26, 16},
+    {-4, 85}, {-24, 102}, {5, 57}, {6, 57}, {-17, 73}, {14, 57},
+    {20, 40}, {20, 10}, {29, 0}, {54, 0}, {37, 42}, {12, 97},
+    {-32, 127}, {-22, 117}, {-2, 74}, {-4, 85}, {-24, 102}, {5, 57},
+    {-6, 93}, {-14, 88}, {-6, 44}, {4, 55}, {-11, 89}, {-15, 103},
+    {-21, 116}, {19, 57}, {20, 58}, {4, 84}, {6, 96}, {1, 63},
+    {-5, 85}, {-13, 106}, {5, 63}, {6, 75}, {-3, 90}, {-1, 101},
+    {3, 55}, {-4, 79}, {-2, 75}, {-12, 97}, {-7, 50}, {1, 60},
+    {0, 41}, {0, 63}, {0, 63}, {0, 63}, {-9, 83}, {4, 86},
+    {0, 97}, {-7, 72}, {13, 41}, {3, 62}, {7, 34}, {-9, 88},
+    {-20, 127}, {-36, 127}, {-17, 91}, {-14, 95}, {-25, 84}, {-25, 86},
+    {-12, 89}, {-17, 91}, {-31, 127}, {-14, 76}, {-18, 103}, {-13, 90},
+    {-37, 127}, {11, 80}, {5, 76}, {2, 84}, {5, 78}, {-6, 55},
+    {4, 61}, {-14, 83}, {-37, 127}, {-5, 79}, {-11, 104}, {-11, 91},
+    {-30, 127}, {0, 65}, {-2, 79}, {0, 72}, {-4, 92}, {-6, 56},
+    {3, 68}, {-8, 71}, {-13, 98}, {-4, 86}, {-12, 88}, {-5, 82},
+    {-3, 72}, {-4, 67}, {-8, 72}, {-16, 89}, {-9, 69}, {-1, 59},
+    {5, 66}, {4, 57}, {-4, 71}, {-2, 71}, {2, 58}, {-1, 74},
+    {-4, 44}, {-1, 69}, {0, 62}, {-7, 51}, {-4, 47}, {-6, 42},
+    {-3, 41}, {-6, 53}, {8, 76}, {-9, 78}, {-11, 83}, {9, 52},
+    {0, 67}, {-5, 90}, {1, 67}, {-15, 72}, {-5, 75}, {-8, 80},
+    {-21, 83}, {-21, 64}, {-13, 31}, {-25, 64}, {-29, 94}, {9, 75},
+    {17, 63}, {-8, 74}, {-5, 35}, {-2, 27}, {13, 91}, {3, 65},
+    {-7, 69}, {8, 77}, {-10, 66}, {3, 62}, {-3, 68}, {-20, 81},
+    {0, 30}, {1, 7}, {-3, 23}, {-21, 74}, {16, 66}, {-23, 124},
+    {17, 37}, {44, -18}, {50, -34}, {-22, 127}, {4, 39}, {0, 42},
+    {7, 34}, {11, 29}, {8, 31}, {6, 37}, {7, 42}, {3, 40},
+    {8, 33}, {13, 43}, {13, 36}, {4, 47}, {3, 55}, {2, 58},
+    {6, 60}, {8, 44}, {11, 44}, {14, 42}, {7, 48}, {4, 56},
+    {4, 52}, {13, 37}, {9, 49}, {19, 58}, {10, 48}, {12, 45},
+    {0, 69}, {20, 33}, {8, 63}, {35, -18}, {33, -25}, {28, -3},
+    {24, 10}, {27, 0}, {34, -14}, {52, -44}, {39, -24}, {19, 17},
+    {31, 25}, {36, 29}, {24, 33}, {34, 15}, {30, 20}, {22, 73},
+    {20, 34}, {19, 31}, {27, 44}, {19, 16}, {15, 36}, {15, 36},
+    {21, 28}, {25, 21}, {30, 20}, {31, 12}, {27, 16}, {24, 42},
+    {0, 93}, {14, 56}, {15, 57}, {26, 38}, {-24, 127}, {-24, 115},
+    {-22, 82}, {-9, 62}, {0, 53}, {0, 59}, {-14, 85}, {-13, 89},
+    {-13, 94}, {-11, 92}, {-29, 127}, {-21, 100}, {-14, 57}, {-12, 67},
+    {-11, 71}, {-10, 77}, {-21, 85}, {-16, 88}, {-23, 104}, {-15, 98},
+    {-37, 127}, {-10, 82}, {-8, 48}, {-8, 61}, {-8, 66}, {-7, 70},
+    {-14, 75}, {-10, 79}, {-9, 83}, {-12, 92}, {-18, 108}, {-4, 79},
+    {-22, 69}, {-16, 75}, {-2, 58}, {1, 58}, {-13, 78}, {-9, 83},
+    {-4, 81}, {-13, 99}, {-13, 81}, {-6, 38}, {-13, 62}, {-6, 58},
+    {-2, 59}, {-16, 73}, {-10, 76}, {-13, 86}, {-9, 83}, {-10, 87},
+    {0, 0}, {-22, 127}, {-25, 127}, {-25, 120}, {-27, 127}, {-19, 114},
+    {-23, 117}, {-25, 118}, {-26, 117}, {-24, 113}, {-28, 118}, {-31, 120},
+    {-37, 124}, {-10, 94}, {-15, 102}, {-10, 99}, {-13, 106}, {-50, 127},
+    {-5, 92}, {17, 57}, {-5, 86}, {-13, 94}, {-12, 91}, {-2, 77},
+    {0, 71}, {-1, 73}, {4, 64}, {-7, 81}, {5, 64}, {15, 57},
+    {1, 67}, {0, 68}, {-10, 67}, {1, 68}, {0, 77}, {2, 64},
+    {0, 68}, {-5, 78}, {7, 55}, {5, 59}, {2, 65}, {14, 54},
+    {15, 44}, {5, 60}, {2, 70}, {-2, 76}, {-18, 86}, {12, 70},
+    {5, 64}, {-12, 70}, {11, 55}, {5, 56}, {0, 69}, {2, 65},
+    {-6, 74}, {5, 54}, {7, 54}, {-6, 76}, {-11, 82}, {-2, 77},
+    {-2, 77}, {25, 42}, {17, -13}, {16, -9}, {17, -12}, {27, -21},
+    {37, -30}, {41, -40}, {42, -41}, {48, -47}, {39, -32}, {46, -40},
+    {52, -51}, {46, -41}, {52, -39}, {43, -19}, {32, 11}, {61, -55},
+    {56, -46}, {62, -50}, {81, -67}, {45, -20}, {35, -2}, {28, 15},
+    {34, 1}, {39, 1}, {30, 17}, {20, 38}, {18, 45}, {15, 54},
+    {0, 79}, {36, -16}, {37, -14}, {37, -17}, {32, 1}, {34, 15},
+    {29, 15}, {24, 25}, {34, 22}, {31, 16}, {35, 18}, {31, 28},
+    {33, 41}, {36, 28}, {27, 47}, {21, 62}, {18, 31}, {19, 26},
+    {36, 24}, {24, 23}, {27, 16}, {24, 30}, {31, 29}, {22, 41},
+    {22, 42}, {16, 60}, {15, 52}, {14, 60}, {3, 78}, {-16, 123},
+    {21, 53}, {22, 56}, {25, 61}, {21, 33}, {19, 50}, {17, 61},
+    {-3, 78}, {-8, 74}, {-9, 72}, {-10, 72}, {-18, 75}, {-12, 71},
+    {-11, 63}, {-5, 70}, {-17, 75}, {-14, 72}, {-16, 67}, {-8, 53},
+    {-14, 59}, {-9, 52}, {-11, 68}, {9, -2}, {30, -10}, {31, -4},
+    {33, -1}, {33, 7}, {31, 12}, {37, 23}, {31, 38}, {20, 64},
+    {-9, 71}, {-7, 37}, {-8, 44}, {-11, 49}, {-10, 56}, {-12, 59},
+    {-8, 63}, {-9, 67}, {-6, 68}, {-10, 79}, {-3, 78}, {-8, 74},
+    {-9, 72}, {-10, 72}, {-18, 75}, {-12, 71}, {-11, 63}, {-5, 70},
+    {-17, 75}, {-14, 72}, {-16, 67}, {-8, 53}, {-14, 59}, {-9, 52},
+    {-11, 68}, {9, -2}, {30, -10}, {31, -4}, {33, -1}, {33, 7},
+    {31, 12}, {37, 23}, {31, 38}, {20, 64},
+  },
+};
+
+/* Table 9-44, rangeTabLPS[pStateIdx][qCodIRangeIdx] */
+static const guint8 cabac_range_lps[64][4] = {
+  {128, 176, 208, 240}, {128, 167, 197, 227}, {128, 158, 187, 216},
+  {123, 150, 178, 205}, {116, 142, 169, 195}, {111, 135, 160, 185},
+  {105, 128, 152, 175}, {100, 122, 144, 166}, {95, 116, 137, 158},
+  {90, 110, 130, 150}, {85, 104, 123, 142}, {81, 99, 117, 135},
+  {77, 94, 111, 128}, {73, 89, 105, 122}, {69, 85, 100, 116},
+  {66, 80, 95, 110}, {62, 76, 90, 104}, {59, 72, 86, 99},
+  {56, 69, 81, 94}, {53, 65, 77, 89}, {51, 62, 73, 85},
+  {48, 59, 69, 80}, {46, 56, 66, 76}, {43, 53, 63, 72},
+  {41, 50, 59, 69}, {39, 48, 56, 65}, {37, 45, 54, 62},
+  {35, 43, 51, 59}, {33, 41, 48, 56}, {32, 39, 46, 53},
+  {30, 37, 43, 50}, {29, 35, 41, 48}, {27, 33, 39, 45},
+  {26, 31, 37, 43}, {24, 30, 35, 41}, {23, 28, 33, 39},
+  {22, 27, 32, 37}, {21, 26, 30, 35}, {20, 24, 29, 33},
+  {19, 23, 27, 31}, {18, 22, 26, 30}, {17, 21, 25, 28},
+  {16, 20, 23, 27}, {15, 19, 22, 25}, {14, 18, 21, 24},
+  {14, 17, 20, 23}, {13, 16, 19, 22}, {12, 15, 18, 21},
+  {12, 14, 17, 20}, {11, 14, 16, 19}, {11, 13, 15, 18},
+  {10, 12, 15, 17}, {10, 12, 14, 16}, {9, 11, 13, 15},
+  {9, 11, 12, 14}, {8, 10, 12, 14}, {8, 9, 11, 13},
+  {7, 9, 11, 12}, {7, 9, 10, 12}, {7, 8, 10, 11},
+  {6, 8, 9, 11}, {6, 7, 9, 10}, {6, 7, 8, 9},
+  {2, 2, 2, 2},
+};
+
+/* Table 9-45, next (pStateIdx << 1 | valMPS) indexed by the current one
+ * shifted left once, plus one after a LPS */
+static const guint8 cabac_next_state[256] = {
+  2, 1, 3, 0, 4, 0, 5, 1, 6, 2, 7, 3, 8, 4, 9, 5,
+  10, 4, 11, 5, 12, 8, 13, 9, 14, 8, 15, 9, 16, 10, 17, 11,
+  18, 12, 19, 13, 20, 14, 21, 15, 22, 16, 23, 17, 24, 18, 25, 19,
+  26, 18, 27, 19, 28, 22, 29, 23, 30, 22, 31, 23, 32, 24, 33, 25,
+  34, 26, 35, 27, 36, 26, 37, 27, 38, 30, 39, 31, 40, 30, 41, 31,
+  42, 32, 43, 33, 44, 32, 45, 33, 46, 36, 47, 37, 48, 36, 49, 37,
+  50, 38, 51, 39, 52, 38, 53, 39, 54, 42, 55, 43, 56, 42, 57, 43,
+  58, 44, 59, 45, 60, 44, 61, 45, 62, 46, 63, 47, 64, 48, 65, 49,
+  66, 48, 67, 49, 68, 50, 69, 51, 70, 52, 71, 53, 72, 52, 73, 53,
+  74, 54, 75, 55, 76, 54, 77, 55, 78, 56, 79, 57, 80, 58, 81, 59,
+  82, 58, 83, 59, 84, 60, 85, 61, 86, 60, 87, 61, 88, 60, 89, 61,
+  90, 62, 91, 63, 92, 64, 93, 65, 94, 64, 95, 65, 96, 66, 97, 67,
+  98, 66, 99, 67, 100, 66, 101, 67, 102, 68, 103, 69, 104, 68, 105, 69,
+  106, 70, 107, 71, 108, 70, 109, 71, 110, 70, 111, 71, 112, 72, 113, 73,
+  114, 72, 115, 73, 116, 72, 117, 73, 118, 74, 119, 75, 120, 74, 121, 75,
+  122, 74, 123, 75, 124, 76, 125, 77, 124, 76, 125, 77, 126, 126, 127, 127
+};
+
+/* Table 9-43, ctxIdxInc of significant and last coefficient flags of
+ * frame coded 8x8 blocks */
+static const guint8 sig_coeff_8x8[63] = {
+  0, 1, 2, 3, 4, 5, 5, 4, 4, 3, 3, 4, 4, 4, 5, 5,
+  4, 4, 4, 4, 3, 3, 6, 7, 7, 7, 8, 9, 10, 9, 8, 7,
+  7, 6, 11, 12, 13, 11, 6, 7, 8, 9, 14, 10, 9, 8, 6, 11,
+  12, 13, 11, 6, 9, 14, 10, 9, 11, 12, 13, 11, 14, 10, 12,
+};
+
+static const guint8 last_coeff_8x8[63] = {
+  0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+  3, 3, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4,
+  5, 5, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7, 8, 8, 8,
+};
+
+/* Table 9-5, coeff_token indexed by TotalCoeff * 4 + TrailingOnes for
+ * 0 <= nC < 2, 2 <= nC < 4, 4 <= nC < 8, 8 <= nC and nC == -1 */
+static const guint8 coeff_token_len[5][68] = {
+  {
+    1, 0, 0, 0, 6, 2, 0, 0, 8, 6, 3, 0, 9, 8, 7, 5,
+    10, 9, 8, 6, 11, 10, 9, 7, 13, 11, 10, 8, 13, 13, 11, 9,
+    13, 13, 13, 10, 14, 14, 13, 11, 14, 14, 14, 13, 15, 15, 14, 14,
+    15, 15, 15, 14, 16, 15, 15, 15, 16, 16, 16, 15, 16, 16, 16, 16,
+    16, 16, 16, 16,
+  },
+  {
+    2, 0, 0, 0, 6, 2, 0, 0, 6, 5, 3, 0, 7, 6, 6, 4,
+    8, 6, 6, 4, 8, 7, 7, 5, 9, 8, 8, 6, 11, 9, 9, 6,
+    11, 11, 11, 7, 12, 11, 11, 9, 12, 12, 12, 11, 12, 12, 12, 11,
+    13, 13, 13, 12, 13, 13, 13, 13, 13, 14, 13, 13, 14, 14, 14, 13,
+    14, 14, 14, 14,
+  },
+  {
+    4, 0, 0, 0, 6, 4, 0, 0, 6, 5, 4, 0, 6, 5, 5, 4,
+    7, 5, 5, 4, 7, 5, 5, 4, 7, 6, 6, 4, 7, 6, 6, 4,
+    8, 7, 7, 5, 8, 8, 7, 6, 9, 8, 8, 7, 9, 9, 8, 8,
+    9, 9, 9, 8, 10, 9, 9, 9, 10, 10, 10, 10, 10, 10, 10, 10,
+    10, 10, 10, 10,
+  },
+  {
+    6, 0, 0, 0, 6, 6, 0, 0, 6, 6, 6, 0, 6, 6, 6, 6,
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+    6, 6, 6, 6,
+  },
+  {
+    2, 0, 0, 0, 6, 1, 0, 0, 6, 6, 3, 0, 6, 7, 7, 6,
+    6, 8, 8, 7, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0,
+  },
+};
+
+static const guint8 coeff_token_bits[5][68] = {
+  {
+    1, 0, 0, 0, 5, 1, 0, 0, 7, 4, 1, 0, 7, 6, 5, 3,
+    7, 6, 5, 3, 7, 6, 5, 4, 15, 6, 5, 4, 11, 14, 5, 4,
+    8, 10, 13, 4, 15, 14, 9, 4, 11, 10, 13, 12, 15, 14, 9, 12,
+    11, 10, 13, 8, 15, 1, 9, 12, 11, 14, 13, 8, 7, 10, 9, 12,
+    4, 6, 5, 8,
+  },
+  {
+    3, 0, 0, 0, 11, 2, 0, 0, 7, 7, 3, 0, 7, 10, 9, 5,
+    7, 6, 5, 4, 4, 6, 5, 6, 7, 6, 5, 8, 15, 6, 5, 4,
+    11, 14, 13, 4, 15, 10, 9, 4, 11, 14, 13, 12, 8, 10, 9, 8,
+    15, 14, 13, 12, 11, 10, 9, 12, 7, 11, 6, 8, 9, 8, 10, 1,
+    7, 6, 5, 4,
+  },
+  {
+    15, 0, 0, 0, 15, 14, 0, 0, 11, 15, 13, 0, 8, 12, 14, 12,
+    15, 10, 11, 11, 11, 8, 9, 10, 9, 14, 13, 9, 8, 10, 9, 8,
+    15, 14, 13, 13, 11, 14, 10, 12, 15, 10, 13, 12, 11, 14, 9, 12,
+    8, 10, 13, 8, 13, 7, 9, 12, 9, 12, 11, 10, 5, 8, 7, 6,
+    1, 4, 3, 2,
+  },
+  {
+    3, 0, 0, 0, 0, 1, 0, 0, 4, 5, 6, 0, 8, 9, 10, 11,
+    12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27,
+    28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43,
+    44, 45, 46, 47, 48, 49, 50, 51, 52, 53, 54, 55, 56, 57, 58, 59,
+    60, 61, 62, 63,
+  },
+  {
+    1, 0, 0, 0, 7, 1, 0, 0, 4, 6, 1, 0, 3, 3, 2, 5,
+    2, 3, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0,
+  },
+};
+
+/* Tables 9-7 and 9-8, total_zeros for TotalCoeff 1..15 of 4x4 blocks */
+static const guint8 total_zeros_len[15][16] = {
+  {1, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 9},
+  {3, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 6, 6, 6, 6, 0},
+  {4, 3, 3, 3, 4, 4, 3, 3, 4, 5, 5, 6, 5, 6, 0, 0},
+  {5, 3, 4, 4, 3, 3, 3, 4, 3, 4, 5, 5, 5, 0, 0, 0},
+  {4, 4, 4, 3, 3, 3, 3, 3, 4, 5, 4, 5, 0, 0, 0, 0},
+  {6, 5, 3, 3, 3, 3, 3, 3, 4, 3, 6, 0, 0, 0, 0, 0},
+  {6, 5, 3, 3, 3, 2, 3, 4, 3, 6, 0, 0, 0, 0, 0, 0},
+  {6, 4, 5, 3, 2, 2, 3, 3, 6, 0, 0, 0, 0, 0, 0, 0},
+  {6, 6, 4, 2, 2, 3, 2, 5, 0, 0, 0, 0, 0, 0, 0, 0},
+  {5, 5, 3, 2, 2, 2, 4, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+  {4, 4, 3, 3, 1, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+  {4, 4, 2, 1, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+  {3, 3, 1, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+  {2, 2, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+  {1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+};
+
+static const guint8 total_zeros_bits[15][16] = {
+  {1, 3, 2, 3, 2, 3, 2, 3, 2, 3, 2, 3, 2, 3, 2, 1},
+  {7, 6, 5, 4, 3, 5, 4, 3, 2, 3, 2, 3, 2, 1, 0, 0},
+  {5, 7, 6, 5, 4, 3, 4, 3, 2, 3, 2, 1, 1, 0, 0, 0},
+  {3, 7, 5, 4, 6, 5, 4, 3, 3, 2, 2, 1, 0, 0, 0, 0},
+  {5, 4, 3, 7, 6, 5, 4, 3, 2, 1, 1, 0, 0, 0, 0, 0},
+  {1, 1, 7, 6, 5, 4, 3, 2, 1, 1, 0, 0, 0, 0, 0, 0},
+  {1, 1, 5, 4, 3, 3, 2, 1, 1, 0, 0, 0, 0, 0, 0, 0},
+  {1, 1, 1, 3, 3, 2, 2, 1, 0, 0, 0, 0, 0, 0, 0, 0},
+  {1, 0, 1, 3, 2, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0},
+  {1, 0, 1, 3, 2, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+  {0, 1, 1, 2, 1, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+  {0, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+  {0, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+  {0, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+  {0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+};
+
+/* Table 9-9a, total_zeros for TotalCoeff 1..3 of 4:2:0 chroma DC */
+static const guint8 chroma_dc_total_zeros_len[3][4] = {
+  {1, 2, 3, 3},
+  {1, 2, 2, 0},
+  {1, 1, 0, 0},
+};
+
+static const guint8 chroma_dc_total_zeros_bits[3][4] = {
+  {1, 1, 1, 0},
+  {1, 1, 0, 0},
+  {1, 0, 0, 0},
+};
+
+/* Table 9-10, run_before for zerosLeft 1..6 and > 6 */
+static const guint8 run_before_len[7][16] = {
+  {1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+  {1, 2, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+  {2, 2, 2, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+  {2, 2, 2, 3, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+  {2, 2, 3, 3, 3, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+  {2, 3, 3, 3, 3, 3, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+  {3, 3, 3, 3, 3, 3, 3, 4, 5, 6, 7, 8, 9, 10, 11, 0},
+};
+
+static const guint8 run_before_bits[7][16] = {
+  {1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+  {1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+  {3, 2, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+  {3, 2, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+  {3, 2, 3, 2, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+  {3, 0, 1, 3, 2, 5, 4, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+  {7, 6, 5, 4, 3, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0},
+};
+
+/* Table 9-4, coded_block_pattern for ChromaArrayType 1 and 2 */
+static const guint8 cbp_intra[48] = {
+  47, 31, 15, 0, 23, 27, 29, 30, 7, 11, 13, 14, 39, 43, 45, 46,
+  16, 3, 5, 10, 12, 19, 21, 26, 28, 35, 37, 42, 44, 1, 2, 4,
+  8, 17, 18, 20, 24, 6, 9, 22, 25, 32, 33, 34, 36, 40, 38, 41,
+};
+
+static const guint8 cbp_inter[48] = {
+  0, 16, 1, 2, 4, 8, 32, 3, 5, 10, 12, 15, 47, 7, 11, 13,
+  14, 6, 9, 31, 35, 37, 42, 44, 33, 34, 36, 40, 39, 43, 45, 46,
+  17, 18, 20, 24, 19, 21, 26, 28, 23, 27, 29, 30, 22, 25, 38, 41,
+};
+
+/* and for ChromaArrayType 0 and 3 */
+static const guint8 cbp_intra_mono[16] = {
+  15, 0, 7, 11, 13, 14, 3, 5, 10, 12, 1, 2, 4, 8, 6, 9,
+};
+
+static const guint8 cbp_inter_mono[16] = {
+  0, 1, 2, 4, 8, 3, 5, 10, 12, 15, 7, 11, 13, 14, 6, 9,
+};
+
+/* Table 9-34, ctxIdxOffset of coded_block_flag, significant_coeff_flag,
+ * last_significant_coeff_flag and coeff_abs_level_minus1 per ctxBlockCat */
+static const guint16 cbf_ctx[6] = { 85, 89, 93, 97, 101, 0 };
+static const guint16 sig_ctx[6] = { 105, 120, 134, 149, 152, 402 };
+static const guint16 last_ctx[6] = { 166, 181, 195, 210, 213, 417 };
+static const guint16 abs_ctx[6] = { 227, 237, 247, 257, 266, 426 };
+
+typedef enum
+{
+  MB_P_SKIP,
+  MB_P_16x16,
+  MB_P_16x8,
+  MB_P_8x16,
+  MB_P_8x8,
+  MB_P_8x8_REF0,
+  MB_I_NxN,
+  MB_I_16x16,
+  MB_I_PCM
+} H264MbType;
+
+#define MB_IS_INTRA(mb)         ((mb)->type >= MB_I_NxN)
+
+#define MB_FLAG_TRANSFORM_8x8   (1 << 0)
+#define MB_FLAG_LUMA_DC         (1 << 1)
+#define MB_FLAG_CB_DC           (1 << 2)
+#define MB_FLAG_CR_DC           (1 << 3)
+/* intra_chroma_pred_mode != 0 */
+#define MB_FLAG_CHROMA_PRED     (1 << 4)
+
+typedef struct
+{
+  /* the macroblock is available to the current one when both belong to the
+   * same slice, slice ids are never reused */
+  guint32 slice_id;
+  guint8 type;
+  guint8 flags;
+  guint8 cbp;
+  gint8 ref[4];
+  gint16 mv[16][2];
+  /* absolute mvd, clamped, for the CABAC context selection */
+  guint8 mvd[16][2];
+  /* coefficient count of the 4x4 luma then chroma AC blocks, 16 for PCM */
+  guint8 nnz[24];
+} H264MvMb;
+
+typedef struct
+{
+  gboolean valid;
+  guint chroma_format_idc;
+  guint chroma_array_type;
+  gboolean separate_colour_plane;
+  guint bit_depth_luma;
+  guint bit_depth_chroma;
+  guint log2_max_frame_num;
+  guint poc_type;
+  guint log2_max_poc_lsb;
+  gboolean delta_pic_order_always_zero;
+  gboolean frame_mbs_only;
+  guint width_mbs;
+  guint height_mbs;
+} H264MvSps;
+
+typedef struct
+{
+  gboolean valid;
+  guint sps_id;
+  gboolean cabac;
+  gboolean bottom_field_pic_order;
+  guint num_ref_idx_l0_default;
+  gboolean weighted_pred;
+  gint pic_init_qp;
+  gboolean deblocking_filter_control;
+  gboolean redundant_pic_cnt;
+  gboolean transform_8x8_mode;
+} H264MvPps;
+
+typedef struct
+{
+  gint16 sym;
+  /* -1 for a link to a second level table at offset sym */
+  gint8 len;
+} VlcEntry;
+
+typedef struct
+{
+  VlcEntry *table;
+} Vlc;
+
+typedef struct
+{
+  const guint8 *data;
+  guint pos;
+  /* position of the rbsp_stop_one_bit */
+  guint end;
+  /* reads past this position return zeros */
+  guint limit;
+} BitReader;
+
+typedef struct
+{
+  guint32 range;
+  guint32 value;
+  gint bits_needed;
+  const guint8 *p;
+  const guint8 *end;
+} Cabac;
+
+struct _GstH264MvParser
+{
+  H264MvSps sps[MAX_SPS_COUNT];
+  H264MvPps pps[MAX_PPS_COUNT];
+
+  Vlc coeff_token[5];
+  Vlc total_zeros[15];
+  Vlc chroma_dc_total_zeros[3];
+  Vlc run_before[7];
+
+  guint8 *rbsp;
+  gsize rbsp_alloc;
+
+  /* macroblocks and output of the current picture */
+  guint width_mbs;
+  guint height_mbs;
+  H264MvMb *mbs;
+  MVInfo *mvs;
+  guint32 slice_id;
+};
+
+typedef struct
+{
+  GstH264MvParser *parser;
+  const H264MvSps *sps;
+  const H264MvPps *pps;
+
+  BitReader br;
+  Cabac cabac;
+  guint8 ctx[NUM_CABAC_CONTEXTS];
+
+  guint slice_type;
+  guint cabac_init_idc;
+  gint qp;
+  guint num_ref;
+  guint first_mb;
+  guint32 slice_id;
+
+  H264MvMb *cur;
+  H264MvMb *mb_a;
+  H264MvMb *mb_b;
+  H264MvMb *mb_c;
+  H264MvMb *mb_d;
+  /* 4x4 blocks of the current macroblock whose vectors are known */
+  guint16 blk_done;
+  gboolean prev_qp_delta;
+  gboolean error;
+} SliceCtx;
+
+/* bit reader */
+
+static inline guint32
+br_peek (const BitReader * br)
+{
+  const guint8 *p;
+
+  if (G_UNLIKELY (br->pos >= br->limit))
+    return 0;
+
+  p = br->data + (br->pos >> 3);
+  return (GST_READ_UINT32_BE (p) << (br->pos & 7)) |
+      (p[4] >> (8 - (br->pos & 7)));
+}
+
+static inline guint32
+br_read (BitReader * br, guint n)
+{
+  guint32 v;
+
+  if (n == 0)
+    return 0;
+
+  v = br_peek (br) >> (32 - n);
+  br->pos += n;
+  return v;
+}
+
+static inline void
+br_skip (BitReader * br, guint n)
+{
+  br->pos += n;
+}
+
+static inline guint32
+br_ue (BitReader * br)
+{
+  guint32 v = br_peek (br);
+  guint lz;
+
+  if (G_UNLIKELY (v == 0)) {
+    br->pos = br->limit + 1;
+    return 0;
+  }
+
+  lz = __builtin_clz (v);
+  if (lz < 16) {
+    br->pos += 2 * lz + 1;
+    return (v >> (31 - 2 * lz)) - 1;
+  }
+
+  br->pos += lz;
+  return br_read (br, lz + 1) - 1;
+}
+
+static inline gint32
+br_se (BitReader * br)
+{
+  guint32 k = br_ue (br);
+
+  return (k & 1) ? (gint32) ((k + 1) >> 1) : -(gint32) (k >> 1);
+}
+
+static inline gboolean
+br_more_data (const BitReader * br)
+{
+  return br->pos < br->end;
+}
+
+static inline gboolean
+br_overrun (const BitReader * br)
+{
+  return br->pos > br->end;
+}
+
+static void
+br_init (BitReader * br, const guint8 * data, guint size)
+{
+  gint i;
+
+  br->data = data;
+  br->pos = 0;
+  br->end = 0;
+  br->limit = size * 8;
+
+  for (i = size - 1; i >= 0; i--) {
+    if (data[i]) {
+      br->end = i * 8 + 7 - __builtin_ctz (data[i]);
+      break;
+    }
+  }
+}
+
+/* CAVLC tables */
+
+static void
+vlc_init (Vlc * vlc, const guint8 * lens, const guint8 * bits, guint n)
+{
+  guint8 link[1 << VLC_BITS];
+  guint i, j, n_links = 0;
+
+  memset (link, 0, sizeof (link));
+  for (i = 0; i < n; i++) {
+    if (lens[i] > VLC_BITS) {
+      guint prefix = bits[i] >> (lens[i] - VLC_BITS);
+      if (!link[prefix])
+        link[prefix] = ++n_links;
+    }
+  }
+
+  vlc->table = g_new0 (VlcEntry, (1 + n_links) << VLC_BITS);
+  for (i = 0; i < (1 << VLC_BITS); i++) {
+    if (link[i]) {
+      vlc->table[i].sym = link[i] << VLC_BITS;
+      vlc->table[i].len = -1;
+    }
+  }
+
+  for (i = 0; i < n; i++) {
+    VlcEntry *e;
+    guint len = lens[i], start, count;
+
+    if (len == 0)
+      continue;
+
+    if (len <= VLC_BITS) {
+      e = vlc->table;
+      start = bits[i] << (VLC_BITS - len);
+      count = 1 << (VLC_BITS - len);
+    } else {
+      guint prefix = bits[i] >> (len - VLC_BITS);
+      e = vlc->table + (link[prefix] << VLC_BITS);
+      start = (bits[i] & ((1 << (len - VLC_BITS)) - 1)) << (2 * VLC_BITS - len);
+      count = 1 << (2 * VLC_BITS - len);
+    }
+
+    for (j = 0; j < count; j++) {
+      e[start + j].sym = i;
+      e[start + j].len = len;
+    }
+  }
+}
+
+static inline gint
+vlc_read (BitReader * br, const Vlc * vlc)
+{
+  guint32 bits = br_peek (br);
+  const VlcEntry *e = &vlc->table[bits >> (32 - VLC_BITS)];
+
+  if (e->len < 0)
+    e = &vlc->table[e->sym + ((bits >> (32 - 2 * VLC_BITS)) &
+            ((1 << VLC_BITS) - 1))];
+  if (e->len == 0)
+    return -1;
+
+  br->pos += e->len;
+  return e->sym;
+}
+
+/* CABAC engine, 9.3.1.2 and 9.3.3.2, with the offset kept scaled by 7 bits
+ * so that whole bytes can be fed in */
+
+static void
+cabac_init_engine (Cabac * c, const guint8 * p, const guint8 * end)
+{
+  c->p = p;
+  c->end = end;
+  c->range = 510;
+  c->value = 0;
+  c->bits_needed = 8;
+
+  if (c->p < c->end) {
+    c->value = *c->p++ << 8;
+    c->bits_needed -= 8;
+  }
+  if (c->p < c->end) {
+    c->value |= *c->p++;
+    c->bits_needed -= 8;
+  }
+}
+
+static void
+cabac_init_contexts (guint8 * states, guint idc, gint qp)
+{
+  guint i;
+
+  qp = CLAMP (qp, 0, 51);
+  for (i = 0; i < NUM_CABAC_CONTEXTS; i++) {
+    gint pre = ((cabac_init_pb[idc][i][0] * qp) >> 4) +
+        cabac_init_pb[idc][i][1];
+
+    pre = CLAMP (pre, 1, 126);
+    states[i] = pre <= 63 ? (63 - pre) << 1 : ((pre - 64) << 1) | 1;
+  }
+}
+
+static inline guint
+cabac_decode (Cabac * c, guint8 * state)
+{
+  guint s = *state >> 1, mps = *state & 1;
+  guint lps = cabac_range_lps[s][(c->range >> 6) & 3];
+  guint32 range = c->range - lps, scaled = range << 7;
+  guint is_lps = c->value >= scaled;
+  guint32 mask = -is_lps;
+  guint n;
+
+  /* branchless selection of the sub-interval, unpredictable bins are the
+   * common case in residual data */
+  c->value -= scaled & mask;
+  range ^= (range ^ lps) & mask;
+  *state = cabac_next_state[(*state << 1) | is_lps];
+
+  n = __builtin_clz (range) - 23;
+  c->range = range << n;
+  c->value <<= n;
+  c->bits_needed += n;
+  if (c->bits_needed >= 0) {
+    if (c->p < c->end)
+      c->value |= *c->p++ << c->bits_needed;
+    c->bits_needed -= 8;
+  }
+
+  return mps ^ is_lps;
+}
+
+static inline guint
+cabac_decode_bypass (Cabac * c)
+{
+  guint32 scaled;
+
+  c->value <<= 1;
+  if (++c->bits_needed == 0) {
+    c->bits_needed = -8;
+    if (c->p < c->end)
+      c->value |= *c->p++;
+  }
+
+  scaled = c->range << 7;
+  if (c->value >= scaled) {
+    c->value -= scaled;
+    return 1;
+  }
+  return 0;
+}
+
+static inline guint
+cabac_decode_terminate (Cabac * c)
+{
+  guint32 scaled;
+
+  c->range -= 2;
+  scaled = c->range << 7;
+  if (c->value >= scaled)
+    return 1;
+
+  if (scaled < (256 << 7)) {
+    c->range = scaled >> 6;
+    c->value <<= 1;
+    if (++c->bits_needed == 0) {
+      c->bits_needed = -8;
+      if (c->p < c->end)
+        c->value |= *c->p++;
+    }
+  }
+  return 0;
+}
+
+/* parameter sets */
+
+static void
+skip_scaling_list (BitReader * br, guint size)
+{
+  gint last = 8, next = 8;
+  guint i;
+
+  for (i = 0; i < size; i++) {
+    if (next != 0)
+      next = (last + br_se (br) + 256) % 256;
+    if (next != 0)
+      last = next;
+  }
+}
+
+static void
+parse_sps (GstH264MvParser * parser, BitReader * br)
+{
+  H264MvSps sps;
+  guint profile_idc, sps_id, map_units, i;
+
+  memset (&sps, 0, sizeof (sps));
+  profile_idc = br_read (br, 8);
+  br_skip (br, 16);
+  sps_id = br_ue (br);
+  if (sps_id >= MAX_SPS_COUNT)
+    return;
+
+  sps.chroma_format_idc = 1;
+  sps.bit_depth_luma = 8;
+  sps.bit_depth_chroma = 8;
+  if (profile_idc == 100 || profile_idc == 110 || profile_idc == 122 ||
+      profile_idc == 244 || profile_idc == 44 || profile_idc == 83 ||
+      profile_idc == 86 || profile_idc == 118 || profile_idc == 128 ||
+      profile_idc == 138 || profile_idc == 139 || profile_idc == 134 ||
+      profile_idc == 135) {
+    sps.chroma_format_idc = br_ue (br);
+    if (sps.chroma_format_idc > 3)
+      return;
+    if (sps.chroma_format_idc == 3)
+      sps.separate_colour_plane = br_read (br, 1);
+    sps.bit_depth_luma = br_ue (br) + 8;
+    sps.bit_depth_chroma = br_ue (br) + 8;
+    if (sps.bit_depth_luma > 14 || sps.bit_depth_chroma > 14)
+      return;
+    /* qpprime_y_zero_transform_bypass_flag */
+    br_skip (br, 1);
+    if (br_read (br, 1)) {
+      for (i = 0; i < (sps.chroma_format_idc != 3 ? 8 : 12); i++) {
+        if (br_read (br, 1))
+          skip_scaling_list (br, i < 6 ? 16 : 64);
+      }
+    }
+  }
+  sps.chroma_array_type =
+      sps.separate_colour_plane ? 0 : sps.chroma_format_idc;
+
+  sps.log2_max_frame_num = br_ue (br) + 4;
+  sps.poc_type = br_ue (br);
+  if (sps.poc_type == 0) {
+    sps.log2_max_poc_lsb = br_ue (br) + 4;
+  } else if (sps.poc_type == 1) {
+    guint n;
+
+    sps.delta_pic_order_always_zero = br_read (br, 1);
+    br_se (br);
+    br_se (br);
+    n = br_ue (br);
+    if (n > 255)
+      return;
+    for (i = 0; i < n; i++)
+      br_se (br);
+  } else if (sps.poc_type != 2) {
+    return;
+  }
+  if (sps.log2_max_frame_num > 16 || sps.log2_max_poc_lsb > 16)
+    return;
+
+  /* max_num_ref_frames, gaps_in_frame_num_value_allowed_flag */
+  br_ue (br);
+  br_skip (br, 1);
+  sps.width_mbs = br_ue (br) + 1;
+  map_units = br_ue (br) + 1;
+  sps.frame_mbs_only = br_read (br, 1);
+  sps.height_mbs = map_units * (sps.frame_mbs_only ? 1 : 2);
+
+  if (br_overrun (br) || sps.width_mbs > 1024 || sps.height_mbs > 1024 ||
+      sps.width_mbs * sps.height_mbs > MAX_FRAME_MBS)
+    return;
+
+  sps.valid = TRUE;
+  parser->sps[sps_id] = sps;
+}
+
+static void
+parse_pps (GstH264MvParser * parser, BitReader * br)
+{
+  H264MvPps pps;
+  guint pps_id, i;
+
+  memset (&pps, 0, sizeof (pps));
+  pps_id = br_ue (br);
+  if (pps_id >= MAX_PPS_COUNT)
+    return;
+  /* a PPS that cannot be used still replaces the previous one */
+  parser->pps[pps_id].valid = FALSE;
+
+  pps.sps_id = br_ue (br);
+  if (pps.sps_id >= MAX_SPS_COUNT)
+    return;
+  pps.cabac = br_read (br, 1);
+  pps.bottom_field_pic_order = br_read (br, 1);
+  /* slice groups are not supported */
+  if (br_ue (br) != 0)
+    return;
+
+  pps.num_ref_idx_l0_default = br_ue (br) + 1;
+  br_ue (br);
+  pps.weighted_pred = br_read (br, 1);
+  br_skip (br, 2);
+  pps.pic_init_qp = 26 + br_se (br);
+  /* pic_init_qs_minus26, chroma_qp_index_offset */
+  br_se (br);
+  br_se (br);
+  pps.deblocking_filter_control = br_read (br, 1);
+  br_skip (br, 1);
+  pps.redundant_pic_cnt = br_read (br, 1);
+
+  if (br_more_data (br)) {
+    pps.transform_8x8_mode = br_read (br, 1);
+    if (br_read (br, 1)) {
+      const H264MvSps *sps = &parser->sps[pps.sps_id];
+      guint n = 6 + (sps->valid && sps->chroma_format_idc == 3 ? 6 : 2) *
+          pps.transform_8x8_mode;
+
+      for (i = 0; i < n; i++) {
+        if (br_read (br, 1))
+          skip_scaling_list (br, i < 6 ? 16 : 64);
+      }
+    }
+    br_se (br);
+  }
+
+  if (br_overrun (br) || pps.num_ref_idx_l0_default > 32)
+    return;
+
+  pps.valid = TRUE;
+  parser->pps[pps_id] = pps;
+}
+
+/* copies the payload of a NAL into the RBSP buffer without its emulation
+ * prevention bytes, stopping after max bytes; returns the RBSP size */
+static guint
+unescape_nal (GstH264MvParser * parser, const guint8 * nal, guint size,
+    guint max)
+{
+  guint i = 0, n = 0;
+
+  if (parser->rbsp_alloc < size + RBSP_PADDING) {
+    parser->rbsp_alloc = size + RBSP_PADDING;
+    g_free (parser->rbsp);
+    parser->rbsp = g_malloc (parser->rbsp_alloc);
+  }
+
+  while (i < size && n < max) {
+    const guint8 *p = memchr (nal + i, 3, size - i);
+    guint next = p ? p - nal : size, len;
+
+    if (p && next >= i + 2 && nal[next - 1] == 0 && nal[next - 2] == 0) {
+      len = next - i;
+      next++;
+    } else {
+      next = p ? next + 1 : size;
+      len = next - i;
+    }
+
+    len = MIN (len, max - n);
+    memcpy (parser->rbsp + n, nal + i, len);
+    n += len;
+    i = next;
+  }
+
+  memset (parser->rbsp + n, 0, RBSP_PADDING);
+  return n;
+}
+
+/* neighbours, 6.4.11 */
+
+static void
+start_mb (SliceCtx * s, guint addr)
+{
+  GstH264MvParser *parser = s->parser;
+  H264MvMb *mbs = parser->mbs;
+  guint w = parser->width_mbs, x = addr % w, y = addr / w;
+
+#define AVAILABLE(a) (mbs[a].slice_id == s->slice_id ? &mbs[a] : NULL)
+  s->mb_a = x > 0 ? AVAILABLE (addr - 1) : NULL;
+  s->mb_b = y > 0 ? AVAILABLE (addr - w) : NULL;
+  s->mb_c = y > 0 && x + 1 < w ? AVAILABLE (addr - w + 1) : NULL;
+  s->mb_d = y > 0 && x > 0 ? AVAILABLE (addr - w - 1) : NULL;
+#undef AVAILABLE
+
+  s->cur = &mbs[addr];
+  s->cur->slice_id = s->slice_id;
+  s->cur->type = MB_P_SKIP;
+  s->cur->flags = 0;
+  s->cur->cbp = 0;
+  memset (s->cur->ref, -1, sizeof (s->cur->ref));
+  memset (s->cur->mv, 0, sizeof (s->cur->mv));
+  memset (s->cur->mvd, 0, sizeof (s->cur->mvd));
+  memset (s->cur->nnz, 0, sizeof (s->cur->nnz));
+  s->blk_done = 0;
+}
+
+/* resolves the 4x4 block at (x, y), in blocks relative to the top left of
+ * the current macroblock with x in -1..4 and y in -1..3. Blocks of the
+ * current macroblock are only available once their vectors are known when
+ * decoded is set. */
+static inline H264MvMb *
+block_at (SliceCtx * s, gint x, gint y, gboolean decoded, guint * idx)
+{
+  H264MvMb *mb;
+
+  if (y < 0) {
+    mb = x < 0 ? s->mb_d : (x < 4 ? s->mb_b : s->mb_c);
+    y += 4;
+  } else if (x < 0) {
+    mb = s->mb_a;
+  } else if (x < 4) {
+    if (decoded && !(s->blk_done & (1 << (y * 4 + x))))
+      return NULL;
+    mb = s->cur;
+  } else {
+    return NULL;
+  }
+
+  *idx = y * 4 + (x & 3);
+  return mb;
+}
+
+#define BLK8(idx) ((((idx) >> 3) << 1) | (((idx) & 3) >> 1))
+
+/* motion vector prediction, 8.4.1.3 */
+
+static void
+neighbour_motion (const H264MvMb * mb, guint idx, gint * ref,
+    const gint16 ** mv)
+{
+  static const gint16 zero[2] = { 0, 0 };
+
+  if (!mb || MB_IS_INTRA (mb)) {
+    *ref = -1;
+    *mv = zero;
+  } else {
+    *ref = mb->ref[BLK8 (idx)];
+    *mv = mb->mv[idx];
+  }
+}
+
+static inline gint
+median3 (gint a, gint b, gint c)
+{
+  return MAX (MIN (a, b), MIN (MAX (a, b), c));
+}
+
+/* shape is 1 for 16x8 and 2 for 8x16 partitions, 0 otherwise */
+static void
+predict_mv (SliceCtx * s, gint x, gint y, gint w, guint shape, gint ref,
+    gint16 * mvp)
+{
+  H264MvMb *mb_a, *mb_b, *mb_c;
+  guint ia = 0, ib = 0, ic = 0;
+  gint ref_a, ref_b, ref_c, n;
+  const gint16 *mv_a, *mv_b, *mv_c;
+
+  mb_a = block_at (s, x - 1, y, TRUE, &ia);
+  mb_b = block_at (s, x, y - 1, TRUE, &ib);
+  mb_c = block_at (s, x + w, y - 1, TRUE, &ic);
+  if (!mb_c)
+    mb_c = block_at (s, x - 1, y - 1, TRUE, &ic);
+
+  neighbour_motion (mb_a, ia, &ref_a, &mv_a);
+  neighbour_motion (mb_b, ib, &ref_b, &mv_b);
+  neighbour_motion (mb_c, ic, &ref_c, &mv_c);
+
+  if (shape == 1) {
+    if (y == 0 && ref_b == ref) {
+      mvp[0] = mv_b[0];
+      mvp[1] = mv_b[1];
+      return;
+    }
+    if (y != 0 && ref_a == ref) {
+      mvp[0] = mv_a[0];
+      mvp[1] = mv_a[1];
+      return;
+    }
+  } else if (shape == 2) {
+    if (x == 0 && ref_a == ref) {
+      mvp[0] = mv_a[0];
+      mvp[1] = mv_a[1];
+      return;
+    }
+    if (x != 0 && ref_c == ref) {
+      mvp[0] = mv_c[0];
+      mvp[1] = mv_c[1];
+      return;
+    }
+  }
+
+  if (!mb_b && !mb_c && mb_a) {
+    ref_b = ref_c = ref_a;
+    mv_b = mv_c = mv_a;
+  }
+
+  n = (ref_a == ref) + (ref_b == ref) + (ref_c == ref);
+  if (n == 1) {
+    const gint16 *mv = ref_a == ref ? mv_a : (ref_b == ref ? mv_b : mv_c);
+    mvp[0] = mv[0];
+    mvp[1] = mv[1];
+  } else {
+    mvp[0] = median3 (mv_a[0], mv_b[0], mv_c[0]);
+    mvp[1] = median3 (mv_a[1], mv_b[1], mv_c[1]);
+  }
+}
+
+static void
+fill_partition (SliceCtx * s, gint x, gint y, gint w, gint h,
+    const gint16 * mv)
+{
+  gint i, j;
+
+  for (j = y; j < y + h; j++) {
+    for (i = x; i < x + w; i++) {
+      s->cur->mv[j * 4 + i][0] = mv[0];
+      s->cur->mv[j * 4 + i][1] = mv[1];
+      s->blk_done |= 1 << (j * 4 + i);
+    }
+  }
+}
+
+/* 8.4.1.1 */
+static void
+decode_skip (SliceCtx * s)
+{
+  H264MvMb *mb = s->cur;
+  gint16 mv[2] = { 0, 0 };
+
+  mb->type = MB_P_SKIP;
+  memset (mb->ref, 0, sizeof (mb->ref));
+
+  if (s->mb_a && s->mb_b) {
+    gint ref_a, ref_b;
+    const gint16 *mv_a, *mv_b;
+
+    neighbour_motion (s->mb_a, 3, &ref_a, &mv_a);
+    neighbour_motion (s->mb_b, 12, &ref_b, &mv_b);
+    if (!(ref_a == 0 && mv_a[0] == 0 && mv_a[1] == 0) &&
+        !(ref_b == 0 && mv_b[0] == 0 && mv_b[1] == 0))
+      predict_mv (s, 0, 0, 4, 0, 0, mv);
+  }
+
+  fill_partition (s, 0, 0, 4, 4, mv);
+  s->prev_qp_delta = FALSE;
+}
+
+/* CABAC syntax elements, 9.3.3.1.1 */
+
+static guint
+cabac_mb_skip (SliceCtx * s)
+{
+  guint inc = (s->mb_a && s->mb_a->type != MB_P_SKIP) +
+      (s->mb_b && s->mb_b->type != MB_P_SKIP);
+
+  return cabac_decode (&s->cabac, &s->ctx[11 + inc]);
+}
+
+/* mb_type of a P slice, 0..4 for the inter and 5..30 for the intra types */
+static guint
+cabac_mb_type (SliceCtx * s)
+{
+  Cabac *c = &s->cabac;
+  guint8 *ctx = s->ctx;
+  guint t;
+
+  if (!cabac_decode (c, &ctx[14])) {
+    if (!cabac_decode (c, &ctx[15]))
+      return cabac_decode (c, &ctx[16]) ? 3 : 0;
+    return cabac_decode (c, &ctx[17]) ? 1 : 2;
+  }
+
+  /* intra prefix, then the I slice binarization with ctxIdxOffset 17 */
+  if (!cabac_decode (c, &ctx[17]))
+    return 5;
+  if (cabac_decode_terminate (c))
+    return 5 + 25;
+
+  t = 1 + 12 * cabac_decode (c, &ctx[18]);
+  if (cabac_decode (c, &ctx[19]))
+    t += 4 + 4 * cabac_decode (c, &ctx[19]);
+  t += 2 * cabac_decode (c, &ctx[20]);
+  t += cabac_decode (c, &ctx[20]);
+  return 5 + t;
+}
+
+static guint
+cabac_sub_mb_type (SliceCtx * s)
+{
+  Cabac *c = &s->cabac;
+
+  if (cabac_decode (c, &s->ctx[21]))
+    return 0;
+  if (!cabac_decode (c, &s->ctx[22]))
+    return 1;
+  return cabac_decode (c, &s->ctx[23]) ? 2 : 3;
+}
+
+static guint
+cabac_ref_idx (SliceCtx * s, gint x, gint y)
+{
+  H264MvMb *mb;
+  guint idx = 0, inc = 0, ref = 0;
+
+  mb = block_at (s, x - 1, y, FALSE, &idx);
+  if (mb && mb->type != MB_P_SKIP && !MB_IS_INTRA (mb) &&
+      mb->ref[BLK8 (idx)] > 0)
+    inc += 1;
+  mb = block_at (s, x, y - 1, FALSE, &idx);
+  if (mb && mb->type != MB_P_SKIP && !MB_IS_INTRA (mb) &&
+      mb->ref[BLK8 (idx)] > 0)
+    inc += 2;
+
+  while (cabac_decode (&s->cabac, &s->ctx[54 + inc])) {
+    inc = ++ref == 1 ? 4 : 5;
+    if (ref >= 32) {
+      s->error = TRUE;
+      break;
+    }
+  }
+  return ref;
+}
+
+static gint
+cabac_mvd (SliceCtx * s, gint x, gint y, guint comp)
+{
+  Cabac *c = &s->cabac;
+  guint8 *ctx = s->ctx + (comp ? 47 : 40);
+  H264MvMb *mb;
+  guint idx = 0, sum = 0, k;
+  gint val;
+
+  mb = block_at (s, x - 1, y, FALSE, &idx);
+  if (mb)
+    sum += mb->mvd[idx][comp];
+  mb = block_at (s, x, y - 1, FALSE, &idx);
+  if (mb)
+    sum += mb->mvd[idx][comp];
+
+  if (!cabac_decode (c, &ctx[sum < 3 ? 0 : (sum > 32 ? 2 : 1)]))
+    return 0;
+
+  /* UEG3 with uCoff 9 */
+  val = 1;
+  for (k = 1; val < 9 && cabac_decode (c, &ctx[k < 4 ? k + 2 : 6]); k++)
+    val++;
+
+  if (val >= 9) {
+    k = 3;
+    while (cabac_decode_bypass (c)) {
+      val += 1 << k++;
+      if (k > 24) {
+        s->error = TRUE;
+        return 0;
+      }
+    }
+    while (k--)
+      val += cabac_decode_bypass (c) << k;
+  }
+
+  return cabac_decode_bypass (c) ? -val : val;
+}
+
+static guint
+cabac_cbp (SliceCtx * s)
+{
+  Cabac *c = &s->cabac;
+  guint cbp = 0, b8, a, b;
+
+  for (b8 = 0; b8 < 4; b8++) {
+    /* the bits of the left and above 8x8 blocks, unavailable counts as
+     * coded */
+    if (b8 & 1)
+      a = (cbp >> (b8 - 1)) & 1;
+    else
+      a = s->mb_a ? (s->mb_a->cbp >> (b8 + 1)) & 1 : 1;
+    if (b8 & 2)
+      b = (cbp >> (b8 - 2)) & 1;
+    else
+      b = s->mb_b ? (s->mb_b->cbp >> (b8 + 2)) & 1 : 1;
+
+    if (cabac_decode (c, &s->ctx[73 + !a + 2 * !b]))
+      cbp |= 1 << b8;
+  }
+
+  if (s->sps->chroma_array_type == 1 || s->sps->chroma_array_type == 2) {
+    a = s->mb_a ? s->mb_a->cbp >> 4 : 0;
+    b = s->mb_b ? s->mb_b->cbp >> 4 : 0;
+    if (cabac_decode (c, &s->ctx[77 + (a != 0) + 2 * (b != 0)]))
+      cbp |= (1 + cabac_decode (c,
+              &s->ctx[81 + (a == 2) + 2 * (b == 2)])) << 4;
+  }
+
+  return cbp;
+}
+
+static gint
+cabac_qp_delta (SliceCtx * s)
+{
+  guint k = 0, inc = s->prev_qp_delta ? 1 : 0;
+
+  while (cabac_decode (&s->cabac, &s->ctx[60 + inc])) {
+    inc = ++k == 1 ? 2 : 3;
+    if (k > 104) {
+      s->error = TRUE;
+      break;
+    }
+  }
+
+  return (k & 1) ? (gint) (k + 1) / 2 : -(gint) (k / 2);
+}
+
+static guint
+cabac_chroma_pred_mode (SliceCtx * s)
+{
+  Cabac *c = &s->cabac;
+  guint inc = (s->mb_a && (s->mb_a->flags & MB_FLAG_CHROMA_PRED)) +
+      (s->mb_b && (s->mb_b->flags & MB_FLAG_CHROMA_PRED));
+
+  if (!cabac_decode (c, &s->ctx[64 + inc]))
+    return 0;
+  if (!cabac_decode (c, &s->ctx[67]))
+    return 1;
+  return cabac_decode (c, &s->ctx[67]) ? 3 : 2;
+}
+
+static guint
+cabac_transform_8x8 (SliceCtx * s)
+{
+  guint inc = (s->mb_a && (s->mb_a->flags & MB_FLAG_TRANSFORM_8x8)) +
+      (s->mb_b && (s->mb_b->flags & MB_FLAG_TRANSFORM_8x8));
+
+  return cabac_decode (&s->cabac, &s->ctx[399 + inc]);
+}
+
+/* coded_block_flag ctxIdxInc of a 4x4 luma block, unavailable neighbours
+ * count as coded for intra macroblocks only */
+static guint
+cabac_luma_cbf_inc (SliceCtx * s, gint x, gint y)
+{
+  guint intra = MB_IS_INTRA (s->cur), a, b;
+
+  if (x > 0)
+    a = s->cur->nnz[y * 4 + x - 1] != 0;
+  else
+    a = s->mb_a ? s->mb_a->nnz[y * 4 + 3] != 0 : intra;
+  if (y > 0)
+    b = s->cur->nnz[(y - 1) * 4 + x] != 0;
+  else
+    b = s->mb_b ? s->mb_b->nnz[12 + x] != 0 : intra;
+
+  return a + 2 * b;
+}
+
+static guint
+cabac_chroma_cbf_inc (SliceCtx * s, guint c, gint x, gint y)
+{
+  guint intra = MB_IS_INTRA (s->cur), a, b;
+  const guint8 *nnz = s->cur->nnz + 16 + 4 * c;
+
+  if (x > 0)
+    a = nnz[y * 2 + x - 1] != 0;
+  else
+    a = s->mb_a ? s->mb_a->nnz[16 + 4 * c + y * 2 + 1] != 0 : intra;
+  if (y > 0)
+    b = nnz[x] != 0;
+  else
+    b = s->mb_b ? s->mb_b->nnz[16 + 4 * c + 2 + x] != 0 : intra;
+
+  return a + 2 * b;
+}
+
+static guint
+cabac_dc_cbf_inc (SliceCtx * s, guint flag)
+{
+  guint intra = MB_IS_INTRA (s->cur);
+
+  return (s->mb_a ? (s->mb_a->flags & flag) != 0 : intra) +
+      2 * (s->mb_b ? (s->mb_b->flags & flag) != 0 : intra);
+}
+
+/* residual_block_cabac (), returns the number of non-zero coefficients */
+static guint
+cabac_residual (SliceCtx * s, guint cat, guint max_coeff, guint cbf_inc)
+{
+  Cabac *c = &s->cabac;
+  guint8 *sig = s->ctx + sig_ctx[cat];
+  guint8 *last = s->ctx + last_ctx[cat];
+  guint8 *abs = s->ctx + abs_ctx[cat];
+  guint i, n = 0, n_eq1 = 0, n_gt1 = 0, max_gt1 = cat == 3 ? 3 : 4;
+  gboolean done = FALSE;
+
+  if (cat != 5 && !cabac_decode (c, &s->ctx[cbf_ctx[cat] + cbf_inc]))
+    return 0;
+
+  if (cat == 5) {
+    for (i = 0; i < 63; i++) {
+      if (cabac_decode (c, &sig[sig_coeff_8x8[i]])) {
+        n++;
+        if (cabac_decode (c, &last[last_coeff_8x8[i]])) {
+          done = TRUE;
+          break;
+        }
+      }
+    }
+  } else {
+    for (i = 0; i < max_coeff - 1; i++) {
+      guint si = cat == 3 ? MIN (i, 2) : i;
+
+      if (cabac_decode (c, &sig[si])) {
+        n++;
+        if (cabac_decode (c, &last[si])) {
+          done = TRUE;
+          break;
+        }
+      }
+    }
+  }
+  if (!done)
+    n++;
+
+  for (i = 0; i < n; i++) {
+    if (!cabac_decode (c, &abs[n_gt1 ? 0 : MIN (4, 1 + n_eq1)])) {
+      n_eq1++;
+    } else {
+      guint8 *state = &abs[5 + MIN (max_gt1, n_gt1)];
+      guint val = 1;
+
+      while (val < 14 && cabac_decode (c, state))
+        val++;
+      if (val >= 14) {
+        guint k = 0;
+
+        while (cabac_decode_bypass (c)) {
+          if (++k > 24) {
+            s->error = TRUE;
+            return n;
+          }
+        }
+        while (k--)
+          cabac_decode_bypass (c);
+      }
+      n_gt1++;
+    }
+    /* coeff_sign_flag */
+    cabac_decode_bypass (c);
+  }
+
+  return n;
+}
+
+/* CAVLC, 9.2 */
+
+static gint
+cavlc_luma_nc (SliceCtx * s, gint x, gint y)
+{
+  gint a = -1, b = -1;
+
+  if (x > 0)
+    a = s->cur->nnz[y * 4 + x - 1];
+  else if (s->mb_a)
+    a = s->mb_a->nnz[y * 4 + 3];
+  if (y > 0)
+    b = s->cur->nnz[(y - 1) * 4 + x];
+  else if (s->mb_b)
+    b = s->mb_b->nnz[12 + x];
+
+  if (a >= 0 && b >= 0)
+    return (a + b + 1) >> 1;
+  return a >= 0 ? a : (b >= 0 ? b : 0);
+}
+
+static gint
+cavlc_chroma_nc (SliceCtx * s, guint c, gint x, gint y)
+{
+  const guint8 *nnz = s->cur->nnz + 16 + 4 * c;
+  gint a = -1, b = -1;
+
+  if (x > 0)
+    a = nnz[y * 2 + x - 1];
+  else if (s->mb_a)
+    a = s->mb_a->nnz[16 + 4 * c + y * 2 + 1];
+  if (y > 0)
+    b = nnz[x];
+  else if (s->mb_b)
+    b = s->mb_b->nnz[16 + 4 * c + 2 + x];
+
+  if (a >= 0 && b >= 0)
+    return (a + b + 1) >> 1;
+  return a >= 0 ? a : (b >= 0 ? b : 0);
+}
+
+/* residual_block_cavlc () with nC < 0 for chroma DC, returns TotalCoeff */
+static guint
+cavlc_residual (SliceCtx * s, gint nc, guint max_coeff)
+{
+  GstH264MvParser *parser = s->parser;
+  BitReader *br = &s->br;
+  const Vlc *vlc;
+  gint token, total, trailing, i, suffix_length, zeros_left;
+
+  if (nc < 0)
+    vlc = &parser->coeff_token[4];
+  else if (nc < 2)
+    vlc = &parser->coeff_token[0];
+  else if (nc < 4)
+    vlc = &parser->coeff_token[1];
+  else if (nc < 8)
+    vlc = &parser->coeff_token[2];
+  else
+    vlc = &parser->coeff_token[3];
+
+  token = vlc_read (br, vlc);
+  if (token < 0)
+    goto error;
+  total = token >> 2;
+  trailing = token & 3;
+  if (total == 0)
+    return 0;
+  if (total > (gint) max_coeff)
+    goto error;
+
+  /* trailing_ones_sign_flag */
+  br_skip (br, trailing);
+
+  suffix_length = total > 10 && trailing < 3 ? 1 : 0;
+  for (i = trailing; i < total; i++) {
+    guint32 bits = br_peek (br);
+    gint prefix, level_code, abs_level;
+
+    if (bits == 0)
+      goto error;
+    prefix = __builtin_clz (bits);
+    br_skip (br, prefix + 1);
+
+    level_code = MIN (15, prefix) << suffix_length;
+    if (suffix_length > 0 || prefix >= 14) {
+      guint size;
+
+      if (prefix == 14 && suffix_length == 0)
+        size = 4;
+      else if (prefix >= 15)
+        size = prefix - 3;
+      else
+        size = suffix_length;
+      level_code += br_read (br, size);
+    }
+    if (prefix >= 15 && suffix_length == 0)
+      level_code += 15;
+    if (prefix >= 16)
+      level_code += (1 << (prefix - 3)) - 4096;
+    if (i == trailing && trailing < 3)
+      level_code += 2;
+
+    if (suffix_length == 0)
+      suffix_length = 1;
+    abs_level = (level_code + 2) >> 1;
+    if (abs_level > (3 << (suffix_length - 1)) && suffix_length < 6)
+      suffix_length++;
+  }
+
+  if (total < (gint) max_coeff) {
+    zeros_left = vlc_read (br, max_coeff == 4 ?
+        &parser->chroma_dc_total_zeros[total - 1] :
+        &parser->total_zeros[total - 1]);
+    if (zeros_left < 0)
+      goto error;
+  } else {
+    zeros_left = 0;
+  }
+
+  for (i = 0; i < total - 1 && zeros_left > 0; i++) {
+    gint run = vlc_read (br, &parser->run_before[MIN (zeros_left, 7) - 1]);
+
+    if (run < 0 || run > zeros_left)
+      goto error;
+    zeros_left -= run;
+  }
+
+  return total;
+
+error:
+  s->error = TRUE;
+  return 0;
+}
+
+/* residual (), only keeping track of which blocks are coded */
+static void
+decode_residual (SliceCtx * s)
+{
+  H264MvMb *mb = s->cur;
+  gboolean cabac = s->pps->cabac;
+  gboolean i16x16 = mb->type == MB_I_16x16;
+  guint b8, i, c, n;
+
+  if (mb->cbp || i16x16) {
+    gint qp_delta = cabac ? cabac_qp_delta (s) : br_se (&s->br);
+
+    s->prev_qp_delta = qp_delta != 0;
+  } else {
+    s->prev_qp_delta = FALSE;
+    return;
+  }
+
+  if (i16x16) {
+    if (cabac)
+      n = cabac_residual (s, 0, 16, cabac_dc_cbf_inc (s, MB_FLAG_LUMA_DC));
+    else
+      n = cavlc_residual (s, cavlc_luma_nc (s, 0, 0), 16);
+    if (n)
+      mb->flags |= MB_FLAG_LUMA_DC;
+  }
+
+  for (b8 = 0; b8 < 4 && !s->error; b8++) {
+    if (!(mb->cbp & (1 << b8)))
+      continue;
+
+    if (cabac && (mb->flags & MB_FLAG_TRANSFORM_8x8)) {
+      cabac_residual (s, 5, 64, 0);
+      for (i = 0; i < 4; i++)
+        mb->nnz[(b8 >> 1) * 8 + (b8 & 1) * 2 + (i >> 1) * 4 + (i & 1)] = 1;
+      continue;
+    }
+
+    for (i = 0; i < 4; i++) {
+      gint x = (b8 & 1) * 2 + (i & 1), y = (b8 >> 1) * 2 + (i >> 1);
+      guint max_coeff = i16x16 ? 15 : 16;
+
+      if (cabac)
+        n = cabac_residual (s, i16x16 ? 1 : 2, max_coeff,
+            cabac_luma_cbf_inc (s, x, y));
+      else
+        n = cavlc_residual (s, cavlc_luma_nc (s, x, y), max_coeff);
+      mb->nnz[y * 4 + x] = n;
+    }
+  }
+
+  if (s->sps->chroma_array_type != 1 || s->error)
+    return;
+
+  if (mb->cbp & 0x30) {
+    for (c = 0; c < 2; c++) {
+      guint flag = c ? MB_FLAG_CR_DC : MB_FLAG_CB_DC;
+
+      if (cabac)
+        n = cabac_residual (s, 3, 4, cabac_dc_cbf_inc (s, flag));
+      else
+        n = cavlc_residual (s, -1, 4);
+      if (n)
+        mb->flags |= flag;
+    }
+  }
+
+  if (mb->cbp & 0x20) {
+    for (c = 0; c < 2; c++) {
+      for (i = 0; i < 4; i++) {
+        gint x = i & 1, y = i >> 1;
+
+        if (cabac)
+          n = cabac_residual (s, 4, 15, cabac_chroma_cbf_inc (s, c, x, y));
+        else
+          n = cavlc_residual (s, cavlc_chroma_nc (s, c, x, y), 15);
+        mb->nnz[16 + 4 * c + i] = n;
+      }
+    }
+  }
+}
+
+static guint
+read_cbp (SliceCtx * s)
+{
+  gboolean intra = MB_IS_INTRA (s->cur);
+  guint code;
+
+  if (s->pps->cabac)
+    return cabac_cbp (s);
+
+  code = br_ue (&s->br);
+  if (s->sps->chroma_array_type == 1 || s->sps->chroma_array_type == 2) {
+    if (code < 48)
+      return intra ? cbp_intra[code] : cbp_inter[code];
+  } else if (code < 16) {
+    return intra ? cbp_intra_mono[code] : cbp_inter_mono[code];
+  }
+
+  s->error = TRUE;
+  return 0;
+}
+
+static gboolean
+read_transform_8x8 (SliceCtx * s)
+{
+  if (s->pps->cabac ? cabac_transform_8x8 (s) : br_read (&s->br, 1)) {
+    s->cur->flags |= MB_FLAG_TRANSFORM_8x8;
+    return TRUE;
+  }
+  return FALSE;
+}
+
+static void
+decode_intra_mb (SliceCtx * s, guint imb)
+{
+  H264MvMb *mb = s->cur;
+  gboolean cabac = s->pps->cabac;
+  guint i;
+
+  if (imb == 25) {
+    guint bits = 256 * s->sps->bit_depth_luma;
+
+    if (s->sps->chroma_array_type == 1)
+      bits += 128 * s->sps->bit_depth_chroma;
+
+    mb->type = MB_I_PCM;
+    mb->cbp = 0x2f;
+    mb->flags = MB_FLAG_LUMA_DC | MB_FLAG_CB_DC | MB_FLAG_CR_DC;
+    memset (mb->nnz, 16, sizeof (mb->nnz));
+    s->prev_qp_delta = FALSE;
+
+    if (cabac) {
+      const guint8 *p = s->cabac.p + bits / 8;
+
+      if (p > s->cabac.end)
+        s->error = TRUE;
+      else
+        cabac_init_engine (&s->cabac, p, s->cabac.end);
+    } else {
+      s->br.pos = ((s->br.pos + 7) & ~7) + bits;
+    }
+    return;
+  }
+
+  if (imb == 0) {
+    guint n = 16;
+
+    mb->type = MB_I_NxN;
+    if (s->pps->transform_8x8_mode && read_transform_8x8 (s))
+      n = 4;
+
+    for (i = 0; i < n; i++) {
+      if (cabac) {
+        if (!cabac_decode (&s->cabac, &s->ctx[68])) {
+          cabac_decode (&s->cabac, &s->ctx[69]);
+          cabac_decode (&s->cabac, &s->ctx[69]);
+          cabac_decode (&s->cabac, &s->ctx[69]);
+        }
+      } else if (!br_read (&s->br, 1)) {
+        br_skip (&s->br, 3);
+      }
+    }
+  } else {
+    mb->type = MB_I_16x16;
+    mb->cbp = (((imb - 1) / 4) % 3) << 4 | (imb >= 13 ? 0xf : 0);
+  }
+
+  if (s->sps->chroma_array_type == 1 || s->sps->chroma_array_type == 2) {
+    if (cabac ? cabac_chroma_pred_mode (s) : br_ue (&s->br))
+      mb->flags |= MB_FLAG_CHROMA_PRED;
+  }
+
+  if (mb->type == MB_I_NxN)
+    mb->cbp = read_cbp (s);
+
+  decode_residual (s);
+}
+
+typedef struct
+{
+  guint8 x, y, w, h;
+  guint8 shape;
+  gint16 mvd[2];
+} Partition;
+
+static void
+decode_inter_mb (SliceCtx * s, guint mb_type)
+{
+  H264MvMb *mb = s->cur;
+  gboolean cabac = s->pps->cabac;
+  Partition parts[16];
+  guint sub[4] = { 0, 0, 0, 0 };
+  guint n_parts = 0, i, j, k;
+  gboolean small_parts = FALSE;
+
+  mb->type = MB_P_16x16 + mb_type;
+
+  if (mb->type >= MB_P_8x8) {
+    for (i = 0; i < 4; i++) {
+      sub[i] = cabac ? cabac_sub_mb_type (s) : br_ue (&s->br);
+      if (sub[i] > 3) {
+        s->error = TRUE;
+        return;
+      }
+      small_parts |= sub[i] != 0;
+    }
+    for (i = 0; i < 4; i++) {
+      guint8 sx = (i & 1) * 2, sy = (i >> 1) * 2;
+
+      for (j = 0; j < (sub[i] == 0 ? 1 : (sub[i] == 3 ? 4 : 2)); j++) {
+        Partition *p = &parts[n_parts++];
+
+        p->shape = 0;
+        p->x = sx + (sub[i] == 2 || sub[i] == 3 ? (j & 1) : 0);
+        p->y = sy + (sub[i] == 1 ? j : (sub[i] == 3 ? j >> 1 : 0));
+        p->w = sub[i] == 0 || sub[i] == 1 ? 2 : 1;
+        p->h = sub[i] == 0 || sub[i] == 2 ? 2 : 1;
+      }
+    }
+  } else {
+    n_parts = mb->type == MB_P_16x16 ? 1 : 2;
+    for (i = 0; i < n_parts; i++) {
+      Partition *p = &parts[i];
+
+      p->shape = mb->type - MB_P_16x16;
+      p->x = mb->type == MB_P_8x16 ? 2 * i : 0;
+      p->y = mb->type == MB_P_16x8 ? 2 * i : 0;
+      p->w = mb->type == MB_P_8x16 ? 2 : 4;
+      p->h = mb->type == MB_P_16x8 ? 2 : 4;
+    }
+  }
+
+  /* ref_idx_l0, stored per 8x8 block */
+  memset (mb->ref, 0, sizeof (mb->ref));
+  if (s->num_ref > 1 && mb->type != MB_P_8x8_REF0) {
+    guint n = mb->type >= MB_P_8x8 ? 4 : n_parts;
+
+    for (i = 0; i < n; i++) {
+      gint x, y;
+      guint ref;
+
+      if (mb->type >= MB_P_8x8) {
+        x = (i & 1) * 2;
+        y = (i >> 1) * 2;
+      } else {
+        x = parts[i].x;
+        y = parts[i].y;
+      }
+
+      if (cabac)
+        ref = cabac_ref_idx (s, x, y);
+      else if (s->num_ref == 2)
+        ref = !br_read (&s->br, 1);
+      else
+        ref = br_ue (&s->br);
+      if (ref >= s->num_ref) {
+        s->error = TRUE;
+        return;
+      }
+
+      if (mb->type >= MB_P_8x8) {
+        mb->ref[i] = ref;
+      } else {
+        for (k = 0; k < 4; k++) {
+          if ((k & 1) * 2 >= parts[i].x && (k & 1) * 2 < parts[i].x + parts[i].w
+              && (k >> 1) * 2 >= parts[i].y
+              && (k >> 1) * 2 < parts[i].y + parts[i].h)
+            mb->ref[k] = ref;
+        }
+      }
+    }
+  }
+
+  /* mvd_l0, kept as absolute values for the context of the next ones */
+  for (i = 0; i < n_parts && !s->error; i++) {
+    Partition *p = &parts[i];
+
+    for (k = 0; k < 2; k++) {
+      guint x, y, v;
+
+      p->mvd[k] = cabac ? cabac_mvd (s, p->x, p->y, k) : br_se (&s->br);
+      if (!cabac)
+        continue;
+
+      v = MIN (ABS (p->mvd[k]), 64);
+      for (y = p->y; y < p->y + p->h; y++)
+        for (x = p->x; x < p->x + p->w; x++)
+          mb->mvd[y * 4 + x][k] = v;
+    }
+  }
+  if (s->error)
+    return;
+
+  for (i = 0; i < n_parts; i++) {
+    Partition *p = &parts[i];
+    gint16 mv[2];
+
+    predict_mv (s, p->x, p->y, p->w, p->shape,
+        mb->ref[(p->y >> 1) * 2 + (p->x >> 1)], mv);
+    mv[0] += p->mvd[0];
+    mv[1] += p->mvd[1];
+    fill_partition (s, p->x, p->y, p->w, p->h, mv);
+  }
+
+  mb->cbp = read_cbp (s);
+  if ((mb->cbp & 0xf) && s->pps->transform_8x8_mode && !small_parts)
+    read_transform_8x8 (s);
+
+  decode_residual (s);
+}
+
+static void
+decode_mb (SliceCtx * s)
+{
+  guint mb_type = s->pps->cabac ? cabac_mb_type (s) : br_ue (&s->br);
+
+  if (mb_type > 30)
+    s->error = TRUE;
+  else if (mb_type >= 5)
+    decode_intra_mb (s, mb_type - 5);
+  else
+    decode_inter_mb (s, mb_type);
+}
+
+/* stores the mean of the 4x4 vectors of the current macroblock, rounded to
+ * nearest */
+static void
+finish_mb (SliceCtx * s, guint addr)
+{
+  MVInfo *info = &s->parser->mvs[addr];
+  gint sum[2] = { 0, 0 }, i, k;
+
+  if (!MB_IS_INTRA (s->cur)) {
+    for (i = 0; i < 16; i++) {
+      sum[0] += s->cur->mv[i][0];
+      sum[1] += s->cur->mv[i][1];
+    }
+  }
+
+  for (k = 0; k < 2; k++)
+    sum[k] = sum[k] >= 0 ? (sum[k] + 8) >> 4 : -((-sum[k] + 8) >> 4);
+
+  info->mv_x = sum[0];
+  info->mv_y = sum[1];
+  info->weight = 0;
+}
+
+static void
+decode_slice_data (SliceCtx * s)
+{
+  GstH264MvParser *parser = s->parser;
+  guint n_mbs = parser->width_mbs * parser->height_mbs;
+  guint addr = s->first_mb;
+
+  if (s->pps->cabac) {
+    guint start = (s->br.pos + 7) >> 3;
+
+    cabac_init_engine (&s->cabac, s->br.data + start,
+        s->br.data + MAX (start, (s->br.end >> 3) + 1));
+    cabac_init_contexts (s->ctx, s->cabac_init_idc, s->qp);
+
+    while (addr < n_mbs) {
+      start_mb (s, addr);
+      if (cabac_mb_skip (s))
+        decode_skip (s);
+      else
+        decode_mb (s);
+      if (s->error)
+        break;
+      finish_mb (s, addr++);
+
+      if (cabac_decode_terminate (&s->cabac))
+        break;
+    }
+  } else {
+    while (addr < n_mbs) {
+      guint run = br_ue (&s->br);
+
+      if (br_overrun (&s->br))
+        break;
+      for (; run > 0 && addr < n_mbs; run--) {
+        start_mb (s, addr);
+        decode_skip (s);
+        finish_mb (s, addr++);
+      }
+      if (addr >= n_mbs || !br_more_data (&s->br))
+        break;
+
+      start_mb (s, addr);
+      decode_mb (s);
+      if (s->error || br_overrun (&s->br))
+        break;
+      finish_mb (s, addr++);
+
+      if (!br_more_data (&s->br))
+        break;
+    }
+  }
+}
+
+/* slice_header (), 7.3.3; returns FALSE for slices that are not decoded */
+static gboolean
+parse_slice_header (GstH264MvParser * parser, SliceCtx * s, guint nal_type,
+    guint nal_ref_idc)
+{
+  BitReader *br = &s->br;
+  guint pps_id, idc;
+
+  s->first_mb = br_ue (br);
+  s->slice_type = br_ue (br) % 5;
+  if (s->slice_type != 0 && s->slice_type != 3)
+    return FALSE;
+
+  pps_id = br_ue (br);
+  if (pps_id >= MAX_PPS_COUNT || !parser->pps[pps_id].valid)
+    return FALSE;
+  s->pps = &parser->pps[pps_id];
+  s->sps = &parser->sps[s->pps->sps_id];
+  if (!s->sps->valid || !s->sps->frame_mbs_only ||
+      s->sps->chroma_array_type > 1 || s->sps->separate_colour_plane)
+    return FALSE;
+
+  /* frame_num, idr_pic_id, picture order count */
+  br_skip (br, s->sps->log2_max_frame_num);
+  if (nal_type == 5)
+    br_ue (br);
+  if (s->sps->poc_type == 0) {
+    br_skip (br, s->sps->log2_max_poc_lsb);
+    if (s->pps->bottom_field_pic_order)
+      br_se (br);
+  } else if (s->sps->poc_type == 1 && !s->sps->delta_pic_order_always_zero) {
+    br_se (br);
+    if (s->pps->bottom_field_pic_order)
+      br_se (br);
+  }
+  /* redundant slices repeat the primary ones */
+  if (s->pps->redundant_pic_cnt && br_ue (br) != 0)
+    return FALSE;
+
+  s->num_ref = s->pps->num_ref_idx_l0_default;
+  if (br_read (br, 1))
+    s->num_ref = br_ue (br) + 1;
+  if (s->num_ref > 32)
+    return FALSE;
+
+  /* ref_pic_list_modification () */
+  if (br_read (br, 1)) {
+    do {
+      idc = br_ue (br);
+      if (idc < 3)
+        br_ue (br);
+      else if (idc != 3 || br_overrun (br))
+        return FALSE;
+    } while (idc != 3);
+  }
+
+  /* pred_weight_table () */
+  if (s->pps->weighted_pred) {
+    guint i;
+
+    br_ue (br);
+    if (s->sps->chroma_array_type != 0)
+      br_ue (br);
+    for (i = 0; i < s->num_ref; i++) {
+      if (br_read (br, 1)) {
+        br_se (br);
+        br_se (br);
+      }
+      if (s->sps->chroma_array_type != 0 && br_read (br, 1)) {
+        br_se (br);
+        br_se (br);
+        br_se (br);
+        br_se (br);
+      }
+    }
+  }
+
+  /* dec_ref_pic_marking () */
+  if (nal_ref_idc != 0) {
+    if (nal_type == 5) {
+      br_skip (br, 2);
+    } else if (br_read (br, 1)) {
+      while ((idc = br_ue (br)) != 0) {
+        if (idc == 1 || idc == 3)
+          br_ue (br);
+        if (idc == 2 || idc == 3 || idc == 4 || idc == 6)
+          br_ue (br);
+        if (idc > 6 || br_overrun (br))
+          return FALSE;
+      }
+    }
+  }
+
+  if (s->pps->cabac) {
+    s->cabac_init_idc = br_ue (br);
+    if (s->cabac_init_idc > 2)
+      return FALSE;
+  }
+  s->qp = s->pps->pic_init_qp + br_se (br);
+  if (s->slice_type == 3) {
+    br_skip (br, 1);
+    br_se (br);
+  }
+  if (s->pps->deblocking_filter_control && br_ue (br) != 1) {
+    br_se (br);
+    br_se (br);
+  }
+
+  return !br_overrun (br);
+}
+
+static gboolean
+start_picture (GstH264MvParser * parser, const H264MvSps * sps)
+{
+  guint n_mbs = sps->width_mbs * sps->height_mbs;
+
+  if (sps->width_mbs != parser->width_mbs ||
+      sps->height_mbs != parser->height_mbs) {
+    g_free (parser->mbs);
+    g_free (parser->mvs);
+    parser->width_mbs = sps->width_mbs;
+    parser->height_mbs = sps->height_mbs;
+    parser->mbs = g_new0 (H264MvMb, n_mbs);
+    parser->mvs = g_new0 (MVInfo, n_mbs);
+    parser->slice_id = 0;
+  }
+
+  memset (parser->mvs, 0, n_mbs * sizeof (MVInfo));
+  return TRUE;
+}
+
+static gboolean
+decode_slice (GstH264MvParser * parser, const guint8 * nal, guint size,
+    gboolean * started)
+{
+  SliceCtx s;
+  guint nal_type = nal[0] & 0x1f, nal_ref_idc = (nal[0] >> 5) & 3, n;
+  BitReader peek;
+
+  /* most slices of a stream are not P slices, have a look first */
+  n = unescape_nal (parser, nal + 1, size - 1, SLICE_PEEK_SIZE);
+  br_init (&peek, parser->rbsp, n);
+  br_ue (&peek);
+  n = br_ue (&peek) % 5;
+  if (n != 0 && n != 3)
+    return FALSE;
+
+  s.parser = parser;
+  s.error = FALSE;
+  n = unescape_nal (parser, nal + 1, size - 1, size);
+  br_init (&s.br, parser->rbsp, n);
+  if (!parse_slice_header (parser, &s, nal_type, nal_ref_idc))
+    return FALSE;
+
+  if (!*started) {
+    *started = start_picture (parser, s.sps);
+  } else if (s.sps->width_mbs != parser->width_mbs ||
+      s.sps->height_mbs != parser->height_mbs) {
+    return FALSE;
+  }
+  if (s.first_mb >= parser->width_mbs * parser->height_mbs)
+    return FALSE;
+
+  s.slice_id = ++parser->slice_id;
+  if (s.slice_id == 0) {
+    /* wrapped, forget which slice old macroblocks belonged to */
+    memset (parser->mbs, 0,
+        parser->width_mbs * parser->height_mbs * sizeof (H264MvMb));
+    s.slice_id = ++parser->slice_id;
+  }
+  s.prev_qp_delta = FALSE;
+  decode_slice_data (&s);
+  return TRUE;
+}
+
+/* returns the start of the next NAL after pos, or size */
+static gsize
+next_nal (const guint8 * data, gsize size, gsize pos)
+{
+  while (pos + 3 <= size) {
+    const guint8 *p = memchr (data + pos + 2, 1, size - pos - 2);
+
+    if (!p)
+      break;
+    pos = p - data;
+    if (data[pos - 1] == 0 && data[pos - 2] == 0)
+      return pos + 1;
+    pos -= 1;
+  }
+  return size;
+}
+
+GstH264MvParser *
+gst_h264_mv_parser_new (void)
+{
+  GstH264MvParser *parser = g_new0 (GstH264MvParser, 1);
+  guint i;
+
+  for (i = 0; i < 5; i++)
+    vlc_init (&parser->coeff_token[i], coeff_token_len[i],
+        coeff_token_bits[i], 68);
+  for (i = 0; i < 15; i++)
+    vlc_init (&parser->total_zeros[i], total_zeros_len[i],
+        total_zeros_bits[i], 16);
+  for (i = 0; i < 3; i++)
+    vlc_init (&parser->chroma_dc_total_zeros[i], chroma_dc_total_zeros_len[i],
+        chroma_dc_total_zeros_bits[i], 4);
+  for (i = 0; i < 7; i++)
+    vlc_init (&parser->run_before[i], run_before_len[i], run_before_bits[i],
+        16);
+
+  return parser;
+}
+
+void
+gst_h264_mv_parser_free (GstH264MvParser * parser)
+{
+  guint i;
+
+  if (!parser)
+    return;
+
+  for (i = 0; i < 5; i++)
+    g_free (parser->coeff_token[i].table);
+  for (i = 0; i < 15; i++)
+    g_free (parser->total_zeros[i].table);
+  for (i = 0; i < 3; i++)
+    g_free (parser->chroma_dc_total_zeros[i].table);
+  for (i = 0; i < 7; i++)
+    g_free (parser->run_before[i].table);
+
+  g_free (parser->rbsp);
+  g_free (parser->mbs);
+  g_free (parser->mvs);
+  g_free (parser);
+}
+
+const MVInfo *
+gst_h264_mv_parser_parse (GstH264MvParser * parser, const guint8 * data,
+    gsize size, guint * n_vectors)
+{
+  gboolean started = FALSE;
+  gsize pos = next_nal (data, size, 0);
+
+  while (pos < size) {
+    gsize end = next_nal (data, size, pos), nal_size;
+    const guint8 *nal = data + pos;
+    BitReader br;
+    guint n;
+
+    /* strip the start code of the next NAL and trailing zero bytes */
+    nal_size = end - pos - (end < size ? 3 : 0);
+    while (nal_size > 0 && nal[nal_size - 1] == 0)
+      nal_size--;
+    pos = end;
+    if (nal_size < 2)
+      continue;
+
+    switch (nal[0] & 0x1f) {
+      case 1:
+      case 5:
+        decode_slice (parser, nal, nal_size, &started);
+        break;
+      case 7:
+        n = unescape_nal (parser, nal + 1, nal_size - 1, nal_size);
+        br_init (&br, parser->rbsp, n);
+        parse_sps (parser, &br);
+        break;
+      case 8:
+        n = unescape_nal (parser, nal + 1, nal_size - 1, nal_size);
+        br_init (&br, parser->rbsp, n);
+        parse_pps (parser, &br);
+        break;
+      default:
+        break;
+    }
+  }
+
+  *n_vectors = started ? parser->width_mbs * parser->height_mbs : 0;
+  return started ? parser->mvs : NULL;
+}
@@ -0,0 +1,61 @@
+/*
+ * gsth264mvparse.h: macroblock motion vectors of H.264 P slices, read from
+ * the compressed bitstream
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_H264_MV_PARSE_H__
+#define __GST_H264_MV_PARSE_H__
+
+#include <gst/gst.h>
+
+#include "gst_buffer_info_meta.h"
+
+G_BEGIN_DECLS
+
+typedef struct _GstH264MvParser GstH264MvParser;
+
+GstH264MvParser *gst_h264_mv_parser_new (void);
+
+void gst_h264_mv_parser_free (GstH264MvParser * parser);
+
+/**
+ * gst_h264_mv_parser_parse:
+ * @parser: a #GstH264MvParser
+ * @data: one byte-stream access unit
+ * @size: size of @data
+ * @n_vectors: (out): number of vectors returned
+ *
+ * Parses the parameter sets and P slices of an access unit. Only the syntax
+ * needed to reconstruct the motion vectors is decoded: no residual is
+ * dequantised and nothing is reconstructed.
+ *
+ * Supports progressive streams without slice groups in 4:2:0 or 4:0:0, coded
+ * with CAVLC or CABAC. Slices of other types, and streams using features
+ * outside of that set, are skipped.
+ *
+ * Returns: one vector per macroblock in raster order, in quarter pixel units,
+ * being the mean of the sixteen 4x4 vectors of the macroblock and zero for
+ * intra macroblocks; or %NULL when the access unit holds no P slice. The
+ * array is owned by @parser and valid until the next call.
+ */
+const MVInfo *gst_h264_mv_parser_parse (GstH264MvParser * parser,
+    const guint8 * data, gsize size, guint * n_vectors);
+
+G_END_DECLS
+
+#endif /* __GST_H264_MV_PARSE_H__ */
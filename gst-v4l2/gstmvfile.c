@@ -0,0 +1,549 @@
+/*
+ * gstmvfile.c: chunked motion vector sidecar files
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "gstmvfile.h"
+#include "gstmvutils.h"
+
+/* bound on the vector count accepted from a file, 8x8 blocks of 8K video */
+#define MV_FILE_MAX_VECTORS     (1 << 20)
+
+#define MV_FILE_ALIGN(n)        (((n) + 7) & ~(gsize) 7)
+
+struct _GstMvFileWriter
+{
+  FILE *file;
+  gchar *location;
+  guint64 offset;
+  guint chunk_frames;
+  guint motion_threshold;
+
+  /* chunk being collected, its frame table and packed fields */
+  GstMvFileChunk chunk;
+  GArray *frames;
+  GByteArray *fields;
+
+  GArray *index;
+};
+
+struct _GstMvFileReader
+{
+  GMappedFile *mapped;
+  const guint8 *data;
+  gsize size;
+  GArray *chunks;
+};
+
+static gboolean
+writer_write (GstMvFileWriter * writer, gconstpointer data, gsize size,
+    GError ** error)
+{
+  if (size > 0 && fwrite (data, size, 1, writer->file) != 1) {
+    g_set_error (error, GST_RESOURCE_ERROR, GST_RESOURCE_ERROR_WRITE,
+        "Could not write to %s: %s", writer->location, g_strerror (errno));
+    return FALSE;
+  }
+
+  writer->offset += size;
+
+  return TRUE;
+}
+
+/**
+ * gst_mv_file_writer_new:
+ * @location: path of the file to create
+ * @chunk_frames: number of frames per chunk
+ * @motion_threshold: |mv_x| + |mv_y| from which a block counts as moving in
+ *   the chunk summaries
+ * @error: return location for a #GError
+ *
+ * Returns: a new #GstMvFileWriter, or %NULL with @error set.
+ */
+GstMvFileWriter *
+gst_mv_file_writer_new (const gchar * location, guint chunk_frames,
+    guint motion_threshold, GError ** error)
+{
+  GstMvFileWriter *writer;
+  GstMvFileHeader header;
+
+  g_return_val_if_fail (location != NULL, NULL);
+  g_return_val_if_fail (chunk_frames > 0, NULL);
+
+  writer = g_new0 (GstMvFileWriter, 1);
+  writer->location = g_strdup (location);
+  writer->chunk_frames = chunk_frames;
+  writer->motion_threshold = motion_threshold;
+  writer->frames = g_array_new (FALSE, FALSE, sizeof (GstMvFileFrame));
+  writer->fields = g_byte_array_new ();
+  writer->index = g_array_new (FALSE, FALSE, sizeof (GstMvFileIndexEntry));
+
+  writer->file = fopen (location, "wb");
+  if (writer->file == NULL) {
+    g_set_error (error, GST_RESOURCE_ERROR, GST_RESOURCE_ERROR_OPEN_WRITE,
+        "Could not open %s: %s", location, g_strerror (errno));
+    gst_mv_file_writer_close (writer, NULL);
+    return NULL;
+  }
+
+  memset (&header, 0, sizeof (header));
+  memcpy (header.magic, GST_MV_FILE_MAGIC, sizeof (header.magic));
+  header.version = GST_MV_FILE_VERSION;
+  header.header_size = sizeof (header);
+
+  if (!writer_write (writer, &header, sizeof (header), error)) {
+    gst_mv_file_writer_close (writer, NULL);
+    return NULL;
+  }
+
+  return writer;
+}
+
+/* writes the chunk being collected, files being read while they are recorded
+ * see whole chunks only */
+static gboolean
+writer_flush_chunk (GstMvFileWriter * writer, GError ** error)
+{
+  static const guint8 padding[8] = { 0, };
+  GstMvFileChunk *chunk = &writer->chunk;
+  GstMvFileFrame *frames = (GstMvFileFrame *) writer->frames->data;
+  GstMvFileIndexEntry entry;
+  gsize table_end, size;
+  guint i;
+
+  if (writer->frames->len == 0)
+    return TRUE;
+
+  table_end = sizeof (GstMvFileChunk) +
+      writer->frames->len * sizeof (GstMvFileFrame);
+  size = MV_FILE_ALIGN (table_end + writer->fields->len);
+  if (size > G_MAXUINT32) {
+    g_set_error (error, GST_RESOURCE_ERROR, GST_RESOURCE_ERROR_WRITE,
+        "Chunk of %" G_GSIZE_FORMAT " bytes is too large", size);
+    return FALSE;
+  }
+
+  chunk->magic = GST_MV_FILE_CHUNK_MAGIC;
+  chunk->size = size;
+  chunk->n_frames = writer->frames->len;
+  chunk->last_pts = frames[writer->frames->len - 1].pts;
+  for (i = 0; i < writer->frames->len; i++)
+    frames[i].offset += table_end;
+
+  entry.offset = writer->offset;
+  entry.first_pts = chunk->first_pts;
+  entry.last_pts = chunk->last_pts;
+  entry.size = chunk->size;
+  entry.n_frames = chunk->n_frames;
+
+  if (!writer_write (writer, chunk, sizeof (GstMvFileChunk), error) ||
+      !writer_write (writer, frames,
+          writer->frames->len * sizeof (GstMvFileFrame), error) ||
+      !writer_write (writer, writer->fields->data, writer->fields->len,
+          error) ||
+      !writer_write (writer, padding, size - table_end - writer->fields->len,
+          error))
+    return FALSE;
+
+  if (fflush (writer->file) != 0) {
+    g_set_error (error, GST_RESOURCE_ERROR, GST_RESOURCE_ERROR_WRITE,
+        "Could not write to %s: %s", writer->location, g_strerror (errno));
+    return FALSE;
+  }
+
+  g_array_append_val (writer->index, entry);
+  g_array_set_size (writer->frames, 0);
+  g_byte_array_set_size (writer->fields, 0);
+
+  return TRUE;
+}
+
+/**
+ * gst_mv_file_writer_add:
+ * @writer: a #GstMvFileWriter
+ * @pts: presentation time of the frame
+ * @width: frame width in pixels
+ * @height: frame height in pixels
+ * @mvs: the vectors of the frame
+ * @n_vectors: number of entries in @mvs
+ * @stats: (allow-none): encoder statistics of the frame
+ * @error: return location for a #GError
+ *
+ * Packs the field of a frame into the current chunk and adds it to the chunk
+ * summary, the chunk is written out once it holds chunk_frames frames or the
+ * vector grid changes.
+ *
+ * Returns: %FALSE with @error set when writing failed.
+ */
+gboolean
+gst_mv_file_writer_add (GstMvFileWriter * writer, GstClockTime pts,
+    guint width, guint height, const MVInfo * mvs, guint n_vectors,
+    const encoder_stats * stats, GError ** error)
+{
+  GstMvFileChunk *chunk = &writer->chunk;
+  GstMvFileFrame frame;
+  GstMvGrid grid;
+  guint len, row, col;
+
+  g_return_val_if_fail (GST_CLOCK_TIME_IS_VALID (pts), FALSE);
+
+  /* frames without vectors, intra frames mostly, fit in any chunk */
+  memset (&grid, 0, sizeof (grid));
+  if (n_vectors > 0)
+    gst_mv_grid_init (&grid, width, height, n_vectors);
+
+  if (writer->frames->len >= writer->chunk_frames || (grid.cols != 0 &&
+          chunk->cols != 0 && (grid.cols != chunk->cols ||
+              grid.rows != chunk->rows))) {
+    if (!writer_flush_chunk (writer, error))
+      return FALSE;
+  }
+
+  if (writer->frames->len == 0) {
+    memset (chunk, 0, sizeof (GstMvFileChunk));
+    chunk->motion_threshold = writer->motion_threshold;
+    chunk->first_pts = pts;
+  }
+
+  if (chunk->cols == 0) {
+    chunk->cols = grid.cols;
+    chunk->rows = grid.rows;
+  }
+
+  for (row = 0; row < grid.rows; row++) {
+    const MVInfo *mv = mvs + row * grid.cols;
+    guint32 *zones = chunk->zone_blocks +
+        row * GST_MV_FILE_ZONES / grid.rows * GST_MV_FILE_ZONES;
+
+    for (col = 0; col < grid.cols; col++, mv++) {
+      if (GST_MV_MAGNITUDE (mv) >= writer->motion_threshold)
+        zones[col * GST_MV_FILE_ZONES / grid.cols]++;
+    }
+  }
+
+  memset (&frame, 0, sizeof (frame));
+  frame.pts = pts;
+  frame.offset = writer->fields->len;
+  frame.n_vectors = n_vectors;
+  if (stats) {
+    frame.flags = GST_MV_FILE_FRAME_STATS;
+    if (stats->KeyFrame)
+      frame.flags |= GST_MV_FILE_FRAME_KEYFRAME;
+    frame.avg_qp = stats->AvgQP;
+    frame.min_qp = stats->FrameMinQP;
+    frame.max_qp = stats->FrameMaxQP;
+    frame.frame_bits = stats->EncodedFrameBits;
+  }
+
+  len = writer->fields->len;
+  g_byte_array_set_size (writer->fields, len + GST_MV_PACK_MAX_SIZE (n_vectors));
+  frame.size = gst_mv_pack (mvs, n_vectors, writer->fields->data + len);
+  g_byte_array_set_size (writer->fields, len + frame.size);
+
+  g_array_append_val (writer->frames, frame);
+
+  return TRUE;
+}
+
+/**
+ * gst_mv_file_writer_close:
+ * @writer: (transfer full): a #GstMvFileWriter
+ * @error: return location for a #GError
+ *
+ * Writes the last chunk and the index, and frees @writer.
+ *
+ * Returns: %FALSE with @error set when writing failed.
+ */
+gboolean
+gst_mv_file_writer_close (GstMvFileWriter * writer, GError ** error)
+{
+  gboolean ret = TRUE;
+
+  if (writer->file) {
+    guint64 index_offset = 0;
+    guint32 index_header[2];
+
+    ret = writer_flush_chunk (writer, error);
+
+    if (ret) {
+      index_offset = writer->offset;
+      index_header[0] = GST_MV_FILE_INDEX_MAGIC;
+      index_header[1] = writer->index->len;
+      ret = writer_write (writer, index_header, sizeof (index_header), error) &&
+          writer_write (writer, writer->index->data,
+          writer->index->len * sizeof (GstMvFileIndexEntry), error);
+    }
+
+    /* the index is only announced once it is complete */
+    if (ret && (fseek (writer->file, G_STRUCT_OFFSET (GstMvFileHeader,
+                    index_offset), SEEK_SET) != 0 ||
+            fwrite (&index_offset, sizeof (index_offset), 1,
+                writer->file) != 1)) {
+      g_set_error (error, GST_RESOURCE_ERROR, GST_RESOURCE_ERROR_WRITE,
+          "Could not write to %s: %s", writer->location, g_strerror (errno));
+      ret = FALSE;
+    }
+
+    if (fclose (writer->file) != 0 && ret) {
+      g_set_error (error, GST_RESOURCE_ERROR, GST_RESOURCE_ERROR_CLOSE,
+          "Could not close %s: %s", writer->location, g_strerror (errno));
+      ret = FALSE;
+    }
+  }
+
+  g_array_free (writer->frames, TRUE);
+  g_byte_array_free (writer->fields, TRUE);
+  g_array_free (writer->index, TRUE);
+  g_free (writer->location);
+  g_free (writer);
+
+  return ret;
+}
+
+static gboolean
+reader_check_chunk (GstMvFileReader * reader, guint64 offset,
+    GstMvFileIndexEntry * entry)
+{
+  const GstMvFileChunk *chunk;
+
+  if (offset % 8 != 0 || offset > reader->size ||
+      reader->size - offset < sizeof (GstMvFileChunk))
+    return FALSE;
+
+  chunk = (const GstMvFileChunk *) (reader->data + offset);
+  if (chunk->magic != GST_MV_FILE_CHUNK_MAGIC ||
+      chunk->size > reader->size - offset ||
+      chunk->size < sizeof (GstMvFileChunk) +
+      (guint64) chunk->n_frames * sizeof (GstMvFileFrame))
+    return FALSE;
+
+  entry->offset = offset;
+  entry->first_pts = chunk->first_pts;
+  entry->last_pts = chunk->last_pts;
+  entry->size = chunk->size;
+  entry->n_frames = chunk->n_frames;
+
+  return TRUE;
+}
+
+static gboolean
+reader_load_index (GstMvFileReader * reader, guint64 index_offset)
+{
+  const guint32 *index_header;
+  const GstMvFileIndexEntry *entries;
+  GstMvFileIndexEntry entry;
+  guint i;
+
+  if (index_offset % 8 != 0 || index_offset > reader->size ||
+      reader->size - index_offset < 2 * sizeof (guint32))
+    return FALSE;
+
+  index_header = (const guint32 *) (reader->data + index_offset);
+  if (index_header[0] != GST_MV_FILE_INDEX_MAGIC ||
+      (reader->size - index_offset - 2 * sizeof (guint32)) /
+      sizeof (GstMvFileIndexEntry) < index_header[1])
+    return FALSE;
+
+  entries = (const GstMvFileIndexEntry *) (index_header + 2);
+  for (i = 0; i < index_header[1]; i++) {
+    if (!reader_check_chunk (reader, entries[i].offset, &entry) ||
+        entry.size != entries[i].size)
+      break;
+    g_array_append_val (reader->chunks, entry);
+  }
+
+  if (i < index_header[1]) {
+    g_array_set_size (reader->chunks, 0);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/**
+ * gst_mv_file_reader_new:
+ * @location: path of the file
+ * @error: return location for a #GError
+ *
+ * Maps a file written by #GstMvFileWriter. Its chunks are taken from the
+ * index or, for files that were not closed, found by walking the file.
+ *
+ * Returns: a new #GstMvFileReader, or %NULL with @error set.
+ */
+GstMvFileReader *
+gst_mv_file_reader_new (const gchar * location, GError ** error)
+{
+  GstMvFileReader *reader;
+  const GstMvFileHeader *header;
+  GstMvFileIndexEntry entry;
+  guint64 offset;
+
+  reader = g_new0 (GstMvFileReader, 1);
+  reader->chunks = g_array_new (FALSE, FALSE, sizeof (GstMvFileIndexEntry));
+
+  reader->mapped = g_mapped_file_new (location, FALSE, error);
+  if (reader->mapped == NULL) {
+    gst_mv_file_reader_free (reader);
+    return NULL;
+  }
+
+  reader->data = (const guint8 *) g_mapped_file_get_contents (reader->mapped);
+  reader->size = g_mapped_file_get_length (reader->mapped);
+
+  header = (const GstMvFileHeader *) reader->data;
+  if (reader->size < sizeof (GstMvFileHeader) ||
+      memcmp (header->magic, GST_MV_FILE_MAGIC, sizeof (header->magic)) != 0 ||
+      header->version != GST_MV_FILE_VERSION ||
+      header->header_size < sizeof (GstMvFileHeader)) {
+    g_set_error (error, GST_STREAM_ERROR, GST_STREAM_ERROR_WRONG_TYPE,
+        "%s is not a motion vector file", location);
+    gst_mv_file_reader_free (reader);
+    return NULL;
+  }
+
+  if (header->index_offset != 0 &&
+      reader_load_index (reader, header->index_offset))
+    return reader;
+
+  GST_DEBUG ("%s has no usable index, walking the chunks", location);
+
+  for (offset = header->header_size;
+      reader_check_chunk (reader, offset, &entry); offset += entry.size)
+    g_array_append_val (reader->chunks, entry);
+
+  return reader;
+}
+
+void
+gst_mv_file_reader_free (GstMvFileReader * reader)
+{
+  if (reader->mapped)
+    g_mapped_file_unref (reader->mapped);
+  g_array_free (reader->chunks, TRUE);
+  g_free (reader);
+}
+
+guint
+gst_mv_file_reader_get_n_chunks (GstMvFileReader * reader)
+{
+  return reader->chunks->len;
+}
+
+const GstMvFileChunk *
+gst_mv_file_reader_get_chunk (GstMvFileReader * reader, guint idx)
+{
+  g_return_val_if_fail (idx < reader->chunks->len, NULL);
+
+  return (const GstMvFileChunk *) (reader->data +
+      g_array_index (reader->chunks, GstMvFileIndexEntry, idx).offset);
+}
+
+/**
+ * gst_mv_file_reader_find_chunk:
+ * @reader: a #GstMvFileReader
+ * @pts: a presentation time
+ *
+ * Returns: the first chunk whose last frame is at or after @pts, or the number
+ * of chunks when there is none.
+ */
+guint
+gst_mv_file_reader_find_chunk (GstMvFileReader * reader, GstClockTime pts)
+{
+  guint lo = 0, hi = reader->chunks->len;
+
+  while (lo < hi) {
+    guint mid = lo + (hi - lo) / 2;
+
+    if (g_array_index (reader->chunks, GstMvFileIndexEntry, mid).last_pts < pts)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo;
+}
+
+const GstMvFileFrame *
+gst_mv_file_chunk_get_frames (const GstMvFileChunk * chunk)
+{
+  return (const GstMvFileFrame *) (chunk + 1);
+}
+
+/**
+ * gst_mv_file_chunk_get_activity:
+ * @chunk: a #GstMvFileChunk
+ * @zone: the part of the frame to look at
+ *
+ * Returns: the number of moving blocks seen in @zone over the chunk, from the
+ * chunk summary alone.
+ */
+guint64
+gst_mv_file_chunk_get_activity (const GstMvFileChunk * chunk,
+    const GstMvFileZone * zone)
+{
+  guint x, y, x1, y1;
+  guint64 activity = 0;
+
+  x1 = MIN (zone->x + zone->width, GST_MV_FILE_ZONES);
+  y1 = MIN (zone->y + zone->height, GST_MV_FILE_ZONES);
+
+  for (y = zone->y; y < y1; y++) {
+    for (x = zone->x; x < x1; x++)
+      activity += chunk->zone_blocks[y * GST_MV_FILE_ZONES + x];
+  }
+
+  return activity;
+}
+
+/**
+ * gst_mv_file_chunk_read_field:
+ * @chunk: a #GstMvFileChunk of a #GstMvFileReader
+ * @idx: index of the frame in @chunk
+ * @vectors: a #GArray of #MVInfo receiving the vectors
+ *
+ * Returns: %FALSE when the field is corrupt.
+ */
+gboolean
+gst_mv_file_chunk_read_field (const GstMvFileChunk * chunk, guint idx,
+    GArray * vectors)
+{
+  const GstMvFileFrame *frame;
+  guint64 table_end;
+
+  g_return_val_if_fail (idx < chunk->n_frames, FALSE);
+
+  frame = gst_mv_file_chunk_get_frames (chunk) + idx;
+  table_end = sizeof (GstMvFileChunk) +
+      (guint64) chunk->n_frames * sizeof (GstMvFileFrame);
+  if (frame->offset < table_end || frame->offset > chunk->size ||
+      frame->size > chunk->size - frame->offset ||
+      frame->n_vectors > MV_FILE_MAX_VECTORS)
+    return FALSE;
+
+  g_array_set_size (vectors, frame->n_vectors);
+
+  return gst_mv_unpack ((const guint8 *) chunk + frame->offset, frame->size,
+      (MVInfo *) vectors->data, frame->n_vectors);
+}
@@ -0,0 +1,158 @@
+/*
+ * gstmvfile.h: chunked motion vector sidecar files
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MV_FILE_H__
+#define __GST_MV_FILE_H__
+
+#include <gst/gst.h>
+
+#include "gst_buffer_info_meta.h"
+
+G_BEGIN_DECLS
+
+#define GST_MV_FILE_MAGIC           "GSTMVF\r\n"
+#define GST_MV_FILE_VERSION         1
+#define GST_MV_FILE_CHUNK_MAGIC     GST_MAKE_FOURCC ('M', 'V', 'C', 'K')
+#define GST_MV_FILE_INDEX_MAGIC     GST_MAKE_FOURCC ('M', 'V', 'I', 'X')
+
+/* the activity summary of a chunk splits the frame in ZONES x ZONES zones */
+#define GST_MV_FILE_ZONES           16
+
+#define GST_MV_FILE_FRAME_KEYFRAME  (1 << 0)
+#define GST_MV_FILE_FRAME_STATS     (1 << 1)
+
+typedef struct _GstMvFileHeader GstMvFileHeader;
+typedef struct _GstMvFileChunk GstMvFileChunk;
+typedef struct _GstMvFileFrame GstMvFileFrame;
+typedef struct _GstMvFileIndexEntry GstMvFileIndexEntry;
+typedef struct _GstMvFileWriter GstMvFileWriter;
+typedef struct _GstMvFileReader GstMvFileReader;
+
+/*
+ * On disk a file is a GstMvFileHeader followed by chunks and, once the writer
+ * was closed, an index. All structures are stored in the native little endian
+ * layout, 8 byte aligned, so that a reader can use them straight from a
+ * mapping of the file.
+ *
+ * A chunk is a GstMvFileChunk, n_frames GstMvFileFrame entries and the packed
+ * vector fields they point to. The index is a GstMvFileIndexEntry per chunk,
+ * preceded by its magic and chunk count. A file whose index_offset is 0 was
+ * not closed and is read by walking the chunks.
+ */
+
+struct _GstMvFileHeader
+{
+  gchar magic[8];
+  guint32 version;
+  guint32 header_size;
+  guint64 index_offset;
+  guint64 reserved[5];
+};
+
+struct _GstMvFileChunk
+{
+  guint32 magic;
+  /* size of the chunk, header, frame table and fields included */
+  guint32 size;
+  guint32 n_frames;
+  /* vector grid of the frames of the chunk */
+  guint32 cols;
+  guint32 rows;
+  /* |mv_x| + |mv_y| from which a block counted as moving in the summary */
+  guint32 motion_threshold;
+  guint64 first_pts;
+  guint64 last_pts;
+  /* moving blocks per zone, summed over the frames of the chunk */
+  guint32 zone_blocks[GST_MV_FILE_ZONES * GST_MV_FILE_ZONES];
+};
+
+struct _GstMvFileFrame
+{
+  guint64 pts;
+  /* position of the packed field from the start of the chunk */
+  guint32 offset;
+  guint32 size;
+  guint32 n_vectors;
+  guint32 flags;
+  guint32 avg_qp;
+  guint32 min_qp;
+  guint32 max_qp;
+  guint32 frame_bits;
+};
+
+struct _GstMvFileIndexEntry
+{
+  guint64 offset;
+  guint64 first_pts;
+  guint64 last_pts;
+  guint32 size;
+  guint32 n_frames;
+};
+
+/**
+ * GstMvFileZone:
+ * @x: first zone column
+ * @y: first zone row
+ * @width: number of zone columns
+ * @height: number of zone rows
+ *
+ * Rectangle of the GST_MV_FILE_ZONES x GST_MV_FILE_ZONES summary grid.
+ */
+typedef struct
+{
+  guint x;
+  guint y;
+  guint width;
+  guint height;
+} GstMvFileZone;
+
+GstMvFileWriter *gst_mv_file_writer_new (const gchar * location,
+    guint chunk_frames, guint motion_threshold, GError ** error);
+
+gboolean gst_mv_file_writer_add (GstMvFileWriter * writer, GstClockTime pts,
+    guint width, guint height, const MVInfo * mvs, guint n_vectors,
+    const encoder_stats * stats, GError ** error);
+
+gboolean gst_mv_file_writer_close (GstMvFileWriter * writer, GError ** error);
+
+GstMvFileReader *gst_mv_file_reader_new (const gchar * location,
+    GError ** error);
+
+void gst_mv_file_reader_free (GstMvFileReader * reader);
+
+guint gst_mv_file_reader_get_n_chunks (GstMvFileReader * reader);
+
+const GstMvFileChunk *gst_mv_file_reader_get_chunk (GstMvFileReader * reader,
+    guint idx);
+
+guint gst_mv_file_reader_find_chunk (GstMvFileReader * reader,
+    GstClockTime pts);
+
+const GstMvFileFrame *gst_mv_file_chunk_get_frames (const GstMvFileChunk *
+    chunk);
+
+guint64 gst_mv_file_chunk_get_activity (const GstMvFileChunk * chunk,
+    const GstMvFileZone * zone);
+
+gboolean gst_mv_file_chunk_read_field (const GstMvFileChunk * chunk,
+    guint idx, GArray * vectors);
+
+G_END_DECLS
+
+#endif /* __GST_MV_FILE_H__ */
@@ -0,0 +1,281 @@
+/*
+ * gstmvfilesink.c: writes motion vector sidecar files
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * SECTION:element-nvmvfilesink
+ *
+ * Stores the #GstBufferInfoMeta of every buffer it receives in a motion vector
+ * sidecar file, see gstmvfile.h for the layout. Frames are grouped in chunks
+ * of chunk-frames frames. Every chunk carries the number of moving blocks seen
+ * in each zone of a 16x16 grid over the frame. A search for motion in part
+ * of the frame only reads those summaries and the chunks that match.
+ *
+ * Chunks are written as soon as they are complete. The index of the file is
+ * written when the element stops. A file that was cut short is still
+ * readable up to its last complete chunk.
+ *
+ * |[
+ * gst-launch-1.0 v4l2src ! nvvidconv ! nvv4l2h264enc EnableMVBufferMeta=1 !
+ *     tee name=t ! queue ! h264parse ! matroskamux ! filesink location=cam.mkv
+ *     t. ! queue ! nvmvfilesink location=cam.mvf
+ * ]|
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstmvfilesink.h"
+#include "gstmvutils.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_mv_file_sink_debug);
+#define GST_CAT_DEFAULT gst_mv_file_sink_debug
+
+#define DEFAULT_CHUNK_FRAMES        300
+#define DEFAULT_MOTION_THRESHOLD    8
+
+enum
+{
+  PROP_0,
+  PROP_LOCATION,
+  PROP_CHUNK_FRAMES,
+  PROP_MOTION_THRESHOLD
+};
+
+static GstStaticPadTemplate gst_mv_file_sink_sink_template =
+GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS_ANY);
+
+#define gst_mv_file_sink_parent_class parent_class
+G_DEFINE_TYPE (GstMvFileSink, gst_mv_file_sink, GST_TYPE_BASE_SINK);
+
+static gboolean
+gst_mv_file_sink_start (GstBaseSink * sink)
+{
+  GstMvFileSink *self = GST_MV_FILE_SINK (sink);
+  GError *error = NULL;
+
+  if (self->location == NULL || self->location[0] == '\0') {
+    GST_ELEMENT_ERROR (self, RESOURCE, NOT_FOUND,
+        ("No file name specified for writing."), (NULL));
+    return FALSE;
+  }
+
+  self->writer = gst_mv_file_writer_new (self->location, self->chunk_frames,
+      self->motion_threshold, &error);
+  if (self->writer == NULL) {
+    GST_ELEMENT_ERROR (self, RESOURCE, OPEN_WRITE,
+        ("Could not open file \"%s\" for writing.", self->location),
+        ("%s", error->message));
+    g_error_free (error);
+    return FALSE;
+  }
+
+  self->width = 0;
+  self->height = 0;
+
+  return TRUE;
+}
+
+static gboolean
+gst_mv_file_sink_stop (GstBaseSink * sink)
+{
+  GstMvFileSink *self = GST_MV_FILE_SINK (sink);
+  GError *error = NULL;
+  gboolean ret = TRUE;
+
+  if (self->writer && !gst_mv_file_writer_close (self->writer, &error)) {
+    GST_ELEMENT_ERROR (self, RESOURCE, CLOSE,
+        ("Error closing file \"%s\".", self->location),
+        ("%s", error->message));
+    g_error_free (error);
+    ret = FALSE;
+  }
+  self->writer = NULL;
+
+  return ret;
+}
+
+static gboolean
+gst_mv_file_sink_set_caps (GstBaseSink * sink, GstCaps * caps)
+{
+  GstMvFileSink *self = GST_MV_FILE_SINK (sink);
+  GstStructure *structure = gst_caps_get_structure (caps, 0);
+
+  /* the frame size places the vectors in the zones of the summary, without it
+   * the field is taken as a single column */
+  if (!gst_structure_get_int (structure, "width", &self->width) ||
+      !gst_structure_get_int (structure, "height", &self->height)) {
+    GST_WARNING_OBJECT (self, "no frame size in caps %" GST_PTR_FORMAT, caps);
+    self->width = 0;
+    self->height = 0;
+  }
+
+  return TRUE;
+}
+
+static GstFlowReturn
+gst_mv_file_sink_render (GstBaseSink * sink, GstBuffer * buf)
+{
+  GstMvFileSink *self = GST_MV_FILE_SINK (sink);
+  const metadata_MV *field;
+  const MVInfo *mvs;
+  guint n_vectors;
+  GError *error = NULL;
+
+  field = gst_mv_buffer_get_field (buf);
+  if (field == NULL) {
+    GST_LOG_OBJECT (self, "no motion vectors on %" GST_PTR_FORMAT, buf);
+    return GST_FLOW_OK;
+  }
+
+  if (!GST_BUFFER_PTS_IS_VALID (buf)) {
+    GST_DEBUG_OBJECT (self, "dropping motion vectors without timestamp");
+    return GST_FLOW_OK;
+  }
+
+  mvs = gst_mv_field_get_vectors (field, &n_vectors);
+
+  if (!gst_mv_file_writer_add (self->writer, GST_BUFFER_PTS (buf),
+          self->width, self->height, mvs, n_vectors,
+          gst_mv_buffer_get_stats (buf), &error)) {
+    GST_ELEMENT_ERROR (self, RESOURCE, WRITE,
+        ("Error while writing to file \"%s\".", self->location),
+        ("%s", error->message));
+    g_error_free (error);
+    return GST_FLOW_ERROR;
+  }
+
+  return GST_FLOW_OK;
+}
+
+static void
+gst_mv_file_sink_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstMvFileSink *self = GST_MV_FILE_SINK (object);
+
+  switch (prop_id) {
+    case PROP_LOCATION:
+      g_free (self->location);
+      self->location = g_value_dup_string (value);
+      break;
+    case PROP_CHUNK_FRAMES:
+      self->chunk_frames = g_value_get_uint (value);
+      break;
+    case PROP_MOTION_THRESHOLD:
+      self->motion_threshold = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_mv_file_sink_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstMvFileSink *self = GST_MV_FILE_SINK (object);
+
+  switch (prop_id) {
+    case PROP_LOCATION:
+      g_value_set_string (value, self->location);
+      break;
+    case PROP_CHUNK_FRAMES:
+      g_value_set_uint (value, self->chunk_frames);
+      break;
+    case PROP_MOTION_THRESHOLD:
+      g_value_set_uint (value, self->motion_threshold);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_mv_file_sink_finalize (GObject * object)
+{
+  GstMvFileSink *self = GST_MV_FILE_SINK (object);
+
+  g_free (self->location);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static void
+gst_mv_file_sink_class_init (GstMvFileSinkClass * klass)
+{
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+  GstElementClass *element_class = (GstElementClass *) klass;
+  GstBaseSinkClass *basesink_class = (GstBaseSinkClass *) klass;
+
+  GST_DEBUG_CATEGORY_INIT (gst_mv_file_sink_debug, "nvmvfilesink", 0,
+      "Motion vector file sink");
+
+  gobject_class->set_property = gst_mv_file_sink_set_property;
+  gobject_class->get_property = gst_mv_file_sink_get_property;
+  gobject_class->finalize = gst_mv_file_sink_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_LOCATION,
+      g_param_spec_string ("location", "File Location",
+          "Location of the motion vector file to write", NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_CHUNK_FRAMES,
+      g_param_spec_uint ("chunk-frames", "Chunk frames",
+          "Number of frames per chunk of the file",
+          1, 65536, DEFAULT_CHUNK_FRAMES,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_MOTION_THRESHOLD,
+      g_param_spec_uint ("motion-threshold", "Motion threshold",
+          "Minimum |mv_x| + |mv_y| for a block to count in the chunk summaries",
+          0, G_MAXUINT, DEFAULT_MOTION_THRESHOLD,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  gst_element_class_add_static_pad_template (element_class,
+      &gst_mv_file_sink_sink_template);
+
+  gst_element_class_set_static_metadata (element_class,
+      "Motion vector file sink",
+      "Sink/File",
+      "Writes the motion vectors of a stream to an indexed sidecar file",
+      "lagurus <https://github.com/lagurus>");
+
+  basesink_class->start = GST_DEBUG_FUNCPTR (gst_mv_file_sink_start);
+  basesink_class->stop = GST_DEBUG_FUNCPTR (gst_mv_file_sink_stop);
+  basesink_class->set_caps = GST_DEBUG_FUNCPTR (gst_mv_file_sink_set_caps);
+  basesink_class->render = GST_DEBUG_FUNCPTR (gst_mv_file_sink_render);
+}
+
+static void
+gst_mv_file_sink_init (GstMvFileSink * self)
+{
+  self->chunk_frames = DEFAULT_CHUNK_FRAMES;
+  self->motion_threshold = DEFAULT_MOTION_THRESHOLD;
+
+  gst_base_sink_set_sync (GST_BASE_SINK (self), FALSE);
+}
@@ -0,0 +1,414 @@
+/*
+ * gstmvfilesrc.c: reads motion vector sidecar files
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * SECTION:element-nvmvfilesrc
+ *
+ * Plays back a file written by nvmvfilesink as empty buffers carrying the
+ * #GstBufferInfoMeta of each frame, stamped with the time the frame had when
+ * it was recorded. The file is memory mapped and seeks in time go through
+ * its index.
+ *
+ * With min-activity set only the chunks that saw at least that many moving
+ * blocks inside the zone given by zone-x, zone-y, zone-width and zone-height
+ * are output; the others are skipped on their summary without reading any of
+ * their frames. The first buffer after a gap is flagged DISCONT.
+ *
+ * |[
+ * gst-launch-1.0 nvmvfilesrc location=cam.mvf zone-x=0.5 zone-width=0.5
+ *     min-activity=100 ! fakesink silent=false -v
+ * ]|
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include <string.h>
+
+#include "gstmvfilesrc.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_mv_file_src_debug);
+#define GST_CAT_DEFAULT gst_mv_file_src_debug
+
+#define DEFAULT_MIN_ACTIVITY    0
+
+enum
+{
+  PROP_0,
+  PROP_LOCATION,
+  PROP_ZONE_X,
+  PROP_ZONE_Y,
+  PROP_ZONE_WIDTH,
+  PROP_ZONE_HEIGHT,
+  PROP_MIN_ACTIVITY
+};
+
+static GstStaticPadTemplate gst_mv_file_src_src_template =
+GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("application/x-mv-field"));
+
+#define gst_mv_file_src_parent_class parent_class
+G_DEFINE_TYPE (GstMvFileSrc, gst_mv_file_src, GST_TYPE_BASE_SRC);
+
+/* smallest rectangle of summary zones covering the requested part of the
+ * frame */
+static void
+gst_mv_file_src_update_zone (GstMvFileSrc * self)
+{
+  gdouble x1 = MIN (self->zone_x + self->zone_width, 1.0);
+  gdouble y1 = MIN (self->zone_y + self->zone_height, 1.0);
+
+  self->zone.x = MIN ((guint) floor (self->zone_x * GST_MV_FILE_ZONES),
+      GST_MV_FILE_ZONES - 1);
+  self->zone.y = MIN ((guint) floor (self->zone_y * GST_MV_FILE_ZONES),
+      GST_MV_FILE_ZONES - 1);
+  self->zone.width = MAX ((guint) ceil (x1 * GST_MV_FILE_ZONES),
+      self->zone.x + 1) - self->zone.x;
+  self->zone.height = MAX ((guint) ceil (y1 * GST_MV_FILE_ZONES),
+      self->zone.y + 1) - self->zone.y;
+}
+
+static gboolean
+gst_mv_file_src_start (GstBaseSrc * src)
+{
+  GstMvFileSrc *self = GST_MV_FILE_SRC (src);
+  GError *error = NULL;
+
+  if (self->location == NULL || self->location[0] == '\0') {
+    GST_ELEMENT_ERROR (self, RESOURCE, NOT_FOUND,
+        ("No file name specified for reading."), (NULL));
+    return FALSE;
+  }
+
+  self->reader = gst_mv_file_reader_new (self->location, &error);
+  if (self->reader == NULL) {
+    GST_ELEMENT_ERROR (self, RESOURCE, OPEN_READ,
+        ("Could not open file \"%s\" for reading.", self->location),
+        ("%s", error->message));
+    g_error_free (error);
+    return FALSE;
+  }
+
+  GST_DEBUG_OBJECT (self, "%u chunks in %s",
+      gst_mv_file_reader_get_n_chunks (self->reader), self->location);
+
+  gst_mv_file_src_update_zone (self);
+  self->chunk = 0;
+  self->frame = 0;
+  self->discont = TRUE;
+  self->n_chunks_skipped = 0;
+
+  return TRUE;
+}
+
+static gboolean
+gst_mv_file_src_stop (GstBaseSrc * src)
+{
+  GstMvFileSrc *self = GST_MV_FILE_SRC (src);
+
+  if (self->reader) {
+    GST_DEBUG_OBJECT (self, "skipped %" G_GUINT64_FORMAT " chunks",
+        self->n_chunks_skipped);
+    gst_mv_file_reader_free (self->reader);
+    self->reader = NULL;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+gst_mv_file_src_is_seekable (GstBaseSrc * src)
+{
+  return TRUE;
+}
+
+static gboolean
+gst_mv_file_src_do_seek (GstBaseSrc * src, GstSegment * segment)
+{
+  GstMvFileSrc *self = GST_MV_FILE_SRC (src);
+  const GstMvFileChunk *chunk;
+  const GstMvFileFrame *frames;
+
+  segment->time = segment->start;
+  if (self->reader == NULL)
+    return TRUE;
+
+  self->chunk = gst_mv_file_reader_find_chunk (self->reader, segment->start);
+  self->frame = 0;
+  self->discont = TRUE;
+
+  if (self->chunk < gst_mv_file_reader_get_n_chunks (self->reader)) {
+    chunk = gst_mv_file_reader_get_chunk (self->reader, self->chunk);
+    frames = gst_mv_file_chunk_get_frames (chunk);
+    while (self->frame < chunk->n_frames &&
+        frames[self->frame].pts < segment->start)
+      self->frame++;
+  }
+
+  GST_DEBUG_OBJECT (self, "seek to %" GST_TIME_FORMAT " lands on frame %u of "
+      "chunk %u", GST_TIME_ARGS (segment->start), self->frame, self->chunk);
+
+  return TRUE;
+}
+
+static GstFlowReturn
+gst_mv_file_src_create (GstBaseSrc * src, guint64 offset, guint size,
+    GstBuffer ** buf)
+{
+  GstMvFileSrc *self = GST_MV_FILE_SRC (src);
+  guint n_chunks = gst_mv_file_reader_get_n_chunks (self->reader);
+  const GstMvFileChunk *chunk = NULL;
+  const GstMvFileFrame *frame;
+  v4l2_ctrl_videoenc_outputbuf_metadata_MV mv_metadata;
+  encoder_stats *stats = &self->info->m_enc_stats;
+  GstBuffer *buffer;
+
+  for (; self->chunk < n_chunks; self->chunk++, self->frame = 0) {
+    chunk = gst_mv_file_reader_get_chunk (self->reader, self->chunk);
+
+    if (self->frame == 0 && self->min_activity > 0 &&
+        gst_mv_file_chunk_get_activity (chunk, &self->zone) <
+        self->min_activity) {
+      self->n_chunks_skipped++;
+      self->discont = TRUE;
+      continue;
+    }
+
+    if (self->frame < chunk->n_frames)
+      break;
+  }
+
+  if (self->chunk >= n_chunks)
+    return GST_FLOW_EOS;
+
+  frame = gst_mv_file_chunk_get_frames (chunk) + self->frame;
+
+  if (GST_CLOCK_TIME_IS_VALID (src->segment.stop) &&
+      frame->pts >= src->segment.stop)
+    return GST_FLOW_EOS;
+
+  if (!gst_mv_file_chunk_read_field (chunk, self->frame, self->vectors)) {
+    GST_ELEMENT_ERROR (self, STREAM, DECODE,
+        ("Corrupt motion vector file \"%s\".", self->location),
+        ("frame %u of chunk %u", self->frame, self->chunk));
+    return GST_FLOW_ERROR;
+  }
+
+  self->info->m_enc_mv_metadata.bufSize = 0;
+#ifdef D_USE_META_STATIC
+  self->info->m_enc_mv_metadata.m_nInfoCount = 0;
+#endif
+  if (self->vectors->len > 0) {
+    mv_metadata.bufSize = self->vectors->len * sizeof (MVInfo);
+    mv_metadata.pMVInfo = (MVInfo *) self->vectors->data;
+    AllocateMyMetaData (self->info, &mv_metadata, self->vectors->len);
+  }
+
+  memset (stats, 0, sizeof (encoder_stats));
+  if (frame->flags & GST_MV_FILE_FRAME_STATS) {
+    stats->bValid = TRUE;
+    stats->KeyFrame = (frame->flags & GST_MV_FILE_FRAME_KEYFRAME) ? TRUE : FALSE;
+    stats->AvgQP = frame->avg_qp;
+    stats->FrameMinQP = frame->min_qp;
+    stats->FrameMaxQP = frame->max_qp;
+    stats->EncodedFrameBits = frame->frame_bits;
+  }
+
+  buffer = gst_buffer_new ();
+  gst_buffer_add_buffer_info_meta (buffer, self->info);
+  GST_BUFFER_PTS (buffer) = frame->pts;
+  /* B-frames leave the recorded PTS out of order, the duration is only
+   * known when the next frame is later */
+  if (self->frame + 1 < chunk->n_frames && frame[1].pts > frame->pts)
+    GST_BUFFER_DURATION (buffer) = frame[1].pts - frame->pts;
+  if (self->discont) {
+    GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DISCONT);
+    self->discont = FALSE;
+  }
+
+  self->frame++;
+  *buf = buffer;
+
+  return GST_FLOW_OK;
+}
+
+static void
+gst_mv_file_src_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstMvFileSrc *self = GST_MV_FILE_SRC (object);
+
+  switch (prop_id) {
+    case PROP_LOCATION:
+      g_free (self->location);
+      self->location = g_value_dup_string (value);
+      break;
+    case PROP_ZONE_X:
+      self->zone_x = g_value_get_double (value);
+      break;
+    case PROP_ZONE_Y:
+      self->zone_y = g_value_get_double (value);
+      break;
+    case PROP_ZONE_WIDTH:
+      self->zone_width = g_value_get_double (value);
+      break;
+    case PROP_ZONE_HEIGHT:
+      self->zone_height = g_value_get_double (value);
+      break;
+    case PROP_MIN_ACTIVITY:
+      self->min_activity = g_value_get_uint64 (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_mv_file_src_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstMvFileSrc *self = GST_MV_FILE_SRC (object);
+
+  switch (prop_id) {
+    case PROP_LOCATION:
+      g_value_set_string (value, self->location);
+      break;
+    case PROP_ZONE_X:
+      g_value_set_double (value, self->zone_x);
+      break;
+    case PROP_ZONE_Y:
+      g_value_set_double (value, self->zone_y);
+      break;
+    case PROP_ZONE_WIDTH:
+      g_value_set_double (value, self->zone_width);
+      break;
+    case PROP_ZONE_HEIGHT:
+      g_value_set_double (value, self->zone_height);
+      break;
+    case PROP_MIN_ACTIVITY:
+      g_value_set_uint64 (value, self->min_activity);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_mv_file_src_finalize (GObject * object)
+{
+  GstMvFileSrc *self = GST_MV_FILE_SRC (object);
+
+  g_free (self->location);
+  g_array_free (self->vectors, TRUE);
+  g_free (self->info);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static void
+gst_mv_file_src_class_init (GstMvFileSrcClass * klass)
+{
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+  GstElementClass *element_class = (GstElementClass *) klass;
+  GstBaseSrcClass *basesrc_class = (GstBaseSrcClass *) klass;
+
+  GST_DEBUG_CATEGORY_INIT (gst_mv_file_src_debug, "nvmvfilesrc", 0,
+      "Motion vector file source");
+
+  gobject_class->set_property = gst_mv_file_src_set_property;
+  gobject_class->get_property = gst_mv_file_src_get_property;
+  gobject_class->finalize = gst_mv_file_src_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_LOCATION,
+      g_param_spec_string ("location", "File Location",
+          "Location of the motion vector file to read", NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_ZONE_X,
+      g_param_spec_double ("zone-x", "Zone left",
+          "Left edge of the zone searched for motion, relative to the width",
+          0.0, 1.0, 0.0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_ZONE_Y,
+      g_param_spec_double ("zone-y", "Zone top",
+          "Top edge of the zone searched for motion, relative to the height",
+          0.0, 1.0, 0.0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_ZONE_WIDTH,
+      g_param_spec_double ("zone-width", "Zone width",
+          "Width of the zone searched for motion, relative to the width",
+          0.0, 1.0, 1.0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_ZONE_HEIGHT,
+      g_param_spec_double ("zone-height", "Zone height",
+          "Height of the zone searched for motion, relative to the height",
+          0.0, 1.0, 1.0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_MIN_ACTIVITY,
+      g_param_spec_uint64 ("min-activity", "Minimum activity",
+          "Moving blocks a chunk needs inside the zone to be output\n"
+          "\t\t\t (0 = output every chunk)",
+          0, G_MAXUINT64, DEFAULT_MIN_ACTIVITY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  gst_element_class_add_static_pad_template (element_class,
+      &gst_mv_file_src_src_template);
+
+  gst_element_class_set_static_metadata (element_class,
+      "Motion vector file source",
+      "Source/File",
+      "Reads the motion vectors stored by nvmvfilesink",
+      "lagurus <https://github.com/lagurus>");
+
+  basesrc_class->start = GST_DEBUG_FUNCPTR (gst_mv_file_src_start);
+  basesrc_class->stop = GST_DEBUG_FUNCPTR (gst_mv_file_src_stop);
+  basesrc_class->is_seekable = GST_DEBUG_FUNCPTR (gst_mv_file_src_is_seekable);
+  basesrc_class->do_seek = GST_DEBUG_FUNCPTR (gst_mv_file_src_do_seek);
+  basesrc_class->create = GST_DEBUG_FUNCPTR (gst_mv_file_src_create);
+}
+
+static void
+gst_mv_file_src_init (GstMvFileSrc * self)
+{
+  self->zone_x = 0.0;
+  self->zone_y = 0.0;
+  self->zone_width = 1.0;
+  self->zone_height = 1.0;
+  self->min_activity = DEFAULT_MIN_ACTIVITY;
+  self->vectors = g_array_new (FALSE, FALSE, sizeof (MVInfo));
+  self->info = g_new0 (GstBufferInfo, 1);
+
+  gst_base_src_set_format (GST_BASE_SRC (self), GST_FORMAT_TIME);
+}
@@ -0,0 +1,78 @@
+/*
+ * gstmvfilesrc.h: reads motion vector sidecar files
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MV_FILE_SRC_H__
+#define __GST_MV_FILE_SRC_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstbasesrc.h>
+
+#include "gstmvfile.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_MV_FILE_SRC \
+  (gst_mv_file_src_get_type())
+#define GST_MV_FILE_SRC(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_MV_FILE_SRC,GstMvFileSrc))
+#define GST_MV_FILE_SRC_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_MV_FILE_SRC,GstMvFileSrcClass))
+#define GST_IS_MV_FILE_SRC(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_MV_FILE_SRC))
+#define GST_IS_MV_FILE_SRC_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_MV_FILE_SRC))
+
+typedef struct _GstMvFileSrc GstMvFileSrc;
+typedef struct _GstMvFileSrcClass GstMvFileSrcClass;
+
+struct _GstMvFileSrc
+{
+  GstBaseSrc parent;
+
+  /* properties */
+  gchar *location;
+  gdouble zone_x;
+  gdouble zone_y;
+  gdouble zone_width;
+  gdouble zone_height;
+  guint64 min_activity;
+
+  /* < private > */
+  GstMvFileReader *reader;
+  GstMvFileZone zone;
+  /* next frame to output */
+  guint chunk;
+  guint frame;
+  gboolean discont;
+  GArray *vectors;
+  GstBufferInfo *info;
+
+  guint64 n_chunks_skipped;
+};
+
+struct _GstMvFileSrcClass
+{
+  GstBaseSrcClass parent_class;
+};
+
+GType gst_mv_file_src_get_type (void);
+
+G_END_DECLS
+
+#endif /* __GST_MV_FILE_SRC_H__ */
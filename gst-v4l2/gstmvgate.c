@@ -0,0 +1,401 @@
+/*
+ * gstmvgate.c: motion gating of downstream inference
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * SECTION:element-nvmvgate
+ *
+ * Decides from the motion vectors of each frame whether a downstream
+ * detector has to run on it and where, and attaches the answer as a
+ * #GstMvInferenceMeta (*gstmvinferencemeta.h*):
+ *
+ * - frames in which no cluster of at least min-blocks blocks moved by
+ *   motion-threshold are marked %GST_MV_INFERENCE_SKIP, the results of the
+ *   previous frame still hold
+ * - otherwise the bounding boxes of the moving clusters, grown by padding
+ *   blocks, at most max-regions of them, are marked
+ *   %GST_MV_INFERENCE_MOTION. When they cover more than full-frame-ratio of
+ *   the frame the whole frame is marked instead
+ * - every refresh-interval frames, and on the first frame after a start,
+ *   flush or discontinuity, the whole frame is marked
+ *   %GST_MV_INFERENCE_REFRESH so that objects which stopped moving or
+ *   entered unnoticed are picked up
+ * - intra frames and frames without vectors are marked
+ *   %GST_MV_INFERENCE_NO_VECTORS on the whole frame
+ *
+ * Buffers are never dropped, inference elements that understand the meta
+ * skip the frames or crop to the regions.
+ *
+ * |[
+ * gst-launch-1.0 rtspsrc ! rtph264depay ! h264parse !
+ *     nvv4l2decoder enable-mv-meta=1 ! nvmvgate refresh-interval=15 !
+ *     appsink
+ * ]|
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstmvgate.h"
+#include "gstmvinferencemeta.h"
+#include "gstmvutils.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_mv_gate_debug);
+#define GST_CAT_DEFAULT gst_mv_gate_debug
+
+#define MAX_REGIONS                 64
+
+#define DEFAULT_MOTION_THRESHOLD    8
+#define DEFAULT_MIN_BLOCKS          2
+#define DEFAULT_MAX_REGIONS         8
+#define DEFAULT_PADDING             1
+#define DEFAULT_FULL_FRAME_RATIO    0.5
+#define DEFAULT_REFRESH_INTERVAL    30
+
+enum
+{
+  PROP_0,
+  PROP_MOTION_THRESHOLD,
+  PROP_MIN_BLOCKS,
+  PROP_MAX_REGIONS,
+  PROP_PADDING,
+  PROP_FULL_FRAME_RATIO,
+  PROP_REFRESH_INTERVAL
+};
+
+static GstStaticPadTemplate gst_mv_gate_sink_template =
+GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("video/x-raw(ANY)"));
+
+static GstStaticPadTemplate gst_mv_gate_src_template =
+GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("video/x-raw(ANY)"));
+
+#define gst_mv_gate_parent_class parent_class
+G_DEFINE_TYPE (GstMvGate, gst_mv_gate, GST_TYPE_BASE_TRANSFORM);
+
+/* Converts the clusters to padded pixel rectangles and returns the area they
+ * cover, overlaps counted twice */
+static guint64
+gst_mv_gate_to_pixels (GstMvGate * self, const GstMvGrid * grid,
+    const GstMvRegion * regions, guint n_regions,
+    GstMvInferenceRegion * rects)
+{
+  guint pad = self->padding;
+  guint64 area = 0;
+  guint i;
+
+  for (i = 0; i < n_regions; i++) {
+    guint x0 = regions[i].x > pad ? regions[i].x - pad : 0;
+    guint y0 = regions[i].y > pad ? regions[i].y - pad : 0;
+    guint x1 = MIN (regions[i].x + regions[i].width + pad, grid->cols);
+    guint y1 = MIN (regions[i].y + regions[i].height + pad, grid->rows);
+
+    rects[i].x = MIN (x0 * grid->block_size, (guint) self->width);
+    rects[i].y = MIN (y0 * grid->block_size, (guint) self->height);
+    rects[i].width = MIN (x1 * grid->block_size, (guint) self->width) -
+        rects[i].x;
+    rects[i].height = MIN (y1 * grid->block_size, (guint) self->height) -
+        rects[i].y;
+    area += (guint64) rects[i].width * rects[i].height;
+  }
+
+  return area;
+}
+
+static GstFlowReturn
+gst_mv_gate_transform_ip (GstBaseTransform * trans, GstBuffer * buf)
+{
+  GstMvGate *self = GST_MV_GATE (trans);
+  GstMvRegion regions[MAX_REGIONS];
+  GstMvInferenceRegion rects[MAX_REGIONS];
+  GstMvInferenceReason reason;
+  const metadata_MV *field;
+  const MVInfo *mvs = NULL;
+  guint n_vectors = 0, n_regions = 0;
+  gboolean full = TRUE;
+  GstMvGrid grid;
+
+  field = gst_mv_buffer_get_field (buf);
+  if (field)
+    mvs = gst_mv_field_get_vectors (field, &n_vectors);
+
+  if (GST_BUFFER_FLAG_IS_SET (buf, GST_BUFFER_FLAG_DISCONT))
+    self->need_full = TRUE;
+
+  if (n_vectors == 0) {
+    reason = GST_MV_INFERENCE_NO_VECTORS;
+  } else if (self->need_full || (self->refresh_interval > 0 &&
+          self->since_full + 1 >= self->refresh_interval)) {
+    reason = GST_MV_INFERENCE_REFRESH;
+  } else {
+    if (!gst_mv_grid_init (&grid, self->width, self->height, n_vectors))
+      GST_LOG_OBJECT (self, "%u vectors do not match %dx%d", n_vectors,
+          self->width, self->height);
+
+    n_regions = gst_mv_find_regions (mvs, &grid, self->motion_threshold,
+        self->min_blocks, regions, self->max_regions, self->scratch);
+
+    if (n_regions == 0) {
+      reason = GST_MV_INFERENCE_SKIP;
+      full = FALSE;
+    } else {
+      guint64 area = gst_mv_gate_to_pixels (self, &grid, regions, n_regions,
+          rects);
+
+      reason = GST_MV_INFERENCE_MOTION;
+      full = self->width <= 0 || self->height <= 0 ||
+          area > self->full_frame_ratio * self->width * self->height;
+    }
+  }
+
+  if (full) {
+    /* no usable size, an empty list stands for the whole frame */
+    n_regions = self->width > 0 && self->height > 0 ? 1 : 0;
+    rects[0].x = 0;
+    rects[0].y = 0;
+    rects[0].width = MAX (self->width, 0);
+    rects[0].height = MAX (self->height, 0);
+    self->since_full = 0;
+    self->need_full = FALSE;
+  } else {
+    self->since_full++;
+  }
+
+  if (reason == GST_MV_INFERENCE_SKIP) {
+    n_regions = 0;
+    self->n_skipped++;
+  }
+  self->n_frames++;
+
+  GST_LOG_OBJECT (self, "%" GST_TIME_FORMAT " reason %d, %u regions",
+      GST_TIME_ARGS (GST_BUFFER_PTS (buf)), reason, n_regions);
+
+  gst_buffer_add_mv_inference_meta (buf, reason, rects, n_regions);
+
+  return GST_FLOW_OK;
+}
+
+static gboolean
+gst_mv_gate_set_caps (GstBaseTransform * trans, GstCaps * incaps,
+    GstCaps * outcaps)
+{
+  GstMvGate *self = GST_MV_GATE (trans);
+  GstStructure *structure = gst_caps_get_structure (incaps, 0);
+
+  /* the frame size places the regions, without it the whole frame is marked
+   * whenever something moved */
+  if (!gst_structure_get_int (structure, "width", &self->width) ||
+      !gst_structure_get_int (structure, "height", &self->height)) {
+    GST_WARNING_OBJECT (self, "no frame size in caps %" GST_PTR_FORMAT,
+        incaps);
+    self->width = 0;
+    self->height = 0;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+gst_mv_gate_sink_event (GstBaseTransform * trans, GstEvent * event)
+{
+  if (GST_EVENT_TYPE (event) == GST_EVENT_FLUSH_STOP)
+    GST_MV_GATE (trans)->need_full = TRUE;
+
+  return GST_BASE_TRANSFORM_CLASS (parent_class)->sink_event (trans, event);
+}
+
+static gboolean
+gst_mv_gate_start (GstBaseTransform * trans)
+{
+  GstMvGate *self = GST_MV_GATE (trans);
+
+  self->scratch = g_array_new (FALSE, FALSE, sizeof (guint32));
+  self->since_full = 0;
+  self->need_full = TRUE;
+  self->n_frames = 0;
+  self->n_skipped = 0;
+
+  return TRUE;
+}
+
+static gboolean
+gst_mv_gate_stop (GstBaseTransform * trans)
+{
+  GstMvGate *self = GST_MV_GATE (trans);
+
+  GST_INFO_OBJECT (self, "%" G_GUINT64_FORMAT " of %" G_GUINT64_FORMAT
+      " frames skipped", self->n_skipped, self->n_frames);
+
+  g_clear_pointer (&self->scratch, g_array_unref);
+
+  return TRUE;
+}
+
+static void
+gst_mv_gate_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstMvGate *self = GST_MV_GATE (object);
+
+  switch (prop_id) {
+    case PROP_MOTION_THRESHOLD:
+      self->motion_threshold = g_value_get_uint (value);
+      break;
+    case PROP_MIN_BLOCKS:
+      self->min_blocks = g_value_get_uint (value);
+      break;
+    case PROP_MAX_REGIONS:
+      self->max_regions = g_value_get_uint (value);
+      break;
+    case PROP_PADDING:
+      self->padding = g_value_get_uint (value);
+      break;
+    case PROP_FULL_FRAME_RATIO:
+      self->full_frame_ratio = g_value_get_double (value);
+      break;
+    case PROP_REFRESH_INTERVAL:
+      self->refresh_interval = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_mv_gate_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstMvGate *self = GST_MV_GATE (object);
+
+  switch (prop_id) {
+    case PROP_MOTION_THRESHOLD:
+      g_value_set_uint (value, self->motion_threshold);
+      break;
+    case PROP_MIN_BLOCKS:
+      g_value_set_uint (value, self->min_blocks);
+      break;
+    case PROP_MAX_REGIONS:
+      g_value_set_uint (value, self->max_regions);
+      break;
+    case PROP_PADDING:
+      g_value_set_uint (value, self->padding);
+      break;
+    case PROP_FULL_FRAME_RATIO:
+      g_value_set_double (value, self->full_frame_ratio);
+      break;
+    case PROP_REFRESH_INTERVAL:
+      g_value_set_uint (value, self->refresh_interval);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_mv_gate_class_init (GstMvGateClass * klass)
+{
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+  GstElementClass *element_class = (GstElementClass *) klass;
+  GstBaseTransformClass *trans_class = (GstBaseTransformClass *) klass;
+
+  GST_DEBUG_CATEGORY_INIT (gst_mv_gate_debug, "nvmvgate", 0,
+      "Motion vector inference gate");
+
+  gobject_class->set_property = gst_mv_gate_set_property;
+  gobject_class->get_property = gst_mv_gate_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_MOTION_THRESHOLD,
+      g_param_spec_uint ("motion-threshold", "Motion threshold",
+          "Minimum |mv_x| + |mv_y| for a block to be considered moving",
+          0, G_MAXUINT, DEFAULT_MOTION_THRESHOLD,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property (gobject_class, PROP_MIN_BLOCKS,
+      g_param_spec_uint ("min-blocks", "Minimum blocks",
+          "Clusters of fewer moving blocks are ignored",
+          1, G_MAXUINT, DEFAULT_MIN_BLOCKS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_REGIONS,
+      g_param_spec_uint ("max-regions", "Maximum regions",
+          "Maximum number of regions per frame, the closest are merged",
+          1, MAX_REGIONS, DEFAULT_MAX_REGIONS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property (gobject_class, PROP_PADDING,
+      g_param_spec_uint ("padding", "Padding",
+          "Blocks added on each side of a region",
+          0, 64, DEFAULT_PADDING,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property (gobject_class, PROP_FULL_FRAME_RATIO,
+      g_param_spec_double ("full-frame-ratio", "Full frame ratio",
+          "Share of the frame covered by the regions from which the whole\n"
+          "\t\t\t frame is marked",
+          0.0, 1.0, DEFAULT_FULL_FRAME_RATIO,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property (gobject_class, PROP_REFRESH_INTERVAL,
+      g_param_spec_uint ("refresh-interval", "Refresh interval",
+          "Mark the whole frame at least every that many frames (0 = never)",
+          0, G_MAXUINT, DEFAULT_REFRESH_INTERVAL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_PLAYING));
+
+  gst_element_class_add_static_pad_template (element_class,
+      &gst_mv_gate_sink_template);
+  gst_element_class_add_static_pad_template (element_class,
+      &gst_mv_gate_src_template);
+
+  gst_element_class_set_static_metadata (element_class,
+      "Motion vector inference gate",
+      "Filter/Analyzer/Video",
+      "Marks the frames and regions a detector needs to run on, from the "
+      "motion vectors",
+      "lagurus <https://github.com/lagurus>");
+
+  trans_class->start = GST_DEBUG_FUNCPTR (gst_mv_gate_start);
+  trans_class->stop = GST_DEBUG_FUNCPTR (gst_mv_gate_stop);
+  trans_class->set_caps = GST_DEBUG_FUNCPTR (gst_mv_gate_set_caps);
+  trans_class->sink_event = GST_DEBUG_FUNCPTR (gst_mv_gate_sink_event);
+  trans_class->transform_ip = GST_DEBUG_FUNCPTR (gst_mv_gate_transform_ip);
+}
+
+static void
+gst_mv_gate_init (GstMvGate * self)
+{
+  self->motion_threshold = DEFAULT_MOTION_THRESHOLD;
+  self->min_blocks = DEFAULT_MIN_BLOCKS;
+  self->max_regions = DEFAULT_MAX_REGIONS;
+  self->padding = DEFAULT_PADDING;
+  self->full_frame_ratio = DEFAULT_FULL_FRAME_RATIO;
+  self->refresh_interval = DEFAULT_REFRESH_INTERVAL;
+}
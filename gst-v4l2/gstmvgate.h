@@ -0,0 +1,76 @@
+/*
+ * gstmvgate.h: motion gating of downstream inference
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MV_GATE_H__
+#define __GST_MV_GATE_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstbasetransform.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_MV_GATE \
+  (gst_mv_gate_get_type())
+#define GST_MV_GATE(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_MV_GATE,GstMvGate))
+#define GST_MV_GATE_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_MV_GATE,GstMvGateClass))
+#define GST_IS_MV_GATE(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_MV_GATE))
+#define GST_IS_MV_GATE_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_MV_GATE))
+
+typedef struct _GstMvGate GstMvGate;
+typedef struct _GstMvGateClass GstMvGateClass;
+
+struct _GstMvGate
+{
+  GstBaseTransform parent;
+
+  /* properties */
+  guint motion_threshold;
+  guint min_blocks;
+  guint max_regions;
+  guint padding;
+  gdouble full_frame_ratio;
+  guint refresh_interval;
+
+  /* < private > */
+  gint width;
+  gint height;
+
+  /* frames since the last whole frame inference, set after a reset */
+  guint since_full;
+  gboolean need_full;
+  GArray *scratch;
+
+  guint64 n_frames;
+  guint64 n_skipped;
+};
+
+struct _GstMvGateClass
+{
+  GstBaseTransformClass parent_class;
+};
+
+GType gst_mv_gate_get_type (void);
+
+G_END_DECLS
+
+#endif /* __GST_MV_GATE_H__ */
@@ -0,0 +1,415 @@
+/*
+ * gstmvhof.c: histogram of flow descriptors from motion vectors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * SECTION:element-nvmvhof
+ *
+ * Splits the motion vector field of each buffer into cells-x x cells-y cells
+ * and attaches a #GstMvTensorMeta with id "mv-hof" of shape
+ * [cells-y, cells-x, orientation-bins + magnitude-bins] holding, per cell:
+ *
+ * - orientation-bins bins of the direction of the moving blocks, counted
+ *   clockwise from the right, i.e. towards the bottom of the image
+ * - magnitude-bins bins of |mv_x| + |mv_y|: the first one for blocks below
+ *   motion-threshold, the others linear up to max-magnitude, the last one
+ *   for max-magnitude and above
+ *
+ * Both histograms are divided by the number of blocks of the cell, the
+ * magnitude bins of a cell thus sum to 1. Frames without vectors get a
+ * tensor of static cells.
+ *
+ * Directions are binned on the diamond angle, which needs no atan2. The bin
+ * edges are exact multiples of 45 degrees when orientation-bins divides 8.
+ *
+ * |[
+ * gst-launch-1.0 rtspsrc ! rtph264depay ! h264parse !
+ *     nvv4l2decoder enable-mv-meta=1 ! nvmvhof cells-x=8 cells-y=6 ! appsink
+ * ]|
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "gstmvhof.h"
+#include "gstmvtensormeta.h"
+#include "gstmvutils.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_mv_hof_debug);
+#define GST_CAT_DEFAULT gst_mv_hof_debug
+
+#define DEFAULT_CELLS_X             4
+#define DEFAULT_CELLS_Y             4
+#define DEFAULT_ORIENTATION_BINS    8
+#define DEFAULT_MAGNITUDE_BINS      4
+#define DEFAULT_MOTION_THRESHOLD    8
+#define DEFAULT_MAX_MAGNITUDE       64
+
+#define MAX_CELLS                   64
+#define MAX_BINS                    32
+
+enum
+{
+  PROP_0,
+  PROP_CELLS_X,
+  PROP_CELLS_Y,
+  PROP_ORIENTATION_BINS,
+  PROP_MAGNITUDE_BINS,
+  PROP_MOTION_THRESHOLD,
+  PROP_MAX_MAGNITUDE
+};
+
+static GstStaticPadTemplate gst_mv_hof_sink_template =
+GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS_ANY);
+
+static GstStaticPadTemplate gst_mv_hof_src_template =
+GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS_ANY);
+
+#define gst_mv_hof_parent_class parent_class
+G_DEFINE_TYPE (GstMvHof, gst_mv_hof, GST_TYPE_BASE_TRANSFORM);
+
+/*
+ * Bins a row of vectors. No branches and no table lookups so that it maps
+ * to SIMD: the diamond angle of (x, y) is the quadrant plus |y| / (|x| + |y|)
+ * or |x| / (|x| + |y|) in odd quadrants, in [0, 4). Static blocks get the
+ * orientation bin n_obins, which is not output.
+ */
+static void
+hof_bin_row (const MVInfo * mvs, guint n, gint threshold, gfloat o_scale,
+    gfloat m_scale, gint n_obins, gint n_mbins, guint8 * obins,
+    guint8 * mbins)
+{
+  guint i;
+
+  for (i = 0; i < n; i++) {
+    gint x = mvs[i].mv_x, y = mvs[i].mv_y;
+    gint ax = ABS (x), ay = ABS (y);
+    gint s = ax + ay;
+    gint q = ((y < 0) << 1) | ((x < 0) ^ (y < 0));
+    gfloat frac = (gfloat) ((q & 1) ? ax : ay) / (gfloat) MAX (s, 1);
+    gint o = MIN ((gint) ((q + frac) * o_scale), n_obins - 1);
+    gint m = MIN (1 + (gint) ((s - threshold) * m_scale), n_mbins - 1);
+    gboolean moving = s >= threshold;
+
+    obins[i] = moving ? o : n_obins;
+    mbins[i] = moving ? m : 0;
+  }
+}
+
+static void
+gst_mv_hof_ensure_scratch (GstMvHof * self, guint cols)
+{
+  guint stride = self->orientation_bins + 1 + self->magnitude_bins;
+  guint n_counts = self->cells_x * self->cells_y * stride;
+
+  if (cols > self->scratch_cols) {
+    self->obins = g_realloc (self->obins, cols);
+    self->mbins = g_realloc (self->mbins, cols);
+    self->col_cells = g_realloc (self->col_cells, cols * sizeof (guint16));
+    self->scratch_cols = cols;
+  }
+  if (n_counts != self->n_counts) {
+    self->counts = g_realloc (self->counts, n_counts * sizeof (guint32));
+    self->n_counts = n_counts;
+  }
+}
+
+static void
+gst_mv_hof_compute (GstMvHof * self, const MVInfo * mvs, guint n_vectors,
+    const GstMvGrid * grid, GstMvTensorMeta * tensor)
+{
+  guint n_obins = self->orientation_bins, n_mbins = self->magnitude_bins;
+  guint cells_x = self->cells_x, cells_y = self->cells_y;
+  guint stride = n_obins + 1 + n_mbins;
+  guint cols = MAX (grid->cols, 1);
+  guint rows = (n_vectors + cols - 1) / cols;
+  guint threshold = MIN (self->motion_threshold, G_MAXINT / 2);
+  guint range = MAX (self->max_magnitude, threshold + 1) - threshold;
+  guint32 cell_blocks[MAX_CELLS * MAX_CELLS];
+  gfloat o_scale = n_obins / 4.0f;
+  /* the moving bins but the last split [threshold, max-magnitude), with
+   * two bins there is only the open ended one */
+  gfloat m_scale = n_mbins > 2 ? (gfloat) (n_mbins - 2) / range : 0.0f;
+  guint row, col, cell, b, i = 0;
+  gfloat *out = tensor->data;
+
+  gst_mv_hof_ensure_scratch (self, cols);
+  memset (self->counts, 0, self->n_counts * sizeof (guint32));
+  memset (cell_blocks, 0, sizeof (cell_blocks));
+
+  for (col = 0; col < cols; col++)
+    self->col_cells[col] = col * cells_x / cols;
+
+  for (row = 0; row < rows; row++) {
+    guint len = MIN (cols, n_vectors - i);
+    guint32 *row_counts = self->counts + (row * cells_y / rows) * cells_x *
+        stride;
+    guint32 *row_blocks = cell_blocks + (row * cells_y / rows) * cells_x;
+
+    hof_bin_row (mvs + i, len, threshold, o_scale, m_scale, n_obins, n_mbins,
+        self->obins, self->mbins);
+
+    for (col = 0; col < len; col++) {
+      guint32 *c = row_counts + self->col_cells[col] * stride;
+
+      c[self->obins[col]]++;
+      c[n_obins + 1 + self->mbins[col]]++;
+      row_blocks[self->col_cells[col]]++;
+    }
+    i += len;
+  }
+
+  for (cell = 0; cell < cells_x * cells_y; cell++) {
+    const guint32 *c = self->counts + cell * stride;
+    gfloat *o = out + cell * (n_obins + n_mbins);
+
+    if (cell_blocks[cell] == 0) {
+      /* no vectors fell in the cell, report it static */
+      o[n_obins] = 1.0f;
+      continue;
+    }
+
+    for (b = 0; b < n_obins; b++)
+      o[b] = (gfloat) c[b] / cell_blocks[cell];
+    for (b = 0; b < n_mbins; b++)
+      o[n_obins + b] = (gfloat) c[n_obins + 1 + b] / cell_blocks[cell];
+  }
+}
+
+static GstFlowReturn
+gst_mv_hof_transform_ip (GstBaseTransform * trans, GstBuffer * buf)
+{
+  GstMvHof *self = GST_MV_HOF (trans);
+  const metadata_MV *field;
+  const MVInfo *mvs = NULL;
+  guint n_vectors = 0;
+  guint dims[3];
+  GstMvTensorMeta *tensor;
+  GstMvGrid grid;
+
+  field = gst_mv_buffer_get_field (buf);
+  if (field)
+    mvs = gst_mv_field_get_vectors (field, &n_vectors);
+
+  dims[0] = self->cells_y;
+  dims[1] = self->cells_x;
+  dims[2] = self->orientation_bins + self->magnitude_bins;
+
+  tensor = gst_buffer_add_mv_tensor_meta (buf,
+      g_quark_from_static_string ("mv-hof"), 3, dims);
+  if (tensor == NULL)
+    return GST_FLOW_OK;
+
+  if (!gst_mv_grid_init (&grid, self->width, self->height, n_vectors) &&
+      n_vectors > 0)
+    GST_LOG_OBJECT (self, "%u vectors do not match %dx%d", n_vectors,
+        self->width, self->height);
+
+  gst_mv_hof_compute (self, mvs, n_vectors, &grid, tensor);
+
+  return GST_FLOW_OK;
+}
+
+static gboolean
+gst_mv_hof_set_caps (GstBaseTransform * trans, GstCaps * incaps,
+    GstCaps * outcaps)
+{
+  GstMvHof *self = GST_MV_HOF (trans);
+  GstStructure *structure = gst_caps_get_structure (incaps, 0);
+
+  /* the frame size places the vectors in the cells, without it the field is
+   * taken as a single column */
+  if (!gst_structure_get_int (structure, "width", &self->width) ||
+      !gst_structure_get_int (structure, "height", &self->height)) {
+    GST_WARNING_OBJECT (self, "no frame size in caps %" GST_PTR_FORMAT,
+        incaps);
+    self->width = 0;
+    self->height = 0;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+gst_mv_hof_stop (GstBaseTransform * trans)
+{
+  GstMvHof *self = GST_MV_HOF (trans);
+
+  g_clear_pointer (&self->obins, g_free);
+  g_clear_pointer (&self->mbins, g_free);
+  g_clear_pointer (&self->col_cells, g_free);
+  g_clear_pointer (&self->counts, g_free);
+  self->scratch_cols = 0;
+  self->n_counts = 0;
+
+  return TRUE;
+}
+
+static void
+gst_mv_hof_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstMvHof *self = GST_MV_HOF (object);
+
+  switch (prop_id) {
+    case PROP_CELLS_X:
+      self->cells_x = g_value_get_uint (value);
+      break;
+    case PROP_CELLS_Y:
+      self->cells_y = g_value_get_uint (value);
+      break;
+    case PROP_ORIENTATION_BINS:
+      self->orientation_bins = g_value_get_uint (value);
+      break;
+    case PROP_MAGNITUDE_BINS:
+      self->magnitude_bins = g_value_get_uint (value);
+      break;
+    case PROP_MOTION_THRESHOLD:
+      self->motion_threshold = g_value_get_uint (value);
+      break;
+    case PROP_MAX_MAGNITUDE:
+      self->max_magnitude = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_mv_hof_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstMvHof *self = GST_MV_HOF (object);
+
+  switch (prop_id) {
+    case PROP_CELLS_X:
+      g_value_set_uint (value, self->cells_x);
+      break;
+    case PROP_CELLS_Y:
+      g_value_set_uint (value, self->cells_y);
+      break;
+    case PROP_ORIENTATION_BINS:
+      g_value_set_uint (value, self->orientation_bins);
+      break;
+    case PROP_MAGNITUDE_BINS:
+      g_value_set_uint (value, self->magnitude_bins);
+      break;
+    case PROP_MOTION_THRESHOLD:
+      g_value_set_uint (value, self->motion_threshold);
+      break;
+    case PROP_MAX_MAGNITUDE:
+      g_value_set_uint (value, self->max_magnitude);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_mv_hof_class_init (GstMvHofClass * klass)
+{
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+  GstElementClass *element_class = (GstElementClass *) klass;
+  GstBaseTransformClass *trans_class = (GstBaseTransformClass *) klass;
+
+  GST_DEBUG_CATEGORY_INIT (gst_mv_hof_debug, "nvmvhof", 0,
+      "Motion vector histogram of flow");
+
+  gobject_class->set_property = gst_mv_hof_set_property;
+  gobject_class->get_property = gst_mv_hof_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_CELLS_X,
+      g_param_spec_uint ("cells-x", "Cells x",
+          "Number of cell columns the field is split into",
+          1, MAX_CELLS, DEFAULT_CELLS_X,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_CELLS_Y,
+      g_param_spec_uint ("cells-y", "Cells y",
+          "Number of cell rows the field is split into",
+          1, MAX_CELLS, DEFAULT_CELLS_Y,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_ORIENTATION_BINS,
+      g_param_spec_uint ("orientation-bins", "Orientation bins",
+          "Number of direction bins per cell",
+          1, MAX_BINS, DEFAULT_ORIENTATION_BINS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_MAGNITUDE_BINS,
+      g_param_spec_uint ("magnitude-bins", "Magnitude bins",
+          "Number of magnitude bins per cell, the first for static blocks",
+          2, MAX_BINS, DEFAULT_MAGNITUDE_BINS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_MOTION_THRESHOLD,
+      g_param_spec_uint ("motion-threshold", "Motion threshold",
+          "Minimum |mv_x| + |mv_y| for a block to be considered moving",
+          0, G_MAXUINT, DEFAULT_MOTION_THRESHOLD,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_MAGNITUDE,
+      g_param_spec_uint ("max-magnitude", "Maximum magnitude",
+          "|mv_x| + |mv_y| from which blocks fall in the last magnitude bin",
+          1, G_MAXUINT, DEFAULT_MAX_MAGNITUDE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  gst_element_class_add_static_pad_template (element_class,
+      &gst_mv_hof_sink_template);
+  gst_element_class_add_static_pad_template (element_class,
+      &gst_mv_hof_src_template);
+
+  gst_element_class_set_static_metadata (element_class,
+      "Motion vector histogram of flow",
+      "Filter/Analyzer/Video",
+      "Attaches per cell histograms of motion direction and magnitude "
+      "as a tensor meta",
+      "lagurus <https://github.com/lagurus>");
+
+  trans_class->set_caps = GST_DEBUG_FUNCPTR (gst_mv_hof_set_caps);
+  trans_class->stop = GST_DEBUG_FUNCPTR (gst_mv_hof_stop);
+  trans_class->transform_ip = GST_DEBUG_FUNCPTR (gst_mv_hof_transform_ip);
+}
+
+static void
+gst_mv_hof_init (GstMvHof * self)
+{
+  self->cells_x = DEFAULT_CELLS_X;
+  self->cells_y = DEFAULT_CELLS_Y;
+  self->orientation_bins = DEFAULT_ORIENTATION_BINS;
+  self->magnitude_bins = DEFAULT_MAGNITUDE_BINS;
+  self->motion_threshold = DEFAULT_MOTION_THRESHOLD;
+  self->max_magnitude = DEFAULT_MAX_MAGNITUDE;
+}
@@ -0,0 +1,76 @@
+/*
+ * gstmvhof.h: histogram of flow descriptors from motion vectors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MV_HOF_H__
+#define __GST_MV_HOF_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstbasetransform.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_MV_HOF \
+  (gst_mv_hof_get_type())
+#define GST_MV_HOF(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_MV_HOF,GstMvHof))
+#define GST_MV_HOF_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_MV_HOF,GstMvHofClass))
+#define GST_IS_MV_HOF(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_MV_HOF))
+#define GST_IS_MV_HOF_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_MV_HOF))
+
+typedef struct _GstMvHof GstMvHof;
+typedef struct _GstMvHofClass GstMvHofClass;
+
+struct _GstMvHof
+{
+  GstBaseTransform parent;
+
+  /* properties */
+  guint cells_x;
+  guint cells_y;
+  guint orientation_bins;
+  guint magnitude_bins;
+  guint motion_threshold;
+  guint max_magnitude;
+
+  /* < private > */
+  gint width;
+  gint height;
+
+  /* bins of the vectors of a row, cell of each column, counts per cell */
+  guint8 *obins;
+  guint8 *mbins;
+  guint16 *col_cells;
+  guint32 *counts;
+  guint scratch_cols;
+  guint n_counts;
+};
+
+struct _GstMvHofClass
+{
+  GstBaseTransformClass parent_class;
+};
+
+GType gst_mv_hof_get_type (void);
+
+G_END_DECLS
+
+#endif /* __GST_MV_HOF_H__ */
@@ -0,0 +1,143 @@
+/*
+ * gstmvinferencemeta.c: which parts of a frame need inference
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "gstmvinferencemeta.h"
+
+static gboolean
+gst_mv_inference_meta_init (GstMeta * meta, gpointer params,
+    GstBuffer * buffer)
+{
+  GstMvInferenceMeta *imeta = (GstMvInferenceMeta *) meta;
+
+  imeta->needs_inference = TRUE;
+  imeta->reason = GST_MV_INFERENCE_NO_VECTORS;
+  imeta->n_regions = 0;
+  imeta->regions = NULL;
+
+  return TRUE;
+}
+
+static void
+gst_mv_inference_meta_free (GstMeta * meta, GstBuffer * buffer)
+{
+  GstMvInferenceMeta *imeta = (GstMvInferenceMeta *) meta;
+
+  g_free (imeta->regions);
+  imeta->regions = NULL;
+}
+
+static gboolean
+gst_mv_inference_meta_transform (GstBuffer * transbuf, GstMeta * meta,
+    GstBuffer * buffer, GQuark type, gpointer data)
+{
+  GstMvInferenceMeta *imeta = (GstMvInferenceMeta *) meta;
+
+  /* the regions are in pixels of this frame, only plain copies keep them */
+  if (!GST_META_TRANSFORM_IS_COPY (type))
+    return FALSE;
+
+  return gst_buffer_add_mv_inference_meta (transbuf, imeta->reason,
+      imeta->regions, imeta->n_regions) != NULL;
+}
+
+GType
+gst_mv_inference_meta_api_get_type (void)
+{
+  static const gchar *tags[] = { NULL };
+  static volatile GType type;
+
+  if (g_once_init_enter (&type)) {
+    GType _type = gst_meta_api_type_register ("GstMvInferenceMetaAPI", tags);
+    g_once_init_leave (&type, _type);
+  }
+
+  return type;
+}
+
+const GstMetaInfo *
+gst_mv_inference_meta_get_info (void)
+{
+  static const GstMetaInfo *meta_info = NULL;
+
+  if (g_once_init_enter (&meta_info)) {
+    const GstMetaInfo *meta =
+        gst_meta_register (GST_MV_INFERENCE_META_API_TYPE,
+        "GstMvInferenceMeta", sizeof (GstMvInferenceMeta),
+        gst_mv_inference_meta_init, gst_mv_inference_meta_free,
+        gst_mv_inference_meta_transform);
+    g_once_init_leave (&meta_info, meta);
+  }
+
+  return meta_info;
+}
+
+/**
+ * gst_buffer_add_mv_inference_meta:
+ * @buffer: a writable #GstBuffer
+ * @reason: why the frame does or does not need inference
+ * @regions: (allow-none): @n_regions rectangles, copied
+ * @n_regions: number of entries in @regions
+ *
+ * Marks @buffer for a downstream detector, see #GstMvInferenceMeta.
+ *
+ * Returns: (transfer none): the meta.
+ */
+GstMvInferenceMeta *
+gst_buffer_add_mv_inference_meta (GstBuffer * buffer,
+    GstMvInferenceReason reason, const GstMvInferenceRegion * regions,
+    guint n_regions)
+{
+  GstMvInferenceMeta *imeta;
+
+  g_return_val_if_fail (gst_buffer_is_writable (buffer), NULL);
+  g_return_val_if_fail (regions != NULL || n_regions == 0, NULL);
+
+  imeta = (GstMvInferenceMeta *) gst_buffer_add_meta (buffer,
+      GST_MV_INFERENCE_META_INFO, NULL);
+
+  imeta->needs_inference = reason != GST_MV_INFERENCE_SKIP;
+  imeta->reason = reason;
+  imeta->n_regions = n_regions;
+  if (n_regions > 0) {
+    imeta->regions = g_new (GstMvInferenceRegion, n_regions);
+    memcpy (imeta->regions, regions,
+        n_regions * sizeof (GstMvInferenceRegion));
+  }
+
+  return imeta;
+}
+
+/**
+ * gst_buffer_get_mv_inference_meta:
+ * @buffer: a #GstBuffer
+ *
+ * Returns: (transfer none): the #GstMvInferenceMeta of @buffer, or %NULL.
+ */
+GstMvInferenceMeta *
+gst_buffer_get_mv_inference_meta (GstBuffer * buffer)
+{
+  return (GstMvInferenceMeta *) gst_buffer_get_meta (buffer,
+      GST_MV_INFERENCE_META_API_TYPE);
+}
@@ -0,0 +1,101 @@
+/*
+ * gstmvinferencemeta.h: which parts of a frame need inference
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MV_INFERENCE_META_H__
+#define __GST_MV_INFERENCE_META_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define GST_MV_INFERENCE_META_API_TYPE (gst_mv_inference_meta_api_get_type())
+#define GST_MV_INFERENCE_META_INFO     (gst_mv_inference_meta_get_info())
+
+typedef struct _GstMvInferenceMeta GstMvInferenceMeta;
+typedef struct _GstMvInferenceRegion GstMvInferenceRegion;
+
+/**
+ * GstMvInferenceReason:
+ * @GST_MV_INFERENCE_SKIP: nothing moved, the previous results still hold
+ * @GST_MV_INFERENCE_MOTION: run on the regions, where something moved
+ * @GST_MV_INFERENCE_REFRESH: periodic run on the whole frame
+ * @GST_MV_INFERENCE_NO_VECTORS: intra frame or no vectors, whole frame
+ *
+ * Why a frame was or was not marked for inference.
+ */
+typedef enum
+{
+  GST_MV_INFERENCE_SKIP,
+  GST_MV_INFERENCE_MOTION,
+  GST_MV_INFERENCE_REFRESH,
+  GST_MV_INFERENCE_NO_VECTORS
+} GstMvInferenceReason;
+
+/**
+ * GstMvInferenceRegion:
+ * @x: left edge, in pixels
+ * @y: top edge, in pixels
+ * @width: width, in pixels
+ * @height: height, in pixels
+ *
+ * A rectangle of the frame inference should look at.
+ */
+struct _GstMvInferenceRegion
+{
+  guint x;
+  guint y;
+  guint width;
+  guint height;
+};
+
+/**
+ * GstMvInferenceMeta:
+ * @meta: parent #GstMeta
+ * @needs_inference: %FALSE when inference can be skipped for the frame
+ * @reason: why
+ * @n_regions: number of entries in @regions, 0 when skipped
+ * @regions: the parts of the frame to run on, a single full frame region
+ *     when the whole frame is needed, none when that is needed but the frame
+ *     size was unknown. Owned by the meta.
+ *
+ * Tells a downstream detector whether and where a frame needs inference.
+ */
+struct _GstMvInferenceMeta
+{
+  GstMeta meta;
+
+  gboolean needs_inference;
+  GstMvInferenceReason reason;
+  guint n_regions;
+  GstMvInferenceRegion *regions;
+};
+
+GType gst_mv_inference_meta_api_get_type (void);
+
+const GstMetaInfo *gst_mv_inference_meta_get_info (void);
+
+GstMvInferenceMeta *gst_buffer_add_mv_inference_meta (GstBuffer * buffer,
+    GstMvInferenceReason reason, const GstMvInferenceRegion * regions,
+    guint n_regions);
+
+GstMvInferenceMeta *gst_buffer_get_mv_inference_meta (GstBuffer * buffer);
+
+G_END_DECLS
+
+#endif /* __GST_MV_INFERENCE_META_H__ */
@@ -0,0 +1,360 @@
+/*
+ * gstmvpool.c: process wide worker pool for motion vector analytics
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * One pool per process, one worker per core, started on first use and kept
+ * for the life of the process.
+ *
+ * The unit of scheduling is a queue, one per analysed stream, not a job: a
+ * queue with pending jobs sits in the ready list of exactly one worker, or
+ * is being run by it. A worker runs a single job of the queue and puts it
+ * back at the tail of its own list if more are pending, so the streams it
+ * holds take turns. A worker whose list is empty steals from the tail of
+ * the others, which is how the jobs of busy streams end up on the cores
+ * quiet streams leave idle. Pushing never blocks: a full queue drops its
+ * oldest job.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstmvpool.h"
+
+typedef struct _GstMvPool GstMvPool;
+typedef struct _GstMvPoolWorker GstMvPoolWorker;
+
+struct _GstMvPoolQueue
+{
+  GMutex lock;
+  GCond cond;
+  GQueue jobs;
+  guint max_jobs;
+  guint64 dropped;
+
+  /* in the ready list of a worker or running */
+  gboolean scheduled;
+  gboolean running;
+
+  GstMvPoolFunc func;
+  GDestroyNotify job_free;
+  gpointer user_data;
+
+  /* one for the owner, one while scheduled */
+  gint refcount;
+};
+
+struct _GstMvPoolWorker
+{
+  GstMvPool *pool;
+  guint idx;
+  GMutex lock;
+  GQueue ready;
+};
+
+struct _GstMvPool
+{
+  guint n_workers;
+  GstMvPoolWorker *workers;
+
+  /* queues in the ready lists, and where the next pushed one goes */
+  gint n_ready;
+  gint next;
+
+  GMutex lock;
+  GCond cond;
+  guint n_idle;
+};
+
+static void
+gst_mv_pool_queue_unref (GstMvPoolQueue * queue)
+{
+  if (!g_atomic_int_dec_and_test (&queue->refcount))
+    return;
+
+  g_mutex_clear (&queue->lock);
+  g_cond_clear (&queue->cond);
+  g_free (queue);
+}
+
+static void
+gst_mv_pool_schedule (GstMvPool * pool, GstMvPoolWorker * worker,
+    GstMvPoolQueue * queue)
+{
+  g_mutex_lock (&worker->lock);
+  g_queue_push_tail (&worker->ready, queue);
+  g_mutex_unlock (&worker->lock);
+
+  g_atomic_int_inc (&pool->n_ready);
+
+  g_mutex_lock (&pool->lock);
+  if (pool->n_idle > 0)
+    g_cond_signal (&pool->cond);
+  g_mutex_unlock (&pool->lock);
+}
+
+static GstMvPoolQueue *
+gst_mv_pool_take (GstMvPool * pool, GstMvPoolWorker * worker)
+{
+  GstMvPoolQueue *queue;
+  guint i;
+
+  g_mutex_lock (&worker->lock);
+  queue = g_queue_pop_head (&worker->ready);
+  g_mutex_unlock (&worker->lock);
+
+  /* steal from the end the victim will get to last */
+  for (i = 1; queue == NULL && i < pool->n_workers; i++) {
+    GstMvPoolWorker *victim =
+        &pool->workers[(worker->idx + i) % pool->n_workers];
+
+    g_mutex_lock (&victim->lock);
+    queue = g_queue_pop_tail (&victim->ready);
+    g_mutex_unlock (&victim->lock);
+  }
+
+  if (queue)
+    g_atomic_int_add (&pool->n_ready, -1);
+
+  return queue;
+}
+
+static void
+gst_mv_pool_run (GstMvPool * pool, GstMvPoolWorker * worker,
+    GstMvPoolQueue * queue)
+{
+  gpointer job;
+  gboolean pending;
+
+  g_mutex_lock (&queue->lock);
+  job = g_queue_pop_head (&queue->jobs);
+  if (job == NULL) {
+    /* flushed while waiting in a ready list */
+    queue->scheduled = FALSE;
+    g_mutex_unlock (&queue->lock);
+    gst_mv_pool_queue_unref (queue);
+    return;
+  }
+  queue->running = TRUE;
+  g_mutex_unlock (&queue->lock);
+
+  queue->func (job, queue->user_data);
+  if (queue->job_free)
+    queue->job_free (job);
+
+  g_mutex_lock (&queue->lock);
+  queue->running = FALSE;
+  pending = !g_queue_is_empty (&queue->jobs);
+  if (!pending)
+    queue->scheduled = FALSE;
+  g_cond_broadcast (&queue->cond);
+  g_mutex_unlock (&queue->lock);
+
+  if (pending)
+    gst_mv_pool_schedule (pool, worker, queue);
+  else
+    gst_mv_pool_queue_unref (queue);
+}
+
+static gpointer
+gst_mv_pool_worker_func (gpointer data)
+{
+  GstMvPoolWorker *worker = data;
+  GstMvPool *pool = worker->pool;
+  GstMvPoolQueue *queue;
+
+  while (TRUE) {
+    queue = gst_mv_pool_take (pool, worker);
+    if (queue) {
+      gst_mv_pool_run (pool, worker, queue);
+      continue;
+    }
+
+    g_mutex_lock (&pool->lock);
+    pool->n_idle++;
+    while (g_atomic_int_get (&pool->n_ready) == 0)
+      g_cond_wait (&pool->cond, &pool->lock);
+    pool->n_idle--;
+    g_mutex_unlock (&pool->lock);
+  }
+
+  return NULL;
+}
+
+static GstMvPool *
+gst_mv_pool_get (void)
+{
+  static GstMvPool *pool = NULL;
+
+  if (g_once_init_enter (&pool)) {
+    GstMvPool *new_pool = g_new0 (GstMvPool, 1);
+    guint i;
+
+    new_pool->n_workers = MAX (g_get_num_processors (), 1);
+    new_pool->workers = g_new0 (GstMvPoolWorker, new_pool->n_workers);
+    g_mutex_init (&new_pool->lock);
+    g_cond_init (&new_pool->cond);
+
+    for (i = 0; i < new_pool->n_workers; i++) {
+      GstMvPoolWorker *worker = &new_pool->workers[i];
+      gchar *name = g_strdup_printf ("mvpool-%u", i);
+
+      worker->pool = new_pool;
+      worker->idx = i;
+      g_mutex_init (&worker->lock);
+      g_queue_init (&worker->ready);
+      g_thread_unref (g_thread_new (name, gst_mv_pool_worker_func, worker));
+      g_free (name);
+    }
+
+    g_once_init_leave (&pool, new_pool);
+  }
+
+  return pool;
+}
+
+/**
+ * gst_mv_pool_queue_new:
+ * @func: runs a job
+ * @job_free: (allow-none): frees a job that ran or was dropped
+ * @user_data: passed to @func
+ * @max_jobs: number of pending jobs from which the oldest is dropped
+ *
+ * Creates the queue of one stream on the process wide pool.
+ *
+ * Returns: the queue, free with gst_mv_pool_queue_free().
+ */
+GstMvPoolQueue *
+gst_mv_pool_queue_new (GstMvPoolFunc func, GDestroyNotify job_free,
+    gpointer user_data, guint max_jobs)
+{
+  GstMvPoolQueue *queue;
+
+  g_return_val_if_fail (func != NULL, NULL);
+  g_return_val_if_fail (max_jobs > 0, NULL);
+
+  /* start the workers now rather than on the first frame */
+  gst_mv_pool_get ();
+
+  queue = g_new0 (GstMvPoolQueue, 1);
+  g_mutex_init (&queue->lock);
+  g_cond_init (&queue->cond);
+  g_queue_init (&queue->jobs);
+  queue->max_jobs = max_jobs;
+  queue->func = func;
+  queue->job_free = job_free;
+  queue->user_data = user_data;
+  queue->refcount = 1;
+
+  return queue;
+}
+
+/**
+ * gst_mv_pool_queue_push:
+ * @queue: a #GstMvPoolQueue
+ * @job: (transfer full): the job
+ *
+ * Queues @job behind the pending jobs of @queue. Never blocks, when
+ * max_jobs jobs are already pending the oldest one is dropped.
+ */
+void
+gst_mv_pool_queue_push (GstMvPoolQueue * queue, gpointer job)
+{
+  GstMvPool *pool = gst_mv_pool_get ();
+  gpointer dropped = NULL;
+  gboolean schedule = FALSE;
+
+  g_mutex_lock (&queue->lock);
+  if (g_queue_get_length (&queue->jobs) >= queue->max_jobs) {
+    dropped = g_queue_pop_head (&queue->jobs);
+    queue->dropped++;
+  }
+  g_queue_push_tail (&queue->jobs, job);
+  if (!queue->scheduled) {
+    queue->scheduled = TRUE;
+    g_atomic_int_inc (&queue->refcount);
+    schedule = TRUE;
+  }
+  g_mutex_unlock (&queue->lock);
+
+  if (dropped && queue->job_free)
+    queue->job_free (dropped);
+
+  if (schedule)
+    gst_mv_pool_schedule (pool,
+        &pool->workers[(guint) g_atomic_int_add (&pool->next, 1) %
+            pool->n_workers], queue);
+}
+
+/**
+ * gst_mv_pool_queue_flush:
+ * @queue: a #GstMvPoolQueue
+ *
+ * Drops the pending jobs of @queue and waits for the running one, if any,
+ * to finish. Must not be called from the function of the queue.
+ */
+void
+gst_mv_pool_queue_flush (GstMvPoolQueue * queue)
+{
+  GQueue jobs = G_QUEUE_INIT;
+  gpointer job;
+
+  g_mutex_lock (&queue->lock);
+  jobs = queue->jobs;
+  g_queue_init (&queue->jobs);
+  while (queue->running)
+    g_cond_wait (&queue->cond, &queue->lock);
+  g_mutex_unlock (&queue->lock);
+
+  while ((job = g_queue_pop_head (&jobs)))
+    if (queue->job_free)
+      queue->job_free (job);
+}
+
+/**
+ * gst_mv_pool_queue_get_dropped:
+ * @queue: a #GstMvPoolQueue
+ *
+ * Returns: the number of jobs dropped because @queue was full.
+ */
+guint64
+gst_mv_pool_queue_get_dropped (GstMvPoolQueue * queue)
+{
+  guint64 dropped;
+
+  g_mutex_lock (&queue->lock);
+  dropped = queue->dropped;
+  g_mutex_unlock (&queue->lock);
+
+  return dropped;
+}
+
+/**
+ * gst_mv_pool_queue_free:
+ * @queue: a #GstMvPoolQueue
+ *
+ * Flushes @queue and releases it. Its function is not called anymore once
+ * this returns.
+ */
+void
+gst_mv_pool_queue_free (GstMvPoolQueue * queue)
+{
+  gst_mv_pool_queue_flush (queue);
+  gst_mv_pool_queue_unref (queue);
+}
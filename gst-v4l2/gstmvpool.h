@@ -0,0 +1,54 @@
+/*
+ * gstmvpool.h: process wide worker pool for motion vector analytics
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MV_POOL_H__
+#define __GST_MV_POOL_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GstMvPoolQueue GstMvPoolQueue;
+
+/**
+ * GstMvPoolFunc:
+ * @job: the job to run
+ * @user_data: user data of the queue
+ *
+ * Runs one job of a #GstMvPoolQueue on a worker of the pool. The jobs of a
+ * queue run one at a time, in the order they were pushed, so the function
+ * can keep per stream state without locking. It must not free @job, the
+ * queue does that afterwards.
+ */
+typedef void (*GstMvPoolFunc) (gpointer job, gpointer user_data);
+
+GstMvPoolQueue *gst_mv_pool_queue_new (GstMvPoolFunc func,
+    GDestroyNotify job_free, gpointer user_data, guint max_jobs);
+
+void gst_mv_pool_queue_push (GstMvPoolQueue * queue, gpointer job);
+
+void gst_mv_pool_queue_flush (GstMvPoolQueue * queue);
+
+guint64 gst_mv_pool_queue_get_dropped (GstMvPoolQueue * queue);
+
+void gst_mv_pool_queue_free (GstMvPoolQueue * queue);
+
+G_END_DECLS
+
+#endif /* __GST_MV_POOL_H__ */
@@ -0,0 +1,564 @@
+/*
+ * gstmvrecord.c: motion triggered recording with a GOP aligned pre-roll
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * SECTION:element-nvmvrecord
+ *
+ * Holds the last preroll-time of encoded access units and only lets data
+ * through once motion is seen. The ring stores references to the encoder
+ * output buffers in a slot array allocated when the element goes to PAUSED,
+ * and is trimmed on key frames so that it always starts with one.
+ *
+ * A recording starts when the #GstBufferInfoMeta of a frame shows at least
+ * trigger-ratio of moving blocks, or when a custom event named
+ * "mv-record-trigger" reaches the element, upstream through the src pad or
+ * downstream through the sink pad. The ring is then pushed as a single
+ * buffer list followed by the live stream. Once no motion has been seen for
+ * hold-time the element returns to buffering on the next key frame, so every
+ * segment it outputs is decodable on its own when the encoder repeats its
+ * headers on IDR frames (insert-sps-pps=1).
+ *
+ * Element messages named "mv-record" are posted on the bus with the fields
+ * "recording" (boolean), "timestamp" and "running-time" (#GstClockTime) at
+ * the start and the end of every segment.
+ *
+ * |[
+ * gst-launch-1.0 nvarguscamerasrc ! nvv4l2h264enc EnableMVBufferMeta=1
+ *     insert-sps-pps=1 ! nvmvrecord preroll-time=5000000000 ! h264parse !
+ *     splitmuxsink location=motion%05d.mp4
+ * ]|
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstmvrecord.h"
+#include "gstmvutils.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_mv_record_debug);
+#define GST_CAT_DEFAULT gst_mv_record_debug
+
+#define DEFAULT_PREROLL_TIME        (5 * GST_SECOND)
+#define DEFAULT_HOLD_TIME           (5 * GST_SECOND)
+#define DEFAULT_RING_SIZE           1024
+#define DEFAULT_MOTION_THRESHOLD    8
+#define DEFAULT_TRIGGER_RATIO       0.01
+
+enum
+{
+  PROP_0,
+  PROP_PREROLL_TIME,
+  PROP_HOLD_TIME,
+  PROP_RING_SIZE,
+  PROP_MOTION_THRESHOLD,
+  PROP_TRIGGER_RATIO
+};
+
+#define MV_CODEC_CAPS "video/x-h264; video/x-h265"
+
+static GstStaticPadTemplate gst_mv_record_sink_template =
+GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (MV_CODEC_CAPS));
+
+static GstStaticPadTemplate gst_mv_record_src_template =
+GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (MV_CODEC_CAPS));
+
+#define gst_mv_record_parent_class parent_class
+G_DEFINE_TYPE (GstMvRecord, gst_mv_record, GST_TYPE_ELEMENT);
+
+#define RING_AT(self, i) \
+  ((self)->ring[((self)->ring_head + (i)) % (self)->ring_alloc])
+
+#define IS_KEYFRAME(buf) \
+  (!GST_BUFFER_FLAG_IS_SET ((buf), GST_BUFFER_FLAG_DELTA_UNIT))
+
+static GstClockTime
+buffer_time (GstBuffer * buf)
+{
+  return GST_BUFFER_PTS_IS_VALID (buf) ? GST_BUFFER_PTS (buf) :
+      GST_BUFFER_DTS (buf);
+}
+
+/* releases the @n oldest entries of the ring */
+static void
+gst_mv_record_ring_drop (GstMvRecord * self, guint n)
+{
+  guint i;
+
+  for (i = 0; i < n; i++) {
+    gst_buffer_unref (RING_AT (self, i));
+    RING_AT (self, i) = NULL;
+  }
+
+  self->ring_len -= n;
+  self->ring_head = self->ring_len ? (self->ring_head + n) % self->ring_alloc : 0;
+}
+
+/* drops the GOPs that are no longer needed to cover the pre-roll at @now */
+static void
+gst_mv_record_ring_trim (GstMvRecord * self, GstClockTime now)
+{
+  guint i, keep = 0;
+
+  if (self->preroll_time == 0) {
+    gst_mv_record_ring_drop (self, self->ring_len);
+    return;
+  }
+
+  if (!GST_CLOCK_TIME_IS_VALID (now))
+    return;
+
+  for (i = 1; i < self->ring_len; i++) {
+    GstBuffer *buf = RING_AT (self, i);
+    GstClockTime ts;
+
+    if (!IS_KEYFRAME (buf))
+      continue;
+
+    ts = buffer_time (buf);
+    if (!GST_CLOCK_TIME_IS_VALID (ts) || now < ts + self->preroll_time)
+      break;
+    keep = i;
+  }
+
+  gst_mv_record_ring_drop (self, keep);
+}
+
+/* takes ownership of @buf */
+static void
+gst_mv_record_ring_push (GstMvRecord * self, GstBuffer * buf)
+{
+  gboolean keyframe = IS_KEYFRAME (buf);
+
+  if (keyframe)
+    gst_mv_record_ring_trim (self, buffer_time (buf));
+
+  if (self->ring_len == self->ring_alloc) {
+    guint i;
+
+    /* out of slots, give up the oldest GOP */
+    for (i = 1; i < self->ring_len; i++)
+      if (IS_KEYFRAME (RING_AT (self, i)))
+        break;
+
+    if (i == self->ring_len)
+      GST_WARNING_OBJECT (self, "GOP longer than ring-size %u, dropping it",
+          self->ring_alloc);
+    gst_mv_record_ring_drop (self, i);
+  }
+
+  /* a pre-roll that does not start with a key frame is useless */
+  if (self->ring_len == 0 && !keyframe) {
+    gst_buffer_unref (buf);
+    return;
+  }
+
+  RING_AT (self, self->ring_len) = buf;
+  self->ring_len++;
+}
+
+static void
+gst_mv_record_ring_clear (GstMvRecord * self)
+{
+  if (self->ring)
+    gst_mv_record_ring_drop (self, self->ring_len);
+}
+
+static GstFlowReturn
+gst_mv_record_ring_flush (GstMvRecord * self)
+{
+  GstBufferList *list;
+  guint i;
+
+  if (self->ring_len == 0)
+    return GST_FLOW_OK;
+
+  list = gst_buffer_list_new_sized (self->ring_len);
+  for (i = 0; i < self->ring_len; i++) {
+    gst_buffer_list_add (list, RING_AT (self, i));
+    RING_AT (self, i) = NULL;
+  }
+  self->ring_len = 0;
+  self->ring_head = 0;
+
+  /* the ring continues past the frames dropped before it, DISCONT marks
+   * that gap */
+  if (gst_buffer_list_length (list) > 0) {
+    GstBuffer *first = gst_buffer_list_get_writable (list, 0);
+    GST_BUFFER_FLAG_SET (first, GST_BUFFER_FLAG_DISCONT);
+  }
+
+  return gst_pad_push_list (self->srcpad, list);
+}
+
+static void
+gst_mv_record_post (GstMvRecord * self, GstClockTime ts, gboolean recording)
+{
+  GstClockTime running_time;
+  GstStructure *s;
+
+  running_time = gst_segment_to_running_time (&self->segment,
+      GST_FORMAT_TIME, ts);
+
+  GST_INFO_OBJECT (self, "recording %s at %" GST_TIME_FORMAT,
+      recording ? "started" : "stopped", GST_TIME_ARGS (ts));
+
+  s = gst_structure_new ("mv-record",
+      "recording", G_TYPE_BOOLEAN, recording,
+      "timestamp", G_TYPE_UINT64, ts,
+      "running-time", G_TYPE_UINT64, running_time, NULL);
+
+  gst_element_post_message (GST_ELEMENT (self),
+      gst_message_new_element (GST_OBJECT (self), s));
+}
+
+static gboolean
+gst_mv_record_has_motion (GstMvRecord * self, GstBuffer * buf)
+{
+  const metadata_MV *field;
+  const MVInfo *mvs;
+  GstMvActivity activity;
+  guint n_vectors;
+
+  field = gst_mv_buffer_get_field (buf);
+  if (field == NULL)
+    return FALSE;
+
+  mvs = gst_mv_field_get_vectors (field, &n_vectors);
+  if (n_vectors == 0)
+    return FALSE;
+
+  gst_mv_compute_activity (mvs, n_vectors, self->motion_threshold, &activity);
+
+  return activity.n_moving > 0 && activity.moving_ratio >= self->trigger_ratio;
+}
+
+static GstFlowReturn
+gst_mv_record_chain (GstPad * pad, GstObject * parent, GstBuffer * buf)
+{
+  GstMvRecord *self = GST_MV_RECORD (parent);
+  GstClockTime ts = buffer_time (buf);
+  gboolean trigger;
+  GstFlowReturn ret;
+
+  GST_OBJECT_LOCK (self);
+  trigger = self->pending_trigger;
+  self->pending_trigger = FALSE;
+  GST_OBJECT_UNLOCK (self);
+
+  if (gst_mv_record_has_motion (self, buf))
+    trigger = TRUE;
+
+  if (trigger && GST_CLOCK_TIME_IS_VALID (ts))
+    self->last_motion = ts;
+
+  if (self->recording) {
+    /* stop on a key frame so that the next segment starts cleanly */
+    if (!trigger && IS_KEYFRAME (buf) && GST_CLOCK_TIME_IS_VALID (ts) &&
+        GST_CLOCK_TIME_IS_VALID (self->last_motion) &&
+        ts >= self->last_motion + self->hold_time) {
+      self->recording = FALSE;
+      gst_mv_record_post (self, ts, FALSE);
+      gst_mv_record_ring_push (self, buf);
+      return GST_FLOW_OK;
+    }
+
+    return gst_pad_push (self->srcpad, buf);
+  }
+
+  gst_mv_record_ring_push (self, buf);
+
+  if (!trigger)
+    return GST_FLOW_OK;
+
+  if (self->ring_len == 0) {
+    /* nothing decodable yet, wait for the next key frame */
+    GST_OBJECT_LOCK (self);
+    self->pending_trigger = TRUE;
+    GST_OBJECT_UNLOCK (self);
+    return GST_FLOW_OK;
+  }
+
+  self->recording = TRUE;
+  gst_mv_record_post (self, buffer_time (RING_AT (self, 0)), TRUE);
+
+  ret = gst_mv_record_ring_flush (self);
+  if (ret != GST_FLOW_OK)
+    GST_DEBUG_OBJECT (self, "pushing pre-roll returned %s",
+        gst_flow_get_name (ret));
+
+  return ret;
+}
+
+static gboolean
+gst_mv_record_handle_trigger (GstMvRecord * self, GstEvent * event)
+{
+  if (!gst_event_has_name (event, GST_MV_RECORD_TRIGGER))
+    return FALSE;
+
+  GST_DEBUG_OBJECT (self, "trigger event received");
+
+  GST_OBJECT_LOCK (self);
+  self->pending_trigger = TRUE;
+  GST_OBJECT_UNLOCK (self);
+
+  gst_event_unref (event);
+  return TRUE;
+}
+
+static gboolean
+gst_mv_record_sink_event (GstPad * pad, GstObject * parent, GstEvent * event)
+{
+  GstMvRecord *self = GST_MV_RECORD (parent);
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_SEGMENT:
+      gst_event_copy_segment (event, &self->segment);
+      break;
+    case GST_EVENT_FLUSH_STOP:
+      gst_mv_record_ring_clear (self);
+      self->recording = FALSE;
+      self->last_motion = GST_CLOCK_TIME_NONE;
+      break;
+    case GST_EVENT_CUSTOM_DOWNSTREAM:
+    case GST_EVENT_CUSTOM_BOTH:
+      if (gst_mv_record_handle_trigger (self, event))
+        return TRUE;
+      break;
+    default:
+      break;
+  }
+
+  return gst_pad_event_default (pad, parent, event);
+}
+
+static gboolean
+gst_mv_record_src_event (GstPad * pad, GstObject * parent, GstEvent * event)
+{
+  GstMvRecord *self = GST_MV_RECORD (parent);
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_CUSTOM_UPSTREAM:
+    case GST_EVENT_CUSTOM_BOTH:
+      if (gst_mv_record_handle_trigger (self, event))
+        return TRUE;
+      break;
+    default:
+      break;
+  }
+
+  return gst_pad_event_default (pad, parent, event);
+}
+
+static void
+gst_mv_record_reset (GstMvRecord * self)
+{
+  gst_mv_record_ring_clear (self);
+  gst_segment_init (&self->segment, GST_FORMAT_TIME);
+  self->recording = FALSE;
+  self->last_motion = GST_CLOCK_TIME_NONE;
+  self->pending_trigger = FALSE;
+}
+
+static GstStateChangeReturn
+gst_mv_record_change_state (GstElement * element, GstStateChange transition)
+{
+  GstMvRecord *self = GST_MV_RECORD (element);
+  GstStateChangeReturn ret;
+
+  switch (transition) {
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+      self->ring_alloc = self->ring_size;
+      self->ring = g_new0 (GstBuffer *, self->ring_alloc);
+      gst_mv_record_reset (self);
+      break;
+    default:
+      break;
+  }
+
+  ret = GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
+
+  switch (transition) {
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      gst_mv_record_reset (self);
+      g_free (self->ring);
+      self->ring = NULL;
+      self->ring_alloc = 0;
+      break;
+    default:
+      break;
+  }
+
+  return ret;
+}
+
+static void
+gst_mv_record_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstMvRecord *self = GST_MV_RECORD (object);
+
+  switch (prop_id) {
+    case PROP_PREROLL_TIME:
+      self->preroll_time = g_value_get_uint64 (value);
+      break;
+    case PROP_HOLD_TIME:
+      self->hold_time = g_value_get_uint64 (value);
+      break;
+    case PROP_RING_SIZE:
+      self->ring_size = g_value_get_uint (value);
+      break;
+    case PROP_MOTION_THRESHOLD:
+      self->motion_threshold = g_value_get_uint (value);
+      break;
+    case PROP_TRIGGER_RATIO:
+      self->trigger_ratio = g_value_get_double (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_mv_record_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstMvRecord *self = GST_MV_RECORD (object);
+
+  switch (prop_id) {
+    case PROP_PREROLL_TIME:
+      g_value_set_uint64 (value, self->preroll_time);
+      break;
+    case PROP_HOLD_TIME:
+      g_value_set_uint64 (value, self->hold_time);
+      break;
+    case PROP_RING_SIZE:
+      g_value_set_uint (value, self->ring_size);
+      break;
+    case PROP_MOTION_THRESHOLD:
+      g_value_set_uint (value, self->motion_threshold);
+      break;
+    case PROP_TRIGGER_RATIO:
+      g_value_set_double (value, self->trigger_ratio);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_mv_record_class_init (GstMvRecordClass * klass)
+{
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+  GstElementClass *element_class = (GstElementClass *) klass;
+
+  GST_DEBUG_CATEGORY_INIT (gst_mv_record_debug, "nvmvrecord", 0,
+      "Motion triggered recording");
+
+  gobject_class->set_property = gst_mv_record_set_property;
+  gobject_class->get_property = gst_mv_record_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_PREROLL_TIME,
+      g_param_spec_uint64 ("preroll-time", "Pre-roll time",
+          "Time in ns of stream kept before a trigger, rounded up to a GOP",
+          0, G_MAXUINT64, DEFAULT_PREROLL_TIME,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property (gobject_class, PROP_HOLD_TIME,
+      g_param_spec_uint64 ("hold-time", "Hold time",
+          "Time in ns without motion after which the recording stops\n"
+          "\t\t\t on the next key frame",
+          0, G_MAXUINT64, DEFAULT_HOLD_TIME,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property (gobject_class, PROP_RING_SIZE,
+      g_param_spec_uint ("ring-size", "Ring size",
+          "Maximum number of access units held in the pre-roll ring",
+          1, G_MAXUINT16, DEFAULT_RING_SIZE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_MOTION_THRESHOLD,
+      g_param_spec_uint ("motion-threshold", "Motion threshold",
+          "Minimum |mv_x| + |mv_y| for a block to be considered moving",
+          0, G_MAXUINT, DEFAULT_MOTION_THRESHOLD,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property (gobject_class, PROP_TRIGGER_RATIO,
+      g_param_spec_double ("trigger-ratio", "Trigger ratio",
+          "Share of moving blocks that starts a recording",
+          0.0, 1.0, DEFAULT_TRIGGER_RATIO,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_PLAYING));
+
+  gst_element_class_add_static_pad_template (element_class,
+      &gst_mv_record_sink_template);
+  gst_element_class_add_static_pad_template (element_class,
+      &gst_mv_record_src_template);
+
+  gst_element_class_set_static_metadata (element_class,
+      "Motion triggered recorder",
+      "Filter/Video",
+      "Buffers encoded video in a GOP aligned pre-roll and outputs it\n"
+      "\t\t\t only around motion",
+      "lagurus <https://github.com/lagurus>");
+
+  element_class->change_state = GST_DEBUG_FUNCPTR (gst_mv_record_change_state);
+}
+
+static void
+gst_mv_record_init (GstMvRecord * self)
+{
+  self->sinkpad =
+      gst_pad_new_from_static_template (&gst_mv_record_sink_template, "sink");
+  gst_pad_set_chain_function (self->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_mv_record_chain));
+  gst_pad_set_event_function (self->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_mv_record_sink_event));
+  GST_PAD_SET_PROXY_CAPS (self->sinkpad);
+  GST_PAD_SET_PROXY_ALLOCATION (self->sinkpad);
+  gst_element_add_pad (GST_ELEMENT (self), self->sinkpad);
+
+  self->srcpad =
+      gst_pad_new_from_static_template (&gst_mv_record_src_template, "src");
+  gst_pad_set_event_function (self->srcpad,
+      GST_DEBUG_FUNCPTR (gst_mv_record_src_event));
+  GST_PAD_SET_PROXY_CAPS (self->srcpad);
+  gst_element_add_pad (GST_ELEMENT (self), self->srcpad);
+
+  self->preroll_time = DEFAULT_PREROLL_TIME;
+  self->hold_time = DEFAULT_HOLD_TIME;
+  self->ring_size = DEFAULT_RING_SIZE;
+  self->motion_threshold = DEFAULT_MOTION_THRESHOLD;
+  self->trigger_ratio = DEFAULT_TRIGGER_RATIO;
+
+  gst_segment_init (&self->segment, GST_FORMAT_TIME);
+  self->last_motion = GST_CLOCK_TIME_NONE;
+}
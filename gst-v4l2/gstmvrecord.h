@@ -0,0 +1,82 @@
+/*
+ * gstmvrecord.h: motion triggered recording with a GOP aligned pre-roll
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MV_RECORD_H__
+#define __GST_MV_RECORD_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_MV_RECORD \
+  (gst_mv_record_get_type())
+#define GST_MV_RECORD(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_MV_RECORD,GstMvRecord))
+#define GST_MV_RECORD_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_MV_RECORD,GstMvRecordClass))
+#define GST_IS_MV_RECORD(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_MV_RECORD))
+#define GST_IS_MV_RECORD_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_MV_RECORD))
+
+/* name of the custom event structure that starts a recording */
+#define GST_MV_RECORD_TRIGGER "mv-record-trigger"
+
+typedef struct _GstMvRecord GstMvRecord;
+typedef struct _GstMvRecordClass GstMvRecordClass;
+
+struct _GstMvRecord
+{
+  GstElement parent;
+
+  GstPad *sinkpad;
+  GstPad *srcpad;
+
+  /* properties */
+  GstClockTime preroll_time;
+  GstClockTime hold_time;
+  guint ring_size;
+  guint motion_threshold;
+  gdouble trigger_ratio;
+
+  /* < private > */
+  /* pre-roll ring of access units, always starts with a key frame */
+  GstBuffer **ring;
+  guint ring_alloc;
+  guint ring_head;
+  guint ring_len;
+
+  GstSegment segment;
+  gboolean recording;
+  GstClockTime last_motion;
+
+  /* set from an upstream event, protected by the object lock */
+  gboolean pending_trigger;
+};
+
+struct _GstMvRecordClass
+{
+  GstElementClass parent_class;
+};
+
+GType gst_mv_record_get_type (void);
+
+G_END_DECLS
+
+#endif /* __GST_MV_RECORD_H__ */
@@ -0,0 +1,479 @@
+/*
+ * gstmvsei.c: motion vector field carried in a user_data_unregistered SEI
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Layout of the SEI payload, after the 16 byte UUID:
+ *
+ *   u8      version (GST_MV_SEI_VERSION)
+ *   u8      flags (GST_MV_SEI_FLAG_*)
+ *   varint  number of vectors
+ *   varint  AvgQP, FrameMinQP, FrameMaxQP, EncodedFrameBits
+ *           (only with GST_MV_SEI_FLAG_STATS)
+ *   vectors, packed by gst_mv_pack()
+ *
+ * Varints are little endian base 128. A still frame costs a handful of bytes.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "gstmvsei.h"
+#include "gstmvutils.h"
+
+#define SEI_TYPE_USER_DATA_UNREGISTERED   5
+
+#define MV_SEI_MAX_HEADER_SIZE            (16 + 2 + 5 * 5)
+
+/* bound on the vector count accepted from a stream, 8x8 blocks of 8K video */
+#define MV_SEI_MAX_VECTORS                (1 << 20)
+
+static const guint8 mv_sei_uuid[16] = {
+  0x6e, 0x76, 0x6d, 0x76, 0x2d, 0x73, 0x65, 0x69,
+  0x9c, 0x41, 0x4f, 0x27, 0xb1, 0x5a, 0x0d, 0x83
+};
+
+static inline guint8 *
+put_varint (guint8 * p, guint32 v)
+{
+  while (v >= 0x80) {
+    *p++ = (guint8) (v | 0x80);
+    v >>= 7;
+  }
+  *p++ = (guint8) v;
+
+  return p;
+}
+
+static inline guint32
+unzigzag (guint32 v)
+{
+  return (v >> 1) ^ (0u - (v & 1));
+}
+
+/* reads the RBSP of a NAL unit, dropping emulation prevention bytes */
+typedef struct
+{
+  const guint8 *p;
+  const guint8 *end;
+  guint zeros;
+} SeiReader;
+
+static inline gboolean
+read_u8 (SeiReader * r, guint8 * b)
+{
+  if (r->zeros >= 2 && r->p < r->end && *r->p == 0x03) {
+    r->p++;
+    r->zeros = 0;
+  }
+  if (r->p >= r->end)
+    return FALSE;
+
+  *b = *r->p++;
+  r->zeros = *b == 0 ? r->zeros + 1 : 0;
+
+  return TRUE;
+}
+
+static inline gboolean
+read_varint (SeiReader * r, guint32 * v)
+{
+  guint8 b;
+  guint shift;
+
+  *v = 0;
+  for (shift = 0; shift < 35; shift += 7) {
+    if (!read_u8 (r, &b))
+      return FALSE;
+    *v |= (guint32) (b & 0x7f) << shift;
+    if (b < 0x80)
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+static gboolean
+skip_bytes (SeiReader * r, guint32 n)
+{
+  guint8 b;
+
+  while (n-- > 0) {
+    if (!read_u8 (r, &b))
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+static gsize
+write_payload (guint8 * out, const MVInfo * mvs, guint n_vectors,
+    const encoder_stats * stats)
+{
+  guint8 *p = out;
+  guint8 flags = 0;
+
+  if (stats) {
+    flags |= GST_MV_SEI_FLAG_STATS;
+    if (stats->KeyFrame)
+      flags |= GST_MV_SEI_FLAG_KEYFRAME;
+  }
+
+  memcpy (p, mv_sei_uuid, sizeof (mv_sei_uuid));
+  p += sizeof (mv_sei_uuid);
+  *p++ = GST_MV_SEI_VERSION;
+  *p++ = flags;
+  p = put_varint (p, n_vectors);
+
+  if (stats) {
+    p = put_varint (p, stats->AvgQP);
+    p = put_varint (p, stats->FrameMinQP);
+    p = put_varint (p, stats->FrameMaxQP);
+    p = put_varint (p, stats->EncodedFrameBits);
+  }
+
+  p += gst_mv_pack (mvs, n_vectors, p);
+
+  return p - out;
+}
+
+/* copies @size bytes of RBSP to @out adding emulation prevention bytes */
+static gsize
+escape_rbsp (guint8 * out, const guint8 * in, gsize size)
+{
+  guint8 *p = out;
+  guint zeros = 0;
+  gsize i;
+
+  for (i = 0; i < size; i++) {
+    if (zeros >= 2 && in[i] <= 3) {
+      *p++ = 0x03;
+      zeros = 0;
+    }
+    zeros = in[i] == 0 ? zeros + 1 : 0;
+    *p++ = in[i];
+  }
+
+  return p - out;
+}
+
+/**
+ * gst_mv_sei_build:
+ * @field: the motion vectors of the frame
+ * @stats: (allow-none): encoder statistics of the frame
+ * @h265: build an HEVC prefix SEI rather than an H.264 one
+ *
+ * Serialises @field and @stats into a user_data_unregistered SEI NAL unit,
+ * start code included, ready to be placed in a byte-stream access unit.
+ *
+ * Returns: (transfer full): the NAL unit.
+ */
+GstMemory *
+gst_mv_sei_build (const metadata_MV * field, const encoder_stats * stats,
+    gboolean h265)
+{
+  const MVInfo *mvs;
+  guint n_vectors;
+  guint8 *rbsp, *p;
+  gsize payload_size, rbsp_size, max_size, size;
+  GstMemory *mem;
+  GstMapInfo map;
+
+  mvs = gst_mv_field_get_vectors (field, &n_vectors);
+  if (mvs == NULL)
+    n_vectors = 0;
+
+  max_size = MV_SEI_MAX_HEADER_SIZE + GST_MV_PACK_MAX_SIZE (n_vectors);
+  /* payload type, payload size and rbsp trailing bits around the payload */
+  rbsp = g_malloc (1 + max_size / 255 + 1 + max_size + 1);
+
+  payload_size = write_payload (rbsp + 1 + max_size / 255 + 1, mvs,
+      n_vectors, stats);
+
+  p = rbsp;
+  *p++ = SEI_TYPE_USER_DATA_UNREGISTERED;
+  for (size = payload_size; size >= 255; size -= 255)
+    *p++ = 0xff;
+  *p++ = (guint8) size;
+  memmove (p, rbsp + 1 + max_size / 255 + 1, payload_size);
+  p += payload_size;
+  *p++ = 0x80;
+  rbsp_size = p - rbsp;
+
+  /* start code, NAL header and the worst case of emulation prevention */
+  mem = gst_allocator_alloc (NULL, 4 + 2 + rbsp_size * 3 / 2 + 1, NULL);
+  gst_memory_map (mem, &map, GST_MAP_WRITE);
+
+  p = map.data;
+  *p++ = 0x00;
+  *p++ = 0x00;
+  *p++ = 0x00;
+  *p++ = 0x01;
+  if (h265) {
+    /* PREFIX_SEI_NUT, layer 0, temporal id 0 */
+    *p++ = 0x4e;
+    *p++ = 0x01;
+  } else {
+    *p++ = 0x06;
+  }
+  p += escape_rbsp (p, rbsp, rbsp_size);
+  size = p - map.data;
+
+  gst_memory_unmap (mem, &map);
+  gst_memory_resize (mem, 0, size);
+  g_free (rbsp);
+
+  return mem;
+}
+
+static gboolean
+read_payload (SeiReader * r, GArray * vectors, encoder_stats * stats)
+{
+  guint8 version, flags;
+  guint32 n_vectors, run, v[4], dx, dy;
+  guint32 x = 0, y = 0;
+  MVInfo mv = { 0 }, *out;
+  guint i = 0;
+
+  if (!read_u8 (r, &version) || version != GST_MV_SEI_VERSION ||
+      !read_u8 (r, &flags) || !read_varint (r, &n_vectors) ||
+      n_vectors > MV_SEI_MAX_VECTORS)
+    return FALSE;
+
+  if (flags & GST_MV_SEI_FLAG_STATS) {
+    for (i = 0; i < G_N_ELEMENTS (v); i++) {
+      if (!read_varint (r, &v[i]))
+        return FALSE;
+    }
+    stats->bValid = TRUE;
+    stats->KeyFrame = (flags & GST_MV_SEI_FLAG_KEYFRAME) ? TRUE : FALSE;
+    stats->AvgQP = v[0];
+    stats->FrameMinQP = v[1];
+    stats->FrameMaxQP = v[2];
+    stats->EncodedFrameBits = v[3];
+  }
+
+  g_array_set_size (vectors, n_vectors);
+  out = (MVInfo *) vectors->data;
+
+  for (i = 0; i < n_vectors;) {
+    if (!read_varint (r, &run) || run > n_vectors - i)
+      return FALSE;
+    for (; run > 0; run--)
+      out[i++] = mv;
+    if (i == n_vectors)
+      break;
+
+    if (!read_varint (r, &dx) || !read_varint (r, &dy))
+      return FALSE;
+    x += unzigzag (dx);
+    y += unzigzag (dy >> 2);
+    mv.mv_x = (gint32) x;
+    mv.mv_y = (gint32) y;
+    mv.weight = dy & 3;
+    out[i++] = mv;
+  }
+
+  return TRUE;
+}
+
+/* looks for our user_data_unregistered message among the messages of a SEI
+ * NAL unit */
+static gboolean
+read_sei (SeiReader * r, GArray * vectors, encoder_stats * stats)
+{
+  guint8 b, uuid[16];
+  guint32 type, size;
+  guint i;
+
+  for (;;) {
+    type = size = 0;
+    do {
+      if (!read_u8 (r, &b))
+        return FALSE;
+      type += b;
+    } while (b == 0xff);
+    do {
+      if (!read_u8 (r, &b))
+        return FALSE;
+      size += b;
+    } while (b == 0xff);
+
+    if (type == SEI_TYPE_USER_DATA_UNREGISTERED && size >= sizeof (uuid)) {
+      for (i = 0; i < sizeof (uuid); i++) {
+        if (!read_u8 (r, &uuid[i]))
+          return FALSE;
+      }
+      if (memcmp (uuid, mv_sei_uuid, sizeof (uuid)) == 0)
+        return read_payload (r, vectors, stats);
+      size -= sizeof (uuid);
+    }
+
+    if (!skip_bytes (r, size))
+      return FALSE;
+  }
+}
+
+static inline gboolean
+is_sei_nal (const guint8 * nal, gboolean h265)
+{
+  if (h265)
+    return ((nal[0] >> 1) & 0x3f) == 39;
+
+  return (nal[0] & 0x1f) == 6;
+}
+
+static inline gboolean
+is_vcl_nal (const guint8 * nal, gboolean h265)
+{
+  if (h265)
+    return ((nal[0] >> 1) & 0x3f) < 32;
+
+  return (nal[0] & 0x1f) >= 1 && (nal[0] & 0x1f) <= 5;
+}
+
+/* offset of the start code of the first slice of the access unit, the SEI has
+ * to go after the AUD and parameter sets but before any VCL NAL unit */
+static gboolean
+find_first_vcl (const guint8 * data, gsize size, gboolean h265,
+    gsize * offset)
+{
+  const guint8 *p = data, *end = data + size;
+
+  while (end - p > 3) {
+    p = memchr (p, 0x01, end - p - 1);
+    if (p == NULL)
+      break;
+
+    if (p - data >= 2 && p[-1] == 0 && p[-2] == 0 && is_vcl_nal (p + 1, h265)) {
+      p -= 2;
+      if (p > data && p[-1] == 0)
+        p--;
+      *offset = p - data;
+      return TRUE;
+    }
+    p++;
+  }
+
+  return FALSE;
+}
+
+/**
+ * gst_mv_sei_insert:
+ * @buffer: a writable byte-stream access unit carrying a #GstBufferInfoMeta
+ * @h265: whether @buffer holds HEVC
+ *
+ * Places the motion vectors and statistics of the #GstBufferInfoMeta of
+ * @buffer in a SEI NAL unit in front of the first slice of the access unit.
+ * The memory of @buffer is split at that point instead of being copied.
+ *
+ * Returns: %TRUE if a SEI was inserted.
+ */
+gboolean
+gst_mv_sei_insert (GstBuffer * buffer, gboolean h265)
+{
+  const metadata_MV *field;
+  GstMapInfo map;
+  GstMemory *sei;
+  GstBuffer *tail;
+  gsize offset;
+  gboolean found;
+
+  field = gst_mv_buffer_get_field (buffer);
+  if (field == NULL)
+    return FALSE;
+
+  if (!gst_buffer_map (buffer, &map, GST_MAP_READ))
+    return FALSE;
+  found = find_first_vcl (map.data, map.size, h265, &offset);
+  gst_buffer_unmap (buffer, &map);
+
+  if (!found)
+    return FALSE;
+
+  sei = gst_mv_sei_build (field, gst_mv_buffer_get_stats (buffer), h265);
+
+  if (offset == 0) {
+    gst_buffer_prepend_memory (buffer, sei);
+    return TRUE;
+  }
+
+  tail = gst_buffer_copy_region (buffer, GST_BUFFER_COPY_MEMORY, offset, -1);
+  gst_buffer_resize (buffer, 0, offset);
+  gst_buffer_append_memory (buffer, sei);
+  gst_buffer_copy_into (buffer, tail, GST_BUFFER_COPY_MEMORY, 0, -1);
+  gst_buffer_unref (tail);
+
+  return TRUE;
+}
+
+/**
+ * gst_mv_sei_parse:
+ * @data: one byte-stream access unit
+ * @size: size of @data
+ * @h265: whether @data holds HEVC
+ * @vectors: a #GArray of #MVInfo receiving the vectors
+ * @stats: (out): the encoder statistics, with bValid unset when the SEI
+ *   carries none
+ *
+ * Looks for the SEI written by gst_mv_sei_insert() in front of the first
+ * slice of the access unit and decodes it.
+ *
+ * Returns: %TRUE if the SEI was found and decoded.
+ */
+gboolean
+gst_mv_sei_parse (const guint8 * data, gsize size, gboolean h265,
+    GArray * vectors, encoder_stats * stats)
+{
+  const guint8 *p = data, *end = data + size, *next;
+  SeiReader r;
+
+  memset (stats, 0, sizeof (*stats));
+
+  while (end - p > 3) {
+    p = memchr (p, 0x01, end - p - 1);
+    if (p == NULL)
+      break;
+    p++;
+
+    if (p - data < 3 || p[-2] != 0 || p[-3] != 0)
+      continue;
+    if (is_vcl_nal (p, h265))
+      break;
+    if (!is_sei_nal (p, h265))
+      continue;
+
+    /* the NAL unit ends at the next start code */
+    for (next = p; (next = memchr (next, 0x01, end - next)) != NULL; next++) {
+      if (next[-1] == 0 && next[-2] == 0)
+        break;
+    }
+
+    r.p = p + (h265 ? 2 : 1);
+    r.end = next ? next - 2 : end;
+    r.zeros = 0;
+    if (r.p < r.end && read_sei (&r, vectors, stats))
+      return TRUE;
+    memset (stats, 0, sizeof (*stats));
+  }
+
+  return FALSE;
+}
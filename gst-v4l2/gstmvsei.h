@@ -0,0 +1,46 @@
+/*
+ * gstmvsei.h: motion vector field carried in a user_data_unregistered SEI
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MV_SEI_H__
+#define __GST_MV_SEI_H__
+
+#include <gst/gst.h>
+
+#include "gst_buffer_info_meta.h"
+
+G_BEGIN_DECLS
+
+/* version of the payload following the UUID, bumped on incompatible changes */
+#define GST_MV_SEI_VERSION      1
+
+/* flags of the payload */
+#define GST_MV_SEI_FLAG_STATS     (1 << 0)
+#define GST_MV_SEI_FLAG_KEYFRAME  (1 << 1)
+
+GstMemory *gst_mv_sei_build (const metadata_MV * field,
+    const encoder_stats * stats, gboolean h265);
+
+gboolean gst_mv_sei_insert (GstBuffer * buffer, gboolean h265);
+
+gboolean gst_mv_sei_parse (const guint8 * data, gsize size, gboolean h265,
+    GArray * vectors, encoder_stats * stats);
+
+G_END_DECLS
+
+#endif /* __GST_MV_SEI_H__ */
@@ -0,0 +1,555 @@
+/*
+ * gstmvshm.c: shared memory ring of encoded frames and their motion vectors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "gstmvshm.h"
+
+#define MV_SHM_ALIGN(n)         (((n) + 63) & ~(gsize) 63)
+
+/* bound on the object a reader agrees to map */
+#define MV_SHM_MAX_SIZE         ((guint64) 1 << 34)
+
+#define MV_SHM_LOAD(p)          __atomic_load_n ((p), __ATOMIC_ACQUIRE)
+#define MV_SHM_STORE(p, v)      __atomic_store_n ((p), (v), __ATOMIC_RELEASE)
+
+struct _GstMvShmWriter
+{
+  gchar *name;
+  GstMvShmHeader *header;
+  gsize size;
+  guint64 seq;
+};
+
+struct _GstMvShmReader
+{
+  const GstMvShmHeader *header;
+  gsize size;
+  guint64 next_seq;
+  guint64 n_lost;
+};
+
+static gchar *
+gst_mv_shm_object_name (const gchar * name)
+{
+  /* shm_open() wants a single leading slash */
+  return name[0] == '/' ? g_strdup (name) : g_strconcat ("/", name, NULL);
+}
+
+static GstMvShmSlot *
+gst_mv_shm_get_slot (const GstMvShmHeader * header, guint64 seq)
+{
+  return (GstMvShmSlot *) ((guint8 *) header + header->data_offset +
+      ((seq - 1) % header->n_slots) * header->slot_size);
+}
+
+static void
+gst_mv_shm_wake (GstMvShmHeader * header)
+{
+  /* not FUTEX_PRIVATE_FLAG, the readers live in other processes */
+  __atomic_add_fetch (&header->futex, 1, __ATOMIC_RELEASE);
+  syscall (SYS_futex, &header->futex, FUTEX_WAKE, G_MAXINT, NULL, NULL, 0);
+}
+
+static void
+gst_mv_shm_close_stale (const gchar * name)
+{
+  GstMvShmHeader *header;
+  struct stat st;
+  int fd;
+
+  /* a previous writer died without closing, release its readers */
+  fd = shm_open (name, O_RDWR, 0);
+  if (fd < 0)
+    return;
+
+  if (fstat (fd, &st) == 0 && st.st_size >= (off_t) sizeof (GstMvShmHeader)) {
+    header = mmap (NULL, sizeof (GstMvShmHeader), PROT_READ | PROT_WRITE,
+        MAP_SHARED, fd, 0);
+    if (header != MAP_FAILED) {
+      if (memcmp (header->magic, GST_MV_SHM_MAGIC, 8) == 0) {
+        MV_SHM_STORE (&header->closed, 1);
+        gst_mv_shm_wake (header);
+      }
+      munmap (header, sizeof (GstMvShmHeader));
+    }
+  }
+  close (fd);
+
+  shm_unlink (name);
+}
+
+/**
+ * gst_mv_shm_writer_new:
+ * @name: name of the shared memory object
+ * @n_slots: number of frames the ring holds
+ * @max_au_size: largest access unit that can be published
+ * @max_vectors: largest vector field that can be published
+ * @error: return location for a #GError
+ *
+ * Creates the shared memory object @name, replacing any previous one.
+ *
+ * Returns: the writer, or %NULL with @error set.
+ */
+GstMvShmWriter *
+gst_mv_shm_writer_new (const gchar * name, guint n_slots, gsize max_au_size,
+    guint max_vectors, GError ** error)
+{
+  GstMvShmWriter *writer;
+  GstMvShmHeader *header;
+  gsize header_size, slot_size, vectors_offset;
+  int fd;
+
+  g_return_val_if_fail (name != NULL, NULL);
+  g_return_val_if_fail (n_slots > 0, NULL);
+
+  header_size = MV_SHM_ALIGN (sizeof (GstMvShmHeader));
+  vectors_offset = MV_SHM_ALIGN (sizeof (GstMvShmSlot)) +
+      MV_SHM_ALIGN (max_au_size);
+  slot_size = vectors_offset + MV_SHM_ALIGN (max_vectors * sizeof (MVInfo));
+
+  if (slot_size > G_MAXUINT32 ||
+      header_size + (guint64) n_slots * slot_size > MV_SHM_MAX_SIZE) {
+    g_set_error (error, GST_RESOURCE_ERROR, GST_RESOURCE_ERROR_SETTINGS,
+        "%u slots of %" G_GSIZE_FORMAT " bytes do not fit in shared memory",
+        n_slots, slot_size);
+    return NULL;
+  }
+
+  writer = g_new0 (GstMvShmWriter, 1);
+  writer->name = gst_mv_shm_object_name (name);
+  writer->size = header_size + (gsize) n_slots * slot_size;
+
+  gst_mv_shm_close_stale (writer->name);
+
+  fd = shm_open (writer->name, O_RDWR | O_CREAT | O_EXCL, 0644);
+  if (fd < 0) {
+    g_set_error (error, GST_RESOURCE_ERROR, GST_RESOURCE_ERROR_OPEN_WRITE,
+        "shm_open(%s): %s", writer->name, g_strerror (errno));
+    goto fail;
+  }
+
+  if (ftruncate (fd, writer->size) < 0) {
+    g_set_error (error, GST_RESOURCE_ERROR, GST_RESOURCE_ERROR_NO_SPACE_LEFT,
+        "ftruncate(%s): %s", writer->name, g_strerror (errno));
+    close (fd);
+    shm_unlink (writer->name);
+    goto fail;
+  }
+
+  header = mmap (NULL, writer->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close (fd);
+  if (header == MAP_FAILED) {
+    g_set_error (error, GST_RESOURCE_ERROR, GST_RESOURCE_ERROR_OPEN_WRITE,
+        "mmap(%s): %s", writer->name, g_strerror (errno));
+    shm_unlink (writer->name);
+    goto fail;
+  }
+
+  header->version = GST_MV_SHM_VERSION;
+  header->header_size = header_size;
+  header->n_slots = n_slots;
+  header->slot_size = slot_size;
+  header->au_offset = MV_SHM_ALIGN (sizeof (GstMvShmSlot));
+  header->max_au_size = max_au_size;
+  header->vectors_offset = vectors_offset;
+  header->max_vectors = max_vectors;
+  header->data_offset = header_size;
+
+  /* readers that open the object before this point see no magic and retry */
+  __atomic_thread_fence (__ATOMIC_RELEASE);
+  memcpy (header->magic, GST_MV_SHM_MAGIC, 8);
+
+  writer->header = header;
+
+  return writer;
+
+fail:
+  g_free (writer->name);
+  g_free (writer);
+  return NULL;
+}
+
+/**
+ * gst_mv_shm_writer_set_caps:
+ * @writer: a #GstMvShmWriter
+ * @caps: caps of the published stream, as a string
+ *
+ * Returns: %FALSE if @caps does not fit and was truncated.
+ */
+gboolean
+gst_mv_shm_writer_set_caps (GstMvShmWriter * writer, const gchar * caps)
+{
+  GstMvShmHeader *header = writer->header;
+  gsize len;
+
+  MV_SHM_STORE (&header->caps_seq, header->caps_seq + 1);
+  __atomic_thread_fence (__ATOMIC_RELEASE);
+  len = g_strlcpy (header->caps, caps, GST_MV_SHM_CAPS_SIZE);
+  MV_SHM_STORE (&header->caps_seq, header->caps_seq + 1);
+
+  return len < GST_MV_SHM_CAPS_SIZE;
+}
+
+/**
+ * gst_mv_shm_writer_publish:
+ * @writer: a #GstMvShmWriter
+ * @pts: presentation timestamp
+ * @dts: decoding timestamp
+ * @duration: duration
+ * @keyframe: whether the frame can be decoded on its own
+ * @data: the encoded access unit
+ * @size: size of @data
+ * @vectors: (allow-none): the motion vectors of the frame
+ * @n_vectors: number of @vectors
+ * @stats: (allow-none): encoder statistics of the frame
+ *
+ * Copies a frame into the next slot of the ring and wakes up the readers,
+ * overwriting the oldest frame. Never waits for the readers.
+ *
+ * Returns: %FALSE if the frame is larger than a slot and was not published.
+ */
+gboolean
+gst_mv_shm_writer_publish (GstMvShmWriter * writer, guint64 pts, guint64 dts,
+    guint64 duration, gboolean keyframe, const guint8 * data, gsize size,
+    const MVInfo * vectors, guint n_vectors, const encoder_stats * stats)
+{
+  GstMvShmHeader *header = writer->header;
+  GstMvShmSlot *slot;
+  guint64 seq;
+
+  if (size > header->max_au_size || n_vectors > header->max_vectors)
+    return FALSE;
+
+  seq = ++writer->seq;
+  slot = gst_mv_shm_get_slot (header, seq);
+
+  /* readers still holding the previous frame of the slot see it change */
+  MV_SHM_STORE (&slot->seq_begin, seq);
+  __atomic_thread_fence (__ATOMIC_RELEASE);
+
+  slot->pts = pts;
+  slot->dts = dts;
+  slot->duration = duration;
+  slot->flags = keyframe ? GST_MV_SHM_FRAME_KEYFRAME : 0;
+  slot->au_size = size;
+  slot->n_vectors = n_vectors;
+  if (stats && stats->bValid) {
+    slot->stats = *stats;
+    slot->flags |= GST_MV_SHM_FRAME_STATS;
+  } else {
+    memset (&slot->stats, 0, sizeof (slot->stats));
+  }
+  memcpy ((guint8 *) slot + header->au_offset, data, size);
+  if (n_vectors)
+    memcpy ((guint8 *) slot + header->vectors_offset, vectors,
+        n_vectors * sizeof (MVInfo));
+
+  MV_SHM_STORE (&slot->seq_end, seq);
+  MV_SHM_STORE (&header->write_seq, seq);
+
+  gst_mv_shm_wake (header);
+
+  return TRUE;
+}
+
+/**
+ * gst_mv_shm_writer_close:
+ * @writer: a #GstMvShmWriter
+ *
+ * Marks the ring closed, wakes up the readers and removes the name of the
+ * object. Readers keep their mapping until they free their reader.
+ */
+void
+gst_mv_shm_writer_close (GstMvShmWriter * writer)
+{
+  MV_SHM_STORE (&writer->header->closed, 1);
+  gst_mv_shm_wake (writer->header);
+
+  munmap (writer->header, writer->size);
+  shm_unlink (writer->name);
+
+  g_free (writer->name);
+  g_free (writer);
+}
+
+/**
+ * gst_mv_shm_reader_new:
+ * @name: name of the shared memory object
+ * @error: return location for a #GError
+ *
+ * Maps the ring @name read only. The reader starts with the first frame
+ * published after this call.
+ *
+ * Returns: the reader, or %NULL with @error set.
+ */
+GstMvShmReader *
+gst_mv_shm_reader_new (const gchar * name, GError ** error)
+{
+  GstMvShmReader *reader;
+  const GstMvShmHeader *header;
+  gchar *object_name;
+  struct stat st;
+  int fd;
+
+  g_return_val_if_fail (name != NULL, NULL);
+
+  object_name = gst_mv_shm_object_name (name);
+  fd = shm_open (object_name, O_RDONLY, 0);
+  if (fd < 0) {
+    g_set_error (error, GST_RESOURCE_ERROR, GST_RESOURCE_ERROR_OPEN_READ,
+        "shm_open(%s): %s", object_name, g_strerror (errno));
+    g_free (object_name);
+    return NULL;
+  }
+
+  if (fstat (fd, &st) < 0 || st.st_size < (off_t) sizeof (GstMvShmHeader) ||
+      (guint64) st.st_size > MV_SHM_MAX_SIZE) {
+    g_set_error (error, GST_RESOURCE_ERROR, GST_RESOURCE_ERROR_OPEN_READ,
+        "%s is not ready", object_name);
+    goto fail;
+  }
+
+  header = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (header == MAP_FAILED) {
+    g_set_error (error, GST_RESOURCE_ERROR, GST_RESOURCE_ERROR_OPEN_READ,
+        "mmap(%s): %s", object_name, g_strerror (errno));
+    goto fail;
+  }
+
+  if (memcmp (header->magic, GST_MV_SHM_MAGIC, 8) != 0) {
+    g_set_error (error, GST_RESOURCE_ERROR, GST_RESOURCE_ERROR_OPEN_READ,
+        "%s is not ready", object_name);
+    goto fail_unmap;
+  }
+  __atomic_thread_fence (__ATOMIC_ACQUIRE);
+
+  if (header->version != GST_MV_SHM_VERSION || header->n_slots == 0 ||
+      header->au_offset < sizeof (GstMvShmSlot) ||
+      (guint64) header->au_offset + header->max_au_size >
+      header->vectors_offset ||
+      (guint64) header->vectors_offset +
+      (guint64) header->max_vectors * sizeof (MVInfo) > header->slot_size ||
+      header->data_offset < sizeof (GstMvShmHeader) ||
+      header->data_offset + (guint64) header->n_slots * header->slot_size >
+      (guint64) st.st_size) {
+    g_set_error (error, GST_STREAM_ERROR, GST_STREAM_ERROR_WRONG_TYPE,
+        "%s has an unsupported layout", object_name);
+    goto fail_unmap;
+  }
+
+  close (fd);
+  g_free (object_name);
+
+  reader = g_new0 (GstMvShmReader, 1);
+  reader->header = header;
+  reader->size = st.st_size;
+  reader->next_seq = MV_SHM_LOAD (&header->write_seq) + 1;
+
+  return reader;
+
+fail_unmap:
+  munmap ((gpointer) header, st.st_size);
+fail:
+  close (fd);
+  g_free (object_name);
+  return NULL;
+}
+
+static gboolean
+gst_mv_shm_reader_wait (GstMvShmReader * reader, gint64 end_time)
+{
+  const GstMvShmHeader *header = reader->header;
+  struct timespec ts, *timeout = NULL;
+  guint32 futex;
+  gint64 left;
+
+  futex = MV_SHM_LOAD (&header->futex);
+  if (MV_SHM_LOAD (&header->write_seq) >= reader->next_seq ||
+      MV_SHM_LOAD (&header->closed))
+    return TRUE;
+
+  if (end_time >= 0) {
+    left = end_time - g_get_monotonic_time ();
+    if (left <= 0)
+      return FALSE;
+    ts.tv_sec = left / G_USEC_PER_SEC;
+    ts.tv_nsec = (left % G_USEC_PER_SEC) * 1000;
+    timeout = &ts;
+  }
+
+  /* returns at once if the writer moved on since futex was read */
+  syscall (SYS_futex, &header->futex, FUTEX_WAIT, futex, timeout, NULL, 0);
+
+  return TRUE;
+}
+
+/**
+ * gst_mv_shm_reader_next:
+ * @reader: a #GstMvShmReader
+ * @frame: (out caller-allocates): the frame
+ * @timeout_us: how long to wait for a frame, -1 to wait forever, 0 to not
+ *     wait at all
+ *
+ * Returns the next frame of the ring. A reader that fell more than the size
+ * of the ring behind skips to the oldest frame still there, @frame->n_lost
+ * tells how many it missed.
+ *
+ * Returns: #GST_MV_SHM_OK with @frame filled, #GST_MV_SHM_TIMEOUT, or
+ *     #GST_MV_SHM_CLOSED once the writer closed and every frame was read.
+ */
+GstMvShmStatus
+gst_mv_shm_reader_next (GstMvShmReader * reader, GstMvShmFrame * frame,
+    gint64 timeout_us)
+{
+  const GstMvShmHeader *header = reader->header;
+  const GstMvShmSlot *slot;
+  gint64 end_time = -1;
+  guint64 latest, n_lost = 0;
+
+  if (timeout_us >= 0)
+    end_time = g_get_monotonic_time () + timeout_us;
+
+  while (TRUE) {
+    latest = MV_SHM_LOAD (&header->write_seq);
+
+    if (latest < reader->next_seq) {
+      if (MV_SHM_LOAD (&header->closed)) {
+        /* a frame may have been published right before closing */
+        if (MV_SHM_LOAD (&header->write_seq) < reader->next_seq)
+          return GST_MV_SHM_CLOSED;
+        continue;
+      }
+      if (!gst_mv_shm_reader_wait (reader, end_time))
+        return GST_MV_SHM_TIMEOUT;
+      continue;
+    }
+
+    if (latest - reader->next_seq >= header->n_slots) {
+      n_lost += latest - header->n_slots + 1 - reader->next_seq;
+      reader->next_seq = latest - header->n_slots + 1;
+    }
+
+    slot = gst_mv_shm_get_slot (header, reader->next_seq);
+    if (MV_SHM_LOAD (&slot->seq_end) != reader->next_seq)
+      goto overrun;
+
+    frame->seq = reader->next_seq;
+    frame->pts = slot->pts;
+    frame->dts = slot->dts;
+    frame->duration = slot->duration;
+    frame->flags = slot->flags;
+    frame->size = MIN (slot->au_size, header->max_au_size);
+    frame->n_vectors = MIN (slot->n_vectors, header->max_vectors);
+    frame->stats = slot->stats;
+    frame->data = (const guint8 *) slot + header->au_offset;
+    frame->vectors =
+        (const MVInfo *) ((const guint8 *) slot + header->vectors_offset);
+
+    if (!gst_mv_shm_reader_release (reader, frame))
+      goto overrun;
+
+    reader->next_seq++;
+    reader->n_lost += n_lost;
+    frame->n_lost = n_lost;
+
+    return GST_MV_SHM_OK;
+
+  overrun:
+    /* the writer lapped us while we were reading the slot */
+    n_lost++;
+    reader->next_seq++;
+  }
+}
+
+/**
+ * gst_mv_shm_reader_release:
+ * @reader: a #GstMvShmReader
+ * @frame: a frame returned by gst_mv_shm_reader_next()
+ *
+ * Checks that the writer did not start overwriting @frame, everything read
+ * from its data and vectors before this call is then valid.
+ *
+ * Returns: %TRUE if @frame was intact.
+ */
+gboolean
+gst_mv_shm_reader_release (GstMvShmReader * reader, const GstMvShmFrame * frame)
+{
+  const GstMvShmSlot *slot = gst_mv_shm_get_slot (reader->header, frame->seq);
+
+  __atomic_thread_fence (__ATOMIC_ACQUIRE);
+
+  return __atomic_load_n (&slot->seq_begin, __ATOMIC_RELAXED) == frame->seq;
+}
+
+/**
+ * gst_mv_shm_reader_get_caps:
+ * @reader: a #GstMvShmReader
+ *
+ * Returns: (transfer full): the caps the writer published, as a string,
+ *     empty before the writer knows them.
+ */
+gchar *
+gst_mv_shm_reader_get_caps (GstMvShmReader * reader)
+{
+  const GstMvShmHeader *header = reader->header;
+  gchar *caps = g_malloc (GST_MV_SHM_CAPS_SIZE);
+  guint32 seq;
+
+  do {
+    while ((seq = MV_SHM_LOAD (&header->caps_seq)) & 1)
+      g_usleep (100);
+    memcpy (caps, header->caps, GST_MV_SHM_CAPS_SIZE);
+    __atomic_thread_fence (__ATOMIC_ACQUIRE);
+  } while (__atomic_load_n (&header->caps_seq, __ATOMIC_RELAXED) != seq);
+
+  caps[GST_MV_SHM_CAPS_SIZE - 1] = '\0';
+
+  return caps;
+}
+
+/**
+ * gst_mv_shm_reader_get_n_lost:
+ * @reader: a #GstMvShmReader
+ *
+ * Returns: the number of frames @reader missed because it fell behind.
+ */
+guint64
+gst_mv_shm_reader_get_n_lost (GstMvShmReader * reader)
+{
+  return reader->n_lost;
+}
+
+void
+gst_mv_shm_reader_free (GstMvShmReader * reader)
+{
+  munmap ((gpointer) reader->header, reader->size);
+  g_free (reader);
+}
@@ -0,0 +1,165 @@
+/*
+ * gstmvshm.h: shared memory ring of encoded frames and their motion vectors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MV_SHM_H__
+#define __GST_MV_SHM_H__
+
+#include <glib.h>
+
+#include "gst_buffer_info_meta.h"
+
+G_BEGIN_DECLS
+
+#define GST_MV_SHM_MAGIC            "GSTMVSHM"
+#define GST_MV_SHM_VERSION          1
+#define GST_MV_SHM_CAPS_SIZE        4096
+
+#define GST_MV_SHM_FRAME_KEYFRAME   (1 << 0)
+#define GST_MV_SHM_FRAME_STATS      (1 << 1)
+
+typedef struct _GstMvShmHeader GstMvShmHeader;
+typedef struct _GstMvShmSlot GstMvShmSlot;
+typedef struct _GstMvShmFrame GstMvShmFrame;
+typedef struct _GstMvShmWriter GstMvShmWriter;
+typedef struct _GstMvShmReader GstMvShmReader;
+
+/*
+ * The shared memory object is a GstMvShmHeader followed by n_slots slots of
+ * slot_size bytes, from data_offset on. A slot is a GstMvShmSlot, the access
+ * unit at au_offset and the vectors at vectors_offset from the start of the
+ * slot. Everything is 64 byte aligned.
+ *
+ * There is a single writer. Frame number s, counted from 1, goes to slot
+ * (s - 1) % n_slots. The writer stores s in seq_begin, fills the slot, stores
+ * s in seq_end and then in write_seq, bumps futex and wakes the readers
+ * waiting on it. Readers never write to the object: a reader holding frame s
+ * knows its copy is intact as long as seq_begin still reads s, and that it
+ * fell behind when write_seq moved more than n_slots past the frame it wants.
+ */
+
+struct _GstMvShmHeader
+{
+  gchar magic[8];
+  guint32 version;
+  guint32 header_size;
+  guint32 n_slots;
+  guint32 slot_size;
+  guint32 au_offset;
+  guint32 max_au_size;
+  guint32 vectors_offset;
+  guint32 max_vectors;
+  guint64 data_offset;
+
+  /* last published frame, 0 before the first one */
+  guint64 write_seq;
+  /* changes on every publish and on close, readers wait on it */
+  guint32 futex;
+  guint32 closed;
+
+  /* even while caps is stable, odd while the writer updates it */
+  guint32 caps_seq;
+  guint32 reserved;
+  gchar caps[GST_MV_SHM_CAPS_SIZE];
+};
+
+struct _GstMvShmSlot
+{
+  guint64 seq_begin;
+  guint64 pts;
+  guint64 dts;
+  guint64 duration;
+  guint32 flags;
+  guint32 au_size;
+  guint32 n_vectors;
+  guint32 reserved;
+  encoder_stats stats;
+  guint64 seq_end;
+};
+
+/**
+ * GstMvShmFrame:
+ * @seq: sequence number of the frame
+ * @n_lost: frames the reader missed right before this one
+ * @pts: presentation timestamp, GST_CLOCK_TIME_NONE if unknown
+ * @dts: decoding timestamp, GST_CLOCK_TIME_NONE if unknown
+ * @duration: duration, GST_CLOCK_TIME_NONE if unknown
+ * @flags: GST_MV_SHM_FRAME_* flags
+ * @data: the encoded access unit, in the shared memory
+ * @size: size of @data
+ * @vectors: the motion vectors, in the shared memory
+ * @n_vectors: number of @vectors
+ * @stats: encoder statistics, only meaningful with GST_MV_SHM_FRAME_STATS
+ *
+ * A frame returned by gst_mv_shm_reader_next(). @data and @vectors point into
+ * the ring and may be overwritten by the writer at any time, the frame is
+ * only known to be intact if gst_mv_shm_reader_release() returns TRUE after
+ * the caller is done with it.
+ */
+struct _GstMvShmFrame
+{
+  guint64 seq;
+  guint64 n_lost;
+  guint64 pts;
+  guint64 dts;
+  guint64 duration;
+  guint32 flags;
+  const guint8 *data;
+  gsize size;
+  const MVInfo *vectors;
+  guint n_vectors;
+  encoder_stats stats;
+};
+
+typedef enum
+{
+  GST_MV_SHM_OK,
+  GST_MV_SHM_TIMEOUT,
+  GST_MV_SHM_CLOSED
+} GstMvShmStatus;
+
+GstMvShmWriter *gst_mv_shm_writer_new (const gchar * name, guint n_slots,
+    gsize max_au_size, guint max_vectors, GError ** error);
+
+gboolean gst_mv_shm_writer_set_caps (GstMvShmWriter * writer,
+    const gchar * caps);
+
+gboolean gst_mv_shm_writer_publish (GstMvShmWriter * writer, guint64 pts,
+    guint64 dts, guint64 duration, gboolean keyframe, const guint8 * data,
+    gsize size, const MVInfo * vectors, guint n_vectors,
+    const encoder_stats * stats);
+
+void gst_mv_shm_writer_close (GstMvShmWriter * writer);
+
+GstMvShmReader *gst_mv_shm_reader_new (const gchar * name, GError ** error);
+
+GstMvShmStatus gst_mv_shm_reader_next (GstMvShmReader * reader,
+    GstMvShmFrame * frame, gint64 timeout_us);
+
+gboolean gst_mv_shm_reader_release (GstMvShmReader * reader,
+    const GstMvShmFrame * frame);
+
+gchar *gst_mv_shm_reader_get_caps (GstMvShmReader * reader);
+
+guint64 gst_mv_shm_reader_get_n_lost (GstMvShmReader * reader);
+
+void gst_mv_shm_reader_free (GstMvShmReader * reader);
+
+G_END_DECLS
+
+#endif /* __GST_MV_SHM_H__ */
@@ -0,0 +1,281 @@
+/*
+ * gstmvshmsink.c: publishes encoded frames in shared memory
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * SECTION:element-nvmvshmsink
+ *
+ * Copies every access unit it receives, together with the vectors and
+ * statistics of its #GstBufferInfoMeta, into a ring of n-slots frames in the
+ * POSIX shared memory object shm-name. The writer never waits: any number of
+ * local processes read the ring with the reader of gstmvshm.h, straight from
+ * their mapping, and learn from the sequence numbers of the frames when they
+ * fell behind and lost some.
+ *
+ * The object is removed when the element stops, readers then get
+ * GST_MV_SHM_CLOSED once they read the last frame.
+ *
+ * |[
+ * gst-launch-1.0 v4l2src ! nvvidconv ! nvv4l2h264enc EnableMVBufferMeta=1 !
+ *     h264parse config-interval=-1 ! video/x-h264,stream-format=byte-stream,alignment=au !
+ *     nvmvshmsink shm-name=cam0
+ * ]|
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstmvshmsink.h"
+#include "gstmvutils.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_mv_shm_sink_debug);
+#define GST_CAT_DEFAULT gst_mv_shm_sink_debug
+
+#define DEFAULT_SHM_NAME        "nvmvshm"
+#define DEFAULT_N_SLOTS         32
+#define DEFAULT_MAX_AU_SIZE     (2 * 1024 * 1024)
+
+/* the largest field a GstBufferInfoMeta holds */
+#define MAX_VECTORS \
+  G_N_ELEMENTS (((metadata_MV *) NULL)->rec_mv_info)
+
+enum
+{
+  PROP_0,
+  PROP_SHM_NAME,
+  PROP_N_SLOTS,
+  PROP_MAX_AU_SIZE
+};
+
+static GstStaticPadTemplate gst_mv_shm_sink_sink_template =
+GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS_ANY);
+
+#define gst_mv_shm_sink_parent_class parent_class
+G_DEFINE_TYPE (GstMvShmSink, gst_mv_shm_sink, GST_TYPE_BASE_SINK);
+
+static gboolean
+gst_mv_shm_sink_start (GstBaseSink * sink)
+{
+  GstMvShmSink *self = GST_MV_SHM_SINK (sink);
+  GError *error = NULL;
+
+  if (self->shm_name == NULL || self->shm_name[0] == '\0') {
+    GST_ELEMENT_ERROR (self, RESOURCE, NOT_FOUND,
+        ("No shared memory name specified."), (NULL));
+    return FALSE;
+  }
+
+  self->writer = gst_mv_shm_writer_new (self->shm_name, self->n_slots,
+      self->max_au_size, MAX_VECTORS, &error);
+  if (self->writer == NULL) {
+    GST_ELEMENT_ERROR (self, RESOURCE, OPEN_WRITE,
+        ("Could not create shared memory \"%s\".", self->shm_name),
+        ("%s", error->message));
+    g_error_free (error);
+    return FALSE;
+  }
+
+  self->warned = FALSE;
+
+  return TRUE;
+}
+
+static gboolean
+gst_mv_shm_sink_stop (GstBaseSink * sink)
+{
+  GstMvShmSink *self = GST_MV_SHM_SINK (sink);
+
+  if (self->writer)
+    gst_mv_shm_writer_close (self->writer);
+  self->writer = NULL;
+
+  return TRUE;
+}
+
+static gboolean
+gst_mv_shm_sink_set_caps (GstBaseSink * sink, GstCaps * caps)
+{
+  GstMvShmSink *self = GST_MV_SHM_SINK (sink);
+  gchar *str = gst_caps_to_string (caps);
+
+  if (!gst_mv_shm_writer_set_caps (self->writer, str))
+    GST_WARNING_OBJECT (self, "caps truncated to %d bytes",
+        GST_MV_SHM_CAPS_SIZE - 1);
+  g_free (str);
+
+  return TRUE;
+}
+
+static GstFlowReturn
+gst_mv_shm_sink_render (GstBaseSink * sink, GstBuffer * buf)
+{
+  GstMvShmSink *self = GST_MV_SHM_SINK (sink);
+  const metadata_MV *field;
+  const MVInfo *mvs = NULL;
+  guint n_vectors = 0;
+  GstMapInfo map;
+  gboolean ret;
+
+  field = gst_mv_buffer_get_field (buf);
+  if (field)
+    mvs = gst_mv_field_get_vectors (field, &n_vectors);
+
+  if (!gst_buffer_map (buf, &map, GST_MAP_READ)) {
+    GST_ELEMENT_ERROR (self, RESOURCE, READ, ("Could not map buffer."),
+        (NULL));
+    return GST_FLOW_ERROR;
+  }
+
+  ret = gst_mv_shm_writer_publish (self->writer, GST_BUFFER_PTS (buf),
+      GST_BUFFER_DTS (buf), GST_BUFFER_DURATION (buf),
+      !GST_BUFFER_FLAG_IS_SET (buf, GST_BUFFER_FLAG_DELTA_UNIT),
+      map.data, map.size, mvs, n_vectors, gst_mv_buffer_get_stats (buf));
+
+  gst_buffer_unmap (buf, &map);
+
+  if (!ret) {
+    if (!self->warned)
+      GST_ELEMENT_WARNING (self, RESOURCE, WRITE,
+          ("Dropping access units larger than max-au-size."),
+          ("%" G_GSIZE_FORMAT " bytes, max-au-size is %u", map.size,
+              self->max_au_size));
+    self->warned = TRUE;
+  }
+
+  return GST_FLOW_OK;
+}
+
+static void
+gst_mv_shm_sink_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstMvShmSink *self = GST_MV_SHM_SINK (object);
+
+  switch (prop_id) {
+    case PROP_SHM_NAME:
+      g_free (self->shm_name);
+      self->shm_name = g_value_dup_string (value);
+      break;
+    case PROP_N_SLOTS:
+      self->n_slots = g_value_get_uint (value);
+      break;
+    case PROP_MAX_AU_SIZE:
+      self->max_au_size = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_mv_shm_sink_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstMvShmSink *self = GST_MV_SHM_SINK (object);
+
+  switch (prop_id) {
+    case PROP_SHM_NAME:
+      g_value_set_string (value, self->shm_name);
+      break;
+    case PROP_N_SLOTS:
+      g_value_set_uint (value, self->n_slots);
+      break;
+    case PROP_MAX_AU_SIZE:
+      g_value_set_uint (value, self->max_au_size);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_mv_shm_sink_finalize (GObject * object)
+{
+  GstMvShmSink *self = GST_MV_SHM_SINK (object);
+
+  g_free (self->shm_name);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static void
+gst_mv_shm_sink_class_init (GstMvShmSinkClass * klass)
+{
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+  GstElementClass *element_class = (GstElementClass *) klass;
+  GstBaseSinkClass *basesink_class = (GstBaseSinkClass *) klass;
+
+  GST_DEBUG_CATEGORY_INIT (gst_mv_shm_sink_debug, "nvmvshmsink", 0,
+      "Motion vector shared memory sink");
+
+  gobject_class->set_property = gst_mv_shm_sink_set_property;
+  gobject_class->get_property = gst_mv_shm_sink_get_property;
+  gobject_class->finalize = gst_mv_shm_sink_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_SHM_NAME,
+      g_param_spec_string ("shm-name", "Shared memory name",
+          "Name of the POSIX shared memory object, replaced if it exists",
+          DEFAULT_SHM_NAME,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_N_SLOTS,
+      g_param_spec_uint ("n-slots", "Slots",
+          "Number of frames the ring holds before overwriting the oldest",
+          2, 4096, DEFAULT_N_SLOTS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_AU_SIZE,
+      g_param_spec_uint ("max-au-size", "Maximum access unit size",
+          "Size in bytes of the largest access unit a slot holds, larger ones are dropped",
+          1024, G_MAXINT32, DEFAULT_MAX_AU_SIZE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  gst_element_class_add_static_pad_template (element_class,
+      &gst_mv_shm_sink_sink_template);
+
+  gst_element_class_set_static_metadata (element_class,
+      "Motion vector shared memory sink",
+      "Sink",
+      "Publishes encoded frames and their motion vectors to local readers "
+      "through a shared memory ring",
+      "lagurus <https://github.com/lagurus>");
+
+  basesink_class->start = GST_DEBUG_FUNCPTR (gst_mv_shm_sink_start);
+  basesink_class->stop = GST_DEBUG_FUNCPTR (gst_mv_shm_sink_stop);
+  basesink_class->set_caps = GST_DEBUG_FUNCPTR (gst_mv_shm_sink_set_caps);
+  basesink_class->render = GST_DEBUG_FUNCPTR (gst_mv_shm_sink_render);
+}
+
+static void
+gst_mv_shm_sink_init (GstMvShmSink * self)
+{
+  self->shm_name = g_strdup (DEFAULT_SHM_NAME);
+  self->n_slots = DEFAULT_N_SLOTS;
+  self->max_au_size = DEFAULT_MAX_AU_SIZE;
+
+  gst_base_sink_set_sync (GST_BASE_SINK (self), FALSE);
+}
@@ -0,0 +1,67 @@
+/*
+ * gstmvshmsink.h: publishes encoded frames in shared memory
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MV_SHM_SINK_H__
+#define __GST_MV_SHM_SINK_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstbasesink.h>
+
+#include "gstmvshm.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_MV_SHM_SINK \
+  (gst_mv_shm_sink_get_type())
+#define GST_MV_SHM_SINK(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_MV_SHM_SINK,GstMvShmSink))
+#define GST_MV_SHM_SINK_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_MV_SHM_SINK,GstMvShmSinkClass))
+#define GST_IS_MV_SHM_SINK(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_MV_SHM_SINK))
+#define GST_IS_MV_SHM_SINK_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_MV_SHM_SINK))
+
+typedef struct _GstMvShmSink GstMvShmSink;
+typedef struct _GstMvShmSinkClass GstMvShmSinkClass;
+
+struct _GstMvShmSink
+{
+  GstBaseSink parent;
+
+  /* properties */
+  gchar *shm_name;
+  guint n_slots;
+  guint max_au_size;
+
+  /* < private > */
+  GstMvShmWriter *writer;
+  gboolean warned;
+};
+
+struct _GstMvShmSinkClass
+{
+  GstBaseSinkClass parent_class;
+};
+
+GType gst_mv_shm_sink_get_type (void);
+
+G_END_DECLS
+
+#endif /* __GST_MV_SHM_SINK_H__ */
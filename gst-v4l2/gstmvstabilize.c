@@ -0,0 +1,339 @@
+/*
+ * gstmvstabilize.c: stabilisation offsets from the global motion of the vectors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * SECTION:element-nvmvstabilize
+ *
+ * Follows the camera path from the median vector of each frame's
+ * #GstBufferInfoMeta, smooths it with a Kalman filter and attaches to every
+ * buffer a #GstVideoCropMeta that cuts margin of the frame on each side,
+ * moved by the difference between the measured and the smoothed path. A
+ * scaler that honours the crop meta then outputs a steady picture and no
+ * pixels have to be analysed.
+ *
+ * With affine a #GstVideoAffineTransformationMeta mapping texture
+ * coordinates to the same window is attached instead, for GL based sinks.
+ *
+ * The filter tracks the path as a constant position with process-noise
+ * variance per frame, measured with measurement-noise variance. A larger
+ * process-noise follows the camera more closely, slow pans pass through
+ * while the shake is taken out. Corrections are limited to the margin.
+ *
+ * |[
+ * gst-launch-1.0 rtspsrc ! rtph264depay ! h264parse !
+ *     nvv4l2decoder enable-mv-meta=1 ! nvmvstabilize margin=0.06 !
+ *     glimagesink
+ * ]|
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+
+#include <gst/video/video.h>
+
+#include "gstmvstabilize.h"
+#include "gstmvutils.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_mv_stabilize_debug);
+#define GST_CAT_DEFAULT gst_mv_stabilize_debug
+
+#define DEFAULT_MARGIN              0.05
+#define DEFAULT_PROCESS_NOISE       0.004
+#define DEFAULT_MEASUREMENT_NOISE   0.25
+#define DEFAULT_AFFINE              FALSE
+
+enum
+{
+  PROP_0,
+  PROP_MARGIN,
+  PROP_PROCESS_NOISE,
+  PROP_MEASUREMENT_NOISE,
+  PROP_AFFINE
+};
+
+static GstStaticPadTemplate gst_mv_stabilize_sink_template =
+GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("video/x-raw(ANY)"));
+
+static GstStaticPadTemplate gst_mv_stabilize_src_template =
+GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("video/x-raw(ANY)"));
+
+#define gst_mv_stabilize_parent_class parent_class
+G_DEFINE_TYPE (GstMvStabilize, gst_mv_stabilize, GST_TYPE_BASE_TRANSFORM);
+
+static void
+gst_mv_stabilize_reset (GstMvStabilize * self)
+{
+  self->path[0][0] = self->path[0][1] = 0;
+  self->path[1][0] = self->path[1][1] = 0;
+  self->variance[0] = self->variance[1] = 0;
+}
+
+static void
+gst_mv_stabilize_update (GstMvStabilize * self, gint axis, gdouble motion)
+{
+  gdouble gain;
+
+  self->path[0][axis] += motion;
+
+  /* predict: the camera stays where it is, give or take process_noise */
+  self->variance[axis] += self->process_noise;
+
+  /* correct towards the measured path */
+  gain = self->variance[axis] /
+      (self->variance[axis] + self->measurement_noise);
+  self->path[1][axis] += gain * (self->path[0][axis] - self->path[1][axis]);
+  self->variance[axis] *= 1 - gain;
+}
+
+static GstFlowReturn
+gst_mv_stabilize_transform_ip (GstBaseTransform * trans, GstBuffer * buf)
+{
+  GstMvStabilize *self = GST_MV_STABILIZE (trans);
+  const metadata_MV *field;
+  const MVInfo *mvs = NULL;
+  guint n_vectors = 0;
+  GstMvActivity activity;
+  gint size[2], margin[2], offset[2];
+  gint axis;
+
+  if (self->width <= 0 || self->height <= 0)
+    return GST_FLOW_OK;
+
+  field = gst_mv_buffer_get_field (buf);
+  if (field)
+    mvs = gst_mv_field_get_vectors (field, &n_vectors);
+
+  if (GST_BUFFER_FLAG_IS_SET (buf, GST_BUFFER_FLAG_DISCONT))
+    gst_mv_stabilize_reset (self);
+
+  /* the vectors point from a block to where it was, in quarter pixels, the
+   * picture moved the other way. Intra frames keep the last path. */
+  if (n_vectors > 0) {
+    gst_mv_compute_activity (mvs, n_vectors, 0, &activity);
+    gst_mv_stabilize_update (self, 0, -activity.global_x / 4.0);
+    gst_mv_stabilize_update (self, 1, -activity.global_y / 4.0);
+  }
+
+  size[0] = self->width;
+  size[1] = self->height;
+  for (axis = 0; axis < 2; axis++) {
+    gdouble shake = self->path[0][axis] - self->path[1][axis];
+
+    /* even offsets keep the chroma of subsampled formats aligned */
+    margin[axis] = (gint) (size[axis] * self->margin) & ~1;
+    offset[axis] = margin[axis] + ((gint) lround (shake) & ~1);
+    offset[axis] = CLAMP (offset[axis], 0, 2 * margin[axis]);
+  }
+
+  GST_LOG_OBJECT (self, "path %.1f,%.1f smoothed %.1f,%.1f crop at %d,%d",
+      self->path[0][0], self->path[0][1], self->path[1][0], self->path[1][1],
+      offset[0], offset[1]);
+
+  if (self->affine) {
+    GstVideoAffineTransformationMeta *meta;
+    gfloat matrix[16] = { 0, };
+
+    /* column major, on texture coordinates in [0, 1] */
+    matrix[0] = (gfloat) (size[0] - 2 * margin[0]) / size[0];
+    matrix[5] = (gfloat) (size[1] - 2 * margin[1]) / size[1];
+    matrix[10] = 1;
+    matrix[12] = (gfloat) offset[0] / size[0];
+    matrix[13] = (gfloat) offset[1] / size[1];
+    matrix[15] = 1;
+
+    meta = gst_buffer_add_video_affine_transformation_meta (buf);
+    gst_video_affine_transformation_meta_apply_matrix (meta, matrix);
+  } else {
+    GstVideoCropMeta *crop = gst_buffer_add_video_crop_meta (buf);
+
+    crop->x = offset[0];
+    crop->y = offset[1];
+    crop->width = size[0] - 2 * margin[0];
+    crop->height = size[1] - 2 * margin[1];
+  }
+
+  return GST_FLOW_OK;
+}
+
+static gboolean
+gst_mv_stabilize_set_caps (GstBaseTransform * trans, GstCaps * incaps,
+    GstCaps * outcaps)
+{
+  GstMvStabilize *self = GST_MV_STABILIZE (trans);
+  GstStructure *structure = gst_caps_get_structure (incaps, 0);
+
+  /* the offsets are in pixels of the frame, without its size buffers pass
+   * untouched */
+  if (!gst_structure_get_int (structure, "width", &self->width) ||
+      !gst_structure_get_int (structure, "height", &self->height)) {
+    GST_WARNING_OBJECT (self, "no frame size in caps %" GST_PTR_FORMAT,
+        incaps);
+    self->width = 0;
+    self->height = 0;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+gst_mv_stabilize_sink_event (GstBaseTransform * trans, GstEvent * event)
+{
+  if (GST_EVENT_TYPE (event) == GST_EVENT_FLUSH_STOP)
+    gst_mv_stabilize_reset (GST_MV_STABILIZE (trans));
+
+  return GST_BASE_TRANSFORM_CLASS (parent_class)->sink_event (trans, event);
+}
+
+static gboolean
+gst_mv_stabilize_start (GstBaseTransform * trans)
+{
+  gst_mv_stabilize_reset (GST_MV_STABILIZE (trans));
+  return TRUE;
+}
+
+static void
+gst_mv_stabilize_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstMvStabilize *self = GST_MV_STABILIZE (object);
+
+  switch (prop_id) {
+    case PROP_MARGIN:
+      self->margin = g_value_get_double (value);
+      break;
+    case PROP_PROCESS_NOISE:
+      self->process_noise = g_value_get_double (value);
+      break;
+    case PROP_MEASUREMENT_NOISE:
+      self->measurement_noise = g_value_get_double (value);
+      break;
+    case PROP_AFFINE:
+      self->affine = g_value_get_boolean (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_mv_stabilize_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstMvStabilize *self = GST_MV_STABILIZE (object);
+
+  switch (prop_id) {
+    case PROP_MARGIN:
+      g_value_set_double (value, self->margin);
+      break;
+    case PROP_PROCESS_NOISE:
+      g_value_set_double (value, self->process_noise);
+      break;
+    case PROP_MEASUREMENT_NOISE:
+      g_value_set_double (value, self->measurement_noise);
+      break;
+    case PROP_AFFINE:
+      g_value_set_boolean (value, self->affine);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_mv_stabilize_class_init (GstMvStabilizeClass * klass)
+{
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+  GstElementClass *element_class = (GstElementClass *) klass;
+  GstBaseTransformClass *trans_class = (GstBaseTransformClass *) klass;
+
+  GST_DEBUG_CATEGORY_INIT (gst_mv_stabilize_debug, "nvmvstabilize", 0,
+      "Motion vector stabilisation");
+
+  gobject_class->set_property = gst_mv_stabilize_set_property;
+  gobject_class->get_property = gst_mv_stabilize_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_MARGIN,
+      g_param_spec_double ("margin", "Margin",
+          "Share of the width and height cut on each side, the largest\n"
+          "\t\t\t correction",
+          0.0, 0.25, DEFAULT_MARGIN,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property (gobject_class, PROP_PROCESS_NOISE,
+      g_param_spec_double ("process-noise", "Process noise",
+          "Variance in square pixels the camera path may drift per frame",
+          0.0, G_MAXDOUBLE, DEFAULT_PROCESS_NOISE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property (gobject_class, PROP_MEASUREMENT_NOISE,
+      g_param_spec_double ("measurement-noise", "Measurement noise",
+          "Variance in square pixels of the shake on the measured path",
+          G_MINDOUBLE, G_MAXDOUBLE, DEFAULT_MEASUREMENT_NOISE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property (gobject_class, PROP_AFFINE,
+      g_param_spec_boolean ("affine", "Affine",
+          "Attach an affine transformation meta instead of a crop meta",
+          DEFAULT_AFFINE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  gst_element_class_add_static_pad_template (element_class,
+      &gst_mv_stabilize_sink_template);
+  gst_element_class_add_static_pad_template (element_class,
+      &gst_mv_stabilize_src_template);
+
+  gst_element_class_set_static_metadata (element_class,
+      "Motion vector stabilisation",
+      "Filter/Effect/Video",
+      "Attaches crop offsets that cancel camera shake, estimated from the "
+      "motion vectors",
+      "lagurus <https://github.com/lagurus>");
+
+  trans_class->start = GST_DEBUG_FUNCPTR (gst_mv_stabilize_start);
+  trans_class->set_caps = GST_DEBUG_FUNCPTR (gst_mv_stabilize_set_caps);
+  trans_class->sink_event = GST_DEBUG_FUNCPTR (gst_mv_stabilize_sink_event);
+  trans_class->transform_ip =
+      GST_DEBUG_FUNCPTR (gst_mv_stabilize_transform_ip);
+}
+
+static void
+gst_mv_stabilize_init (GstMvStabilize * self)
+{
+  self->margin = DEFAULT_MARGIN;
+  self->process_noise = DEFAULT_PROCESS_NOISE;
+  self->measurement_noise = DEFAULT_MEASUREMENT_NOISE;
+  self->affine = DEFAULT_AFFINE;
+
+  gst_mv_stabilize_reset (self);
+}
@@ -0,0 +1,71 @@
+/*
+ * gstmvstabilize.h: stabilisation offsets from the global motion of the vectors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MV_STABILIZE_H__
+#define __GST_MV_STABILIZE_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstbasetransform.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_MV_STABILIZE \
+  (gst_mv_stabilize_get_type())
+#define GST_MV_STABILIZE(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_MV_STABILIZE,GstMvStabilize))
+#define GST_MV_STABILIZE_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_MV_STABILIZE,GstMvStabilizeClass))
+#define GST_IS_MV_STABILIZE(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_MV_STABILIZE))
+#define GST_IS_MV_STABILIZE_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_MV_STABILIZE))
+
+typedef struct _GstMvStabilize GstMvStabilize;
+typedef struct _GstMvStabilizeClass GstMvStabilizeClass;
+
+struct _GstMvStabilize
+{
+  GstBaseTransform parent;
+
+  /* properties */
+  gdouble margin;
+  gdouble process_noise;
+  gdouble measurement_noise;
+  gboolean affine;
+
+  /* < private > */
+  gint width;
+  gint height;
+
+  /* camera path in pixels, measured [0] and filtered [1], x and y */
+  gdouble path[2][2];
+  /* error variance of the filtered path */
+  gdouble variance[2];
+};
+
+struct _GstMvStabilizeClass
+{
+  GstBaseTransformClass parent_class;
+};
+
+GType gst_mv_stabilize_get_type (void);
+
+G_END_DECLS
+
+#endif /* __GST_MV_STABILIZE_H__ */
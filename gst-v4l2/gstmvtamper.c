@@ -0,0 +1,566 @@
+/*
+ * gstmvtamper.c: camera tamper detection from encoder side data
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * SECTION:element-nvmvtamper
+ *
+ * Watches the #GstBufferInfoMeta of an encoded stream and posts element
+ * messages named "mv-tamper" on the bus with the fields
+ * "alert" (string: "covered", "reposition" or "defocus"),
+ * "active" (boolean, %FALSE once a covered lens or a defocus is gone),
+ * "timestamp" and "running-time" (#GstClockTime).
+ *
+ * The frame size the encoder needed at its average QP is normalised to a
+ * complexity value, learnt separately for intra and inter frames:
+ *
+ * - covered: the complexity collapses below covered-ratio of the learnt one
+ *   while the motion vectors vanish
+ * - defocus: the intra complexity stays between covered-ratio and
+ *   defocus-ratio of the learnt one for defocus-keyframes key frames
+ * - reposition: most blocks move along a common global vector and the scene
+ *   is static again afterwards, the learnt complexity is reset then
+ *
+ * With async the frames are analysed on the shared worker pool of
+ * gstmvpool.c and the buffers leave the element at once. At most max-pending
+ * frames wait for analysis, the oldest ones are skipped beyond that.
+ *
+ * |[
+ * gst-launch-1.0 nvarguscamerasrc ! nvv4l2h264enc EnableMVBufferMeta=1 !
+ *     nvmvtamper ! h264parse ! fakesink
+ * ]|
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include <string.h>
+
+#include "gstmvtamper.h"
+#include "gstmvutils.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_mv_tamper_debug);
+#define GST_CAT_DEFAULT gst_mv_tamper_debug
+
+#define DEFAULT_MOTION_THRESHOLD        8
+#define DEFAULT_COVERED_RATIO           0.2
+#define DEFAULT_DEFOCUS_RATIO           0.55
+#define DEFAULT_REPOSITION_THRESHOLD    16
+#define DEFAULT_REPOSITION_RATIO        0.6
+#define DEFAULT_HOLD_FRAMES             15
+#define DEFAULT_DEFOCUS_KEYFRAMES       3
+#define DEFAULT_LEARNING_RATE           0.05
+#define DEFAULT_WARMUP_FRAMES           30
+#define DEFAULT_ASYNC                   TRUE
+#define DEFAULT_MAX_PENDING             30
+
+/* below this share of moving blocks a scene counts as static */
+#define STATIC_RATIO                    0.02
+/* frames of global motion needed before a burst is considered */
+#define MIN_BURST_FRAMES                3
+
+enum
+{
+  PROP_0,
+  PROP_MOTION_THRESHOLD,
+  PROP_COVERED_RATIO,
+  PROP_DEFOCUS_RATIO,
+  PROP_REPOSITION_THRESHOLD,
+  PROP_REPOSITION_RATIO,
+  PROP_HOLD_FRAMES,
+  PROP_DEFOCUS_KEYFRAMES,
+  PROP_LEARNING_RATE,
+  PROP_WARMUP_FRAMES,
+  PROP_ASYNC,
+  PROP_MAX_PENDING
+};
+
+/* what the analysis needs from a buffer, copied when it runs on the pool */
+typedef struct
+{
+  GstClockTime pts;
+  GstClockTime running_time;
+  const encoder_stats *stats;
+  encoder_stats stats_copy;
+  const MVInfo *mvs;
+  guint n_vectors;
+} GstMvTamperFrame;
+
+#define MV_CODEC_CAPS "video/x-h264; video/x-h265"
+
+static GstStaticPadTemplate gst_mv_tamper_sink_template =
+GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (MV_CODEC_CAPS));
+
+static GstStaticPadTemplate gst_mv_tamper_src_template =
+GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (MV_CODEC_CAPS));
+
+#define gst_mv_tamper_parent_class parent_class
+G_DEFINE_TYPE (GstMvTamper, gst_mv_tamper, GST_TYPE_BASE_TRANSFORM);
+
+static void
+gst_mv_tamper_reset (GstMvTamper * self)
+{
+  self->complexity[0] = self->complexity[1] = 0;
+  self->n_samples[0] = self->n_samples[1] = 0;
+  self->covered = FALSE;
+  self->covered_count = 0;
+  self->uncovered_count = 0;
+  self->defocused = FALSE;
+  self->defocus_count = 0;
+  self->in_burst = FALSE;
+  self->burst_count = 0;
+  self->settle_count = 0;
+}
+
+static void
+gst_mv_tamper_post (GstMvTamper * self, const GstMvTamperFrame * frame,
+    const gchar * alert, gboolean active)
+{
+  GstStructure *s;
+
+  GST_INFO_OBJECT (self, "%s %s at %" GST_TIME_FORMAT, alert,
+      active ? "detected" : "cleared", GST_TIME_ARGS (frame->pts));
+
+  s = gst_structure_new ("mv-tamper",
+      "alert", G_TYPE_STRING, alert,
+      "active", G_TYPE_BOOLEAN, active,
+      "timestamp", G_TYPE_UINT64, frame->pts,
+      "running-time", G_TYPE_UINT64, frame->running_time, NULL);
+
+  gst_element_post_message (GST_ELEMENT (self),
+      gst_message_new_element (GST_OBJECT (self), s));
+}
+
+/* H.264/H.265 roughly halve the frame size every 6 QP steps */
+static gdouble
+frame_complexity (const encoder_stats * stats)
+{
+  return stats->EncodedFrameBits * pow (2.0, ((gdouble) stats->AvgQP - 26) / 6);
+}
+
+static void
+gst_mv_tamper_check_covered (GstMvTamper * self,
+    const GstMvTamperFrame * frame, gdouble complexity, gint type,
+    const GstMvActivity * activity)
+{
+  gdouble reference = self->complexity[type];
+  gboolean collapsed = complexity < self->covered_ratio * reference &&
+      activity->moving_ratio < STATIC_RATIO;
+
+  if (!self->covered) {
+    self->covered_count = collapsed ? self->covered_count + 1 : 0;
+    if (self->covered_count >= self->hold_frames) {
+      self->covered = TRUE;
+      self->uncovered_count = 0;
+      gst_mv_tamper_post (self, frame, "covered", TRUE);
+    }
+  } else {
+    /* require twice the trigger level to clear */
+    gboolean restored = complexity >= 2 * self->covered_ratio * reference;
+
+    self->uncovered_count = restored ? self->uncovered_count + 1 : 0;
+    if (self->uncovered_count >= self->hold_frames) {
+      self->covered = FALSE;
+      self->covered_count = 0;
+      gst_mv_tamper_post (self, frame, "covered", FALSE);
+    }
+  }
+}
+
+static void
+gst_mv_tamper_check_defocus (GstMvTamper * self,
+    const GstMvTamperFrame * frame, gdouble complexity)
+{
+  gdouble reference = self->complexity[1];
+  gboolean blurred = complexity >= self->covered_ratio * reference &&
+      complexity < self->defocus_ratio * reference;
+
+  if (!self->defocused) {
+    self->defocus_count = blurred ? self->defocus_count + 1 : 0;
+    if (self->defocus_count >= self->defocus_keyframes) {
+      self->defocused = TRUE;
+      gst_mv_tamper_post (self, frame, "defocus", TRUE);
+    }
+  } else if (complexity >= self->defocus_ratio * reference) {
+    self->defocused = FALSE;
+    self->defocus_count = 0;
+    gst_mv_tamper_post (self, frame, "defocus", FALSE);
+  }
+}
+
+static void
+gst_mv_tamper_check_reposition (GstMvTamper * self,
+    const GstMvTamperFrame * frame, const GstMvActivity * activity)
+{
+  guint global = ABS (activity->global_x) + ABS (activity->global_y);
+
+  if (activity->moving_ratio >= self->reposition_ratio &&
+      global >= self->reposition_threshold) {
+    self->burst_count++;
+    self->settle_count = 0;
+    if (self->burst_count >= MIN_BURST_FRAMES)
+      self->in_burst = TRUE;
+    return;
+  }
+
+  self->burst_count = 0;
+  if (!self->in_burst)
+    return;
+
+  if (activity->moving_ratio < STATIC_RATIO) {
+    if (++self->settle_count >= self->hold_frames) {
+      gst_mv_tamper_post (self, frame, "reposition", TRUE);
+      /* a new view, learn it from scratch */
+      gst_mv_tamper_reset (self);
+    }
+  } else {
+    self->settle_count = 0;
+  }
+}
+
+static void
+gst_mv_tamper_analyse (GstMvTamper * self, const GstMvTamperFrame * frame)
+{
+  const encoder_stats *stats = frame->stats;
+  GstMvActivity activity;
+
+  gst_mv_compute_activity (frame->mvs, frame->n_vectors,
+      self->motion_threshold, &activity);
+
+  /* intra frames carry no vectors */
+  if (frame->n_vectors > 0)
+    gst_mv_tamper_check_reposition (self, frame, &activity);
+
+  if (stats && !self->in_burst) {
+    gint type = stats->KeyFrame ? 1 : 0;
+    gdouble complexity = frame_complexity (stats);
+
+    if (self->n_samples[type] >= self->warmup_frames) {
+      gst_mv_tamper_check_covered (self, frame, complexity, type, &activity);
+      if (type == 1 && !self->covered)
+        gst_mv_tamper_check_defocus (self, frame, complexity);
+    }
+
+    /* only learn from a view that looks healthy */
+    if (!self->covered && !self->defocused && self->covered_count == 0 &&
+        self->defocus_count == 0) {
+      if (self->n_samples[type] == 0)
+        self->complexity[type] = complexity;
+      else
+        self->complexity[type] += self->learning_rate *
+            (complexity - self->complexity[type]);
+      if (self->n_samples[type] < G_MAXUINT)
+        self->n_samples[type]++;
+    }
+  }
+}
+
+static void
+gst_mv_tamper_analyse_job (gpointer job, gpointer user_data)
+{
+  gst_mv_tamper_analyse (GST_MV_TAMPER (user_data), job);
+}
+
+static GstFlowReturn
+gst_mv_tamper_transform_ip (GstBaseTransform * trans, GstBuffer * buf)
+{
+  GstMvTamper *self = GST_MV_TAMPER (trans);
+  const metadata_MV *field;
+  GstMvTamperFrame frame = { 0, };
+  GstMvTamperFrame *job;
+
+  field = gst_mv_buffer_get_field (buf);
+  frame.stats = gst_mv_buffer_get_stats (buf);
+  if (field == NULL && frame.stats == NULL)
+    return GST_FLOW_OK;
+
+  if (field)
+    frame.mvs = gst_mv_field_get_vectors (field, &frame.n_vectors);
+  frame.pts = GST_BUFFER_PTS (buf);
+  frame.running_time = gst_segment_to_running_time (&trans->segment,
+      GST_FORMAT_TIME, frame.pts);
+
+  if (self->queue == NULL) {
+    gst_mv_tamper_analyse (self, &frame);
+    return GST_FLOW_OK;
+  }
+
+  /* the meta goes away with the buffer, the job keeps its own copy */
+  job = g_malloc (sizeof (GstMvTamperFrame) +
+      frame.n_vectors * sizeof (MVInfo));
+  *job = frame;
+  if (frame.stats) {
+    job->stats_copy = *frame.stats;
+    job->stats = &job->stats_copy;
+  }
+  if (frame.n_vectors)
+    job->mvs = memcpy (job + 1, frame.mvs, frame.n_vectors * sizeof (MVInfo));
+
+  gst_mv_pool_queue_push (self->queue, job);
+
+  return GST_FLOW_OK;
+}
+
+static gboolean
+gst_mv_tamper_start (GstBaseTransform * trans)
+{
+  GstMvTamper *self = GST_MV_TAMPER (trans);
+
+  gst_mv_tamper_reset (self);
+
+  if (self->async)
+    self->queue = gst_mv_pool_queue_new (gst_mv_tamper_analyse_job, g_free,
+        self, self->max_pending);
+
+  return TRUE;
+}
+
+static gboolean
+gst_mv_tamper_stop (GstBaseTransform * trans)
+{
+  GstMvTamper *self = GST_MV_TAMPER (trans);
+
+  if (self->queue) {
+    GST_DEBUG_OBJECT (self, "%" G_GUINT64_FORMAT " frames skipped by analysis",
+        gst_mv_pool_queue_get_dropped (self->queue));
+    gst_mv_pool_queue_free (self->queue);
+    self->queue = NULL;
+  }
+
+  return TRUE;
+}
+
+static void
+gst_mv_tamper_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstMvTamper *self = GST_MV_TAMPER (object);
+
+  switch (prop_id) {
+    case PROP_MOTION_THRESHOLD:
+      self->motion_threshold = g_value_get_uint (value);
+      break;
+    case PROP_COVERED_RATIO:
+      self->covered_ratio = g_value_get_double (value);
+      break;
+    case PROP_DEFOCUS_RATIO:
+      self->defocus_ratio = g_value_get_double (value);
+      break;
+    case PROP_REPOSITION_THRESHOLD:
+      self->reposition_threshold = g_value_get_uint (value);
+      break;
+    case PROP_REPOSITION_RATIO:
+      self->reposition_ratio = g_value_get_double (value);
+      break;
+    case PROP_HOLD_FRAMES:
+      self->hold_frames = g_value_get_uint (value);
+      break;
+    case PROP_DEFOCUS_KEYFRAMES:
+      self->defocus_keyframes = g_value_get_uint (value);
+      break;
+    case PROP_LEARNING_RATE:
+      self->learning_rate = g_value_get_double (value);
+      break;
+    case PROP_WARMUP_FRAMES:
+      self->warmup_frames = g_value_get_uint (value);
+      break;
+    case PROP_ASYNC:
+      self->async = g_value_get_boolean (value);
+      break;
+    case PROP_MAX_PENDING:
+      self->max_pending = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_mv_tamper_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstMvTamper *self = GST_MV_TAMPER (object);
+
+  switch (prop_id) {
+    case PROP_MOTION_THRESHOLD:
+      g_value_set_uint (value, self->motion_threshold);
+      break;
+    case PROP_COVERED_RATIO:
+      g_value_set_double (value, self->covered_ratio);
+      break;
+    case PROP_DEFOCUS_RATIO:
+      g_value_set_double (value, self->defocus_ratio);
+      break;
+    case PROP_REPOSITION_THRESHOLD:
+      g_value_set_uint (value, self->reposition_threshold);
+      break;
+    case PROP_REPOSITION_RATIO:
+      g_value_set_double (value, self->reposition_ratio);
+      break;
+    case PROP_HOLD_FRAMES:
+      g_value_set_uint (value, self->hold_frames);
+      break;
+    case PROP_DEFOCUS_KEYFRAMES:
+      g_value_set_uint (value, self->defocus_keyframes);
+      break;
+    case PROP_LEARNING_RATE:
+      g_value_set_double (value, self->learning_rate);
+      break;
+    case PROP_WARMUP_FRAMES:
+      g_value_set_uint (value, self->warmup_frames);
+      break;
+    case PROP_ASYNC:
+      g_value_set_boolean (value, self->async);
+      break;
+    case PROP_MAX_PENDING:
+      g_value_set_uint (value, self->max_pending);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_mv_tamper_class_init (GstMvTamperClass * klass)
+{
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+  GstElementClass *element_class = (GstElementClass *) klass;
+  GstBaseTransformClass *trans_class = (GstBaseTransformClass *) klass;
+
+  GST_DEBUG_CATEGORY_INIT (gst_mv_tamper_debug, "nvmvtamper", 0,
+      "Motion vector tamper detection");
+
+  gobject_class->set_property = gst_mv_tamper_set_property;
+  gobject_class->get_property = gst_mv_tamper_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_MOTION_THRESHOLD,
+      g_param_spec_uint ("motion-threshold", "Motion threshold",
+          "Minimum |mv_x| + |mv_y| for a block to be considered moving",
+          0, G_MAXUINT, DEFAULT_MOTION_THRESHOLD,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_COVERED_RATIO,
+      g_param_spec_double ("covered-ratio", "Covered ratio",
+          "Share of the learnt frame complexity below which the lens\n"
+          "\t\t\t is considered covered",
+          0.0, 1.0, DEFAULT_COVERED_RATIO,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_DEFOCUS_RATIO,
+      g_param_spec_double ("defocus-ratio", "Defocus ratio",
+          "Share of the learnt key frame complexity below which the view\n"
+          "\t\t\t is considered out of focus",
+          0.0, 1.0, DEFAULT_DEFOCUS_RATIO,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_REPOSITION_THRESHOLD,
+      g_param_spec_uint ("reposition-threshold", "Reposition threshold",
+          "Minimum |x| + |y| of the global motion vector of a reposition",
+          0, G_MAXUINT, DEFAULT_REPOSITION_THRESHOLD,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_REPOSITION_RATIO,
+      g_param_spec_double ("reposition-ratio", "Reposition ratio",
+          "Minimum share of moving blocks during a reposition",
+          0.0, 1.0, DEFAULT_REPOSITION_RATIO,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_HOLD_FRAMES,
+      g_param_spec_uint ("hold-frames", "Hold frames",
+          "Number of consecutive frames a condition has to last",
+          1, G_MAXUINT, DEFAULT_HOLD_FRAMES,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_DEFOCUS_KEYFRAMES,
+      g_param_spec_uint ("defocus-keyframes", "Defocus key frames",
+          "Number of consecutive key frames a defocus has to last",
+          1, G_MAXUINT, DEFAULT_DEFOCUS_KEYFRAMES,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_LEARNING_RATE,
+      g_param_spec_double ("learning-rate", "Learning rate",
+          "Weight of a healthy frame in the learnt frame complexity",
+          0.0, 1.0, DEFAULT_LEARNING_RATE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_WARMUP_FRAMES,
+      g_param_spec_uint ("warmup-frames", "Warm-up frames",
+          "Number of frames of each type learnt before alerts are raised",
+          1, G_MAXUINT, DEFAULT_WARMUP_FRAMES,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_ASYNC,
+      g_param_spec_boolean ("async", "Asynchronous analysis",
+          "Analyse the frames on the shared worker pool instead of the\n"
+          "\t\t\t streaming thread",
+          DEFAULT_ASYNC,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_PENDING,
+      g_param_spec_uint ("max-pending", "Maximum pending frames",
+          "Number of frames waiting for asynchronous analysis from which\n"
+          "\t\t\t the oldest is skipped",
+          1, G_MAXUINT, DEFAULT_MAX_PENDING,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  gst_element_class_add_static_pad_template (element_class,
+      &gst_mv_tamper_sink_template);
+  gst_element_class_add_static_pad_template (element_class,
+      &gst_mv_tamper_src_template);
+
+  gst_element_class_set_static_metadata (element_class,
+      "Motion vector tamper detection",
+      "Filter/Analyzer/Video",
+      "Detects covered, moved and defocused cameras from encoder side data",
+      "lagurus <https://github.com/lagurus>");
+
+  trans_class->start = GST_DEBUG_FUNCPTR (gst_mv_tamper_start);
+  trans_class->stop = GST_DEBUG_FUNCPTR (gst_mv_tamper_stop);
+  trans_class->transform_ip = GST_DEBUG_FUNCPTR (gst_mv_tamper_transform_ip);
+}
+
+static void
+gst_mv_tamper_init (GstMvTamper * self)
+{
+  self->motion_threshold = DEFAULT_MOTION_THRESHOLD;
+  self->covered_ratio = DEFAULT_COVERED_RATIO;
+  self->defocus_ratio = DEFAULT_DEFOCUS_RATIO;
+  self->reposition_threshold = DEFAULT_REPOSITION_THRESHOLD;
+  self->reposition_ratio = DEFAULT_REPOSITION_RATIO;
+  self->hold_frames = DEFAULT_HOLD_FRAMES;
+  self->defocus_keyframes = DEFAULT_DEFOCUS_KEYFRAMES;
+  self->learning_rate = DEFAULT_LEARNING_RATE;
+  self->warmup_frames = DEFAULT_WARMUP_FRAMES;
+  self->async = DEFAULT_ASYNC;
+  self->max_pending = DEFAULT_MAX_PENDING;
+
+  gst_mv_tamper_reset (self);
+  gst_base_transform_set_passthrough (GST_BASE_TRANSFORM (self), TRUE);
+}
@@ -0,0 +1,89 @@
+/*
+ * gstmvtamper.h: camera tamper detection from encoder side data
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MV_TAMPER_H__
+#define __GST_MV_TAMPER_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstbasetransform.h>
+
+#include "gstmvpool.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_MV_TAMPER \
+  (gst_mv_tamper_get_type())
+#define GST_MV_TAMPER(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_MV_TAMPER,GstMvTamper))
+#define GST_MV_TAMPER_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_MV_TAMPER,GstMvTamperClass))
+#define GST_IS_MV_TAMPER(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_MV_TAMPER))
+#define GST_IS_MV_TAMPER_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_MV_TAMPER))
+
+typedef struct _GstMvTamper GstMvTamper;
+typedef struct _GstMvTamperClass GstMvTamperClass;
+
+struct _GstMvTamper
+{
+  GstBaseTransform parent;
+
+  /* properties */
+  guint motion_threshold;
+  gdouble covered_ratio;
+  gdouble defocus_ratio;
+  guint reposition_threshold;
+  gdouble reposition_ratio;
+  guint hold_frames;
+  guint defocus_keyframes;
+  gdouble learning_rate;
+  guint warmup_frames;
+  gboolean async;
+  guint max_pending;
+
+  /* < private > */
+  GstMvPoolQueue *queue;
+
+  /* QP normalised frame sizes of a healthy view, inter [0] and intra [1] */
+  gdouble complexity[2];
+  guint n_samples[2];
+
+  gboolean covered;
+  guint covered_count;
+  guint uncovered_count;
+
+  gboolean defocused;
+  guint defocus_count;
+
+  gboolean in_burst;
+  guint burst_count;
+  guint settle_count;
+};
+
+struct _GstMvTamperClass
+{
+  GstBaseTransformClass parent_class;
+};
+
+GType gst_mv_tamper_get_type (void);
+
+G_END_DECLS
+
+#endif /* __GST_MV_TAMPER_H__ */
@@ -0,0 +1,162 @@
+/*
+ * gstmvtensormeta.c: float tensors derived from motion vectors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "gstmvtensormeta.h"
+
+static gboolean
+gst_mv_tensor_meta_init (GstMeta * meta, gpointer params, GstBuffer * buffer)
+{
+  GstMvTensorMeta *tmeta = (GstMvTensorMeta *) meta;
+
+  tmeta->id = 0;
+  tmeta->n_dims = 0;
+  memset (tmeta->dims, 0, sizeof (tmeta->dims));
+  tmeta->n_elements = 0;
+  tmeta->data = NULL;
+
+  return TRUE;
+}
+
+static void
+gst_mv_tensor_meta_free (GstMeta * meta, GstBuffer * buffer)
+{
+  GstMvTensorMeta *tmeta = (GstMvTensorMeta *) meta;
+
+  g_free (tmeta->data);
+  tmeta->data = NULL;
+}
+
+static gboolean
+gst_mv_tensor_meta_transform (GstBuffer * transbuf, GstMeta * meta,
+    GstBuffer * buffer, GQuark type, gpointer data)
+{
+  GstMvTensorMeta *tmeta = (GstMvTensorMeta *) meta;
+  GstMvTensorMeta *copy;
+
+  /* the tensor describes the whole frame, only plain copies keep it */
+  if (!GST_META_TRANSFORM_IS_COPY (type))
+    return FALSE;
+
+  copy = gst_buffer_add_mv_tensor_meta (transbuf, tmeta->id, tmeta->n_dims,
+      tmeta->dims);
+  if (copy == NULL)
+    return FALSE;
+
+  memcpy (copy->data, tmeta->data, tmeta->n_elements * sizeof (gfloat));
+
+  return TRUE;
+}
+
+GType
+gst_mv_tensor_meta_api_get_type (void)
+{
+  static const gchar *tags[] = { NULL };
+  static volatile GType type;
+
+  if (g_once_init_enter (&type)) {
+    GType _type = gst_meta_api_type_register ("GstMvTensorMetaAPI", tags);
+    g_once_init_leave (&type, _type);
+  }
+
+  return type;
+}
+
+const GstMetaInfo *
+gst_mv_tensor_meta_get_info (void)
+{
+  static const GstMetaInfo *meta_info = NULL;
+
+  if (g_once_init_enter (&meta_info)) {
+    const GstMetaInfo *meta = gst_meta_register (GST_MV_TENSOR_META_API_TYPE,
+        "GstMvTensorMeta", sizeof (GstMvTensorMeta),
+        gst_mv_tensor_meta_init, gst_mv_tensor_meta_free,
+        gst_mv_tensor_meta_transform);
+    g_once_init_leave (&meta_info, meta);
+  }
+
+  return meta_info;
+}
+
+/**
+ * gst_buffer_add_mv_tensor_meta:
+ * @buffer: a writable #GstBuffer
+ * @id: what the tensor holds
+ * @n_dims: number of dimensions, at most GST_MV_TENSOR_MAX_DIMS
+ * @dims: size of each dimension
+ *
+ * Adds a zero filled tensor of the given shape to @buffer.
+ *
+ * Returns: (transfer none): the meta, or %NULL if the shape is invalid.
+ */
+GstMvTensorMeta *
+gst_buffer_add_mv_tensor_meta (GstBuffer * buffer, GQuark id, guint n_dims,
+    const guint * dims)
+{
+  GstMvTensorMeta *tmeta;
+  gsize n_elements = 1;
+  guint i;
+
+  g_return_val_if_fail (gst_buffer_is_writable (buffer), NULL);
+  g_return_val_if_fail (n_dims > 0 && n_dims <= GST_MV_TENSOR_MAX_DIMS, NULL);
+
+  for (i = 0; i < n_dims; i++) {
+    if (dims[i] == 0 || n_elements > G_MAXSIZE / sizeof (gfloat) / dims[i])
+      return NULL;
+    n_elements *= dims[i];
+  }
+
+  tmeta = (GstMvTensorMeta *) gst_buffer_add_meta (buffer,
+      GST_MV_TENSOR_META_INFO, NULL);
+
+  tmeta->id = id;
+  tmeta->n_dims = n_dims;
+  memcpy (tmeta->dims, dims, n_dims * sizeof (guint));
+  tmeta->n_elements = n_elements;
+  tmeta->data = g_new0 (gfloat, n_elements);
+
+  return tmeta;
+}
+
+/**
+ * gst_buffer_get_mv_tensor_meta:
+ * @buffer: a #GstBuffer
+ * @id: what the tensor holds
+ *
+ * Returns: (transfer none): the tensor @id of @buffer, or %NULL.
+ */
+GstMvTensorMeta *
+gst_buffer_get_mv_tensor_meta (GstBuffer * buffer, GQuark id)
+{
+  gpointer state = NULL;
+  GstMeta *meta;
+
+  while ((meta = gst_buffer_iterate_meta_filtered (buffer, &state,
+              GST_MV_TENSOR_META_API_TYPE))) {
+    if (((GstMvTensorMeta *) meta)->id == id)
+      return (GstMvTensorMeta *) meta;
+  }
+
+  return NULL;
+}
@@ -0,0 +1,70 @@
+/*
+ * gstmvtensormeta.h: float tensors derived from motion vectors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MV_TENSOR_META_H__
+#define __GST_MV_TENSOR_META_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define GST_MV_TENSOR_META_API_TYPE (gst_mv_tensor_meta_api_get_type())
+#define GST_MV_TENSOR_META_INFO     (gst_mv_tensor_meta_get_info())
+
+#define GST_MV_TENSOR_MAX_DIMS      4
+
+typedef struct _GstMvTensorMeta GstMvTensorMeta;
+
+/**
+ * GstMvTensorMeta:
+ * @meta: parent #GstMeta
+ * @id: what the tensor holds, e.g. "mv-hof"
+ * @n_dims: number of dimensions
+ * @dims: size of each dimension, the last one varies fastest
+ * @n_elements: product of @dims
+ * @data: @n_elements floats, owned by the meta
+ *
+ * A dense row major float tensor computed from the motion vectors of a
+ * buffer, ready to be fed to a model. A buffer carries at most one tensor
+ * per @id.
+ */
+struct _GstMvTensorMeta
+{
+  GstMeta meta;
+
+  GQuark id;
+  guint n_dims;
+  guint dims[GST_MV_TENSOR_MAX_DIMS];
+  gsize n_elements;
+  gfloat *data;
+};
+
+GType gst_mv_tensor_meta_api_get_type (void);
+
+const GstMetaInfo *gst_mv_tensor_meta_get_info (void);
+
+GstMvTensorMeta *gst_buffer_add_mv_tensor_meta (GstBuffer * buffer, GQuark id,
+    guint n_dims, const guint * dims);
+
+GstMvTensorMeta *gst_buffer_get_mv_tensor_meta (GstBuffer * buffer,
+    GQuark id);
+
+G_END_DECLS
+
+#endif /* __GST_MV_TENSOR_META_H__ */
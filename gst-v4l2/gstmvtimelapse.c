@@ -0,0 +1,440 @@
+/*
+ * gstmvtimelapse.c: compressed domain activity summary
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * SECTION:element-nvmvtimelapse
+ *
+ * Scores every GOP of an encoded stream by the mean share of moving blocks
+ * found in the #GstBufferInfoMeta of its inter frames and drops the GOPs that
+ * score below activity-threshold. The GOPs that are kept are shifted back in
+ * time so that the output plays without gaps; nothing is decoded or
+ * re-encoded.
+ *
+ * A GOP is held in memory until the next key frame arrives. GOPs longer than
+ * max-gop-frames are decided on their first max-gop-frames access units and
+ * the rest of them follows that decision. GOPs without any motion vector
+ * metadata cannot be scored and are passed through, with a warning.
+ *
+ * |[
+ * gst-launch-1.0 filesrc location=day.h264 ! h264parse ! nvv4l2decoder !
+ *     nvv4l2h264enc EnableMVBufferMeta=1 ! nvmvtimelapse ! h264parse !
+ *     mp4mux ! filesink location=summary.mp4
+ * ]|
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstmvtimelapse.h"
+#include "gstmvutils.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_mv_timelapse_debug);
+#define GST_CAT_DEFAULT gst_mv_timelapse_debug
+
+#define DEFAULT_MOTION_THRESHOLD    8
+#define DEFAULT_ACTIVITY_THRESHOLD  0.01
+#define DEFAULT_MAX_GOP_FRAMES      300
+
+enum
+{
+  PROP_0,
+  PROP_MOTION_THRESHOLD,
+  PROP_ACTIVITY_THRESHOLD,
+  PROP_MAX_GOP_FRAMES
+};
+
+#define MV_CODEC_CAPS "video/x-h264; video/x-h265"
+
+static GstStaticPadTemplate gst_mv_timelapse_sink_template =
+GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (MV_CODEC_CAPS));
+
+static GstStaticPadTemplate gst_mv_timelapse_src_template =
+GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (MV_CODEC_CAPS));
+
+#define gst_mv_timelapse_parent_class parent_class
+G_DEFINE_TYPE (GstMvTimelapse, gst_mv_timelapse, GST_TYPE_ELEMENT);
+
+static GstClockTime
+shift_time (GstClockTime ts, GstClockTimeDiff shift)
+{
+  if (!GST_CLOCK_TIME_IS_VALID (ts))
+    return ts;
+  if (shift < 0 && ts < (GstClockTime) - shift)
+    return 0;
+  return ts + shift;
+}
+
+static void
+gst_mv_timelapse_clear_gop (GstMvTimelapse * self)
+{
+  GstBuffer *buf;
+
+  while ((buf = g_queue_pop_head (&self->gop)))
+    gst_buffer_unref (buf);
+}
+
+static void
+gst_mv_timelapse_reset (GstMvTimelapse * self)
+{
+  gst_mv_timelapse_clear_gop (self);
+  /* nothing is output before the first key frame */
+  self->state = GST_MV_GOP_DROP;
+  self->gop_start = GST_CLOCK_TIME_NONE;
+  self->activity = 0;
+  self->n_scored = 0;
+  self->n_meta = 0;
+  self->warned_no_meta = FALSE;
+  self->out_time = GST_CLOCK_TIME_NONE;
+  self->shift = 0;
+  self->last_out = GST_CLOCK_TIME_NONE;
+  self->n_kept = 0;
+  self->n_dropped = 0;
+}
+
+static GstFlowReturn
+gst_mv_timelapse_push (GstMvTimelapse * self, GstBuffer * buf)
+{
+  GstClockTime pts, dts;
+
+  if (self->shift != 0) {
+    buf = gst_buffer_make_writable (buf);
+    pts = shift_time (GST_BUFFER_PTS (buf), self->shift);
+    dts = shift_time (GST_BUFFER_DTS (buf), self->shift);
+
+    /* the shift must not take the stream back past what was pushed already */
+    if (GST_CLOCK_TIME_IS_VALID (dts)) {
+      if (GST_CLOCK_TIME_IS_VALID (self->last_out) && dts < self->last_out)
+        dts = self->last_out;
+      if (GST_CLOCK_TIME_IS_VALID (pts) && pts < dts)
+        pts = dts;
+    } else if (GST_CLOCK_TIME_IS_VALID (pts) &&
+        GST_CLOCK_TIME_IS_VALID (self->last_out) && pts < self->last_out) {
+      pts = self->last_out;
+    }
+
+    GST_BUFFER_PTS (buf) = pts;
+    GST_BUFFER_DTS (buf) = dts;
+  }
+
+  if (GST_BUFFER_DTS_IS_VALID (buf))
+    self->last_out = GST_BUFFER_DTS (buf);
+  else if (GST_BUFFER_PTS_IS_VALID (buf))
+    self->last_out = GST_BUFFER_PTS (buf);
+
+  return gst_pad_push (self->srcpad, buf);
+}
+
+/* keeps or drops the access units collected for the current GOP */
+static GstFlowReturn
+gst_mv_timelapse_decide (GstMvTimelapse * self)
+{
+  gdouble score = self->n_scored ? self->activity / self->n_scored : 0;
+  GstFlowReturn ret = GST_FLOW_OK;
+  GstBuffer *buf;
+
+  GST_LOG_OBJECT (self, "GOP at %" GST_TIME_FORMAT " scored %f over %u frames",
+      GST_TIME_ARGS (self->gop_start), score, self->n_scored);
+
+  if (self->n_meta == 0) {
+    if (!self->warned_no_meta) {
+      GST_ELEMENT_WARNING (self, STREAM, FORMAT,
+          ("No motion vector metadata, GOPs are passed through"),
+          ("enable EnableMVBufferMeta on the encoder"));
+      self->warned_no_meta = TRUE;
+    }
+  } else if (score < self->activity_threshold) {
+    self->state = GST_MV_GOP_DROP;
+    self->n_dropped++;
+    gst_mv_timelapse_clear_gop (self);
+    return GST_FLOW_OK;
+  }
+
+  self->state = GST_MV_GOP_KEEP;
+  self->n_kept++;
+
+  if (!GST_CLOCK_TIME_IS_VALID (self->out_time))
+    self->out_time = self->gop_start;
+  if (GST_CLOCK_TIME_IS_VALID (self->gop_start))
+    self->shift = GST_CLOCK_DIFF (self->gop_start, self->out_time);
+
+  while ((buf = g_queue_pop_head (&self->gop))) {
+    if (ret == GST_FLOW_OK)
+      ret = gst_mv_timelapse_push (self, buf);
+    else
+      gst_buffer_unref (buf);
+  }
+
+  return ret;
+}
+
+/* closes the current GOP, @next_start being the time of the next key frame */
+static GstFlowReturn
+gst_mv_timelapse_finish_gop (GstMvTimelapse * self, GstClockTime next_start)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+
+  if (self->state == GST_MV_GOP_COLLECT)
+    ret = gst_mv_timelapse_decide (self);
+
+  if (self->state == GST_MV_GOP_KEEP &&
+      GST_CLOCK_TIME_IS_VALID (self->gop_start) &&
+      GST_CLOCK_TIME_IS_VALID (next_start) && next_start > self->gop_start)
+    self->out_time += next_start - self->gop_start;
+
+  return ret;
+}
+
+static void
+gst_mv_timelapse_score (GstMvTimelapse * self, GstBuffer * buf)
+{
+  const metadata_MV *field;
+  const MVInfo *mvs;
+  GstMvActivity activity;
+  guint n_vectors;
+
+  field = gst_mv_buffer_get_field (buf);
+  if (field == NULL)
+    return;
+
+  self->n_meta++;
+
+  mvs = gst_mv_field_get_vectors (field, &n_vectors);
+  if (n_vectors == 0)
+    return;
+
+  gst_mv_compute_activity (mvs, n_vectors, self->motion_threshold, &activity);
+  self->activity += activity.moving_ratio;
+  self->n_scored++;
+}
+
+static GstFlowReturn
+gst_mv_timelapse_chain (GstPad * pad, GstObject * parent, GstBuffer * buf)
+{
+  GstMvTimelapse *self = GST_MV_TIMELAPSE (parent);
+  GstFlowReturn ret;
+
+  if (!GST_BUFFER_FLAG_IS_SET (buf, GST_BUFFER_FLAG_DELTA_UNIT)) {
+    GstClockTime ts = GST_BUFFER_PTS_IS_VALID (buf) ? GST_BUFFER_PTS (buf) :
+        GST_BUFFER_DTS (buf);
+
+    ret = gst_mv_timelapse_finish_gop (self, ts);
+
+    self->state = GST_MV_GOP_COLLECT;
+    self->gop_start = ts;
+    self->activity = 0;
+    self->n_scored = 0;
+    self->n_meta = 0;
+
+    if (ret != GST_FLOW_OK) {
+      gst_buffer_unref (buf);
+      return ret;
+    }
+  }
+
+  switch (self->state) {
+    case GST_MV_GOP_COLLECT:
+      gst_mv_timelapse_score (self, buf);
+      g_queue_push_tail (&self->gop, buf);
+      if (g_queue_get_length (&self->gop) >= self->max_gop_frames)
+        return gst_mv_timelapse_decide (self);
+      return GST_FLOW_OK;
+    case GST_MV_GOP_KEEP:
+      return gst_mv_timelapse_push (self, buf);
+    case GST_MV_GOP_DROP:
+    default:
+      gst_buffer_unref (buf);
+      return GST_FLOW_OK;
+  }
+}
+
+static gboolean
+gst_mv_timelapse_sink_event (GstPad * pad, GstObject * parent,
+    GstEvent * event)
+{
+  GstMvTimelapse *self = GST_MV_TIMELAPSE (parent);
+  GstFlowReturn ret;
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_EOS:
+      ret = gst_mv_timelapse_finish_gop (self, GST_CLOCK_TIME_NONE);
+      GST_INFO_OBJECT (self, "kept %" G_GUINT64_FORMAT " of %" G_GUINT64_FORMAT
+          " GOPs", self->n_kept, self->n_kept + self->n_dropped);
+
+      if (ret == GST_FLOW_FLUSHING) {
+        gst_event_unref (event);
+        return FALSE;
+      }
+      /* the last GOP could not be pushed, EOS alone would hide that */
+      if (ret == GST_FLOW_NOT_LINKED || ret < GST_FLOW_EOS)
+        GST_ELEMENT_FLOW_ERROR (self, ret);
+      break;
+    case GST_EVENT_FLUSH_STOP:
+      gst_mv_timelapse_reset (self);
+      break;
+    default:
+      break;
+  }
+
+  return gst_pad_event_default (pad, parent, event);
+}
+
+static GstStateChangeReturn
+gst_mv_timelapse_change_state (GstElement * element, GstStateChange transition)
+{
+  GstMvTimelapse *self = GST_MV_TIMELAPSE (element);
+  GstStateChangeReturn ret;
+
+  ret = GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
+
+  switch (transition) {
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      gst_mv_timelapse_reset (self);
+      break;
+    default:
+      break;
+  }
+
+  return ret;
+}
+
+static void
+gst_mv_timelapse_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstMvTimelapse *self = GST_MV_TIMELAPSE (object);
+
+  switch (prop_id) {
+    case PROP_MOTION_THRESHOLD:
+      self->motion_threshold = g_value_get_uint (value);
+      break;
+    case PROP_ACTIVITY_THRESHOLD:
+      self->activity_threshold = g_value_get_double (value);
+      break;
+    case PROP_MAX_GOP_FRAMES:
+      self->max_gop_frames = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_mv_timelapse_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstMvTimelapse *self = GST_MV_TIMELAPSE (object);
+
+  switch (prop_id) {
+    case PROP_MOTION_THRESHOLD:
+      g_value_set_uint (value, self->motion_threshold);
+      break;
+    case PROP_ACTIVITY_THRESHOLD:
+      g_value_set_double (value, self->activity_threshold);
+      break;
+    case PROP_MAX_GOP_FRAMES:
+      g_value_set_uint (value, self->max_gop_frames);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_mv_timelapse_class_init (GstMvTimelapseClass * klass)
+{
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+  GstElementClass *element_class = (GstElementClass *) klass;
+
+  GST_DEBUG_CATEGORY_INIT (gst_mv_timelapse_debug, "nvmvtimelapse", 0,
+      "Motion vector time-lapse");
+
+  gobject_class->set_property = gst_mv_timelapse_set_property;
+  gobject_class->get_property = gst_mv_timelapse_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_MOTION_THRESHOLD,
+      g_param_spec_uint ("motion-threshold", "Motion threshold",
+          "Minimum |mv_x| + |mv_y| for a block to be considered moving",
+          0, G_MAXUINT, DEFAULT_MOTION_THRESHOLD,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property (gobject_class, PROP_ACTIVITY_THRESHOLD,
+      g_param_spec_double ("activity-threshold", "Activity threshold",
+          "Mean share of moving blocks below which a GOP is dropped",
+          0.0, 1.0, DEFAULT_ACTIVITY_THRESHOLD,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_GOP_FRAMES,
+      g_param_spec_uint ("max-gop-frames", "Max GOP frames",
+          "Maximum number of access units held while scoring a GOP",
+          1, G_MAXUINT, DEFAULT_MAX_GOP_FRAMES,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_PLAYING));
+
+  gst_element_class_add_static_pad_template (element_class,
+      &gst_mv_timelapse_sink_template);
+  gst_element_class_add_static_pad_template (element_class,
+      &gst_mv_timelapse_src_template);
+
+  gst_element_class_set_static_metadata (element_class,
+      "Motion vector time-lapse",
+      "Filter/Video",
+      "Drops the GOPs of an encoded stream that show no motion",
+      "lagurus <https://github.com/lagurus>");
+
+  element_class->change_state =
+      GST_DEBUG_FUNCPTR (gst_mv_timelapse_change_state);
+}
+
+static void
+gst_mv_timelapse_init (GstMvTimelapse * self)
+{
+  self->sinkpad =
+      gst_pad_new_from_static_template (&gst_mv_timelapse_sink_template,
+      "sink");
+  gst_pad_set_chain_function (self->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_mv_timelapse_chain));
+  gst_pad_set_event_function (self->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_mv_timelapse_sink_event));
+  GST_PAD_SET_PROXY_CAPS (self->sinkpad);
+  GST_PAD_SET_PROXY_ALLOCATION (self->sinkpad);
+  gst_element_add_pad (GST_ELEMENT (self), self->sinkpad);
+
+  self->srcpad =
+      gst_pad_new_from_static_template (&gst_mv_timelapse_src_template, "src");
+  GST_PAD_SET_PROXY_CAPS (self->srcpad);
+  gst_element_add_pad (GST_ELEMENT (self), self->srcpad);
+
+  self->motion_threshold = DEFAULT_MOTION_THRESHOLD;
+  self->activity_threshold = DEFAULT_ACTIVITY_THRESHOLD;
+  self->max_gop_frames = DEFAULT_MAX_GOP_FRAMES;
+
+  g_queue_init (&self->gop);
+  gst_mv_timelapse_reset (self);
+}
@@ -0,0 +1,88 @@
+/*
+ * gstmvtimelapse.h: compressed domain activity summary
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MV_TIMELAPSE_H__
+#define __GST_MV_TIMELAPSE_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_MV_TIMELAPSE \
+  (gst_mv_timelapse_get_type())
+#define GST_MV_TIMELAPSE(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_MV_TIMELAPSE,GstMvTimelapse))
+#define GST_MV_TIMELAPSE_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_MV_TIMELAPSE,GstMvTimelapseClass))
+#define GST_IS_MV_TIMELAPSE(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_MV_TIMELAPSE))
+#define GST_IS_MV_TIMELAPSE_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_MV_TIMELAPSE))
+
+typedef struct _GstMvTimelapse GstMvTimelapse;
+typedef struct _GstMvTimelapseClass GstMvTimelapseClass;
+
+typedef enum
+{
+  GST_MV_GOP_COLLECT,
+  GST_MV_GOP_KEEP,
+  GST_MV_GOP_DROP
+} GstMvGopState;
+
+struct _GstMvTimelapse
+{
+  GstElement parent;
+
+  GstPad *sinkpad;
+  GstPad *srcpad;
+
+  /* properties */
+  guint motion_threshold;
+  gdouble activity_threshold;
+  guint max_gop_frames;
+
+  /* < private > */
+  /* access units of the current GOP while it is being scored */
+  GQueue gop;
+  GstMvGopState state;
+  GstClockTime gop_start;
+  gdouble activity;
+  guint n_scored;
+  guint n_meta;              /* access units that carried vectors at all */
+  gboolean warned_no_meta;
+
+  /* output time of the next kept GOP and the shift applied to this one */
+  GstClockTime out_time;
+  GstClockTimeDiff shift;
+  GstClockTime last_out;     /* last decoding time pushed */
+
+  guint64 n_kept;
+  guint64 n_dropped;
+};
+
+struct _GstMvTimelapseClass
+{
+  GstElementClass parent_class;
+};
+
+GType gst_mv_timelapse_get_type (void);
+
+G_END_DECLS
+
+#endif /* __GST_MV_TIMELAPSE_H__ */
@@ -0,0 +1,655 @@
+/*
+ * gstmvutils.c: helpers for the per-block motion vector field carried in
+ * GstBufferInfoMeta
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "gstmvutils.h"
+
+/* vector components outside of this range are clamped when looking for the
+ * median, NVENC search ranges stay well within it */
+#define MV_HISTOGRAM_RANGE      512
+
+/* upper bound on the clusters tracked while labelling a frame, the cheapest
+ * pair is merged whenever it overflows */
+#define MV_MAX_CANDIDATES       64
+
+/* regions gst_mv_regions_complement() cuts around, one ROI param set */
+#define MV_MAX_COMPLEMENT_INPUT 8
+
+static const guint block_sizes[] = { 16, 32, 8 };
+
+/**
+ * gst_mv_field_get_vectors:
+ * @field: a #metadata_MV
+ * @n_vectors: (out): number of vectors in the field
+ *
+ * Returns: the vectors of @field in raster order.
+ */
+const MVInfo *
+gst_mv_field_get_vectors (const metadata_MV * field, guint * n_vectors)
+{
+  *n_vectors = field->bufSize / sizeof (MVInfo);
+#ifdef D_USE_META_STATIC
+  return field->rec_mv_info;
+#else
+  return field->pMVInfo;
+#endif
+}
+
+/**
+ * gst_mv_buffer_get_field:
+ * @buffer: a #GstBuffer
+ *
+ * Returns: the motion vector field attached to @buffer by the encoder, or
+ * %NULL when the buffer has no #GstBufferInfoMeta.
+ */
+const metadata_MV *
+gst_mv_buffer_get_field (GstBuffer * buffer)
+{
+  GstBufferInfoMeta *meta;
+
+  meta = (GstBufferInfoMeta *) gst_buffer_get_meta (buffer,
+      GST_BUFFER_INFO_META_API_TYPE);
+  if (meta == NULL)
+    return NULL;
+
+  return &meta->info.m_enc_mv_metadata;
+}
+
+/**
+ * gst_mv_buffer_get_stats:
+ * @buffer: a #GstBuffer
+ *
+ * Returns: the encoder statistics attached to @buffer, or %NULL when the
+ * buffer has no #GstBufferInfoMeta or the encoder did not report them.
+ */
+const encoder_stats *
+gst_mv_buffer_get_stats (GstBuffer * buffer)
+{
+  GstBufferInfoMeta *meta;
+
+  meta = (GstBufferInfoMeta *) gst_buffer_get_meta (buffer,
+      GST_BUFFER_INFO_META_API_TYPE);
+  if (meta == NULL || !meta->info.m_enc_stats.bValid)
+    return NULL;
+
+  return &meta->info.m_enc_stats;
+}
+
+/**
+ * gst_mv_grid_init:
+ * @grid: the #GstMvGrid to fill
+ * @width: frame width in pixels
+ * @height: frame height in pixels
+ * @n_vectors: number of vectors reported for the frame
+ *
+ * Works out the block size of the field from the number of vectors the
+ * encoder reported, H.264 uses one vector per 16x16 macroblock and H.265 one
+ * per 32x32 block. When no block size matches, 16x16 is assumed and the row
+ * count is derived from @n_vectors.
+ *
+ * Returns: %TRUE if the geometry matched @n_vectors exactly.
+ */
+gboolean
+gst_mv_grid_init (GstMvGrid * grid, guint width, guint height, guint n_vectors)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (block_sizes); i++) {
+    guint bs = block_sizes[i];
+    guint cols = (width + bs - 1) / bs;
+    guint rows = (height + bs - 1) / bs;
+
+    if (cols * rows == n_vectors && n_vectors > 0) {
+      grid->block_size = bs;
+      grid->cols = cols;
+      grid->rows = rows;
+      return TRUE;
+    }
+  }
+
+  grid->block_size = 16;
+  grid->cols = MAX ((width + 15) / 16, 1);
+  grid->rows = n_vectors / grid->cols;
+
+  return FALSE;
+}
+
+static gint
+histogram_median (const guint32 * histogram, guint n)
+{
+  guint i, acc = 0;
+
+  for (i = 0; i < 2 * MV_HISTOGRAM_RANGE; i++) {
+    acc += histogram[i];
+    if (acc * 2 > n)
+      break;
+  }
+
+  return (gint) i - MV_HISTOGRAM_RANGE;
+}
+
+/**
+ * gst_mv_compute_activity:
+ * @mvs: the vectors
+ * @n_vectors: number of entries in @mvs
+ * @threshold: L1 magnitude from which a block counts as moving
+ * @activity: (out): the summary
+ *
+ * Summarises a motion vector field in a single pass.
+ */
+void
+gst_mv_compute_activity (const MVInfo * mvs, guint n_vectors,
+    guint threshold, GstMvActivity * activity)
+{
+  guint32 hist_x[2 * MV_HISTOGRAM_RANGE];
+  guint32 hist_y[2 * MV_HISTOGRAM_RANGE];
+  guint64 magnitude = 0;
+  guint i;
+
+  memset (activity, 0, sizeof (GstMvActivity));
+  if (n_vectors == 0)
+    return;
+
+  memset (hist_x, 0, sizeof (hist_x));
+  memset (hist_y, 0, sizeof (hist_y));
+
+  for (i = 0; i < n_vectors; i++) {
+    gint x = mvs[i].mv_x;
+    gint y = mvs[i].mv_y;
+    guint m = ABS (x) + ABS (y);
+
+    if (m >= threshold && m > 0) {
+      activity->n_moving++;
+      magnitude += m;
+    }
+
+    hist_x[CLAMP (x, -MV_HISTOGRAM_RANGE, MV_HISTOGRAM_RANGE - 1) +
+        MV_HISTOGRAM_RANGE]++;
+    hist_y[CLAMP (y, -MV_HISTOGRAM_RANGE, MV_HISTOGRAM_RANGE - 1) +
+        MV_HISTOGRAM_RANGE]++;
+  }
+
+  activity->n_blocks = n_vectors;
+  activity->moving_ratio = (gdouble) activity->n_moving / n_vectors;
+  if (activity->n_moving)
+    activity->mean_magnitude = (gdouble) magnitude / activity->n_moving;
+  activity->global_x = histogram_median (hist_x, n_vectors);
+  activity->global_y = histogram_median (hist_y, n_vectors);
+}
+
+static gint64
+region_merge_cost (const GstMvRegion * a, const GstMvRegion * b)
+{
+  guint x0 = MIN (a->x, b->x);
+  guint y0 = MIN (a->y, b->y);
+  guint x1 = MAX (a->x + a->width, b->x + b->width);
+  guint y1 = MAX (a->y + a->height, b->y + b->height);
+
+  return (gint64) (x1 - x0) * (y1 - y0)
+      - (gint64) a->width * a->height - (gint64) b->width * b->height;
+}
+
+static void
+region_merge (GstMvRegion * a, const GstMvRegion * b)
+{
+  guint x1 = MAX (a->x + a->width, b->x + b->width);
+  guint y1 = MAX (a->y + a->height, b->y + b->height);
+
+  a->x = MIN (a->x, b->x);
+  a->y = MIN (a->y, b->y);
+  a->width = x1 - a->x;
+  a->height = y1 - a->y;
+  a->n_blocks += b->n_blocks;
+  a->magnitude += b->magnitude;
+}
+
+/* merges the pair whose bounding box grows the least, returns the new count */
+static guint
+regions_merge_cheapest (GstMvRegion * regions, guint n)
+{
+  gint64 best = G_MAXINT64;
+  guint i, j, bi = 0, bj = 1;
+
+  if (n < 2)
+    return n;
+
+  for (i = 0; i < n; i++) {
+    for (j = i + 1; j < n; j++) {
+      gint64 cost = region_merge_cost (&regions[i], &regions[j]);
+      if (cost < best) {
+        best = cost;
+        bi = i;
+        bj = j;
+      }
+    }
+  }
+
+  region_merge (&regions[bi], &regions[bj]);
+  regions[bj] = regions[n - 1];
+
+  return n - 1;
+}
+
+static gint
+region_compare (gconstpointer a, gconstpointer b)
+{
+  const GstMvRegion *ra = a, *rb = b;
+
+  if (ra->magnitude != rb->magnitude)
+    return ra->magnitude > rb->magnitude ? -1 : 1;
+  return 0;
+}
+
+/**
+ * gst_mv_find_regions:
+ * @mvs: the vectors, @grid->cols * @grid->rows entries
+ * @grid: geometry of @mvs
+ * @threshold: L1 magnitude from which a block counts as moving
+ * @min_blocks: 4-connected clusters smaller than this are ignored
+ * @regions: (out caller-allocates): array of at least @max_regions entries
+ * @max_regions: maximum number of regions to return
+ * @scratch: a #GArray of guint32 reused between calls to avoid allocations
+ *
+ * Labels the 4-connected clusters of moving blocks and returns their bounding
+ * boxes, most active first. When there are more than @max_regions clusters
+ * the pair whose union adds the least area is merged until they fit.
+ *
+ * Returns: the number of entries written to @regions.
+ */
+guint
+gst_mv_find_regions (const MVInfo * mvs, const GstMvGrid * grid,
+    guint threshold, guint min_blocks, GstMvRegion * regions,
+    guint max_regions, GArray * scratch)
+{
+  GstMvRegion candidates[MV_MAX_CANDIDATES + 1];
+  guint n_candidates = 0;
+  guint n = grid->cols * grid->rows;
+  guint32 *state, *stack;
+  guint i;
+
+  if (n == 0 || max_regions == 0)
+    return 0;
+
+  g_array_set_size (scratch, 2 * n);
+  state = (guint32 *) scratch->data;
+  stack = state + n;
+
+  /* 0: static or visited, otherwise the block magnitude */
+  for (i = 0; i < n; i++) {
+    guint m = GST_MV_MAGNITUDE (&mvs[i]);
+    state[i] = (m >= threshold && m > 0) ? m : 0;
+  }
+
+  for (i = 0; i < n; i++) {
+    GstMvRegion region;
+    guint x0, y0, x1, y1, top = 0;
+
+    if (state[i] == 0)
+      continue;
+
+    x0 = x1 = i % grid->cols;
+    y0 = y1 = i / grid->cols;
+    memset (&region, 0, sizeof (region));
+
+    stack[top++] = i;
+    region.magnitude = state[i];
+    state[i] = 0;
+
+    while (top > 0) {
+      guint idx = stack[--top];
+      guint x = idx % grid->cols;
+      guint y = idx / grid->cols;
+
+      region.n_blocks++;
+      x0 = MIN (x0, x);
+      x1 = MAX (x1, x);
+      y0 = MIN (y0, y);
+      y1 = MAX (y1, y);
+
+#define VISIT(cond, next)                         \
+      if ((cond) && state[next] != 0) {           \
+        region.magnitude += state[next];          \
+        state[next] = 0;                          \
+        stack[top++] = next;                      \
+      }
+      VISIT (x > 0, idx - 1);
+      VISIT (x + 1 < grid->cols, idx + 1);
+      VISIT (y > 0, idx - grid->cols);
+      VISIT (y + 1 < grid->rows, idx + grid->cols);
+#undef VISIT
+    }
+
+    if (region.n_blocks < min_blocks)
+      continue;
+
+    region.x = x0;
+    region.y = y0;
+    region.width = x1 - x0 + 1;
+    region.height = y1 - y0 + 1;
+
+    candidates[n_candidates++] = region;
+    if (n_candidates > MV_MAX_CANDIDATES)
+      n_candidates = regions_merge_cheapest (candidates, n_candidates);
+  }
+
+  while (n_candidates > max_regions)
+    n_candidates = regions_merge_cheapest (candidates, n_candidates);
+
+  qsort (candidates, n_candidates, sizeof (GstMvRegion), region_compare);
+  memcpy (regions, candidates, n_candidates * sizeof (GstMvRegion));
+
+  return n_candidates;
+}
+
+static gint
+guint_compare (gconstpointer a, gconstpointer b)
+{
+  guint ua = *(const guint *) a, ub = *(const guint *) b;
+
+  return ua < ub ? -1 : ua > ub;
+}
+
+static gint
+region_x_compare (gconstpointer a, gconstpointer b)
+{
+  const GstMvRegion *ra = a, *rb = b;
+
+  return ra->x < rb->x ? -1 : ra->x > rb->x;
+}
+
+/**
+ * gst_mv_regions_complement:
+ * @regions: rectangles of the grid, in blocks, they may overlap
+ * @n_regions: number of entries in @regions, at most 8
+ * @cols: width of the grid, in blocks
+ * @rows: height of the grid, in blocks
+ * @out: (out caller-allocates): array of at least @max_out entries
+ * @max_out: maximum number of rectangles to write
+ *
+ * Covers the blocks outside of @regions with rectangles that overlap neither
+ * @regions nor each other. The grid is cut into bands at the top and bottom
+ * edges of @regions and every band into the runs @regions leave free, runs
+ * of consecutive bands with the same columns are joined. Only @x, @y, @width
+ * and @height of the results are set.
+ *
+ * Returns: the number of rectangles needed, of which only the first
+ * @max_out are written.
+ */
+guint
+gst_mv_regions_complement (const GstMvRegion * regions, guint n_regions,
+    guint cols, guint rows, GstMvRegion * out, guint max_out)
+{
+  GstMvRegion pieces[(MV_MAX_COMPLEMENT_INPUT + 1) *
+      (2 * MV_MAX_COMPLEMENT_INPUT + 1)];
+  GstMvRegion spans[MV_MAX_COMPLEMENT_INPUT];
+  guint edges[2 * MV_MAX_COMPLEMENT_INPUT + 2];
+  guint n_edges = 0, n_pieces = 0, i, j, k;
+
+  g_return_val_if_fail (n_regions <= MV_MAX_COMPLEMENT_INPUT, 0);
+
+  if (cols == 0 || rows == 0)
+    return 0;
+
+  edges[n_edges++] = 0;
+  edges[n_edges++] = rows;
+  for (i = 0; i < n_regions; i++) {
+    edges[n_edges++] = MIN (regions[i].y, rows);
+    edges[n_edges++] = MIN (regions[i].y + regions[i].height, rows);
+  }
+  qsort (edges, n_edges, sizeof (guint), guint_compare);
+
+  for (k = 0; k + 1 < n_edges; k++) {
+    guint top = edges[k], bottom = edges[k + 1], x = 0, n_spans = 0;
+
+    if (top == bottom)
+      continue;
+
+    /* the regions crossing the band cover all of its rows */
+    for (i = 0; i < n_regions; i++) {
+      if (regions[i].y <= top && regions[i].y + regions[i].height >= bottom)
+        spans[n_spans++] = regions[i];
+    }
+    qsort (spans, n_spans, sizeof (GstMvRegion), region_x_compare);
+
+    for (i = 0; i <= n_spans; i++) {
+      guint end = i < n_spans ? MIN (spans[i].x, cols) : cols;
+
+      if (end > x) {
+        /* continue the piece of the band above when it has the same run */
+        for (j = 0; j < n_pieces; j++) {
+          if (pieces[j].x == x && pieces[j].width == end - x &&
+              pieces[j].y + pieces[j].height == top)
+            break;
+        }
+        if (j < n_pieces) {
+          pieces[j].height += bottom - top;
+        } else {
+          memset (&pieces[n_pieces], 0, sizeof (GstMvRegion));
+          pieces[n_pieces].x = x;
+          pieces[n_pieces].y = top;
+          pieces[n_pieces].width = end - x;
+          pieces[n_pieces].height = bottom - top;
+          n_pieces++;
+        }
+      }
+      if (i < n_spans)
+        x = MAX (x, MIN (spans[i].x + spans[i].width, cols));
+    }
+  }
+
+  memcpy (out, pieces, MIN (n_pieces, max_out) * sizeof (GstMvRegion));
+
+  return n_pieces;
+}
+
+/* the layout of AVMotionVector, which FFmpeg keeps stable across versions */
+G_STATIC_ASSERT (sizeof (GstMvAVMotionVector) == 40);
+G_STATIC_ASSERT (G_STRUCT_OFFSET (GstMvAVMotionVector, dst_y) == 12);
+G_STATIC_ASSERT (G_STRUCT_OFFSET (GstMvAVMotionVector, flags) == 16);
+G_STATIC_ASSERT (G_STRUCT_OFFSET (GstMvAVMotionVector, motion_scale) == 32);
+
+/**
+ * gst_mv_export_av_motion_vectors:
+ * @mvs: the vectors
+ * @n_vectors: number of entries in @mvs
+ * @grid: geometry of the field
+ * @out: array of #GstMvAVMotionVector, resized to the result
+ *
+ * Converts a vector field to FFmpeg's AV_FRAME_DATA_MOTION_VECTORS layout,
+ * one entry per block in raster order. @out is meant to be kept across
+ * frames, it is only reallocated when a field has more blocks than any
+ * before it. The inner loop walks a row without branches or divisions so
+ * the compiler can vectorise the component extraction.
+ *
+ * Returns: the number of entries written to @out.
+ */
+guint
+gst_mv_export_av_motion_vectors (const MVInfo * mvs, guint n_vectors,
+    const GstMvGrid * grid, GArray * out)
+{
+  GstMvAVMotionVector *av;
+  guint cols = MAX (grid->cols, 1);
+  gint bs = grid->block_size;
+  guint row, col, i = 0;
+
+  g_return_val_if_fail (g_array_get_element_size (out) ==
+      sizeof (GstMvAVMotionVector), 0);
+
+  g_array_set_size (out, n_vectors);
+  av = (GstMvAVMotionVector *) out->data;
+
+  for (row = 0; i < n_vectors; row++) {
+    guint len = MIN (cols, n_vectors - i);
+    gint dst_y = row * bs + bs / 2;
+
+    for (col = 0; col < len; col++, i++) {
+      gint mx = mvs[i].mv_x, my = mvs[i].mv_y;
+      gint dst_x = col * bs + bs / 2;
+
+      av[i].source = -1;
+      av[i].w = bs;
+      av[i].h = bs;
+      av[i].src_x = dst_x + mx / 4;
+      av[i].src_y = dst_y + my / 4;
+      av[i].dst_x = dst_x;
+      av[i].dst_y = dst_y;
+      av[i].flags = 0;
+      av[i].motion_x = mx;
+      av[i].motion_y = my;
+      av[i].motion_scale = 4;
+    }
+  }
+
+  return n_vectors;
+}
+
+static inline guint8 *
+put_varint (guint8 * p, guint32 v)
+{
+  while (v >= 0x80) {
+    *p++ = (guint8) (v | 0x80);
+    v >>= 7;
+  }
+  *p++ = (guint8) v;
+
+  return p;
+}
+
+static inline guint32
+zigzag (gint32 v)
+{
+  return ((guint32) v << 1) ^ (guint32) (v >> 31);
+}
+
+static inline guint32
+unzigzag (guint32 v)
+{
+  return (v >> 1) ^ (0u - (v & 1));
+}
+
+static inline const guint8 *
+get_varint (const guint8 * p, const guint8 * end, guint32 * v)
+{
+  guint shift;
+
+  *v = 0;
+  for (shift = 0; shift < 35 && p < end; shift += 7) {
+    *v |= (guint32) (*p & 0x7f) << shift;
+    if (*p++ < 0x80)
+      return p;
+  }
+
+  return NULL;
+}
+
+/**
+ * gst_mv_pack:
+ * @mvs: the vectors
+ * @n_vectors: number of entries in @mvs
+ * @out: destination, at least GST_MV_PACK_MAX_SIZE (@n_vectors) bytes
+ *
+ * Compresses a vector field. Each vector is coded against the previous one,
+ * starting from a zero vector of weight 0, as a sequence of
+ *
+ *   varint  number of vectors equal to the previous one
+ *   varint  zigzag (mv_x - previous mv_x)
+ *   varint  zigzag (mv_y - previous mv_y) << 2 | weight
+ *
+ * where the last two fields are left out once all vectors are written.
+ * Varints are little endian base 128. Static areas thus cost a byte per run.
+ *
+ * Returns: the number of bytes written.
+ */
+gsize
+gst_mv_pack (const MVInfo * mvs, guint n_vectors, guint8 * out)
+{
+  guint8 *p = out;
+  gint prev_x = 0, prev_y = 0, prev_w = 0;
+  guint32 run = 0;
+  guint i;
+
+  for (i = 0; i < n_vectors; i++) {
+    gint x = mvs[i].mv_x, y = mvs[i].mv_y, w = mvs[i].weight;
+
+    if (x == prev_x && y == prev_y && w == prev_w) {
+      run++;
+      continue;
+    }
+
+    p = put_varint (p, run);
+    p = put_varint (p, zigzag (x - prev_x));
+    p = put_varint (p, (zigzag (y - prev_y) << 2) | (guint32) w);
+    prev_x = x;
+    prev_y = y;
+    prev_w = w;
+    run = 0;
+  }
+
+  if (run > 0)
+    p = put_varint (p, run);
+
+  return p - out;
+}
+
+/**
+ * gst_mv_unpack:
+ * @data: output of gst_mv_pack()
+ * @size: size of @data
+ * @mvs: destination, @n_vectors entries
+ * @n_vectors: number of vectors packed in @data
+ *
+ * Reverses gst_mv_pack().
+ *
+ * Returns: %FALSE when @data is truncated or corrupt.
+ */
+gboolean
+gst_mv_unpack (const guint8 * data, gsize size, MVInfo * mvs, guint n_vectors)
+{
+  const guint8 *p = data, *end = data + size;
+  guint32 run, dx, dy, x = 0, y = 0;
+  MVInfo mv = { 0 };
+  guint i;
+
+  for (i = 0; i < n_vectors;) {
+    if (!(p = get_varint (p, end, &run)) || run > n_vectors - i)
+      return FALSE;
+    for (; run > 0; run--)
+      mvs[i++] = mv;
+    if (i == n_vectors)
+      break;
+
+    if (!(p = get_varint (p, end, &dx)) || !(p = get_varint (p, end, &dy)))
+      return FALSE;
+    x += unzigzag (dx);
+    y += unzigzag (dy >> 2);
+    mv.mv_x = (gint32) x;
+    mv.mv_y = (gint32) y;
+    mv.weight = dy & 3;
+    mvs[i++] = mv;
+  }
+
+  return TRUE;
+}
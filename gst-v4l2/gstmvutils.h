@@ -0,0 +1,160 @@
+/*
+ * gstmvutils.h: helpers for the per-block motion vector field carried in
+ * GstBufferInfoMeta
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MV_UTILS_H__
+#define __GST_MV_UTILS_H__
+
+#include <gst/gst.h>
+
+#include "gst_buffer_info_meta.h"
+
+G_BEGIN_DECLS
+
+typedef struct _GstMvGrid GstMvGrid;
+typedef struct _GstMvActivity GstMvActivity;
+typedef struct _GstMvRegion GstMvRegion;
+typedef struct _GstMvAVMotionVector GstMvAVMotionVector;
+
+/**
+ * GstMvGrid:
+ * @block_size: size in pixels of the square block one vector describes
+ * @cols: number of blocks per row
+ * @rows: number of block rows
+ *
+ * Geometry of a motion vector field. Vectors are stored in raster order,
+ * @cols * @rows entries.
+ */
+struct _GstMvGrid
+{
+  guint block_size;
+  guint cols;
+  guint rows;
+};
+
+/**
+ * GstMvActivity:
+ * @n_blocks: number of vectors inspected
+ * @n_moving: vectors whose magnitude reached the threshold
+ * @moving_ratio: @n_moving / @n_blocks
+ * @mean_magnitude: mean L1 magnitude over the moving vectors
+ * @global_x: median horizontal component over all vectors
+ * @global_y: median vertical component over all vectors
+ *
+ * Frame level summary of a motion vector field.
+ */
+struct _GstMvActivity
+{
+  guint n_blocks;
+  guint n_moving;
+  gdouble moving_ratio;
+  gdouble mean_magnitude;
+  gint global_x;
+  gint global_y;
+};
+
+/**
+ * GstMvRegion:
+ * @x: left column, in blocks
+ * @y: top row, in blocks
+ * @width: width, in blocks
+ * @height: height, in blocks
+ * @n_blocks: number of moving blocks inside the region
+ * @magnitude: sum of the L1 magnitudes of those blocks
+ *
+ * Bounding box of a cluster of moving blocks.
+ */
+struct _GstMvRegion
+{
+  guint x;
+  guint y;
+  guint width;
+  guint height;
+  guint n_blocks;
+  guint64 magnitude;
+};
+
+/**
+ * GstMvAVMotionVector:
+ * @source: -1 as the vectors point into a past frame
+ * @w: block width
+ * @h: block height
+ * @src_x: x of the center of the matching block in the reference frame
+ * @src_y: y of the center of the matching block in the reference frame
+ * @dst_x: x of the center of the block
+ * @dst_y: y of the center of the block
+ * @flags: always 0
+ * @motion_x: @src_x - @dst_x, in 1 / @motion_scale pixels
+ * @motion_y: @src_y - @dst_y, in 1 / @motion_scale pixels
+ * @motion_scale: 4, the vectors are in quarter pixels
+ *
+ * Same layout as AVMotionVector of FFmpeg (libavutil/motion_vector.h), the
+ * side data of AV_FRAME_DATA_MOTION_VECTORS, so an array of them can be
+ * handed to code written against FFmpeg as is.
+ */
+struct _GstMvAVMotionVector
+{
+  gint32 source;
+  guint8 w;
+  guint8 h;
+  gint16 src_x;
+  gint16 src_y;
+  gint16 dst_x;
+  gint16 dst_y;
+  guint64 flags;
+  gint32 motion_x;
+  gint32 motion_y;
+  guint16 motion_scale;
+};
+
+#define GST_MV_MAGNITUDE(mv) (ABS ((gint) (mv)->mv_x) + ABS ((gint) (mv)->mv_y))
+
+/* upper bound on the output of gst_mv_pack() for @n vectors */
+#define GST_MV_PACK_MAX_SIZE(n) ((gsize) (n) * 11)
+
+const MVInfo * gst_mv_field_get_vectors (const metadata_MV * field, guint * n_vectors);
+
+const metadata_MV * gst_mv_buffer_get_field (GstBuffer * buffer);
+
+const encoder_stats * gst_mv_buffer_get_stats (GstBuffer * buffer);
+
+gboolean gst_mv_grid_init (GstMvGrid * grid, guint width, guint height,
+    guint n_vectors);
+
+void gst_mv_compute_activity (const MVInfo * mvs, guint n_vectors,
+    guint threshold, GstMvActivity * activity);
+
+guint gst_mv_find_regions (const MVInfo * mvs, const GstMvGrid * grid,
+    guint threshold, guint min_blocks, GstMvRegion * regions,
+    guint max_regions, GArray * scratch);
+
+guint gst_mv_regions_complement (const GstMvRegion * regions, guint n_regions,
+    guint cols, guint rows, GstMvRegion * out, guint max_out);
+
+guint gst_mv_export_av_motion_vectors (const MVInfo * mvs, guint n_vectors,
+    const GstMvGrid * grid, GArray * out);
+
+gsize gst_mv_pack (const MVInfo * mvs, guint n_vectors, guint8 * out);
+
+gboolean gst_mv_unpack (const guint8 * data, gsize size, MVInfo * mvs,
+    guint n_vectors);
+
+G_END_DECLS
+
+#endif /* __GST_MV_UTILS_H__ */
@@ -61,6 +61,18 @@
 #include "gstv4l2vp8enc.h"
 #include "gstv4l2vp9enc.h"
 
+#ifdef USE_V4L2_TARGET_NV
+#include "gstmvtamper.h"
+#include "gstmvrecord.h"
+#include "gstmvtimelapse.h"
+#include "gstmvfilesink.h"
+#include "gstmvfilesrc.h"
+#include "gstmvshmsink.h"
+#include "gstmvhof.h"
+#include "gstmvstabilize.h"
+#include "gstmvgate.h"
+#endif
+
 /* used in gstv4l2object.c and v4l2_calls.c */
 GST_DEBUG_CATEGORY (v4l2_debug);
 #define GST_CAT_DEFAULT v4l2_debug
@@ -315,6 +327,25 @@ plugin_init (GstPlugin * plugin)
           NULL,
           NULL);
 
+  ret &= gst_element_register (plugin, "nvmvtamper", GST_RANK_NONE,
+      GST_TYPE_MV_TAMPER);
+  ret &= gst_element_register (plugin, "nvmvrecord", GST_RANK_NONE,
+      GST_TYPE_MV_RECORD);
+  ret &= gst_element_register (plugin, "nvmvtimelapse", GST_RANK_NONE,
+      GST_TYPE_MV_TIMELAPSE);
+  ret &= gst_element_register (plugin, "nvmvfilesink", GST_RANK_NONE,
+      GST_TYPE_MV_FILE_SINK);
+  ret &= gst_element_register (plugin, "nvmvfilesrc", GST_RANK_NONE,
+      GST_TYPE_MV_FILE_SRC);
+  ret &= gst_element_register (plugin, "nvmvshmsink", GST_RANK_NONE,
+      GST_TYPE_MV_SHM_SINK);
+  ret &= gst_element_register (plugin, "nvmvhof", GST_RANK_NONE,
+      GST_TYPE_MV_HOF);
+  ret &= gst_element_register (plugin, "nvmvstabilize", GST_RANK_NONE,
+      GST_TYPE_MV_STABILIZE);
+  ret &= gst_element_register (plugin, "nvmvgate", GST_RANK_NONE,
+      GST_TYPE_MV_GATE);
+
   return ret;
 }
 
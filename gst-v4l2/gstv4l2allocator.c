@@ -36,6 +36,9 @@
 #include <gst/allocators/gstdmabuf.h>
 
 #include <fcntl.h>
+#ifdef USE_V4L2_TARGET_NV
+#include <poll.h>
+#endif
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -269,7 +272,7 @@ gst_v4l2_memory_group_new (GstV4l2Allocator * allocator, guint32 index)
      * mapped. Also, even with two memories, both memories map to the same NvBufSurface.
      * Need to take similar care in the is_buffer_valid function. */
     if (!V4L2_TYPE_IS_OUTPUT (obj->type) &&
-       ((!strcmp (obj->videodev, V4L2_DEVICE_PATH_NVDEC))))
+        GST_V4L2_DEVICE_HAS (obj, GST_V4L2_DEVICE_SURFACE_CAPTURE))
       group->n_mem = 1;
 #endif
   } else {
@@ -412,7 +415,7 @@ gst_v4l2_allocator_free (GstAllocator * gallocator, GstMemory * gmem)
       if (mem->data) {
 #ifdef USE_V4L2_TARGET_NV
         if ((V4L2_TYPE_IS_OUTPUT (obj->type)) ||
-            (strcmp (obj->videodev, V4L2_DEVICE_PATH_NVDEC)))
+            !GST_V4L2_DEVICE_HAS (obj, GST_V4L2_DEVICE_SURFACE_CAPTURE))
 #endif
           obj->munmap (mem->data, group->planes[mem->plane].length);
       }
@@ -860,7 +863,7 @@ gst_v4l2_allocator_alloc_mmap (GstV4l2Allocator * allocator)
         GST_ERROR_OBJECT (allocator, "expbuf_failed");
 
       if ((!V4L2_TYPE_IS_OUTPUT (obj->type)) &&
-          (!strcmp (obj->videodev, V4L2_DEVICE_PATH_NVDEC)))
+          GST_V4L2_DEVICE_HAS (obj, GST_V4L2_DEVICE_SURFACE_CAPTURE))
       {
         if (obj->nvbuf_api_version_new)
             retval = NvBufSurfaceFromFd(expbuf.fd, (void**)(&nvbuf_surf));
@@ -1383,6 +1386,43 @@ done:
   return ret;
 }
 
+#ifdef USE_V4L2_TARGET_NV
+/* The elements break this wait with V4L2_CID_MPEG_SET_POLL_INTERRUPT when
+ * they stop or flush, in which case no event is reported and the caller
+ * should give up. */
+static GstFlowReturn
+gst_v4l2_allocator_wait_dqbuf (GstV4l2Allocator * allocator)
+{
+  GstV4l2Object *obj = allocator->obj;
+  gushort revents = 0;
+
+  /* POLLPRI is left out, a pending event would keep the wait from sleeping */
+  if (!gst_v4l2_object_device_poll (obj, POLLERR |
+          (V4L2_TYPE_IS_OUTPUT (obj->type) ? POLLOUT : POLLIN), &revents)) {
+    GST_ERROR_OBJECT (allocator, "failed polling device: %s",
+        g_strerror (errno));
+    return GST_FLOW_ERROR;
+  }
+
+  if (!g_atomic_int_get (&allocator->active))
+    goto flushing;
+
+  /* the driver reports an error while it is not streaming */
+  if (revents & POLLERR)
+    goto flushing;
+
+  if (!(revents & (POLLIN | POLLOUT)))
+    goto flushing;
+
+  return GST_FLOW_OK;
+
+flushing:
+  GST_DEBUG_OBJECT (allocator, "device poll interrupted (events 0x%x)",
+      revents);
+  return GST_FLOW_FLUSHING;
+}
+#endif
+
 GstFlowReturn
 gst_v4l2_allocator_dqbuf (GstV4l2Allocator * allocator,
     GstV4l2MemoryGroup ** group_out)
@@ -1408,13 +1448,19 @@ gst_v4l2_allocator_dqbuf (GstV4l2Allocator * allocator,
   if (obj->ioctl (obj->video_fd, VIDIOC_DQBUF, &buffer) < 0)
     goto error;
 #else
- /* TODO: This could a possible bug in library */
-  while (1)
-  {
-    if (v4l2_ioctl (obj->video_fd, VIDIOC_DQBUF, &buffer) == 0)
-      break;
-    else if (errno == EPIPE)
+  while (v4l2_ioctl (obj->video_fd, VIDIOC_DQBUF, &buffer) < 0) {
+    GstFlowReturn ret;
+
+    if (errno == EINTR)
+      continue;
+
+    if (errno != EAGAIN)
       goto error;
+
+    /* nothing is ready yet, wait for the device instead of retrying */
+    ret = gst_v4l2_allocator_wait_dqbuf (allocator);
+    if (ret != GST_FLOW_OK)
+      return ret;
   }
 #endif
 
@@ -1439,7 +1485,7 @@ gst_v4l2_allocator_dqbuf (GstV4l2Allocator * allocator,
 
   /* TODO: Need to resolve below WAR */
 #ifdef USE_V4L2_TARGET_NV
-  if (V4L2_TYPE_IS_MULTIPLANAR (obj->type) && (!strcmp(obj->videodev, V4L2_DEVICE_PATH_NVDEC))) {
+  if (V4L2_TYPE_IS_MULTIPLANAR (obj->type) && GST_V4L2_IS_NVDEC (obj)) {
     if (obj->nvbuf_api_version_new)
       buffer.m.planes[0].bytesused = sizeof(NvBufSurface);
 #ifndef USE_V4L2_TARGET_NV_CODECSDK
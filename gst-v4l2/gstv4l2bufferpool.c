@@ -88,6 +88,13 @@ report_metadata (GstV4l2Object * obj, guint32 buffer_index,
 static void
 v4l2_video_dec_get_enable_frame_type_reporting (GstV4l2Object * obj,
     guint32 buffer_index, v4l2_ctrl_videodec_outputbuf_metadata * dec_metadata);
+static gboolean
+v4l2_video_enc_set_roi_params (GstV4l2Object * obj, guint32 buffer_index);
+static gint
+v4l2_video_enc_get_metadata (GstV4l2Object * obj, guint32 buffer_index,
+    v4l2_ctrl_videoenc_outputbuf_metadata * enc_metadata);
+static void
+gst_v4l2_buffer_pool_exported_unmap (GstV4l2BufferPool * pool, guint index);
 #endif
 
 static gboolean
@@ -153,6 +160,41 @@ gst_v4l2_buffer_pool_copy_buffer (GstV4l2BufferPool * pool, GstBuffer * dest,
 #ifdef USE_V4L2_TARGET_NV
   gboolean ret;
   gint retn = 0;
+
+  /* encoder output buffers are sized for the usual frame, give the rare
+   * larger bitstream memory of its own, from where the buffer came from */
+  if (GST_V4L2_IS_NVENC (pool->obj) && !V4L2_TYPE_IS_OUTPUT (pool->obj->type)
+      && gst_buffer_get_size (dest) < gst_buffer_get_size (src)) {
+    GstAllocator *allocator = NULL;
+    GstAllocationParams params;
+    GstMemory *mem;
+
+    gst_allocation_params_init (&params);
+    if (pool->other_pool) {
+      GstStructure *config = gst_buffer_pool_get_config (pool->other_pool);
+
+      if (gst_buffer_pool_config_get_allocator (config, &allocator, &params)
+          && allocator && !GST_OBJECT_FLAG_IS_SET (allocator,
+              GST_ALLOCATOR_FLAG_CUSTOM_ALLOC))
+        gst_object_ref (allocator);
+      else
+        allocator = NULL;
+      gst_structure_free (config);
+    }
+
+    GST_DEBUG_OBJECT (pool, "%" G_GSIZE_FORMAT " bytes do not fit in %"
+        G_GSIZE_FORMAT, gst_buffer_get_size (src), gst_buffer_get_size (dest));
+
+    mem = gst_allocator_alloc (allocator, gst_buffer_get_size (src), &params);
+    if (allocator)
+      gst_object_unref (allocator);
+    if (mem == NULL) {
+      GST_ERROR_OBJECT (pool, "could not allocate %" G_GSIZE_FORMAT " bytes",
+          gst_buffer_get_size (src));
+      return GST_FLOW_ERROR;
+    }
+    gst_buffer_replace_all_memory (dest, mem);
+  }
 #endif
 
   if (finfo && (finfo->format != GST_VIDEO_FORMAT_UNKNOWN &&
@@ -195,8 +237,8 @@ gst_v4l2_buffer_pool_copy_buffer (GstV4l2BufferPool * pool, GstBuffer * dest,
   gst_buffer_copy_into (dest, src,
       GST_BUFFER_COPY_FLAGS | GST_BUFFER_COPY_TIMESTAMPS | extra_flags, 0, -1);
 #else
-  if ((!strcmp (pool->obj->videodev, V4L2_DEVICE_PATH_NVDEC)) ||
-      ((!strcmp (pool->obj->videodev, V4L2_DEVICE_PATH_NVENC)) && (!V4L2_TYPE_IS_OUTPUT (pool->obj->type))))
+  if (GST_V4L2_IS_NVDEC (pool->obj) ||
+      (GST_V4L2_IS_NVENC (pool->obj) && (!V4L2_TYPE_IS_OUTPUT (pool->obj->type))))
   {
     ret = gst_buffer_copy_into (dest, src,
             GST_BUFFER_COPY_FLAGS | GST_BUFFER_COPY_TIMESTAMPS | extra_flags, 0, -1);
@@ -204,7 +246,7 @@ gst_v4l2_buffer_pool_copy_buffer (GstV4l2BufferPool * pool, GstBuffer * dest,
       GST_ERROR_OBJECT (src,"Copy Failed");
   }
 
-  if ((!strcmp (pool->obj->videodev, V4L2_DEVICE_PATH_NVENC)) && !V4L2_TYPE_IS_OUTPUT (pool->obj->type))
+  if (GST_V4L2_IS_NVENC (pool->obj) && !V4L2_TYPE_IS_OUTPUT (pool->obj->type))
   {
     GstMapInfo outmap = { NULL, (GstMapFlags) 0, NULL, 0, 0, };
     void *sBaseAddr = NULL;
@@ -256,7 +298,7 @@ gst_v4l2_buffer_pool_copy_buffer (GstV4l2BufferPool * pool, GstBuffer * dest,
     gst_buffer_unmap (dest, &outmap);
   }
 
-  if ((!strcmp (pool->obj->videodev, V4L2_DEVICE_PATH_NVENC)) && V4L2_TYPE_IS_OUTPUT (pool->obj->type))
+  if (GST_V4L2_DEVICE_HAS (pool->obj, GST_V4L2_DEVICE_DMABUF_OUTPUT) && V4L2_TYPE_IS_OUTPUT (pool->obj->type))
   {
     gint input_dmabuf_fd = -1;
     GstV4l2Memory *inmemory = NULL;
@@ -330,6 +372,7 @@ struct UserPtrData
 {
   GstBuffer *buffer;
   gboolean is_frame;
+  gboolean cached;
   GstVideoFrame frame;
   GstMapInfo map;
 };
@@ -350,7 +393,7 @@ _unmap_userptr_frame (struct UserPtrData *data)
 {
   if (data->is_frame)
     gst_video_frame_unmap (&data->frame);
-  else
+  else if (!data->cached)
     gst_buffer_unmap (data->buffer, &data->map);
 
   if (data->buffer)
@@ -359,6 +402,104 @@ _unmap_userptr_frame (struct UserPtrData *data)
   g_slice_free (struct UserPtrData, data);
 }
 
+static GstV4l2UserPtrCache *
+gst_v4l2_userptr_cache_new (void)
+{
+  GstV4l2UserPtrCache *cache = g_slice_new0 (GstV4l2UserPtrCache);
+
+  cache->refcount = 1;
+  g_mutex_init (&cache->lock);
+
+  return cache;
+}
+
+static void
+gst_v4l2_userptr_cache_unref (GstV4l2UserPtrCache * cache)
+{
+  if (!g_atomic_int_dec_and_test (&cache->refcount))
+    return;
+
+  g_mutex_clear (&cache->lock);
+  g_slice_free (GstV4l2UserPtrCache, cache);
+}
+
+/* The only place an entry is removed: the memory cannot be weak unreffed
+ * safely from another thread, it may be in the middle of being freed */
+static void
+gst_v4l2_buffer_pool_userptr_freed (gpointer user_data, GstMiniObject * obj)
+{
+  GstV4l2UserPtrCache *cache = user_data;
+  guint i;
+
+  g_mutex_lock (&cache->lock);
+  for (i = 0; i < GST_V4L2_USERPTR_CACHE_SIZE; i++) {
+    if (cache->entries[i].mem == (GstMemory *) obj) {
+      cache->entries[i].mem = NULL;
+      break;
+    }
+  }
+  g_mutex_unlock (&cache->lock);
+
+  gst_v4l2_userptr_cache_unref (cache);
+}
+
+/* Demuxers and parsers keep handing out the same few system memory blocks,
+ * or slices of them. Their address is fixed for as long as they live, so it
+ * is resolved once and then found again by memory identity instead of
+ * mapping and unmapping every buffer that is queued. Blocks stay cached
+ * until they are freed, new ones are mapped as usual while the cache is
+ * full. */
+static gboolean
+gst_v4l2_buffer_pool_lookup_userptr (GstV4l2BufferPool * pool,
+    GstMemory * mem, gpointer * ptr)
+{
+  GstV4l2UserPtrCache *cache = pool->userptr_cache;
+  GstV4l2UserPtrMapping *entry = NULL;
+  GstMemory *root = mem;
+  GstMapInfo map;
+  guint i;
+
+  if (!gst_memory_is_type (mem, GST_ALLOCATOR_SYSMEM))
+    return FALSE;
+
+  /* the caller holds mem, which holds its parents */
+  while (root->parent)
+    root = root->parent;
+
+  g_mutex_lock (&cache->lock);
+  for (i = 0; i < GST_V4L2_USERPTR_CACHE_SIZE; i++) {
+    GstV4l2UserPtrMapping *slot = &cache->entries[i];
+
+    if (slot->mem == root) {
+      entry = slot;
+      goto found;
+    }
+
+    if (entry == NULL && slot->mem == NULL)
+      entry = slot;
+  }
+
+  if (entry == NULL || !gst_memory_map (root, &map, GST_MAP_READ)) {
+    g_mutex_unlock (&cache->lock);
+    return FALSE;
+  }
+  entry->base = (guint8 *) map.data - root->offset;
+  gst_memory_unmap (root, &map);
+
+  entry->mem = root;
+  g_atomic_int_inc (&cache->refcount);
+  gst_mini_object_weak_ref (GST_MINI_OBJECT_CAST (root),
+      gst_v4l2_buffer_pool_userptr_freed, cache);
+
+  GST_LOG_OBJECT (pool, "caching address %p of memory %p", entry->base, root);
+
+found:
+  *ptr = entry->base + mem->offset;
+  g_mutex_unlock (&cache->lock);
+
+  return TRUE;
+}
+
 static GstFlowReturn
 gst_v4l2_buffer_pool_import_userptr (GstV4l2BufferPool * pool,
     GstBuffer * dest, GstBuffer * src)
@@ -448,14 +589,23 @@ gst_v4l2_buffer_pool_import_userptr (GstV4l2BufferPool * pool,
 
     data->is_frame = FALSE;
 
-    if (!gst_buffer_map (src, &data->map, flags))
-      goto invalid_buffer;
+    if (V4L2_TYPE_IS_OUTPUT (pool->obj->type) &&
+        gst_buffer_n_memory (src) == 1 &&
+        gst_v4l2_buffer_pool_lookup_userptr (pool,
+            gst_buffer_peek_memory (src, 0), &ptr[0])) {
+      /* the reference on src below keeps the memory alive while queued */
+      data->cached = TRUE;
+      size[0] = gst_buffer_peek_memory (src, 0)->size;
+    } else {
+      if (!gst_buffer_map (src, &data->map, flags))
+        goto invalid_buffer;
 
-    ptr[0] = data->map.data;
-    size[0] = data->map.size;
+      ptr[0] = data->map.data;
+      size[0] = data->map.size;
+    }
 
     if (!gst_v4l2_allocator_import_userptr (pool->vallocator, group,
-            data->map.size, 1, ptr, size))
+            size[0], 1, ptr, size))
       goto import_failed;
   }
 
@@ -494,6 +644,93 @@ import_failed:
   }
 }
 
+#ifdef USE_V4L2_TARGET_NV
+/* Get the dmabuf behind the NvBuffer or NvBufSurface upstream handed us */
+static gboolean
+gst_v4l2_buffer_pool_get_dmafd (GstV4l2BufferPool * pool, GstBuffer * src,
+    gint * dmafd)
+{
+  GstMapInfo inmap = { NULL, (GstMapFlags) 0, NULL, 0, 0, };
+  gboolean ret = TRUE;
+
+  if (!gst_buffer_map (src, &inmap, GST_MAP_READ))
+    return FALSE;
+
+#ifndef USE_V4L2_TARGET_NV_CODECSDK
+  if (pool->obj->nvbuf_api_version_new) {
+    NvBufSurface *src_bufsurf = (NvBufSurface *) inmap.data;
+    *dmafd = src_bufsurf->surfaceList->bufferDesc;
+  } else {
+    ret = ExtractFdFromNvBuffer (inmap.data, dmafd) == 0;
+  }
+#else
+  /* device memory surfaces are not dmabufs */
+  ret = FALSE;
+#endif
+
+  gst_buffer_unmap (src, &inmap);
+
+  return ret;
+}
+
+/* Upstream surface pools hand out the same few dmabufs over and over. Queue
+ * each of them on the V4L2 buffer it was imported into last time, so that
+ * the driver finds the dmabuf already attached to that index instead of
+ * mapping it again. Falls back to any free buffer. */
+static GstFlowReturn
+gst_v4l2_buffer_pool_acquire_import (GstV4l2BufferPool * pool,
+    GstBuffer * src, GstBuffer ** buffer)
+{
+  GstBufferPool *bpool = GST_BUFFER_POOL (pool);
+  GstBufferPoolAcquireParams params = { 0 };
+  GstBuffer *skipped[VIDEO_MAX_FRAME];
+  GstV4l2MemoryGroup *group = NULL;
+  GstFlowReturn ret;
+  guint n_skipped = 0, i;
+  gint dmafd = -1, index = -1;
+
+  params.flags = GST_BUFFER_POOL_ACQUIRE_FLAG_DONTWAIT;
+  ret = gst_buffer_pool_acquire_buffer (bpool, buffer, &params);
+  if (ret != GST_FLOW_OK)
+    return ret;
+
+  if (gst_v4l2_buffer_pool_get_dmafd (pool, src, &dmafd)) {
+    for (i = 0; i < VIDEO_MAX_FRAME; i++) {
+      if (pool->import_fd[i] == dmafd) {
+        index = i;
+        break;
+      }
+    }
+  }
+
+  /* unknown dmabuf, or its buffer is still queued */
+  if (index < 0 || pool->buffers[index] != NULL)
+    return GST_FLOW_OK;
+
+  while (gst_v4l2_is_buffer_valid (*buffer, &group, pool->obj->is_encode) &&
+      group->buffer.index != (guint32) index && n_skipped < VIDEO_MAX_FRAME) {
+    skipped[n_skipped++] = *buffer;
+
+    if (gst_buffer_pool_acquire_buffer (bpool, buffer, &params) != GST_FLOW_OK) {
+      /* held somewhere else, settle for the first free one */
+      *buffer = skipped[0];
+      skipped[0] = NULL;
+      break;
+    }
+  }
+
+  GST_LOG_OBJECT (pool, "dmabuf %d was on buffer %d, skipped %u", dmafd,
+      index, n_skipped);
+
+  for (i = 0; i < n_skipped; i++) {
+    if (skipped[i])
+      gst_buffer_unref (skipped[i]);
+  }
+
+  return GST_FLOW_OK;
+}
+#endif
+
 static GstFlowReturn
 gst_v4l2_buffer_pool_import_dmabuf (GstV4l2BufferPool * pool,
     GstBuffer * dest, GstBuffer * src)
@@ -505,7 +742,6 @@ gst_v4l2_buffer_pool_import_dmabuf (GstV4l2BufferPool * pool,
   GstMemory *dma_mem[GST_VIDEO_MAX_PLANES] = { 0 };
 #else
   guint i;
-  gint retn = 0;
 #endif
 
   GST_LOG_OBJECT (pool, "importing dmabuf");
@@ -531,33 +767,16 @@ gst_v4l2_buffer_pool_import_dmabuf (GstV4l2BufferPool * pool,
 #else
   g_return_val_if_fail (pool->vallocator->memory == V4L2_MEMORY_DMABUF, FALSE);
 
-  if ((!strcmp (pool->obj->videodev, V4L2_DEVICE_PATH_NVENC)) && V4L2_TYPE_IS_OUTPUT (pool->obj->type))
+  if (GST_V4L2_DEVICE_HAS (pool->obj, GST_V4L2_DEVICE_DMABUF_OUTPUT) && V4L2_TYPE_IS_OUTPUT (pool->obj->type))
   {
     gint dmafd = -1;
     GstV4l2Memory *mem = NULL;
     GstMemory *inmemory = NULL;
-    GstMapInfo inmap = { NULL, (GstMapFlags) 0, NULL, 0, 0, };
-
-    if (!gst_buffer_map (src, &inmap, GST_MAP_READ))
-    {
-      GST_ERROR_OBJECT (pool, "could not map input buffer");
-      return GST_FLOW_ERROR;
-    }
 
 #ifndef USE_V4L2_TARGET_NV_CODECSDK
-    if (pool->obj->nvbuf_api_version_new)
-    {
-      NvBufSurface *src_bufsurf = (NvBufSurface*)inmap.data;
-      dmafd = src_bufsurf->surfaceList->bufferDesc;
-    }
-    else
-    {
-      retn = ExtractFdFromNvBuffer (inmap.data, &dmafd);
-      if (retn != 0) {
-        GST_ERROR_OBJECT (pool, "could not extract fd, failed to import dmabuf");
-        gst_buffer_unmap (src, &inmap);
-        return GST_FLOW_ERROR;
-      }
+    if (!gst_v4l2_buffer_pool_get_dmafd (pool, src, &dmafd)) {
+      GST_ERROR_OBJECT (pool, "could not extract fd, failed to import dmabuf");
+      return GST_FLOW_ERROR;
     }
 
     /* NOTE: gst-memory with input buffer for nvidia proprietary plugins mostly will be 1,
@@ -595,13 +814,13 @@ gst_v4l2_buffer_pool_import_dmabuf (GstV4l2BufferPool * pool,
     } else {
       group->buffer.length = group->n_mem;
     }
+
+    pool->import_fd[group->buffer.index] = dmafd;
 #else
     //TODO Add encoder support for dGPU
     GST_ERROR_OBJECT(pool, "FIXME : DMABUF_IMPORT for dGPU not yet supported %s ", pool->obj->videodev);
     return GST_FLOW_ERROR;
 #endif
-
-    gst_buffer_unmap(src, &inmap);
   } else {
     GST_INFO_OBJECT (pool, "DMABUF_IMPORT io mode not supported for device %s ",
         pool->obj->videodev);
@@ -835,6 +1054,15 @@ gst_v4l2_buffer_pool_set_config (GstBufferPool * bpool, GstStructure * config)
     GST_INFO_OBJECT (pool, "reducing maximum buffers to %u", max_buffers);
   }
 
+#ifdef USE_V4L2_TARGET_NV
+  if (!V4L2_TYPE_IS_OUTPUT (obj->type) && obj->max_capture_buffers != 0 &&
+      max_buffers > MAX (obj->max_capture_buffers, min_buffers)) {
+    updated = TRUE;
+    max_buffers = MAX (obj->max_capture_buffers, min_buffers);
+    GST_INFO_OBJECT (pool, "limiting capture buffers to %u", max_buffers);
+  }
+#endif
+
   if (min_buffers > max_buffers) {
     updated = TRUE;
     min_buffers = max_buffers;
@@ -908,6 +1136,78 @@ gst_v4l2_buffer_pool_resurect_buffer (GstV4l2BufferPool * pool)
   return ret;
 }
 
+#ifdef USE_V4L2_TARGET_NV
+/* frames in a row with spare buffers queued before a grown one is retired */
+#define GST_V4L2_SHRINK_DELAY 300
+
+/* Called for every dequeued capture buffer. When downstream holds so many
+ * buffers that the driver is about to starve, one more is queued, reusing a
+ * retired buffer or creating one with CREATE_BUFS, up to the maximum of the
+ * pool. Grown buffers are retired again one by one after a long stretch with
+ * spare buffers in the queue. V4L2 can't free a single buffer, retired ones
+ * wait in the pool until they are needed again or the pool stops. */
+static void
+gst_v4l2_buffer_pool_adjust_capture (GstV4l2BufferPool * pool)
+{
+  gint num_queued = g_atomic_int_get (&pool->num_queued);
+
+  if (num_queued < (gint) pool->min_latency) {
+    pool->slack_frames = 0;
+    g_atomic_int_set (&pool->n_retire, 0);
+
+    if (g_atomic_int_get (&pool->n_parked) == 0 &&
+        !GST_V4L2_ALLOCATOR_CAN_ALLOCATE (pool->vallocator, MMAP))
+      return;
+
+    if (gst_v4l2_buffer_pool_resurect_buffer (pool) != GST_FLOW_OK)
+      return;
+
+    if (g_atomic_int_get (&pool->n_parked) > 0)
+      g_atomic_int_add (&pool->n_parked, -1);
+    g_atomic_int_inc (&pool->n_grown);
+
+    GST_CAT_LOG_OBJECT (CAT_PERFORMANCE, pool,
+        "%d buffers queued, grew to %d extra buffers", num_queued,
+        g_atomic_int_get (&pool->n_grown));
+    return;
+  }
+
+  if (g_atomic_int_get (&pool->n_grown) <=
+      g_atomic_int_get (&pool->n_retire)) {
+    pool->slack_frames = 0;
+    return;
+  }
+
+  /* one spare buffer is normal, the one downstream gets next */
+  if (num_queued > (gint) pool->min_latency + 1) {
+    if (++pool->slack_frames >= GST_V4L2_SHRINK_DELAY) {
+      pool->slack_frames = 0;
+      g_atomic_int_inc (&pool->n_retire);
+    }
+  } else {
+    pool->slack_frames = 0;
+  }
+}
+
+/* Takes one pending retirement, if any */
+static gboolean
+gst_v4l2_buffer_pool_take_retire (GstV4l2BufferPool * pool)
+{
+  gint n;
+
+  do {
+    n = g_atomic_int_get (&pool->n_retire);
+    if (n <= 0)
+      return FALSE;
+  } while (!g_atomic_int_compare_and_exchange (&pool->n_retire, n, n - 1));
+
+  g_atomic_int_add (&pool->n_grown, -1);
+  g_atomic_int_inc (&pool->n_parked);
+
+  return TRUE;
+}
+#endif
+
 static gboolean
 gst_v4l2_buffer_pool_streamon (GstV4l2BufferPool * pool)
 {
@@ -928,6 +1228,14 @@ gst_v4l2_buffer_pool_streamon (GstV4l2BufferPool * pool)
          * them back. */
         while (gst_v4l2_buffer_pool_resurect_buffer (pool) == GST_FLOW_OK)
           continue;
+#ifdef USE_V4L2_TARGET_NV
+        /* that brought the retired buffers back too */
+        g_atomic_int_add (&pool->n_grown,
+            g_atomic_int_get (&pool->n_parked));
+        g_atomic_int_set (&pool->n_parked, 0);
+        g_atomic_int_set (&pool->n_retire, 0);
+        pool->has_warned_on_enc_metadata = FALSE;
+#endif
       }
 
       if (obj->ioctl (pool->video_fd, VIDIOC_STREAMON, &obj->type) < 0)
@@ -1183,6 +1491,9 @@ gst_v4l2_buffer_pool_stop (GstBufferPool * bpool)
 {
   GstV4l2BufferPool *pool = GST_V4L2_BUFFER_POOL (bpool);
   gboolean ret;
+#ifdef USE_V4L2_TARGET_NV
+  guint i;
+#endif
 
   GST_DEBUG_OBJECT (pool, "stopping pool");
 
@@ -1200,6 +1511,12 @@ gst_v4l2_buffer_pool_stop (GstBufferPool * bpool)
 
   gst_v4l2_buffer_pool_streamoff (pool);
 
+#ifdef USE_V4L2_TARGET_NV
+  /* the exported buffers are all back, stop waits for outstanding ones */
+  for (i = 0; i < VIDEO_MAX_FRAME; i++)
+    gst_v4l2_buffer_pool_exported_unmap (pool, i);
+#endif
+
   ret = GST_BUFFER_POOL_CLASS (parent_class)->stop (bpool);
 
   if (ret && pool->vallocator) {
@@ -1311,7 +1628,8 @@ select_error:
 }
 
 static GstFlowReturn
-gst_v4l2_buffer_pool_qbuf (GstV4l2BufferPool * pool, GstBuffer * buf)
+gst_v4l2_buffer_pool_qbuf (GstV4l2BufferPool * pool, GstBuffer * buf,
+    guint32 * frame_number)
 {
   GstV4l2MemoryGroup *group = NULL;
   const GstV4l2Object *obj = pool->obj;
@@ -1359,11 +1677,25 @@ gst_v4l2_buffer_pool_qbuf (GstV4l2BufferPool * pool, GstBuffer * buf)
     group->buffer.field = field;
   }
 
-  if (GST_BUFFER_TIMESTAMP_IS_VALID (buf)) {
+  if (frame_number) {
+    /* the driver copies the timestamp to the matching capture buffer, use it
+     * to carry the frame number across */
+    group->buffer.timestamp.tv_sec = *frame_number;
+    group->buffer.timestamp.tv_usec = 0;
+  } else if (GST_BUFFER_TIMESTAMP_IS_VALID (buf)) {
     timestamp = GST_BUFFER_TIMESTAMP (buf);
     GST_TIME_TO_TIMEVAL (timestamp, group->buffer.timestamp);
   }
 
+#ifdef USE_V4L2_TARGET_NV
+  /* the config store of the buffer tells the encoder which input metadata
+   * applies to it */
+  if (V4L2_TYPE_IS_OUTPUT (obj->type) && obj->enableROI) {
+    if (v4l2_video_enc_set_roi_params (pool->obj, index))
+      group->buffer.reserved2 = index;
+  }
+#endif
+
   GST_OBJECT_LOCK (pool);
   g_atomic_int_inc (&pool->num_queued);
   pool->buffers[index] = buf;
@@ -1397,9 +1729,9 @@ queue_failed:
 // ------------------- META CHANGES -------------------
 
 #ifdef USE_V4L2_TARGET_NV
-static GstFlowReturn gst_v4l2_buffer_pool_dqbuf (GstV4l2BufferPool * pool, GstBuffer ** buffer, GstBufferInfo *p_buffer_info )  
+static GstFlowReturn gst_v4l2_buffer_pool_dqbuf (GstV4l2BufferPool * pool, GstBuffer ** buffer, GstBufferInfo *p_buffer_info, guint32 * frame_number )  
 #else
-static GstFlowReturn gst_v4l2_buffer_pool_dqbuf (GstV4l2BufferPool * pool, GstBuffer ** buffer, void )
+static GstFlowReturn gst_v4l2_buffer_pool_dqbuf (GstV4l2BufferPool * pool, GstBuffer ** buffer, void, guint32 * frame_number )
 #endif
 {
   GstFlowReturn res;
@@ -1411,6 +1743,11 @@ static GstFlowReturn gst_v4l2_buffer_pool_dqbuf (GstV4l2BufferPool * pool, GstBu
   gsize size;
   gint i;
 
+#ifdef USE_V4L2_TARGET_NV
+  /* The device cannot be polled here, this only waits while nothing is
+   * queued. DQBUF on the non-blocking node returns a finished buffer at
+   * once, so dequeueing several per call would not save a wake-up. */
+#endif
   if ((res = gst_v4l2_buffer_pool_poll (pool)) != GST_FLOW_OK)
     goto poll_failed;
 
@@ -1440,7 +1777,7 @@ static GstFlowReturn gst_v4l2_buffer_pool_dqbuf (GstV4l2BufferPool * pool, GstBu
 #ifdef USE_V4L2_TARGET_NV
   if (pool->obj->type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE
       && obj->enableMVBufferMeta
-      && (!strcmp (obj->videodev, V4L2_DEVICE_PATH_NVENC)))
+      && GST_V4L2_DEVICE_HAS (obj, GST_V4L2_DEVICE_MV_METADATA))
   {
     v4l2_ctrl_videoenc_outputbuf_metadata_MV enc_mv_metadata;
     memset ((void *) &enc_mv_metadata, 0, sizeof (enc_mv_metadata));
@@ -1501,6 +1838,22 @@ static GstFlowReturn gst_v4l2_buffer_pool_dqbuf (GstV4l2BufferPool * pool, GstBu
         // ------------------- META CHANGES -------------------
         }
     }
+
+    if (p_buffer_info != NULL)
+    {
+      v4l2_ctrl_videoenc_outputbuf_metadata enc_metadata;
+      memset ((void *) &enc_metadata, 0, sizeof (enc_metadata));
+
+      if (v4l2_video_enc_get_metadata (obj, group->buffer.index,
+              &enc_metadata) == 0) {
+        SetMyEncoderStats (p_buffer_info, &enc_metadata);
+      } else if (!pool->has_warned_on_enc_metadata) {
+        /* this runs for every frame, warn only once per stream */
+        pool->has_warned_on_enc_metadata = TRUE;
+        GST_WARNING_OBJECT (pool, "Error while getting encoder metadata: %s",
+            g_strerror (errno));
+      }
+    }
   }
 
   for (i = 0; i < group->n_mem; i++) {
@@ -1536,7 +1889,7 @@ static GstFlowReturn gst_v4l2_buffer_pool_dqbuf (GstV4l2BufferPool * pool, GstBu
   }
 
   if (pool->obj->type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE
-      && (!strcmp(obj->videodev, V4L2_DEVICE_PATH_NVDEC))
+      && GST_V4L2_DEVICE_HAS (obj, GST_V4L2_DEVICE_DEC_METADATA)
       && (obj->Enable_frame_type_reporting || obj->Enable_error_check)) {
     v4l2_ctrl_videodec_outputbuf_metadata dec_metadata;
     memset ((void *) &dec_metadata, 0, sizeof (dec_metadata));
@@ -1547,6 +1900,9 @@ static GstFlowReturn gst_v4l2_buffer_pool_dqbuf (GstV4l2BufferPool * pool, GstBu
 #endif
   timestamp = GST_TIMEVAL_TO_TIME (group->buffer.timestamp);
 
+  if (!V4L2_TYPE_IS_OUTPUT (obj->type) && frame_number)
+    *frame_number = group->buffer.timestamp.tv_sec;
+
   size = 0;
   vmeta = gst_buffer_get_video_meta (outbuf);
   for (i = 0; i < group->n_mem; i++) {
@@ -1662,6 +2018,11 @@ eos:
   }
 dqbuf_failed:
   {
+#ifdef USE_V4L2_TARGET_NV
+    /* the device wait was interrupted by a flush or stop */
+    if (res == GST_FLOW_FLUSHING)
+      return res;
+#endif
     return GST_FLOW_ERROR;
   }
 no_buffer:
@@ -1710,7 +2071,7 @@ gst_v4l2_buffer_pool_acquire_buffer (GstBufferPool * bpool, GstBuffer ** buffer,
           /* just dequeue a buffer, we basically use the queue of v4l2 as the
            * storage for our buffers. This function does poll first so we can
            * interrupt it fine. */
-          ret = gst_v4l2_buffer_pool_dqbuf (pool, buffer, NULL );
+          ret = gst_v4l2_buffer_pool_dqbuf (pool, buffer, NULL, NULL );
           
           break;
         }
@@ -1787,10 +2148,19 @@ gst_v4l2_buffer_pool_release_buffer (GstBufferPool * bpool, GstBuffer * buffer)
           if (gst_v4l2_is_buffer_valid (buffer, &group)) {
 #endif
             gst_v4l2_allocator_reset_group (pool->vallocator, group);
+#ifdef USE_V4L2_TARGET_NV
+            /* keep a retired buffer out of the driver */
+            if (gst_v4l2_buffer_pool_take_retire (pool)) {
+              GST_CAT_LOG_OBJECT (CAT_PERFORMANCE, pool,
+                  "retiring buffer %d", group->buffer.index);
+              pclass->release_buffer (bpool, buffer);
+              break;
+            }
+#endif
             /* queue back in the device */
             if (pool->other_pool)
               gst_v4l2_buffer_pool_prepare_buffer (pool, buffer, NULL);
-            if (gst_v4l2_buffer_pool_qbuf (pool, buffer) != GST_FLOW_OK)
+            if (gst_v4l2_buffer_pool_qbuf (pool, buffer, NULL) != GST_FLOW_OK)
               pclass->release_buffer (bpool, buffer);
           } else {
             /* Simply release invalide/modified buffer, the allocator will
@@ -1907,6 +2277,9 @@ gst_v4l2_buffer_pool_finalize (GObject * object)
    * multiple times */
   gst_object_unref (pool->obj->element);
 
+  /* entries still cached keep it alive until their memory is freed */
+  gst_v4l2_userptr_cache_unref (pool->userptr_cache);
+
   g_cond_clear (&pool->empty_cond);
 
   /* FIXME have we done enough here ? */
@@ -1922,6 +2295,11 @@ gst_v4l2_buffer_pool_init (GstV4l2BufferPool * pool)
 #endif
   g_cond_init (&pool->empty_cond);
   pool->empty = TRUE;
+  pool->userptr_cache = gst_v4l2_userptr_cache_new ();
+#ifdef USE_V4L2_TARGET_NV
+  memset (pool->import_fd, -1, sizeof (pool->import_fd));
+  memset (pool->export_fd, -1, sizeof (pool->export_fd));
+#endif
 }
 
 static void
@@ -2007,14 +2385,14 @@ gst_v4l2_buffer_pool_new (GstV4l2Object * obj, GstCaps * caps)
   gst_buffer_pool_config_set_params (config, caps, obj->info.size, 0, 0);
 #else
   /* TODO: Fix below once have a single source for Jetson TX1, TX2 and Xavier */
-  if (!strcmp(obj->videodev, V4L2_DEVICE_PATH_NVDEC)) {
+  if (GST_V4L2_IS_NVDEC (obj)) {
       gst_buffer_pool_config_set_params (config, caps, obj->info.size, 0, 0);
      /* Need to adjust the size to 0th plane's size since we will only output
      v4l2 memory associated with 0th plane. */
       if (!V4L2_TYPE_IS_OUTPUT(obj->type))
         gst_buffer_pool_config_set_params (config, caps, obj->info.width * obj->info.height, 0, 0);
   }
-  if (!strcmp(obj->videodev, V4L2_DEVICE_PATH_NVENC))
+  if (GST_V4L2_IS_NVENC (obj))
       gst_buffer_pool_config_set_params (config, caps, obj->info.size, 0, 0);
 #endif
   /* This will simply set a default config, but will not configure the pool
@@ -2103,15 +2481,20 @@ cleanup:
  * gst_v4l2_buffer_pool_process:
  * @bpool: a #GstBufferPool
  * @buf: a #GstBuffer, maybe be replaced
+ * @frame_number: (inout) (allow-none): the system frame number of @buf
  *
  * Process @buf in @bpool. For capture devices, this functions fills @buf with
  * data from the device. For output devices, this functions send the contents of
  * @buf to the device for playback.
  *
+ * For M2M devices the frame number given with an output buffer is returned
+ * with the capture buffer produced from it.
+ *
  * Returns: %GST_FLOW_OK on success.
  */
 GstFlowReturn
-gst_v4l2_buffer_pool_process (GstV4l2BufferPool * pool, GstBuffer ** buf)
+gst_v4l2_buffer_pool_process (GstV4l2BufferPool * pool, GstBuffer ** buf,
+    guint32 * frame_number)
 {
   GstFlowReturn ret = GST_FLOW_OK;
   GstBufferPool *bpool = GST_BUFFER_POOL_CAST (pool);
@@ -2138,7 +2521,17 @@ gst_v4l2_buffer_pool_process (GstV4l2BufferPool * pool, GstBuffer ** buf)
           GstBuffer *tmp;
 
           if ((*buf)->pool == bpool) {
-#ifndef USE_V4L2_TARGET_NV
+#ifdef USE_V4L2_TARGET_NV
+            GstV4l2MemoryGroup *group;
+
+            /* dequeued in _acquire(), the group still has the timestamp */
+            if (frame_number && gst_v4l2_is_buffer_valid (*buf, &group,
+                    pool->obj->is_encode))
+              *frame_number = group->buffer.timestamp.tv_sec;
+
+            /* downstream keeps this one, don't let the driver starve */
+            gst_v4l2_buffer_pool_adjust_capture (pool);
+#else
             guint num_queued;
             gsize size = gst_buffer_get_size (*buf);
 
@@ -2190,9 +2583,13 @@ gst_v4l2_buffer_pool_process (GstV4l2BufferPool * pool, GstBuffer ** buf)
           /* buffer not from our pool, grab a frame and copy it into the target */
           #ifdef USE_V4L2_TARGET_NV
           GstBufferInfo buffer_info;
-          if ((ret = gst_v4l2_buffer_pool_dqbuf(pool, &tmp, &buffer_info )) != GST_FLOW_OK)
+          /* the vectors themselves are only copied up to bufSize */
+          buffer_info.m_enc_mv_metadata.bufSize = 0;
+          buffer_info.m_enc_mv_metadata.m_nInfoCount = 0;
+          memset (&buffer_info.m_enc_stats, 0, sizeof (buffer_info.m_enc_stats));
+          if ((ret = gst_v4l2_buffer_pool_dqbuf(pool, &tmp, &buffer_info, frame_number )) != GST_FLOW_OK)
           #else
-          if ((ret = gst_v4l2_buffer_pool_dqbuf(pool, &tmp, NULL )) != GST_FLOW_OK)
+          if ((ret = gst_v4l2_buffer_pool_dqbuf(pool, &tmp, NULL, frame_number )) != GST_FLOW_OK)
           #endif
             goto done;
 
@@ -2337,6 +2734,11 @@ gst_v4l2_buffer_pool_process (GstV4l2BufferPool * pool, GstBuffer ** buf)
              * be strange because we would expect the upstream element to have
              * allocated them and returned to us.. */
             params.flags = GST_BUFFER_POOL_ACQUIRE_FLAG_DONTWAIT;
+#ifdef USE_V4L2_TARGET_NV
+            if (obj->mode == GST_V4L2_IO_DMABUF_IMPORT)
+              ret = gst_v4l2_buffer_pool_acquire_import (pool, *buf, &to_queue);
+            else
+#endif
             ret = gst_buffer_pool_acquire_buffer (bpool, &to_queue, &params);
             if (ret != GST_FLOW_OK)
               goto acquire_failed;
@@ -2348,7 +2750,8 @@ gst_v4l2_buffer_pool_process (GstV4l2BufferPool * pool, GstBuffer ** buf)
             }
           }
 
-          if ((ret = gst_v4l2_buffer_pool_qbuf (pool, to_queue)) != GST_FLOW_OK)
+          if ((ret = gst_v4l2_buffer_pool_qbuf (pool, to_queue,
+                      frame_number)) != GST_FLOW_OK)
             goto queue_failed;
 
           /* if we are not streaming yet (this is the first buffer, start
@@ -2388,7 +2791,7 @@ gst_v4l2_buffer_pool_process (GstV4l2BufferPool * pool, GstBuffer ** buf)
             GstBuffer *out;
             /* all buffers are queued, try to dequeue one and release it back
              * into the pool so that _acquire can get to it again. */
-            ret = gst_v4l2_buffer_pool_dqbuf (pool, &out, NULL );
+            ret = gst_v4l2_buffer_pool_dqbuf (pool, &out, NULL, NULL );
             
             if (ret == GST_FLOW_OK && out->pool == NULL)
               /* release the rendered buffer back into the pool. This wakes up any
@@ -2455,6 +2858,226 @@ start_failed:
   }
 }
 
+#ifdef USE_V4L2_TARGET_NV
+typedef struct
+{
+  GstV4l2BufferPool *pool;
+  GstBuffer *buffer;
+} GstV4l2ExportedBuffer;
+
+static void
+gst_v4l2_buffer_pool_exported_unmap (GstV4l2BufferPool * pool, guint index)
+{
+  if (pool->export_data[index] == NULL)
+    return;
+
+  if (pool->export_surf[index])
+    NvBufSurfaceUnMap (pool->export_surf[index], 0, 0);
+#ifndef USE_V4L2_TARGET_NV_CODECSDK
+  else
+    NvBufferMemUnMap (pool->export_fd[index], 0, &pool->export_data[index]);
+#endif
+
+  pool->export_fd[index] = -1;
+  pool->export_surf[index] = NULL;
+  pool->export_data[index] = NULL;
+}
+
+/* Returns the bitstream of @index for reading the way the copy path maps it.
+ * The mapping is made on the first export of the buffer and kept, every
+ * frame is only synced for the CPU since the encoder writes it behind the
+ * CPU caches */
+static gpointer
+gst_v4l2_buffer_pool_exported_map (GstV4l2BufferPool * pool, guint index,
+    GstV4l2Memory * vmem)
+{
+  GstV4l2Object *obj = pool->obj;
+
+  if (pool->export_fd[index] != vmem->dmafd)
+    gst_v4l2_buffer_pool_exported_unmap (pool, index);
+
+  if (pool->export_data[index] == NULL) {
+    if (obj->nvbuf_api_version_new) {
+      NvBufSurface *nvbuf_surf = NULL;
+
+      if (NvBufSurfaceFromFd (vmem->dmafd, (void **) (&nvbuf_surf)) != 0)
+        return NULL;
+      if (NvBufSurfaceMap (nvbuf_surf, 0, 0, NVBUF_MAP_READ) != 0)
+        return NULL;
+      pool->export_surf[index] = nvbuf_surf;
+      pool->export_data[index] =
+          nvbuf_surf->surfaceList[0].mappedAddr.addr[0];
+    } else {
+#ifndef USE_V4L2_TARGET_NV_CODECSDK
+      if (NvBufferMemMap (vmem->dmafd, 0, NvBufferMem_Read,
+              &pool->export_data[index]) != 0) {
+        pool->export_data[index] = NULL;
+        return NULL;
+      }
+#else
+      return NULL;
+#endif
+    }
+    pool->export_fd[index] = vmem->dmafd;
+
+    GST_DEBUG_OBJECT (pool, "mapped buffer %u for export", index);
+  }
+
+  if (pool->export_surf[index])
+    NvBufSurfaceSyncForCpu (pool->export_surf[index], 0, 0);
+#ifndef USE_V4L2_TARGET_NV_CODECSDK
+  else
+    NvBufferMemSyncForCpu (vmem->dmafd, 0, &pool->export_data[index]);
+#endif
+
+  return pool->export_data[index];
+}
+
+static void
+gst_v4l2_buffer_pool_exported_free (GstV4l2ExportedBuffer * exported)
+{
+  GST_LOG_OBJECT (exported->pool, "exported buffer %p returned",
+      exported->buffer);
+
+  /* queue it back, or put it on the free list when we stopped streaming in
+   * the meantime, it is resurrected on the next STREAMON */
+  gst_v4l2_buffer_pool_release_buffer (GST_BUFFER_POOL (exported->pool),
+      exported->buffer);
+  gst_object_unref (exported->pool);
+  g_slice_free (GstV4l2ExportedBuffer, exported);
+}
+
+/**
+ * gst_v4l2_buffer_pool_process_zero_copy:
+ * @pool: the capture #GstV4l2BufferPool of an encoder
+ * @buf: (out): the encoded buffer
+ * @frame_number: (out) (allow-none): the system frame number of @buf
+ *
+ * Like gst_v4l2_buffer_pool_process() on a capture pool, without a buffer to
+ * copy into: the bitstream is handed out in place, mapped and synced for the
+ * CPU like the copy path does, in read only memory that queues the V4L2
+ * buffer back once downstream drops the last reference.
+ *
+ * The driver must be left with buffers to encode into. When downstream holds
+ * so many of them that fewer than the copy threshold remain queued, the pool
+ * is grown if the driver can allocate, otherwise that frame is copied and its
+ * V4L2 buffer queued back right away.
+ *
+ * Returns: a #GstFlowReturn, as gst_v4l2_buffer_pool_process().
+ */
+GstFlowReturn
+gst_v4l2_buffer_pool_process_zero_copy (GstV4l2BufferPool * pool,
+    GstBuffer ** buf, guint32 * frame_number)
+{
+  GstBufferPool *bpool = GST_BUFFER_POOL_CAST (pool);
+  GstV4l2Object *obj = pool->obj;
+  GstBufferInfo buffer_info;
+  GstV4l2MemoryGroup *group = NULL;
+  GstV4l2ExportedBuffer *exported = NULL;
+  GstFlowReturn ret;
+  GstBuffer *tmp, *out;
+  gpointer data = NULL;
+  gint num_queued;
+
+  g_return_val_if_fail (!V4L2_TYPE_IS_OUTPUT (obj->type), GST_FLOW_ERROR);
+  /* only MMAP memory has a CPU mapping to hand out */
+  g_return_val_if_fail (obj->mode == GST_V4L2_IO_MMAP, GST_FLOW_ERROR);
+
+  if (GST_BUFFER_POOL_IS_FLUSHING (pool))
+    return GST_FLOW_FLUSHING;
+
+  /* the vectors themselves are only copied up to bufSize */
+  buffer_info.m_enc_mv_metadata.bufSize = 0;
+  buffer_info.m_enc_mv_metadata.m_nInfoCount = 0;
+  memset (&buffer_info.m_enc_stats, 0, sizeof (buffer_info.m_enc_stats));
+  if ((ret = gst_v4l2_buffer_pool_dqbuf (pool, &tmp, &buffer_info,
+              frame_number)) != GST_FLOW_OK)
+    return ret;
+
+  /* An empty buffer on capture indicates the end of stream */
+  if (gst_buffer_get_size (tmp) == 0) {
+    gboolean corrupted = GST_BUFFER_FLAG_IS_SET (tmp,
+        GST_BUFFER_FLAG_CORRUPTED);
+
+    gst_v4l2_buffer_pool_release_buffer (bpool, tmp);
+
+    if (corrupted) {
+      GST_WARNING_OBJECT (pool, "Dropping corrupted buffer without payload");
+      return GST_V4L2_FLOW_CORRUPTED_BUFFER;
+    }
+    GST_DEBUG_OBJECT (pool, "end of stream reached");
+    return GST_V4L2_FLOW_LAST_BUFFER;
+  }
+
+  num_queued = g_atomic_int_get (&pool->num_queued);
+  gst_v4l2_buffer_pool_adjust_capture (pool);
+
+  /* the bitstream is a single plane */
+  if (g_atomic_int_get (&pool->num_queued) >= (gint) MAX (pool->copy_threshold,
+          1) && gst_v4l2_is_buffer_valid (tmp, &group, obj->is_encode) &&
+      group->n_mem == 1) {
+    data = gst_v4l2_buffer_pool_exported_map (pool, group->buffer.index,
+        (GstV4l2Memory *) group->mem[0]);
+    if (data) {
+      exported = g_slice_new (GstV4l2ExportedBuffer);
+      exported->pool = pool;
+      exported->buffer = tmp;
+    } else {
+      GST_WARNING_OBJECT (pool, "failed to map buffer %p, copying", tmp);
+    }
+  }
+
+  if (!exported) {
+    GST_CAT_LOG_OBJECT (CAT_PERFORMANCE, pool, "%d buffers queued, copying",
+        num_queued);
+
+    out = gst_buffer_new_allocate (NULL, gst_buffer_get_size (tmp), NULL);
+    ret = gst_v4l2_buffer_pool_copy_buffer (pool, out, tmp, 0);
+    gst_v4l2_buffer_pool_release_buffer (bpool, tmp);
+
+    if (ret != GST_FLOW_OK) {
+      GST_ERROR_OBJECT (pool, "failed to copy buffer");
+      gst_buffer_unref (out);
+      return ret;
+    }
+  } else {
+    gsize offset, maxsize, size;
+
+    /* the memory keeps the V4L2 buffer out of the driver, releasing it
+     * queues the buffer back */
+    gst_object_ref (pool);
+    size = gst_memory_get_sizes (group->mem[0], &offset, &maxsize);
+
+    out = gst_buffer_new ();
+    gst_buffer_append_memory (out,
+        gst_memory_new_wrapped (GST_MEMORY_FLAG_READONLY, data,
+            maxsize, offset, size, exported,
+            (GDestroyNotify) gst_v4l2_buffer_pool_exported_free));
+
+    gst_buffer_copy_into (out, tmp,
+        GST_BUFFER_COPY_FLAGS | GST_BUFFER_COPY_TIMESTAMPS, 0, -1);
+
+    GST_LOG_OBJECT (pool, "exporting buffer %p as %p, %d still queued", tmp,
+        out, g_atomic_int_get (&pool->num_queued));
+  }
+
+  if (obj->enableMVBufferMeta) {
+    gst_buffer_add_buffer_info_meta (out, &buffer_info);
+
+#ifndef D_USE_META_STATIC
+    if (buffer_info.m_enc_mv_metadata.pMVInfo != NULL) {
+      free (buffer_info.m_enc_mv_metadata.pMVInfo);
+      buffer_info.m_enc_mv_metadata.pMVInfo = NULL;
+    }
+#endif
+  }
+
+  *buf = out;
+
+  return GST_FLOW_OK;
+}
+#endif
+
 void
 gst_v4l2_buffer_pool_set_other_pool (GstV4l2BufferPool * pool,
     GstBufferPool * other_pool)
@@ -2571,5 +3194,66 @@ v4l2_video_dec_get_enable_frame_type_reporting (GstV4l2Object * obj,
   if (ret < 0)
     g_print ("Error while getting report metadata\n");
 }
+
+static gint
+v4l2_video_enc_get_metadata (GstV4l2Object * obj, guint32 buffer_index,
+    v4l2_ctrl_videoenc_outputbuf_metadata * enc_metadata)
+{
+  v4l2_ctrl_video_metadata metadata;
+  struct v4l2_ext_control control;
+  struct v4l2_ext_controls ctrls;
+  gint ret;
+
+  ctrls.count = 1;
+  ctrls.controls = &control;
+  ctrls.ctrl_class = V4L2_CTRL_CLASS_MPEG;
+
+  metadata.buffer_index = buffer_index;
+  metadata.VideoEncMetadata = enc_metadata;
+
+  control.id = V4L2_CID_MPEG_VIDEOENC_METADATA;
+  control.string = (gchar *) &metadata;
+
+  ret = obj->ioctl (obj->video_fd, VIDIOC_G_EXT_CTRLS, &ctrls);
+  return ret;
+}
+
+static gboolean
+v4l2_video_enc_set_roi_params (GstV4l2Object * obj, guint32 buffer_index)
+{
+  v4l2_ctrl_videoenc_input_metadata metadata;
+  v4l2_enc_frame_ROI_params roi_params;
+  struct v4l2_ext_control control;
+  struct v4l2_ext_controls ctrls;
+  gint ret;
+
+  GST_OBJECT_LOCK (obj->element);
+  roi_params = obj->roi_params;
+  GST_OBJECT_UNLOCK (obj->element);
+
+  memset (&control, 0, sizeof (control));
+  memset (&ctrls, 0, sizeof (ctrls));
+  memset (&metadata, 0, sizeof (metadata));
+
+  roi_params.config_store = buffer_index;
+  metadata.flag = V4L2_ENC_INPUT_ROI_PARAM_FLAG;
+  metadata.VideoEncROIParams = &roi_params;
+  metadata.config_store = buffer_index;
+
+  ctrls.count = 1;
+  ctrls.controls = &control;
+  ctrls.ctrl_class = V4L2_CTRL_CLASS_MPEG;
+
+  control.id = V4L2_CID_MPEG_VIDEOENC_INPUT_METADATA;
+  control.string = (gchar *) &metadata;
+
+  ret = obj->ioctl (obj->video_fd, VIDIOC_S_EXT_CTRLS, &ctrls);
+  if (ret < 0) {
+    GST_WARNING_OBJECT (obj->element, "Could not set ROI params for buffer %u",
+        buffer_index);
+    return FALSE;
+  }
+  return TRUE;
+}
 #endif
 
@@ -38,6 +38,8 @@
 typedef struct _GstV4l2BufferPool GstV4l2BufferPool;
 typedef struct _GstV4l2BufferPoolClass GstV4l2BufferPoolClass;
 typedef struct _GstV4l2Meta GstV4l2Meta;
+typedef struct _GstV4l2UserPtrMapping GstV4l2UserPtrMapping;
+typedef struct _GstV4l2UserPtrCache GstV4l2UserPtrCache;
 
 #include "gstv4l2object.h"
 #include "gstv4l2allocator.h"
@@ -59,6 +61,25 @@ G_BEGIN_DECLS
  * simply waiting for next buffer. */
 #define GST_V4L2_FLOW_CORRUPTED_BUFFER GST_FLOW_CUSTOM_SUCCESS_1
 
+/* number of upstream memory blocks whose address is remembered for USERPTR
+ * imports */
+#define GST_V4L2_USERPTR_CACHE_SIZE 16
+
+struct _GstV4l2UserPtrMapping
+{
+  GstMemory *mem;            /* weak, only cleared when the memory is freed */
+  guint8 *base;              /* address of offset 0 of mem */
+};
+
+/* shared with the weak references of the cached memory, which can outlive
+ * the pool */
+struct _GstV4l2UserPtrCache
+{
+  gint refcount;             /* the pool and one per cached memory */
+  GMutex lock;
+  GstV4l2UserPtrMapping entries[GST_V4L2_USERPTR_CACHE_SIZE];
+};
+
 struct _GstV4l2BufferPool
 {
   GstBufferPool parent;
@@ -97,6 +118,28 @@ struct _GstV4l2BufferPool
 
   /* Control to warn only once on buggy feild driver bug */
   gboolean has_warned_on_buggy_field;
+
+  /* recently imported system memory */
+  GstV4l2UserPtrCache *userptr_cache;
+
+#ifdef USE_V4L2_TARGET_NV
+  /* on demand growth of capture pools */
+  gint n_grown;              /* buffers queued on top of the initial ones */
+  gint n_parked;             /* grown buffers taken out of the queue again */
+  gint n_retire;             /* grown buffers to take out on release */
+  guint slack_frames;        /* frames in a row with spare buffers queued */
+
+  gint import_fd[VIDEO_MAX_FRAME]; /* dmabuf last imported on each index */
+
+  /* CPU mappings of the exported bitstreams, made on the first export of
+   * each index and kept until the pool stops */
+  gint export_fd[VIDEO_MAX_FRAME];
+  NvBufSurface *export_surf[VIDEO_MAX_FRAME];
+  gpointer export_data[VIDEO_MAX_FRAME];
+
+  /* Control to warn only once per stream on missing encoder metadata */
+  gboolean has_warned_on_enc_metadata;
+#endif
 };
 
 struct _GstV4l2BufferPoolClass
@@ -108,7 +151,8 @@ GType gst_v4l2_buffer_pool_get_type (void);
 
 GstBufferPool *     gst_v4l2_buffer_pool_new     (GstV4l2Object *obj, GstCaps *caps);
 
-GstFlowReturn       gst_v4l2_buffer_pool_process (GstV4l2BufferPool * bpool, GstBuffer ** buf);
+GstFlowReturn       gst_v4l2_buffer_pool_process (GstV4l2BufferPool * bpool, GstBuffer ** buf,
+                                                  guint32 * frame_number);
 
 void                gst_v4l2_buffer_pool_set_other_pool (GstV4l2BufferPool * pool,
                                                          GstBufferPool * other_pool);
@@ -118,6 +162,10 @@ void                gst_v4l2_buffer_pool_copy_at_threshold (GstV4l2BufferPool *
 gboolean            gst_v4l2_buffer_pool_flush   (GstBufferPool *pool);
 
 #ifdef USE_V4L2_TARGET_NV
+GstFlowReturn       gst_v4l2_buffer_pool_process_zero_copy (GstV4l2BufferPool * pool,
+                                                            GstBuffer ** buf,
+                                                            guint32 * frame_number);
+
 gint
 get_motion_vectors (GstV4l2Object *obj, guint32 bufferIndex,
             v4l2_ctrl_videoenc_outputbuf_metadata_MV *enc_mv_metadata);
@@ -963,7 +963,7 @@ gst_v4l2_object_open (GstV4l2Object * v4l2object)
 #else
   if (!gst_v4l2_open (v4l2object))
     return FALSE;
-  v4l2object->is_encode = !g_strcmp0(v4l2object->videodev, V4L2_DEVICE_PATH_NVENC);
+  v4l2object->is_encode = GST_V4L2_IS_NVENC (v4l2object);
 #endif
 
   return TRUE;
@@ -3094,7 +3094,7 @@ gst_v4l2_object_setup_pool (GstV4l2Object * v4l2object, GstCaps * caps)
   if (v4l2object->device_caps & V4L2_CAP_STREAMING) {
     if (v4l2object->req_mode == GST_V4L2_IO_AUTO) {
       if ((V4L2_TYPE_IS_OUTPUT (v4l2object->type)) &&
-          (!strcmp (v4l2object->videodev, V4L2_DEVICE_PATH_NVENC))) {
+          GST_V4L2_DEVICE_HAS (v4l2object, GST_V4L2_DEVICE_DMABUF_OUTPUT)) {
         /* Currently, DMABUF_IMPORT io mode is used on encoder
            output plane, when default mode V4L2_IO_AUTO is set */
 #ifdef USE_V4L2_TARGET_NV_CODECSDK
@@ -3450,7 +3450,7 @@ gst_v4l2_object_set_format_full (GstV4l2Object * v4l2object, GstCaps * caps,
 #else
   guint width, height, fps_n, fps_d;
   GstV4l2VideoEnc *videoenc = NULL;
-  if (!strcmp (v4l2object->videodev, V4L2_DEVICE_PATH_NVENC)) {
+  if (GST_V4L2_IS_NVENC (v4l2object)) {
     videoenc = GST_V4L2_VIDEO_ENC (v4l2object->element);
   }
 #endif
@@ -3718,7 +3718,7 @@ gst_v4l2_object_set_format_full (GstV4l2Object * v4l2object, GstCaps * caps,
   }
 
 #ifdef USE_V4L2_TARGET_NV
-  if ((!strcmp (v4l2object->videodev, V4L2_DEVICE_PATH_NVDEC)) &&
+  if (GST_V4L2_IS_NVDEC (v4l2object) &&
       (v4l2object->open_mjpeg_block == TRUE) &&
       (g_str_equal(gst_structure_get_name(gst_caps_get_structure (caps, 0)), "image/jpeg")))
     format.fmt.pix_mp.pixelformat = pixelformat = V4L2_PIX_FMT_MJPEG;
@@ -3841,7 +3841,7 @@ gst_v4l2_object_set_format_full (GstV4l2Object * v4l2object, GstCaps * caps,
      in decode pipeline format derived colorimetry(bt2020-"2:6:11:7") do not
      match with caps received colorimetry values "2:6:0:7" */
   if (gst_structure_has_field (s, "colorimetry") &&
-      strcmp (v4l2object->videodev, V4L2_DEVICE_PATH_NVDEC)) {
+      !GST_V4L2_IS_NVDEC (v4l2object)) {
 #endif
     GstVideoColorimetry ci;
     if (!gst_video_colorimetry_from_string (&ci,
@@ -4506,7 +4506,7 @@ gst_v4l2_object_decide_allocation (GstV4l2Object * obj, GstQuery * query)
 
 #ifdef USE_V4L2_TARGET_NV
   /* TODO: Check if have better way to handle NVMM caps */
-  if (!strcmp (obj->videodev, V4L2_DEVICE_PATH_NVDEC))
+  if (GST_V4L2_IS_NVDEC (obj))
   {
     caps = gst_caps_make_writable (caps);
     GstCapsFeatures *ift;
@@ -4629,7 +4629,7 @@ gst_v4l2_object_decide_allocation (GstV4l2Object * obj, GstQuery * query)
      * pushed downstream the other one can already be queued for the next
      * frame. */
 #ifdef USE_V4L2_TARGET_NV
-    if (!strcmp (obj->videodev, V4L2_DEVICE_PATH_NVDEC)) {
+    if (GST_V4L2_IS_NVDEC (obj)) {
       GstV4l2VideoDec *videodec = NULL;
       videodec = GST_V4L2_VIDEO_DEC (obj->element);
       own_min = min + obj->min_buffers + videodec->num_extra_surfaces;
@@ -4902,4 +4902,49 @@ set_v4l2_video_mpeg_class (GstV4l2Object * v4l2object, guint label,
 
   return TRUE;
 }
+
+/**
+ * gst_v4l2_object_device_poll:
+ * @v4l2object: the open #GstV4l2Object
+ * @events: POLLIN, POLLOUT, POLLPRI and POLLERR bits to wait for
+ * @revents: (out): the events that are ready
+ *
+ * The NV devices are driven through the libv4l2 plugin which does not
+ * support poll() on the file descriptor, this sleeps in the library until
+ * one of @events is ready instead. The wait returns early with no event
+ * set once V4L2_CID_MPEG_SET_POLL_INTERRUPT is cleared.
+ *
+ * Returns: %FALSE if the library could not poll, errno is set then.
+ */
+gboolean
+gst_v4l2_object_device_poll (GstV4l2Object * v4l2object, gushort events,
+    gushort * revents)
+{
+  struct v4l2_ext_control control;
+  struct v4l2_ext_controls ctrls;
+  v4l2_ctrl_video_device_poll devpoll;
+
+  memset (&control, 0, sizeof (control));
+  memset (&ctrls, 0, sizeof (ctrls));
+  memset (&devpoll, 0, sizeof (devpoll));
+
+  devpoll.req_events = events;
+
+  ctrls.count = 1;
+  ctrls.controls = &control;
+  ctrls.ctrl_class = V4L2_CTRL_CLASS_MPEG;
+
+  control.id = V4L2_CID_MPEG_VIDEO_DEVICE_POLL;
+  control.string = (gchar *) &devpoll;
+
+  while (v4l2object->ioctl (v4l2object->video_fd, VIDIOC_S_EXT_CTRLS,
+          &ctrls) < 0) {
+    if (errno != EINTR)
+      return FALSE;
+  }
+
+  *revents = devpoll.resp_events;
+
+  return TRUE;
+}
 #endif
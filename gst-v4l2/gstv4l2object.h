@@ -58,6 +58,41 @@ typedef struct _GstV4l2ObjectClassHelper GstV4l2ObjectClassHelper;
 #define  V4L2_DEVICE_BASENAME_NVENC  "msenc"
 #define  V4L2_DEVICE_PATH_NVDEC      "/dev/nvhost-nvdec"
 #define  V4L2_DEVICE_PATH_NVENC      "/dev/nvhost-msenc"
+
+/**
+ * GstV4l2DeviceRole:
+ * @GST_V4L2_DEVICE_ROLE_UNKNOWN: not one of the NV codecs
+ * @GST_V4L2_DEVICE_ROLE_DECODER: the NVDEC decoder
+ * @GST_V4L2_DEVICE_ROLE_ENCODER: the NVENC encoder
+ *
+ * What the opened device is, classified once by gst_v4l2_open().
+ */
+typedef enum {
+  GST_V4L2_DEVICE_ROLE_UNKNOWN = 0,
+  GST_V4L2_DEVICE_ROLE_DECODER,
+  GST_V4L2_DEVICE_ROLE_ENCODER,
+} GstV4l2DeviceRole;
+
+/**
+ * GstV4l2DeviceFlags:
+ * @GST_V4L2_DEVICE_SURFACE_CAPTURE: capture buffers hold NvBuffer or
+ *   NvBufSurface handles rather than pixels
+ * @GST_V4L2_DEVICE_DMABUF_OUTPUT: the output plane imports upstream dmabufs
+ * @GST_V4L2_DEVICE_MV_METADATA: capture buffers carry motion vector metadata
+ * @GST_V4L2_DEVICE_DEC_METADATA: capture buffers carry decode metadata
+ */
+typedef enum {
+  GST_V4L2_DEVICE_SURFACE_CAPTURE = (1 << 0),
+  GST_V4L2_DEVICE_DMABUF_OUTPUT   = (1 << 1),
+  GST_V4L2_DEVICE_MV_METADATA     = (1 << 2),
+  GST_V4L2_DEVICE_DEC_METADATA    = (1 << 3),
+} GstV4l2DeviceFlags;
+
+#define GST_V4L2_IS_NVDEC(obj) \
+    ((obj)->device_role == GST_V4L2_DEVICE_ROLE_DECODER)
+#define GST_V4L2_IS_NVENC(obj) \
+    ((obj)->device_role == GST_V4L2_DEVICE_ROLE_ENCODER)
+#define GST_V4L2_DEVICE_HAS(obj,flag) (((obj)->device_flags & (flag)) != 0)
 #endif
 
 /* max frame width/height */
@@ -149,6 +184,8 @@ struct _GstV4l2Object {
 
 #ifdef USE_V4L2_TARGET_NV
   gboolean is_encode;
+  GstV4l2DeviceRole device_role;
+  GstV4l2DeviceFlags device_flags;
 #endif
 
   /* the video-device's file descriptor */
@@ -222,6 +259,12 @@ struct _GstV4l2Object {
   gint ProcessedFrames;
   gboolean nvbuf_api_version_new;
   gboolean open_mjpeg_block;
+  /* ROI params applied to every buffer queued on the encoder output plane,
+   * protected by the element object lock */
+  gboolean enableROI;
+  v4l2_enc_frame_ROI_params roi_params;
+  /* ceiling for the capture pool to grow to, 0 for the V4L2 limit */
+  guint max_capture_buffers;
 #endif
 
   /* funcs */
@@ -372,6 +415,9 @@ gboolean     gst_v4l2_set_controls    (GstV4l2Object * v4l2object, GstStructure
 #ifdef USE_V4L2_TARGET_NV
 gboolean set_v4l2_video_mpeg_class (GstV4l2Object * v4l2object, guint label,
     gint params);
+
+gboolean gst_v4l2_object_device_poll (GstV4l2Object * v4l2object,
+    gushort events, gushort * revents);
 #endif
 
 G_END_DECLS
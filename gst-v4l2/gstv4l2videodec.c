@@ -29,6 +29,9 @@
 #include <errno.h>
 #include <unistd.h>
 #include <string.h>
+#ifdef USE_V4L2_TARGET_NV
+#include <poll.h>
+#endif
 #include "gstv4l2object.h"
 #include "gstv4l2videodec.h"
 #include "stdlib.h"
@@ -52,6 +55,7 @@ GST_DEBUG_CATEGORY_STATIC (gst_v4l2_video_dec_debug);
 #define DEFAULT_FRAME_TYPR_REPORTING FALSE
 #define DEFAULT_ERROR_CHECK FALSE
 #define DEFAULT_MAX_PERFORMANCE FALSE
+#define DEFAULT_ENABLE_MV_META FALSE
 #define GST_TYPE_V4L2_VID_DEC_SKIP_FRAMES (gst_video_dec_skip_frames ())
 
 #ifdef USE_V4L2_TARGET_NV_CODECSDK
@@ -60,6 +64,16 @@ GST_DEBUG_CATEGORY_STATIC (gst_v4l2_video_dec_debug);
 #define DEFAULT_NUM_EXTRA_SURFACES 1 //default for Tegra
 #endif
 
+/* how long to wait for the headers to be parsed, in microseconds */
+#define SOURCE_CHANGE_TIMEOUT (2 * G_USEC_PER_SEC)
+/* retry interval when the library can't poll for events */
+#define SOURCE_CHANGE_RETRY_INTERVAL (5 * 1000)
+
+#ifdef USE_V4L2_TARGET_NV
+/* vectors that fit in the static array of the buffer meta */
+#define MAX_MV_VECTORS G_N_ELEMENTS (((metadata_MV *) NULL)->rec_mv_info)
+#endif
+
 static gboolean enable_latency_measurement = FALSE;
 
 typedef struct _BufferIdentification BufferIdentification;
@@ -67,10 +81,20 @@ struct _BufferIdentification
 {
   gdouble in_timestamp;
   guint frame_num;
+#ifdef USE_V4L2_TARGET_NV
+  /* vectors parsed from the input access unit, attached to the output */
+  gboolean has_mv;
+  MVInfo *mv_vectors;
+  guint n_mv_vectors;
+  encoder_stats mv_stats;
+#endif
 };
 
 static void buffer_identification_free (BufferIdentification * id)
 {
+#ifdef USE_V4L2_TARGET_NV
+  g_free (id->mv_vectors);
+#endif
   g_slice_free (BufferIdentification, id);
 }
 
@@ -220,6 +244,8 @@ enum
   PROP_SKIP_FRAME,
   PROP_DROP_FRAME_INTERVAL,
   PROP_NUM_EXTRA_SURFACES,
+  PROP_ENABLE_MV_META,
+  PROP_MAX_CAPTURE_BUFFERS,
 #ifndef USE_V4L2_TARGET_NV_CODECSDK
 /*Properties exposed on Tegra only */
   PROP_DISABLE_DPB,
@@ -349,6 +375,12 @@ gst_v4l2_video_dec_set_property (GObject * object,
     case PROP_NUM_EXTRA_SURFACES:
       self->num_extra_surfaces = g_value_get_uint (value);
       break;
+    case PROP_ENABLE_MV_META:
+      self->enable_mv_meta = g_value_get_boolean (value);
+      break;
+    case PROP_MAX_CAPTURE_BUFFERS:
+      self->v4l2capture->max_capture_buffers = g_value_get_uint (value);
+      break;
 #ifndef USE_V4L2_TARGET_NV_CODECSDK
     case PROP_DISABLE_DPB:
       self->disable_dpb = g_value_get_boolean (value);
@@ -428,6 +460,14 @@ gst_v4l2_video_dec_get_property (GObject * object,
       g_value_set_uint (value, self->num_extra_surfaces);
       break;
 
+    case PROP_ENABLE_MV_META:
+      g_value_set_boolean (value, self->enable_mv_meta);
+      break;
+
+    case PROP_MAX_CAPTURE_BUFFERS:
+      g_value_set_uint (value, self->v4l2capture->max_capture_buffers);
+      break;
+
 #ifndef USE_V4L2_TARGET_NV_CODECSDK
     case PROP_DISABLE_DPB:
       g_value_set_boolean (value, self->disable_dpb);
@@ -604,6 +644,13 @@ gst_v4l2_video_dec_stop (GstVideoDecoder * decoder)
     self->input_state = NULL;
   }
 
+#ifdef USE_V4L2_TARGET_NV
+  gst_h264_mv_parser_free (self->mv_parser);
+  self->mv_parser = NULL;
+  self->mv_sei = FALSE;
+  self->mv_overflow_warned = FALSE;
+#endif
+
   GST_DEBUG_OBJECT (self, "Stopped");
 
   return TRUE;
@@ -662,6 +709,25 @@ gst_v4l2_video_dec_set_format (GstVideoDecoder * decoder,
     gst_v4l2_error (self, &error);
 
 #ifdef USE_V4L2_TARGET_NV
+  /* a new stream may carry new parameter sets, start from scratch */
+  gst_h264_mv_parser_free (self->mv_parser);
+  self->mv_parser = NULL;
+  self->mv_sei = FALSE;
+  if (ret && self->enable_mv_meta) {
+    GstStructure *structure = gst_caps_get_structure (state->caps, 0);
+
+    /* vectors embedded by an encoder with mv-sei come first, H.264 access
+     * units without them are parsed in software */
+    if (gst_structure_has_name (structure, "video/x-h264")) {
+      self->mv_parser = gst_h264_mv_parser_new ();
+      self->mv_sei = TRUE;
+      self->mv_sei_h265 = FALSE;
+    } else if (gst_structure_has_name (structure, "video/x-h265")) {
+      self->mv_sei = TRUE;
+      self->mv_sei_h265 = TRUE;
+    }
+  }
+
   {
     if (!set_v4l2_video_mpeg_class (self->v4l2output,
         V4L2_CID_MPEG_VIDEO_DISABLE_COMPLETE_FRAME_INPUT, 0)) {
@@ -875,7 +941,7 @@ gst_v4l2_video_dec_finish (GstVideoDecoder * decoder)
       buffer = gst_buffer_new ();
       ret =
           gst_v4l2_buffer_pool_process (GST_V4L2_BUFFER_POOL (self->
-              v4l2output->pool), &buffer);
+              v4l2output->pool), &buffer, NULL);
       gst_buffer_unref (buffer);
     }
   }
@@ -947,6 +1013,42 @@ gst_v4l2_video_dec_get_oldest_frame (GstVideoDecoder * decoder)
   return frame;
 }
 
+/* Frames are output in presentation order, once @current came out every
+ * pending frame presented before it was lost by the driver and would
+ * otherwise stay queued in the base class until EOS. Without timestamps
+ * the order they came in is all there is. */
+static void
+gst_v4l2_video_dec_clean_older_frames (GstVideoDecoder * decoder,
+    GstVideoCodecFrame * current)
+{
+  GList *frames, *l;
+
+  frames = gst_video_decoder_get_frames (decoder);
+
+  for (l = frames; l != NULL; l = l->next) {
+    GstVideoCodecFrame *f = l->data;
+    gboolean older;
+
+    if (f == current)
+      continue;
+
+    if (GST_CLOCK_TIME_IS_VALID (current->pts) &&
+        GST_CLOCK_TIME_IS_VALID (f->pts))
+      older = f->pts < current->pts;
+    else
+      older = f->system_frame_number < current->system_frame_number;
+
+    if (older) {
+      GST_WARNING_OBJECT (decoder, "Lost frame %u %" GST_TIME_FORMAT
+          ", dropping", f->system_frame_number, GST_TIME_ARGS (f->pts));
+      gst_video_decoder_release_frame (decoder,
+          gst_video_codec_frame_ref (f));
+    }
+  }
+
+  g_list_free_full (frames, (GDestroyNotify) gst_video_codec_frame_unref);
+}
+
 static void
 gst_v4l2_video_dec_loop (GstVideoDecoder * decoder)
 {
@@ -956,6 +1058,7 @@ gst_v4l2_video_dec_loop (GstVideoDecoder * decoder)
   GstVideoCodecFrame *frame;
   GstBuffer *buffer = NULL;
   GstFlowReturn ret;
+  guint32 frame_number = G_MAXUINT32;
 
   GST_LOG_OBJECT (decoder, "Allocate output buffer");
 
@@ -980,14 +1083,21 @@ gst_v4l2_video_dec_loop (GstVideoDecoder * decoder)
       goto beach;
 
     GST_LOG_OBJECT (decoder, "Process output buffer");
-    ret = gst_v4l2_buffer_pool_process (v4l2_pool, &buffer);
+    ret = gst_v4l2_buffer_pool_process (v4l2_pool, &buffer, &frame_number);
 
   } while (ret == GST_V4L2_FLOW_CORRUPTED_BUFFER);
 
   if (ret != GST_FLOW_OK)
     goto beach;
 
-  frame = gst_v4l2_video_dec_get_oldest_frame (decoder);
+  frame = gst_video_decoder_get_frame (decoder, frame_number);
+  if (frame) {
+    gst_v4l2_video_dec_clean_older_frames (decoder, frame);
+  } else {
+    GST_DEBUG_OBJECT (decoder, "no frame %u, using the oldest one",
+        frame_number);
+    frame = gst_v4l2_video_dec_get_oldest_frame (decoder);
+  }
 #ifdef USE_V4L2_TARGET_NV
 #ifndef USE_V4L2_TARGET_NV_CODECSDK
   if (frame && self->enable_frame_type_reporting) {
@@ -999,6 +1109,27 @@ gst_v4l2_video_dec_loop (GstVideoDecoder * decoder)
     frame->output_buffer = buffer;
     buffer = NULL;
 
+#ifdef USE_V4L2_TARGET_NV
+    {
+      BufferIdentification *id =
+          (BufferIdentification *) gst_video_codec_frame_get_user_data (frame);
+
+      if (id && id->has_mv) {
+        v4l2_ctrl_videoenc_outputbuf_metadata_MV mv_metadata;
+
+        self->mv_info->m_enc_mv_metadata.bufSize = 0;
+        self->mv_info->m_enc_mv_metadata.m_nInfoCount = 0;
+        if (id->n_mv_vectors > 0) {
+          mv_metadata.bufSize = id->n_mv_vectors * sizeof (MVInfo);
+          mv_metadata.pMVInfo = id->mv_vectors;
+          AllocateMyMetaData (self->mv_info, &mv_metadata, id->n_mv_vectors);
+        }
+        self->mv_info->m_enc_stats = id->mv_stats;
+        gst_buffer_add_buffer_info_meta (frame->output_buffer, self->mv_info);
+      }
+    }
+#endif
+
     if(enable_latency_measurement) /* TODO with better option */
     {
       BufferIdentification *id = (BufferIdentification *)gst_video_codec_frame_get_user_data (frame);
@@ -1086,6 +1217,119 @@ gst_v4l2_video_remove_padding (GstCapsFeatures * features,
   return TRUE;
 }
 
+#ifdef USE_V4L2_TARGET_NV
+/* Reads the motion vectors of the access unit, from the MV SEI of the
+ * encoder or in software, before it is handed to the decoder and keeps them
+ * with the frame until it is output */
+static void
+gst_v4l2_video_dec_parse_mv (GstV4l2VideoDec * self, GstVideoCodecFrame * frame)
+{
+  BufferIdentification *id;
+  encoder_stats stats = { 0 };
+  const MVInfo *vectors = NULL;
+  GstMapInfo map;
+  guint n_vectors = 0;
+  gboolean found;
+
+  if (!gst_buffer_map (frame->input_buffer, &map, GST_MAP_READ))
+    return;
+
+  found = gst_mv_sei_parse (map.data, map.size, self->mv_sei_h265,
+      self->mv_sei_vectors, &stats);
+  if (found) {
+    vectors = (const MVInfo *) self->mv_sei_vectors->data;
+    n_vectors = self->mv_sei_vectors->len;
+  } else if (self->mv_parser) {
+    vectors = gst_h264_mv_parser_parse (self->mv_parser, map.data, map.size,
+        &n_vectors);
+    found = vectors != NULL;
+  }
+
+  if (found && n_vectors > MAX_MV_VECTORS) {
+    if (!self->mv_overflow_warned) {
+      GST_ELEMENT_WARNING (self, STREAM, DECODE,
+          ("Motion vectors do not fit in the buffer meta"),
+          ("%u vectors per frame, the meta holds %u, only the statistics "
+              "are attached", n_vectors, (guint) MAX_MV_VECTORS));
+      self->mv_overflow_warned = TRUE;
+    }
+    n_vectors = 0;
+  }
+
+  if (found) {
+    id = (BufferIdentification *) gst_video_codec_frame_get_user_data (frame);
+    if (!id) {
+      id = g_slice_new0 (BufferIdentification);
+      gst_video_codec_frame_set_user_data (frame, id,
+          (GDestroyNotify) buffer_identification_free);
+    }
+
+    /* only what the frame needs, the meta is built when it is output */
+    id->has_mv = TRUE;
+    id->mv_stats = stats;
+    g_free (id->mv_vectors);
+    id->mv_vectors = NULL;
+    id->n_mv_vectors = n_vectors;
+    if (n_vectors > 0) {
+      id->mv_vectors = g_malloc (n_vectors * sizeof (MVInfo));
+      memcpy (id->mv_vectors, vectors, n_vectors * sizeof (MVInfo));
+    }
+  }
+
+  gst_buffer_unmap (frame->input_buffer, &map);
+}
+#endif
+
+#ifdef USE_V4L2_TARGET_NV
+/* Waits until the decoder has parsed the stream headers and reports the
+ * source change, so the capture format can be read. */
+static GstFlowReturn
+gst_v4l2_video_dec_wait_source_change (GstV4l2VideoDec * self)
+{
+  GstV4l2Object *obj = self->v4l2output;
+  struct v4l2_event ev;
+  gushort revents;
+  gint64 deadline;
+
+  deadline = g_get_monotonic_time () + SOURCE_CHANGE_TIMEOUT;
+
+  /* a previous flush leaves the device poll interrupted */
+  set_v4l2_video_mpeg_class (obj, V4L2_CID_MPEG_SET_POLL_INTERRUPT, 1);
+
+  while (TRUE) {
+    memset (&ev, 0, sizeof (ev));
+    if (obj->ioctl (obj->video_fd, VIDIOC_DQEVENT, &ev) == 0) {
+      GST_DEBUG_OBJECT (self, "got event %u", ev.type);
+      return GST_FLOW_OK;
+    }
+
+    if (!g_atomic_int_get (&self->active) ||
+        GST_PAD_IS_FLUSHING (GST_VIDEO_DECODER_SINK_PAD (self)))
+      return GST_FLOW_FLUSHING;
+
+    if (g_get_monotonic_time () >= deadline)
+      goto timeout;
+
+    revents = 0;
+    if (!gst_v4l2_object_device_poll (obj, POLLPRI, &revents)) {
+      g_usleep (SOURCE_CHANGE_RETRY_INTERVAL);
+      continue;
+    }
+
+    /* woken up by V4L2_CID_MPEG_SET_POLL_INTERRUPT */
+    if (!(revents & POLLPRI))
+      return GST_FLOW_FLUSHING;
+  }
+
+timeout:
+  GST_ELEMENT_ERROR (self, STREAM, DECODE,
+      (_("Could not determine the stream format.")),
+      ("No source change event within %" G_GINT64_FORMAT " ms",
+          (gint64) SOURCE_CHANGE_TIMEOUT / 1000));
+  return GST_FLOW_ERROR;
+}
+#endif
+
 static GstFlowReturn
 gst_v4l2_video_dec_handle_frame (GstVideoDecoder * decoder,
     GstVideoCodecFrame * frame)
@@ -1123,6 +1367,11 @@ gst_v4l2_video_dec_handle_frame (GstVideoDecoder * decoder,
         (GDestroyNotify) buffer_identification_free);
   }
 
+#ifdef USE_V4L2_TARGET_NV
+  if (self->mv_sei)
+    gst_v4l2_video_dec_parse_mv (self, frame);
+#endif
+
   if (G_UNLIKELY (!g_atomic_int_get (&self->active)))
     goto flushing;
 
@@ -1183,7 +1432,8 @@ gst_v4l2_video_dec_handle_frame (GstVideoDecoder * decoder,
     GST_VIDEO_DECODER_STREAM_UNLOCK (decoder);
     ret =
         gst_v4l2_buffer_pool_process (GST_V4L2_BUFFER_POOL (self->
-            v4l2output->pool), &codec_data);
+            v4l2output->pool), &codec_data,
+            processed ? &frame->system_frame_number : NULL);
     GST_VIDEO_DECODER_STREAM_LOCK (decoder);
 
     gst_buffer_unref (codec_data);
@@ -1196,7 +1446,7 @@ gst_v4l2_video_dec_handle_frame (GstVideoDecoder * decoder,
       GST_VIDEO_DECODER_STREAM_UNLOCK (decoder);
       ret =
           gst_v4l2_buffer_pool_process (GST_V4L2_BUFFER_POOL (self->v4l2output->
-              pool), &frame->input_buffer);
+              pool), &frame->input_buffer, &frame->system_frame_number);
       GST_VIDEO_DECODER_STREAM_LOCK (decoder);
 
       if (ret == GST_FLOW_FLUSHING) {
@@ -1210,19 +1460,11 @@ gst_v4l2_video_dec_handle_frame (GstVideoDecoder * decoder,
     }
 
     if (V4L2_TYPE_IS_OUTPUT (obj->type)) {
-      gint retval;
-      struct v4l2_event ev;
-      while (1) {
-        memset (&ev, 0, sizeof (ev));
-        retval = obj->ioctl (obj->video_fd, VIDIOC_DQEVENT, &ev);
-        if (retval != 0)
-        {
-          usleep(100*1000); //TODO is this needed ?
-          continue;
-        }
-        else
-          break;
-      }
+      ret = gst_v4l2_video_dec_wait_source_change (self);
+      if (ret == GST_FLOW_FLUSHING)
+        goto flushing;
+      else if (ret != GST_FLOW_OK)
+        goto drop;
     }
 #endif
 
@@ -1342,7 +1584,7 @@ gst_v4l2_video_dec_handle_frame (GstVideoDecoder * decoder,
     GST_VIDEO_DECODER_STREAM_UNLOCK (decoder);
     ret =
         gst_v4l2_buffer_pool_process (GST_V4L2_BUFFER_POOL (self->v4l2output->
-            pool), &frame->input_buffer);
+            pool), &frame->input_buffer, &frame->system_frame_number);
     GST_VIDEO_DECODER_STREAM_LOCK (decoder);
 
     if (ret == GST_FLOW_FLUSHING) {
@@ -1501,6 +1743,11 @@ gst_v4l2_video_dec_sink_event (GstVideoDecoder * decoder, GstEvent * event)
       GST_DEBUG_OBJECT (self, "flush start");
       gst_v4l2_object_unlock (self->v4l2output);
       gst_v4l2_object_unlock (self->v4l2capture);
+#ifdef USE_V4L2_TARGET_NV
+      /* wake up a pending source change wait */
+      set_v4l2_video_mpeg_class (self->v4l2output,
+          V4L2_CID_MPEG_SET_POLL_INTERRUPT, 0);
+#endif
       break;
     default:
       break;
@@ -1561,6 +1808,11 @@ gst_v4l2_video_dec_finalize (GObject * object)
   gst_v4l2_object_destroy (self->v4l2capture);
   gst_v4l2_object_destroy (self->v4l2output);
 
+#ifdef USE_V4L2_TARGET_NV
+  g_array_free (self->mv_sei_vectors, TRUE);
+  g_free (self->mv_info);
+#endif
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
@@ -1573,6 +1825,9 @@ gst_v4l2_video_dec_init (GstV4l2VideoDec * self)
   self->nvbuf_api_version_new = DEFAULT_NVBUF_API_VERSION_NEW;
   self->drop_frame_interval = 0;
   self->num_extra_surfaces = DEFAULT_NUM_EXTRA_SURFACES;
+  self->enable_mv_meta = DEFAULT_ENABLE_MV_META;
+  self->mv_sei_vectors = g_array_new (FALSE, FALSE, sizeof (MVInfo));
+  self->mv_info = g_new0 (GstBufferInfo, 1);
 #ifndef USE_V4L2_TARGET_NV_CODECSDK
   self->disable_dpb = DEFAULT_DISABLE_DPB;
   self->enable_full_frame = DEFAULT_FULL_FRAME;
@@ -1672,6 +1927,23 @@ gst_v4l2_video_dec_class_init (GstV4l2VideoDecClass * klass)
           0,
           24, 24,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_ENABLE_MV_META,
+      g_param_spec_boolean ("enable-mv-meta",
+          "Enable motion vector metadata",
+          "Attach the motion vectors of the input to the decoded buffers as "
+          "GstBufferInfoMeta, taken from the MV SEI of an encoder with "
+          "mv-sei or parsed from the P slices of H.264",
+          DEFAULT_ENABLE_MV_META,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_CAPTURE_BUFFERS,
+      g_param_spec_uint ("max-capture-buffers",
+          "Maximum capture buffers",
+          "Number of capture buffers the pool may grow to with CREATE_BUFS\n"
+          "\t\t\t when downstream holds on to buffers, 0 for the V4L2 limit",
+          0, VIDEO_MAX_FRAME, 0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
 #ifndef USE_V4L2_TARGET_NV_CODECSDK
   g_object_class_install_property (gobject_class, PROP_DISABLE_DPB,
       g_param_spec_boolean ("disable-dpb",
@@ -30,6 +30,10 @@
 
 #include <gstv4l2object.h>
 #include <gstv4l2bufferpool.h>
+#ifdef USE_V4L2_TARGET_NV
+#include "gsth264mvparse.h"
+#include "gstmvsei.h"
+#endif
 
 G_BEGIN_DECLS
 #define GST_TYPE_V4L2_VIDEO_DEC \
@@ -75,6 +79,14 @@ struct _GstV4l2VideoDec
   guint32 drop_frame_interval;
   gboolean nvbuf_api_version_new;
   guint32 num_extra_surfaces;
+  gboolean enable_mv_meta;
+  GstH264MvParser *mv_parser;
+  gboolean mv_sei;
+  gboolean mv_sei_h265;
+  GArray *mv_sei_vectors;
+  /* the meta of each output frame is built here and copied to the buffer */
+  GstBufferInfo *mv_info;
+  gboolean mv_overflow_warned;
 #ifndef USE_V4L2_TARGET_NV_CODECSDK
   gboolean disable_dpb;
   gboolean enable_full_frame;
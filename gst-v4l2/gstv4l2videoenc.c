@@ -34,6 +34,8 @@
 #ifdef USE_V4L2_TARGET_NV
 #include <stdlib.h>
 #include "gst_buffer_info_meta.h"
+#include "gstmvutils.h"
+#include "gstmvsei.h"
 #endif
 
 #include "gstv4l2object.h"
@@ -92,6 +94,11 @@ gst_v4l2_video_enc_parse_quantization_range (GstV4l2VideoEnc * self,
 static GType gst_v4l2_videnc_ratecontrol_get_type (void);
 static GType gst_v4l2_videnc_hw_preset_level_get_type (void);
 static void gst_v4l2_video_encoder_forceIDR (GstV4l2VideoEnc * self);
+static gboolean setROIEnable (GstV4l2Object * v4l2object, gboolean enable);
+static void gst_v4l2_video_enc_update_roi (GstV4l2VideoEnc * self,
+    GstBuffer * buffer);
+static void gst_v4l2_video_enc_update_bitrate (GstV4l2VideoEnc * self,
+    GstBuffer * buffer);
 
 enum
 {
@@ -112,6 +119,22 @@ enum
   PROP_BITRATE,
   PROP_RATE_CONTROL,
   PROP_INTRA_FRAME_INTERVAL,
+  PROP_MV_ROI_ENABLE,
+  PROP_MV_ROI_THRESHOLD,
+  PROP_MV_ROI_MIN_BLOCKS,
+  PROP_MV_ROI_QP_DELTA,
+  PROP_MV_ROI_BACKGROUND_QP_DELTA,
+  PROP_MV_BITRATE_CONTROL,
+  PROP_MV_BITRATE_THRESHOLD,
+  PROP_MV_BITRATE_MIN,
+  PROP_MV_BITRATE_MAX,
+  PROP_MV_BITRATE_SMOOTHING,
+  PROP_MV_BITRATE_SATURATION,
+  PROP_MV_BITRATE_HYSTERESIS,
+  PROP_MV_BITRATE_INTERVAL,
+  PROP_MV_SEI,
+  PROP_ZERO_COPY_OUTPUT,
+  PROP_MAX_CAPTURE_BUFFERS,
 #ifdef USE_V4L2_TARGET_NV_CODECSDK
   /* Properties exposed on dGPU only */
   PROP_CUDAENC_GPU_ID
@@ -146,8 +169,22 @@ enum
 #define GST_TYPE_V4L2_VID_ENC_HW_PRESET_LEVEL        (gst_v4l2_videnc_hw_preset_level_get_type ())
 #define GST_TYPE_V4L2_VID_ENC_RATECONTROL            (gst_v4l2_videnc_ratecontrol_get_type())
 #define DEFAULT_VBV_SIZE                             4000000
+#define DEFAULT_MV_ROI_THRESHOLD                     8
+#define DEFAULT_MV_ROI_MIN_BLOCKS                    2
+#define DEFAULT_MV_ROI_QP_DELTA                      (-6)
+#define DEFAULT_MV_ROI_BACKGROUND_QP_DELTA           2
+#define DEFAULT_MV_BITRATE_THRESHOLD                 8
+#define DEFAULT_MV_BITRATE_MIN                       (500000)
+#define DEFAULT_MV_BITRATE_MAX                       (0)
+#define DEFAULT_MV_BITRATE_SMOOTHING                 0.05
+#define DEFAULT_MV_BITRATE_SATURATION                0.2
+#define DEFAULT_MV_BITRATE_HYSTERESIS                0.1
+#define DEFAULT_MV_BITRATE_INTERVAL                  30
 #endif
 
+/* B frames an anchor frame can be coded ahead of, num-B-Frames of H264 */
+#define GST_V4L2_ENC_MAX_REORDER                     2
+
 #define gst_v4l2_video_enc_parent_class parent_class
 G_DEFINE_ABSTRACT_TYPE (GstV4l2VideoEnc, gst_v4l2_video_enc,
     GST_TYPE_VIDEO_ENCODER);
@@ -213,19 +250,91 @@ gst_v4l2_video_enc_set_property (GObject * object,
       break;
 
     case PROP_BITRATE:
+      /* taken across the control so that the motion rate control of the
+       * streaming thread cannot overwrite the new bitrate */
+      GST_OBJECT_LOCK (self);
       self->bitrate = g_value_get_uint (value);
       if (GST_V4L2_IS_OPEN (self->v4l2output)) {
         if (!set_v4l2_video_mpeg_class (self->v4l2output,
             V4L2_CID_MPEG_VIDEO_BITRATE, self->bitrate)) {
           g_print ("S_EXT_CTRLS for BITRATE failed\n");
+        } else {
+          /* the motion rate control steers from the new bitrate on */
+          self->mvrc_bitrate = self->bitrate;
+          self->mvrc_frames = 0;
         }
       }
+      GST_OBJECT_UNLOCK (self);
       break;
 
     case PROP_INTRA_FRAME_INTERVAL:
       self->iframeinterval = g_value_get_uint (value);
       break;
 
+    case PROP_MV_ROI_ENABLE:
+      self->mvroi_enable = g_value_get_boolean (value);
+      break;
+
+    case PROP_MV_ROI_THRESHOLD:
+      self->mvroi_threshold = g_value_get_uint (value);
+      break;
+
+    case PROP_MV_ROI_MIN_BLOCKS:
+      self->mvroi_min_blocks = g_value_get_uint (value);
+      break;
+
+    case PROP_MV_ROI_QP_DELTA:
+      self->mvroi_qp_delta = g_value_get_int (value);
+      break;
+
+    case PROP_MV_ROI_BACKGROUND_QP_DELTA:
+      self->mvroi_background_qp_delta = g_value_get_int (value);
+      break;
+
+    case PROP_MV_BITRATE_CONTROL:
+      self->mvrc_enable = g_value_get_boolean (value);
+      break;
+
+    case PROP_MV_BITRATE_THRESHOLD:
+      self->mvrc_threshold = g_value_get_uint (value);
+      break;
+
+    case PROP_MV_BITRATE_MIN:
+      self->mvrc_min_bitrate = g_value_get_uint (value);
+      break;
+
+    case PROP_MV_BITRATE_MAX:
+      self->mvrc_max_bitrate = g_value_get_uint (value);
+      break;
+
+    case PROP_MV_BITRATE_SMOOTHING:
+      self->mvrc_smoothing = g_value_get_double (value);
+      break;
+
+    case PROP_MV_BITRATE_SATURATION:
+      self->mvrc_saturation = g_value_get_double (value);
+      break;
+
+    case PROP_MV_BITRATE_HYSTERESIS:
+      self->mvrc_hysteresis = g_value_get_double (value);
+      break;
+
+    case PROP_MV_BITRATE_INTERVAL:
+      self->mvrc_interval = g_value_get_uint (value);
+      break;
+
+    case PROP_MV_SEI:
+      self->mvsei_enable = g_value_get_boolean (value);
+      break;
+
+    case PROP_ZERO_COPY_OUTPUT:
+      self->zero_copy_output = g_value_get_boolean (value);
+      break;
+
+    case PROP_MAX_CAPTURE_BUFFERS:
+      self->v4l2capture->max_capture_buffers = g_value_get_uint (value);
+      break;
+
 #ifdef USE_V4L2_TARGET_NV_CODECSDK
     case PROP_CUDAENC_GPU_ID:
       self->cudaenc_gpu_id = g_value_get_uint (value);
@@ -317,6 +426,70 @@ gst_v4l2_video_enc_get_property (GObject * object,
     case PROP_INTRA_FRAME_INTERVAL:
       g_value_set_uint (value, self->iframeinterval);
       break;
+
+    case PROP_MV_ROI_ENABLE:
+      g_value_set_boolean (value, self->mvroi_enable);
+      break;
+
+    case PROP_MV_ROI_THRESHOLD:
+      g_value_set_uint (value, self->mvroi_threshold);
+      break;
+
+    case PROP_MV_ROI_MIN_BLOCKS:
+      g_value_set_uint (value, self->mvroi_min_blocks);
+      break;
+
+    case PROP_MV_ROI_QP_DELTA:
+      g_value_set_int (value, self->mvroi_qp_delta);
+      break;
+
+    case PROP_MV_ROI_BACKGROUND_QP_DELTA:
+      g_value_set_int (value, self->mvroi_background_qp_delta);
+      break;
+
+    case PROP_MV_BITRATE_CONTROL:
+      g_value_set_boolean (value, self->mvrc_enable);
+      break;
+
+    case PROP_MV_BITRATE_THRESHOLD:
+      g_value_set_uint (value, self->mvrc_threshold);
+      break;
+
+    case PROP_MV_BITRATE_MIN:
+      g_value_set_uint (value, self->mvrc_min_bitrate);
+      break;
+
+    case PROP_MV_BITRATE_MAX:
+      g_value_set_uint (value, self->mvrc_max_bitrate);
+      break;
+
+    case PROP_MV_BITRATE_SMOOTHING:
+      g_value_set_double (value, self->mvrc_smoothing);
+      break;
+
+    case PROP_MV_BITRATE_SATURATION:
+      g_value_set_double (value, self->mvrc_saturation);
+      break;
+
+    case PROP_MV_BITRATE_HYSTERESIS:
+      g_value_set_double (value, self->mvrc_hysteresis);
+      break;
+
+    case PROP_MV_BITRATE_INTERVAL:
+      g_value_set_uint (value, self->mvrc_interval);
+      break;
+
+    case PROP_MV_SEI:
+      g_value_set_boolean (value, self->mvsei_enable);
+      break;
+
+    case PROP_ZERO_COPY_OUTPUT:
+      g_value_set_boolean (value, self->zero_copy_output);
+      break;
+
+    case PROP_MAX_CAPTURE_BUFFERS:
+      g_value_set_uint (value, self->v4l2capture->max_capture_buffers);
+      break;
 #ifdef USE_V4L2_TARGET_NV_CODECSDK
     case PROP_CUDAENC_GPU_ID:
       g_value_set_uint(value, self->cudaenc_gpu_id);
@@ -540,6 +713,16 @@ gst_v4l2_video_enc_stop (GstVideoEncoder * encoder)
     self->input_state = NULL;
   }
 
+#ifdef USE_V4L2_TARGET_NV
+  if (self->output_pool) {
+    gst_buffer_pool_set_active (self->output_pool, FALSE);
+    gst_object_unref (self->output_pool);
+    self->output_pool = NULL;
+  }
+  self->output_size = 0;
+  self->output_peak = 0;
+#endif
+
   GST_DEBUG_OBJECT (self, "Stopped");
 
   return TRUE;
@@ -670,6 +853,27 @@ gst_v4l2_video_enc_set_format (GstVideoEncoder * encoder,
     return FALSE;
   }
 
+#ifdef USE_V4L2_TARGET_NV
+  self->v4l2output->enableROI = FALSE;
+  if (self->mvroi_enable) {
+    GST_OBJECT_LOCK (self);
+    memset (&self->v4l2output->roi_params, 0,
+        sizeof (self->v4l2output->roi_params));
+    GST_OBJECT_UNLOCK (self);
+
+    self->v4l2output->enableROI = setROIEnable (self->v4l2output, TRUE);
+    if (!self->v4l2output->enableROI)
+      g_print ("S_EXT_CTRLS for ENABLE_ROI_PARAM failed\n");
+  }
+
+  /* the controller starts from the configured bitrate */
+  GST_OBJECT_LOCK (self);
+  self->mvrc_activity = 0;
+  self->mvrc_bitrate = self->bitrate;
+  self->mvrc_frames = 0;
+  GST_OBJECT_UNLOCK (self);
+#endif
+
   /* activating a capture pool will also call STREAMON. CODA driver will
    * refuse to configure the output if the capture is stremaing. */
   if (!gst_buffer_pool_set_active (GST_BUFFER_POOL (self->v4l2capture->pool),
@@ -974,6 +1178,122 @@ gst_v4l2_video_enc_get_oldest_frame (GstVideoEncoder * encoder)
   return frame;
 }
 
+/* Frames come out in coding order, an anchor frame ahead of the at most
+ * GST_V4L2_ENC_MAX_REORDER B frames displayed before it. Pending frames
+ * further behind @current were lost by the driver and would otherwise stay
+ * queued in the base class until EOS, they are finished without output. */
+static void
+gst_v4l2_video_enc_clean_older_frames (GstVideoEncoder * encoder,
+    GstVideoCodecFrame * current)
+{
+#ifdef USE_V4L2_TARGET_NV
+  GstV4l2VideoEnc *self = GST_V4L2_VIDEO_ENC (encoder);
+#endif
+  GList *frames, *l;
+
+  frames = gst_video_encoder_get_frames (encoder);
+
+  for (l = frames; l != NULL; l = l->next) {
+    GstVideoCodecFrame *f = l->data;
+
+    if (f->system_frame_number + GST_V4L2_ENC_MAX_REORDER >=
+        current->system_frame_number)
+      continue;
+
+    GST_WARNING_OBJECT (encoder, "Lost frame %u %" GST_TIME_FORMAT
+        ", dropping", f->system_frame_number, GST_TIME_ARGS (f->pts));
+
+#ifdef USE_V4L2_TARGET_NV
+    /* keep the queued input times in step with the finished frames */
+    if (self->tracing_file_enc)
+      g_free (g_queue_pop_head (self->got_frame_pt));
+#endif
+
+    gst_video_encoder_finish_frame (encoder, gst_video_codec_frame_ref (f));
+  }
+
+  g_list_free_full (frames, (GDestroyNotify) gst_video_codec_frame_unref);
+}
+
+#ifdef USE_V4L2_TARGET_NV
+/* Output buffers come from a pool sized for the frames seen lately rather
+ * than for the whole capture plane, see
+ * gst_v4l2_video_enc_update_output_size(). A frame that does not fit gets
+ * memory of its own in gst_v4l2_buffer_pool_copy_buffer(). */
+static GstBuffer *
+gst_v4l2_video_enc_acquire_output_buffer (GstV4l2VideoEnc * self)
+{
+  GstVideoEncoder *encoder = GST_VIDEO_ENCODER (self);
+  GstBuffer *buffer = NULL;
+
+  if (self->output_size == 0)
+    self->output_size = self->v4l2capture->info.size;
+
+  if (self->output_pool == NULL) {
+    GstAllocator *allocator = NULL;
+    GstAllocationParams params;
+    GstStructure *config;
+
+    gst_video_encoder_get_allocator (encoder, &allocator, &params);
+
+    self->output_pool = gst_buffer_pool_new ();
+    config = gst_buffer_pool_get_config (self->output_pool);
+    gst_buffer_pool_config_set_params (config, NULL, self->output_size, 0, 0);
+    gst_buffer_pool_config_set_allocator (config, allocator, &params);
+    if (allocator)
+      gst_object_unref (allocator);
+
+    if (!gst_buffer_pool_set_config (self->output_pool, config) ||
+        !gst_buffer_pool_set_active (self->output_pool, TRUE)) {
+      GST_WARNING_OBJECT (self, "could not activate the output buffer pool");
+      gst_object_unref (self->output_pool);
+      self->output_pool = NULL;
+      return gst_video_encoder_allocate_output_buffer (encoder,
+          self->output_size);
+    }
+
+    GST_DEBUG_OBJECT (self, "output buffers of %" G_GSIZE_FORMAT " bytes",
+        self->output_size);
+  }
+
+  if (gst_buffer_pool_acquire_buffer (self->output_pool, &buffer,
+          NULL) != GST_FLOW_OK)
+    return NULL;
+
+  return buffer;
+}
+
+/* Follows a peak of the encoded frame sizes that decays by 1/256 per frame,
+ * so the key frames of long GOPs are still remembered. A larger frame grows
+ * the output buffers right away, they shrink once they are more than twice
+ * the size the peak needs. The pool is replaced rather than reconfigured as
+ * downstream may still hold buffers of the old size. */
+static void
+gst_v4l2_video_enc_update_output_size (GstV4l2VideoEnc * self, gsize size)
+{
+  gsize target;
+
+  self->output_peak = MAX ((gdouble) size,
+      self->output_peak * (1.0 - 1.0 / 256));
+
+  target = GST_ROUND_UP_N ((gsize) (self->output_peak * 1.5), 4096);
+  target = MIN (target, self->v4l2capture->info.size);
+
+  if (target <= self->output_size && 2 * target >= self->output_size)
+    return;
+
+  GST_DEBUG_OBJECT (self, "resizing output buffers from %" G_GSIZE_FORMAT
+      " to %" G_GSIZE_FORMAT " bytes", self->output_size, target);
+
+  self->output_size = target;
+  if (self->output_pool) {
+    gst_buffer_pool_set_active (self->output_pool, FALSE);
+    gst_object_unref (self->output_pool);
+    self->output_pool = NULL;
+  }
+}
+#endif
+
 static void
 gst_v4l2_video_enc_loop (GstVideoEncoder * encoder)
 {
@@ -981,34 +1301,80 @@ gst_v4l2_video_enc_loop (GstVideoEncoder * encoder)
   GstVideoCodecFrame *frame;
   GstBuffer *buffer = NULL;
   GstFlowReturn ret;
+  guint32 frame_number = G_MAXUINT32;
 #ifdef USE_V4L2_TARGET_NV
   struct timeval ts;
   guint64 done_time;
   guint64 *in_time_pt;
 #endif
 
-  GST_LOG_OBJECT (encoder, "Allocate output buffer");
+#ifdef USE_V4L2_TARGET_NV
+  if (self->zero_copy_output &&
+      self->v4l2capture->mode == GST_V4L2_IO_MMAP) {
+    GST_LOG_OBJECT (encoder, "Dequeue output buffer");
+    ret =
+        gst_v4l2_buffer_pool_process_zero_copy (GST_V4L2_BUFFER_POOL
+        (self->v4l2capture->pool), &buffer, &frame_number);
+  } else
+#endif
+  {
+    GST_LOG_OBJECT (encoder, "Allocate output buffer");
 
-  buffer = gst_video_encoder_allocate_output_buffer (encoder,
-      self->v4l2capture->info.size);
+#ifdef USE_V4L2_TARGET_NV
+    buffer = gst_v4l2_video_enc_acquire_output_buffer (self);
+#else
+    buffer = gst_video_encoder_allocate_output_buffer (encoder,
+        self->v4l2capture->info.size);
+#endif
 
-  if (NULL == buffer) {
-    ret = GST_FLOW_FLUSHING;
-    goto beach;
-  }
+    if (NULL == buffer) {
+      ret = GST_FLOW_FLUSHING;
+      goto beach;
+    }
 
 
-  /* FIXME Check if buffer isn't the last one here */
+    /* FIXME Check if buffer isn't the last one here */
+
+    GST_LOG_OBJECT (encoder, "Process output buffer");
+    ret =
+        gst_v4l2_buffer_pool_process (GST_V4L2_BUFFER_POOL
+        (self->v4l2capture->pool), &buffer, &frame_number);
 
-  GST_LOG_OBJECT (encoder, "Process output buffer");
-  ret =
-      gst_v4l2_buffer_pool_process (GST_V4L2_BUFFER_POOL
-      (self->v4l2capture->pool), &buffer);
+#ifdef USE_V4L2_TARGET_NV
+    if (ret == GST_FLOW_OK)
+      gst_v4l2_video_enc_update_output_size (self,
+          gst_buffer_get_size (buffer));
+#endif
+  }
 
   if (ret != GST_FLOW_OK)
     goto beach;
 
-  frame = gst_v4l2_video_enc_get_oldest_frame (encoder);
+#ifdef USE_V4L2_TARGET_NV
+  if (self->v4l2output->enableROI)
+    gst_v4l2_video_enc_update_roi (self, buffer);
+
+  if (self->mvrc_enable)
+    gst_v4l2_video_enc_update_bitrate (self, buffer);
+
+  if (self->mvsei_enable) {
+    GstV4l2VideoEncClass *klass = GST_V4L2_VIDEO_ENC_GET_CLASS (self);
+
+    if (strcmp (klass->codec_name, "H264") == 0)
+      gst_mv_sei_insert (buffer, FALSE);
+    else if (strcmp (klass->codec_name, "H265") == 0)
+      gst_mv_sei_insert (buffer, TRUE);
+  }
+#endif
+
+  frame = gst_video_encoder_get_frame (encoder, frame_number);
+  if (frame) {
+    gst_v4l2_video_enc_clean_older_frames (encoder, frame);
+  } else {
+    GST_DEBUG_OBJECT (encoder, "no frame %u, using the oldest one",
+        frame_number);
+    frame = gst_v4l2_video_enc_get_oldest_frame (encoder);
+  }
 
   if (frame) {
     frame->output_buffer = buffer;
@@ -1136,7 +1502,8 @@ gst_v4l2_video_enc_handle_frame (GstVideoEncoder * encoder,
     GST_VIDEO_ENCODER_STREAM_UNLOCK (encoder);
     ret =
         gst_v4l2_buffer_pool_process (GST_V4L2_BUFFER_POOL
-        (self->v4l2output->pool), &frame->input_buffer);
+        (self->v4l2output->pool), &frame->input_buffer,
+        &frame->system_frame_number);
     GST_VIDEO_ENCODER_STREAM_LOCK (encoder);
 
     if (ret == GST_FLOW_FLUSHING) {
@@ -1411,6 +1778,10 @@ gst_v4l2_video_enc_finalize (GObject * object)
   gst_v4l2_object_destroy (self->v4l2capture);
   gst_v4l2_object_destroy (self->v4l2output);
 
+#ifdef USE_V4L2_TARGET_NV
+  g_array_free (self->mvroi_scratch, TRUE);
+#endif
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
@@ -1439,6 +1810,22 @@ gst_v4l2_video_enc_init (GstV4l2VideoEnc * self)
   self->maxperf_enable = FALSE;
   self->measure_latency = FALSE;
   self->nvbuf_api_version_new = DEFAULT_NVBUF_API_VERSION_NEW;
+  self->mvroi_enable = FALSE;
+  self->mvroi_threshold = DEFAULT_MV_ROI_THRESHOLD;
+  self->mvroi_min_blocks = DEFAULT_MV_ROI_MIN_BLOCKS;
+  self->mvroi_qp_delta = DEFAULT_MV_ROI_QP_DELTA;
+  self->mvroi_background_qp_delta = DEFAULT_MV_ROI_BACKGROUND_QP_DELTA;
+  self->mvroi_scratch = g_array_new (FALSE, FALSE, sizeof (guint32));
+  self->mvrc_enable = FALSE;
+  self->mvrc_threshold = DEFAULT_MV_BITRATE_THRESHOLD;
+  self->mvrc_min_bitrate = DEFAULT_MV_BITRATE_MIN;
+  self->mvrc_max_bitrate = DEFAULT_MV_BITRATE_MAX;
+  self->mvrc_smoothing = DEFAULT_MV_BITRATE_SMOOTHING;
+  self->mvrc_saturation = DEFAULT_MV_BITRATE_SATURATION;
+  self->mvrc_hysteresis = DEFAULT_MV_BITRATE_HYSTERESIS;
+  self->mvrc_interval = DEFAULT_MV_BITRATE_INTERVAL;
+  self->mvsei_enable = FALSE;
+  self->zero_copy_output = FALSE;
 #ifdef USE_V4L2_TARGET_NV_CODECSDK
   self->cudaenc_gpu_id = DEFAULT_CUDAENC_GPU_ID;
 #endif
@@ -1515,6 +1902,131 @@ gst_v4l2_video_enc_class_init (GstV4l2VideoEncClass * klass)
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
           GST_PARAM_MUTABLE_READY));
 
+  g_object_class_install_property (gobject_class, PROP_MV_ROI_ENABLE,
+      g_param_spec_boolean ("mv-roi-enable",
+          "Enable motion adaptive ROI",
+          "Cluster the motion vectors of each encoded frame into ROI regions\n"
+          "\t\t\t applied with mv-roi-qp-delta to the next queued frame.\n"
+          "\t\t\t Enables the motion vector metadata of the encoder",
+          FALSE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_MV_ROI_THRESHOLD,
+      g_param_spec_uint ("mv-roi-threshold", "Motion threshold",
+          "Minimum |mv_x| + |mv_y| for a block to be considered moving",
+          0, G_MAXUINT, DEFAULT_MV_ROI_THRESHOLD,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property (gobject_class, PROP_MV_ROI_MIN_BLOCKS,
+      g_param_spec_uint ("mv-roi-min-blocks", "Minimum ROI size",
+          "Clusters with fewer moving blocks are ignored",
+          1, G_MAXUINT, DEFAULT_MV_ROI_MIN_BLOCKS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property (gobject_class, PROP_MV_ROI_QP_DELTA,
+      g_param_spec_int ("mv-roi-qp-delta", "Moving region QP delta",
+          "QP delta applied to the regions with motion",
+          -51, 51, DEFAULT_MV_ROI_QP_DELTA,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property (gobject_class,
+      PROP_MV_ROI_BACKGROUND_QP_DELTA,
+      g_param_spec_int ("mv-roi-background-qp-delta",
+          "Background QP delta",
+          "QP delta of the regions covering the frame around the moving ones,\n"
+          "\t\t\t positive to move bits onto the motion (0 = no background regions)",
+          -51, 51, DEFAULT_MV_ROI_BACKGROUND_QP_DELTA,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property (gobject_class, PROP_MV_BITRATE_CONTROL,
+      g_param_spec_boolean ("mv-bitrate-control",
+          "Enable motion driven bitrate",
+          "Move the bitrate between mv-bitrate-min and mv-bitrate-max\n"
+          "\t\t\t following the smoothed share of moving blocks.\n"
+          "\t\t\t Enables the motion vector metadata of the encoder",
+          FALSE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_MV_BITRATE_THRESHOLD,
+      g_param_spec_uint ("mv-bitrate-threshold", "Motion threshold",
+          "Minimum |mv_x| + |mv_y| for a block to be considered moving",
+          0, G_MAXUINT, DEFAULT_MV_BITRATE_THRESHOLD,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property (gobject_class, PROP_MV_BITRATE_MIN,
+      g_param_spec_uint ("mv-bitrate-min", "Floor bitrate",
+          "Bitrate of a static scene",
+          0, G_MAXUINT, DEFAULT_MV_BITRATE_MIN,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property (gobject_class, PROP_MV_BITRATE_MAX,
+      g_param_spec_uint ("mv-bitrate-max", "Ceiling bitrate",
+          "Bitrate of a busy scene (0 = bitrate)",
+          0, G_MAXUINT, DEFAULT_MV_BITRATE_MAX,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property (gobject_class, PROP_MV_BITRATE_SMOOTHING,
+      g_param_spec_double ("mv-bitrate-smoothing", "Activity smoothing",
+          "Weight of the current frame in the moving average of the activity",
+          0.0, 1.0, DEFAULT_MV_BITRATE_SMOOTHING,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property (gobject_class, PROP_MV_BITRATE_SATURATION,
+      g_param_spec_double ("mv-bitrate-saturation", "Activity saturation",
+          "Share of moving blocks at which mv-bitrate-max is reached",
+          0.0, 1.0, DEFAULT_MV_BITRATE_SATURATION,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property (gobject_class, PROP_MV_BITRATE_HYSTERESIS,
+      g_param_spec_double ("mv-bitrate-hysteresis", "Bitrate hysteresis",
+          "Relative difference to the current bitrate below which\n"
+          "\t\t\t a new target is ignored",
+          0.0, 1.0, DEFAULT_MV_BITRATE_HYSTERESIS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property (gobject_class, PROP_MV_BITRATE_INTERVAL,
+      g_param_spec_uint ("mv-bitrate-interval", "Bitrate update interval",
+          "Minimum number of frames between two bitrate changes",
+          1, G_MAXUINT, DEFAULT_MV_BITRATE_INTERVAL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property (gobject_class, PROP_MV_SEI,
+      g_param_spec_boolean ("mv-sei",
+          "Embed motion vectors",
+          "Carry the motion vectors and statistics of each frame in a\n"
+          "\t\t\t user_data_unregistered SEI in front of its first slice.\n"
+          "\t\t\t Enables the motion vector metadata of the encoder",
+          FALSE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_ZERO_COPY_OUTPUT,
+      g_param_spec_boolean ("zero-copy-output",
+          "Zero copy output",
+          "Push the bitstream in the capture buffers of the encoder instead\n"
+          "\t\t\t of copying it, a buffer is queued back to the encoder when\n"
+          "\t\t\t downstream releases it. Needs capture-io-mode mmap",
+          FALSE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_CAPTURE_BUFFERS,
+      g_param_spec_uint ("max-capture-buffers",
+          "Maximum capture buffers",
+          "Number of capture buffers the pool may grow to with CREATE_BUFS\n"
+          "\t\t\t when downstream holds on to buffers, 0 for the V4L2 limit",
+          0, VIDEO_MAX_FRAME, 0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+
 #ifdef USE_V4L2_TARGET_NV_CODECSDK
   g_object_class_install_property (gobject_class, PROP_CUDAENC_GPU_ID,
       g_param_spec_uint ("gpu-id",
@@ -1979,6 +2491,185 @@ gst_v4l2_video_encoder_forceIDR (GstV4l2VideoEnc * self)
     g_print ("Error while signalling force IDR\n");
 }
 
+static gboolean
+setROIEnable (GstV4l2Object * v4l2object, gboolean enable)
+{
+  v4l2_enc_enable_roi_param roi_param;
+  struct v4l2_ext_control control;
+  struct v4l2_ext_controls ctrls;
+  gint ret;
+
+  memset (&control, 0, sizeof (control));
+  memset (&ctrls, 0, sizeof (ctrls));
+  memset (&roi_param, 0, sizeof (roi_param));
+
+  roi_param.bEnableROI = enable ? 1 : 0;
+
+  ctrls.count = 1;
+  ctrls.controls = &control;
+  ctrls.ctrl_class = V4L2_CTRL_CLASS_MPEG;
+
+  control.id = V4L2_CID_MPEG_VIDEOENC_ENABLE_ROI_PARAM;
+  control.string = (gchar *) &roi_param;
+
+  ret = v4l2object->ioctl (v4l2object->video_fd, VIDIOC_S_EXT_CTRLS, &ctrls);
+  if (ret < 0) {
+    g_print ("Error while enabling ROI params\n");
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/* Turns the motion of the frame that was just encoded into the ROI params of
+ * the next frames queued on the output plane: moving clusters get
+ * mv-roi-qp-delta and, when mv-roi-background-qp-delta is set, the rest of
+ * the frame is covered with regions of the background delta. NVENC leaves
+ * the delta of overlapping regions unspecified, so the background regions
+ * are cut around the moving ones, the least active moving regions are given
+ * up when that takes more regions than there are. Intra frames carry no
+ * vectors and keep the regions of the previous frame. */
+static void
+gst_v4l2_video_enc_update_roi (GstV4l2VideoEnc * self, GstBuffer * buffer)
+{
+  GstMvRegion regions[V4L2_MAX_ROI_REGIONS];
+  GstMvRegion background[V4L2_MAX_ROI_REGIONS];
+  v4l2_enc_frame_ROI_params roi;
+  const metadata_MV *field;
+  const MVInfo *mvs;
+  GstMvGrid grid;
+  guint width, height, n_vectors, n_regions, n_background = 0, i;
+
+  field = gst_mv_buffer_get_field (buffer);
+  if (field == NULL)
+    return;
+
+  mvs = gst_mv_field_get_vectors (field, &n_vectors);
+  if (n_vectors == 0 || self->input_state == NULL)
+    return;
+
+  width = GST_VIDEO_INFO_WIDTH (&self->input_state->info);
+  height = GST_VIDEO_INFO_HEIGHT (&self->input_state->info);
+  gst_mv_grid_init (&grid, width, height, n_vectors);
+
+  n_regions = gst_mv_find_regions (mvs, &grid, self->mvroi_threshold,
+      self->mvroi_min_blocks, regions, V4L2_MAX_ROI_REGIONS,
+      self->mvroi_scratch);
+
+  /* grow by one block, the objects will have moved by the next frame */
+  for (i = 0; i < n_regions; i++) {
+    guint x1 = MIN (regions[i].x + regions[i].width + 1, grid.cols);
+    guint y1 = MIN (regions[i].y + regions[i].height + 1, grid.rows);
+
+    regions[i].x = regions[i].x > 0 ? regions[i].x - 1 : 0;
+    regions[i].y = regions[i].y > 0 ? regions[i].y - 1 : 0;
+    regions[i].width = x1 - regions[i].x;
+    regions[i].height = y1 - regions[i].y;
+  }
+
+  if (self->mvroi_background_qp_delta != 0) {
+    /* the regions come most active first, never runs dry as no moving
+     * region leaves the whole frame as one background region */
+    while ((n_background = gst_mv_regions_complement (regions, n_regions,
+                grid.cols, grid.rows, background,
+                V4L2_MAX_ROI_REGIONS)) + n_regions > V4L2_MAX_ROI_REGIONS)
+      n_regions--;
+  }
+
+  memset (&roi, 0, sizeof (roi));
+
+  for (i = 0; i < n_regions + n_background; i++) {
+    v4l2_enc_ROI_param *param = &roi.ROI_params[roi.num_ROI_regions++];
+    const GstMvRegion *r =
+        i < n_regions ? &regions[i] : &background[i - n_regions];
+
+    param->ROIRect.left = r->x * grid.block_size;
+    param->ROIRect.top = r->y * grid.block_size;
+    param->ROIRect.width = MIN ((r->x + r->width) * grid.block_size, width) -
+        param->ROIRect.left;
+    param->ROIRect.height = MIN ((r->y + r->height) * grid.block_size,
+        height) - param->ROIRect.top;
+    param->QPdelta = i < n_regions ? self->mvroi_qp_delta :
+        self->mvroi_background_qp_delta;
+  }
+
+  GST_LOG_OBJECT (self, "%u moving and %u background regions on a %ux%u "
+      "grid", n_regions, n_background, grid.cols, grid.rows);
+
+  GST_OBJECT_LOCK (self);
+  self->v4l2output->roi_params = roi;
+  GST_OBJECT_UNLOCK (self);
+}
+
+/* Maps the smoothed share of moving blocks linearly onto
+ * [mv-bitrate-min, mv-bitrate-max]. A new target is only applied once
+ * mv-bitrate-interval frames went by since the last change and when it
+ * differs from the current bitrate by more than mv-bitrate-hysteresis, the
+ * floor and the ceiling themselves are always reached. */
+static void
+gst_v4l2_video_enc_update_bitrate (GstV4l2VideoEnc * self, GstBuffer * buffer)
+{
+  const metadata_MV *field;
+  const MVInfo *mvs;
+  GstMvActivity activity;
+  guint n_vectors, min, max, target;
+  gdouble level;
+
+  field = gst_mv_buffer_get_field (buffer);
+  if (field == NULL)
+    return;
+
+  /* intra frames carry no vectors */
+  mvs = gst_mv_field_get_vectors (field, &n_vectors);
+  if (n_vectors != 0)
+    gst_mv_compute_activity (mvs, n_vectors, self->mvrc_threshold, &activity);
+
+  /* the bitrate property resets the state below from the application
+   * thread */
+  GST_OBJECT_LOCK (self);
+
+  self->mvrc_frames++;
+  if (n_vectors == 0)
+    goto done;
+
+  self->mvrc_activity += self->mvrc_smoothing *
+      (activity.moving_ratio - self->mvrc_activity);
+
+  if (self->mvrc_frames < self->mvrc_interval)
+    goto done;
+
+  max = self->mvrc_max_bitrate ? self->mvrc_max_bitrate : self->bitrate;
+  min = MIN (self->mvrc_min_bitrate, max);
+
+  if (self->mvrc_saturation > 0)
+    level = CLAMP (self->mvrc_activity / self->mvrc_saturation, 0.0, 1.0);
+  else
+    level = 1.0;
+
+  target = min + (guint) ((max - min) * level);
+  if (target == self->mvrc_bitrate)
+    goto done;
+
+  if (target != min && target != max &&
+      ABS ((gdouble) target - self->mvrc_bitrate) <
+      self->mvrc_hysteresis * self->mvrc_bitrate)
+    goto done;
+
+  if (!set_v4l2_video_mpeg_class (self->v4l2output,
+      V4L2_CID_MPEG_VIDEO_BITRATE, target)) {
+    g_print ("S_EXT_CTRLS for BITRATE failed\n");
+    goto done;
+  }
+
+  GST_DEBUG_OBJECT (self, "activity %.3f, bitrate %u -> %u",
+      self->mvrc_activity, self->mvrc_bitrate, target);
+
+  self->mvrc_bitrate = target;
+  self->mvrc_frames = 0;
+
+done:
+  GST_OBJECT_UNLOCK (self);
+}
+
 gboolean
 set_v4l2_video_encoder_properties (GstVideoEncoder * encoder)
 {
@@ -2082,6 +2773,18 @@ set_v4l2_video_encoder_properties (GstVideoEncoder * encoder)
     }
   }
 
+  if (video_enc->mvroi_enable || video_enc->mvrc_enable ||
+      video_enc->mvsei_enable) {
+    /* ROI regions, bitrate control and the MV SEI are derived from the
+     * motion vectors */
+    if (!set_v4l2_video_mpeg_class (video_enc->v4l2output,
+        V4L2_CID_MPEG_VIDEOENC_ENABLE_METADATA_MV, TRUE)) {
+      g_print ("S_EXT_CTRLS for ENABLE_METADATA_MV failed\n");
+      return FALSE;
+    }
+    video_enc->v4l2capture->enableMVBufferMeta = TRUE;
+  }
+
   if (!set_v4l2_video_mpeg_class (video_enc->v4l2output,
       V4L2_CID_MPEG_VIDEOENC_VIRTUALBUFFER_SIZE,
       video_enc->virtual_buffer_size)) {
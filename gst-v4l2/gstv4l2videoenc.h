@@ -74,6 +74,28 @@ struct _GstV4l2VideoEnc
   FILE *tracing_file_enc;
   GQueue *got_frame_pt;
   gboolean nvbuf_api_version_new;
+  gboolean mvroi_enable;
+  guint mvroi_threshold;
+  guint mvroi_min_blocks;
+  gint mvroi_qp_delta;
+  gint mvroi_background_qp_delta;
+  GArray *mvroi_scratch;
+  gboolean mvrc_enable;
+  guint mvrc_threshold;
+  guint mvrc_min_bitrate;
+  guint mvrc_max_bitrate;
+  gdouble mvrc_smoothing;
+  gdouble mvrc_saturation;
+  gdouble mvrc_hysteresis;
+  guint mvrc_interval;
+  gdouble mvrc_activity;
+  guint mvrc_bitrate;
+  guint mvrc_frames;
+  gboolean mvsei_enable;
+  gboolean zero_copy_output;
+  GstBufferPool *output_pool;
+  gsize output_size;
+  gdouble output_peak;
 #ifdef USE_V4L2_TARGET_NV_CODECSDK
   guint32 cudaenc_gpu_id;
 #endif
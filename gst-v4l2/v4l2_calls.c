@@ -49,6 +49,9 @@
 #endif
 
 #include "gstv4l2videodec.h"
+#ifdef USE_V4L2_TARGET_NV
+#include "gstv4l2videoenc.h"
+#endif
 
 #include "gst/gst-i18n-plugin.h"
 
@@ -100,6 +103,64 @@ cap_failed:
   }
 }
 
+#ifdef USE_V4L2_TARGET_NV
+static gboolean
+gst_v4l2_cap_string_has (const __u8 * field, const gchar * name)
+{
+  gchar *lower = g_ascii_strdown ((const gchar *) field, -1);
+  gboolean ret = strstr (lower, name) != NULL;
+
+  g_free (lower);
+  return ret;
+}
+
+/******************************************************
+ * gst_v4l2_classify_device():
+ *   work out once which NV codec the device is, from what
+ *   VIDIOC_QUERYCAP reported, so that the streaming code
+ *   does not depend on the path it was opened with
+ ******************************************************/
+static void
+gst_v4l2_classify_device (GstV4l2Object * v4l2object)
+{
+  struct v4l2_capability *vcap = &v4l2object->vcap;
+  GstV4l2DeviceRole role = GST_V4L2_DEVICE_ROLE_UNKNOWN;
+  GstV4l2DeviceFlags flags = 0;
+
+  if (gst_v4l2_cap_string_has (vcap->card, V4L2_DEVICE_BASENAME_NVDEC) ||
+      gst_v4l2_cap_string_has (vcap->driver, V4L2_DEVICE_BASENAME_NVDEC))
+    role = GST_V4L2_DEVICE_ROLE_DECODER;
+  else if (gst_v4l2_cap_string_has (vcap->card, V4L2_DEVICE_BASENAME_NVENC) ||
+      gst_v4l2_cap_string_has (vcap->card, "nvenc") ||
+      gst_v4l2_cap_string_has (vcap->driver, V4L2_DEVICE_BASENAME_NVENC) ||
+      gst_v4l2_cap_string_has (vcap->driver, "nvenc"))
+    role = GST_V4L2_DEVICE_ROLE_ENCODER;
+  /* drivers that report a generic name, trust the element */
+  else if (GST_IS_V4L2_VIDEO_DEC (v4l2object->element))
+    role = GST_V4L2_DEVICE_ROLE_DECODER;
+  else if (GST_IS_V4L2_VIDEO_ENC (v4l2object->element))
+    role = GST_V4L2_DEVICE_ROLE_ENCODER;
+
+  switch (role) {
+    case GST_V4L2_DEVICE_ROLE_DECODER:
+      flags = GST_V4L2_DEVICE_SURFACE_CAPTURE | GST_V4L2_DEVICE_DEC_METADATA;
+      break;
+    case GST_V4L2_DEVICE_ROLE_ENCODER:
+      flags = GST_V4L2_DEVICE_DMABUF_OUTPUT | GST_V4L2_DEVICE_MV_METADATA;
+      break;
+    default:
+      break;
+  }
+
+  v4l2object->device_role = role;
+  v4l2object->device_flags = flags;
+
+  GST_DEBUG_OBJECT (v4l2object->dbg_obj,
+      "device '%s' (%s) has role %d, flags 0x%x", vcap->card, vcap->driver,
+      role, flags);
+}
+#endif
+
 /******************************************************
  * The video4linux command line tool v4l2-ctrl
  * normalises the names of the controls received from
@@ -543,7 +604,7 @@ gst_v4l2_open (GstV4l2Object * v4l2object)
   {
     g_snprintf(buf, sizeof(buf), "/dev/nvidia%d", i);
     v4l2object->video_fd =
-      open (buf, O_RDWR /* | O_NONBLOCK */ );
+      open (buf, O_RDWR | O_NONBLOCK);
     if (v4l2object->video_fd != -1)
       break;
     else
@@ -559,8 +620,15 @@ gst_v4l2_open (GstV4l2Object * v4l2object)
     goto no_device;
 
   /* open the device */
+#ifdef USE_V4L2_TARGET_NV
+  /* the dequeue loops wait in V4L2_CID_MPEG_VIDEO_DEVICE_POLL on EAGAIN, the
+   * library only polls, and interrupts the poll, on a non-blocking node */
   v4l2object->video_fd =
-      open (v4l2object->videodev, O_RDWR /* | O_NONBLOCK */ );
+      open (v4l2object->videodev, O_RDWR | O_NONBLOCK);
+#else
+  /* the pool polls the fd before every DQBUF, that never waits */
+  v4l2object->video_fd = open (v4l2object->videodev, O_RDWR);
+#endif
 #endif
 
   if (!GST_V4L2_IS_OPEN (v4l2object))
@@ -585,6 +653,10 @@ gst_v4l2_open (GstV4l2Object * v4l2object)
   if (!gst_v4l2_get_capabilities (v4l2object))
     goto error;
 
+#ifdef USE_V4L2_TARGET_NV
+  gst_v4l2_classify_device (v4l2object);
+#endif
+
 #ifndef USE_V4L2_TARGET_NV
   /* do we need to be a capture device? */
   if (GST_IS_V4L2SRC (v4l2object->element) &&
@@ -709,6 +781,10 @@ gst_v4l2_dup (GstV4l2Object * v4l2object, GstV4l2Object * other)
 
   v4l2object->vcap = other->vcap;
   v4l2object->device_caps = other->device_caps;
+#ifdef USE_V4L2_TARGET_NV
+  v4l2object->device_role = other->device_role;
+  v4l2object->device_flags = other->device_flags;
+#endif
   gst_v4l2_adjust_buf_type (v4l2object);
 
   v4l2object->video_fd = v4l2object->dup (other->video_fd);